@@ -32,8 +32,7 @@
 
 #include "BubblePlotData.h"
 
-#include <valarray>
-#include <complex>
+#include <math.h>
 
 //------------------------------------------------------------------------------
 #pragma package(smart_init)
@@ -42,18 +41,85 @@
 /// constructor. initializes members
 //------------------------------------------------------------------------------
 TBubbleData::TBubbleData()
-   : m_dFrequency(0.0), m_dVectorStrength(0.0), m_dPUniform(0.0)
+   :  m_dSumCos(0.0), m_dSumSin(0.0), m_nNumCycles(0),
+      m_dFrequency(0.0), m_dVectorStrength(0.0), m_dPUniform(0.0)
 {
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// clears internal vectors
+/// clears spike times, period histogram and sums
 //------------------------------------------------------------------------------
 void TBubbleData::Clear()
 {
    m_vdSpikeTimes.clear();
-   m_vdSpikeCycles.clear();
+   m_vnPhaseBins.clear();
+   m_dSumCos         = 0.0;
+   m_dSumSin         = 0.0;
+   m_nNumCycles      = 0;
+   m_dVectorStrength = 0.0;
+   m_dPUniform       = 0.0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds phase sums and period histogram of spikes of one stimulus (see
+/// TSWStimulusResponse) to the bubble
+//------------------------------------------------------------------------------
+void TBubbleData::AddCycles(double dSumCos,
+                            double dSumSin,
+                            unsigned int nNumCycles,
+                            const std::vector<unsigned int >& rvnPhaseBins)
+{
+   if (!nNumCycles)
+      return;
+   m_dSumCos    += dSumCos;
+   m_dSumSin    += dSumSin;
+   m_nNumCycles += nNumCycles;
+   if (m_vnPhaseBins.size() < rvnPhaseBins.size())
+      m_vnPhaseBins.resize(rvnPhaseBins.size(), 0);
+   unsigned int n;
+   for (n = 0; n < rvnPhaseBins.size(); n++)
+      m_vnPhaseBins[n] += rvnPhaseBins[n];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// calculates vector strength and Rayleigh test from sums
+//------------------------------------------------------------------------------
+void TBubbleData::CalculateVectorStrength()
+{
+   if (!m_nNumCycles)
+      return;
+   double dN         = (double)m_nNumCycles;
+   m_dVectorStrength = sqrt(m_dSumCos*m_dSumCos + m_dSumSin*m_dSumSin) / dN;
+
+   // (approximate) Rayleigh test for circular uniformity
+   // Zar, Biostatistical Analysis, 5th Ed., 2010, equation 27.4, p. 625
+   double dRN  = m_dVectorStrength*dN;
+   m_dPUniform = exp(sqrt((1.0+4.0*dN+4*(dN*dN-dRN*dRN))) - (1.0+2.0*dN));
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes period histogram with nNumBins bins to rvnBins by summing up
+/// passed base bins (SWSR_PHASE_BINS): every base bin is counted in the bin
+/// containing its center
+//------------------------------------------------------------------------------
+void TBubbleData::SumPhaseBins(const std::vector<unsigned int >& rvnPhaseBins,
+                               unsigned int nNumBins,
+                               std::vector<unsigned int >& rvnBins)
+{
+   rvnBins.assign(nNumBins, 0);
+   if (!nNumBins)
+      return;
+   unsigned int n, nBin;
+   for (n = 0; n < rvnPhaseBins.size(); n++)
+      {
+      nBin = (unsigned int)floor(((double)n + 0.5) * (double)nNumBins / (double)rvnPhaseBins.size());
+      if (nBin < nNumBins)
+         rvnBins[nBin] += rvnPhaseBins[n];
+      }
 }
 //------------------------------------------------------------------------------
 
@@ -96,40 +162,12 @@ bool TBubblePlotData::HasFrequency()
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// calculates vector strength
+/// calculates vector strength of all bubbles
 //------------------------------------------------------------------------------
 void TBubblePlotData::CalculateVectorStrength()
 {
-   std::valarray<std::complex<double > > vac;
-
-   // go through bubbles
-   unsigned int nBubble, nNum, n;
-   double d;
+   unsigned int nBubble;
    for (nBubble = 0; nBubble < m_vBubbleData.size(); nBubble++)
-      {
-      nNum = (unsigned int)m_vBubbleData[nBubble].m_vdSpikeCycles.size();
-      if (!nNum)
-         continue;
-
-      // calculate vector strength
-      vac.resize(nNum);
-      // - collect all complex vectors
-
-      for (n = 0; n < nNum; n++)
-         {
-         d = 2.0*M_PI*m_vBubbleData[nBubble].m_vdSpikeCycles[n];
-         vac[n].real(cos(d));
-         vac[n].imag(sin(d));
-         }
-      m_vBubbleData[nBubble].m_dVectorStrength = std::abs(vac.sum() / (double)vac.size());
-
-      // (approximate) Rayleigh test for circular uniformity
-      // Zar, Biostatistical Analysis, 5th Ed., 2010, equation 27.4, p. 625
-      double dN   = (double)nNum;
-      double dRN  = m_vBubbleData[nBubble].m_dVectorStrength*dN;
-      m_vBubbleData[nBubble].m_dPUniform = exp(sqrt((1.0+4.0*dN+4*(dN*dN-dRN*dRN))) - (1.0+2.0*dN));
-      }
+      m_vBubbleData[nBubble].CalculateVectorStrength();
 }
 //------------------------------------------------------------------------------
-
-
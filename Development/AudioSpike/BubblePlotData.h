@@ -35,24 +35,39 @@
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// class for storing data for a bubble in a bubble plot
+/// class for storing data for a bubble in a bubble plot. Spike cycles are not
+/// stored: sums of cosine and sine of their phases and a period histogram of
+/// all stimuli of the bubble (see AddCycles) are kept instead
 //------------------------------------------------------------------------------
 class TBubbleData
 {
    public:
       std::vector<double > m_vdSpikeTimes;
-      std::vector<double > m_vdSpikeCycles;
+      /// period histogram (empty, if no cycles were added)
+      std::vector<unsigned int > m_vnPhaseBins;
+      double               m_dSumCos;
+      double               m_dSumSin;
+      unsigned int         m_nNumCycles;
       double               m_dFrequency;
       double               m_dNonFreqValue;
       double               m_dVectorStrength;
       double               m_dPUniform;
       TBubbleData();
       void                 Clear();
+      void                 AddCycles(double dSumCos,
+                                     double dSumSin,
+                                     unsigned int nNumCycles,
+                                     const std::vector<unsigned int >& rvnPhaseBins);
+      void                 CalculateVectorStrength();
+      static void          SumPhaseBins(const std::vector<unsigned int >& rvnPhaseBins,
+                                        unsigned int nNumBins,
+                                        std::vector<unsigned int >& rvnBins);
 };
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// class for storing multiple TBubbleData and calculating vector strength
+/// class for storing multiple TBubbleData and calculating vector strength.
+/// Vector strength and Rayleigh test only read the sums of the bubbles
 //------------------------------------------------------------------------------
 class TBubblePlotData
 {
@@ -104,17 +104,17 @@ void CHtFFT::Cleanup()
          }
       m_fftw_plan_Wave2Spec = NULL;
       }
-   if (m_fftw_plan_Wave2Spec)
+   if (m_fftw_plan_Spec2Wave)
       {
       // secure silent cleanup
       try
          {
-         fftwf_destroy_plan(m_fftw_plan_Wave2Spec);
+         fftwf_destroy_plan(m_fftw_plan_Spec2Wave);
          }
       catch (...)
          {
          }
-      m_fftw_plan_Wave2Spec = NULL;
+      m_fftw_plan_Spec2Wave = NULL;
       }
 }
 //--------------------------------------------------------------------------
@@ -0,0 +1,356 @@
+//------------------------------------------------------------------------------
+/// \file SWEpocheFile.cpp
+///
+/// \author Berg
+/// \brief Definition of the AudioSpike epoche file format and implementation of
+/// class TSWEpocheFile for maintaining header and index
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWEpocheFile.h"
+#include "SWTools.h"
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns epoche file of a result in passed path: the legacy file is only
+/// returned, if it exists and no new epoche file exists
+//------------------------------------------------------------------------------
+UnicodeString TSWEpocheFile::GetFileName(UnicodeString usPath)
+{
+   UnicodeString usFileName = IncludeTrailingBackslash(usPath) + SWEF_FILENAME;
+   UnicodeString usLegacyFileName = IncludeTrailingBackslash(usPath) + SWEF_LEGACYFILENAME;
+   if (!FileExists(usFileName) && FileExists(usLegacyFileName))
+      return usLegacyFileName;
+   return usFileName;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if passed file starts with a valid epoche file header (i.e.
+/// is not a legacy file)
+//------------------------------------------------------------------------------
+bool TSWEpocheFile::IsEpocheFile(UnicodeString usFileName)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenRead | fmShareDenyNone);
+   try
+      {
+      TSWEpocheFileHeader swefh;
+      if (pfs->Read(&swefh, sizeof(swefh)) != (int)sizeof(swefh))
+         return false;
+      return CheckHeader(swefh);
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns size of record header of passed file version in bytes (fields
+/// added in later versions are missing in older files)
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheFile::GetRecordHeaderSize(unsigned int nVersion)
+{
+   if (nVersion < 2)
+      return SWEF_RECORDHEADERSIZE_V1;
+   return (unsigned int)sizeof(TSWEpocheRecordHeader);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns size of one epoche record in bytes
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheFile::GetRecordSize(unsigned int nNumChannels,
+                                          unsigned int nNumSamples,
+                                          unsigned int nVersion)
+{
+   return GetRecordDataOffset(nNumChannels, nVersion) + nNumChannels*nNumSamples*(unsigned int)sizeof(float);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns offset of sample data within an epoche record in bytes
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheFile::GetRecordDataOffset(unsigned int nNumChannels, unsigned int nVersion)
+{
+   return GetRecordHeaderSize(nVersion) + nNumChannels*(unsigned int)sizeof(double);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// initializes passed header for a new file
+//------------------------------------------------------------------------------
+void TSWEpocheFile::InitHeader(  TSWEpocheFileHeader &rHeader,
+                                 unsigned int nNumChannels,
+                                 unsigned int nNumSamples,
+                                 double dSampleRate,
+                                 double dSampleRateDevider)
+{
+   ZeroMemory(&rHeader, sizeof(rHeader));
+   CopyMemory(rHeader.szMagic, SWEF_MAGIC, sizeof(rHeader.szMagic));
+   rHeader.nVersion           = SWEF_VERSION;
+   rHeader.nHeaderSize        = (unsigned int)sizeof(rHeader);
+   rHeader.nNumChannels       = nNumChannels;
+   rHeader.nNumSamples        = nNumSamples;
+   rHeader.dSampleRate        = dSampleRate;
+   rHeader.dSampleRateDevider = dSampleRateDevider;
+   rHeader.nRecordSize        = GetRecordSize(nNumChannels, nNumSamples);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// checks passed header. Returns false if magic does not match (i.e. legacy
+/// file), throws an exception if header is invalid, version is not supported
+/// or file is marked as broken
+//------------------------------------------------------------------------------
+bool TSWEpocheFile::CheckHeader(const TSWEpocheFileHeader &rHeader)
+{
+   if (memcmp(rHeader.szMagic, SWEF_MAGIC, sizeof(rHeader.szMagic)))
+      return false;
+   if (rHeader.nVersion > SWEF_VERSION)
+      throw Exception("epoche file version " + IntToStr((int)rHeader.nVersion) + " is not supported");
+   if (  rHeader.nHeaderSize < sizeof(TSWEpocheFileHeader)
+      || !rHeader.nNumChannels
+      || !rHeader.nNumSamples
+      || rHeader.nRecordSize != GetRecordSize(rHeader.nNumChannels, rHeader.nNumSamples, rHeader.nVersion)
+      )
+      throw Exception("invalid epoche file header");
+   if (rHeader.nFlags & SWEF_FILEBROKEN)
+      throw Exception("epoche file is broken: records were lost while writing");
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// prepares an existing epoche file for appending records: removes index and
+/// resets number of epoches in header. Returns version of file: records must
+/// be appended in this version
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheFile::PrepareAppend(  UnicodeString usFileName,
+                                    unsigned int nNumChannels,
+                                    unsigned int nNumSamples)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenReadWrite | fmShareDenyWrite);
+   try
+      {
+      TSWEpocheFileHeader swefh;
+      pfs->ReadBuffer(&swefh, sizeof(swefh));
+      if (!CheckHeader(swefh))
+         throw Exception("'" + usFileName + "' is not an epoche file");
+      if (swefh.nNumChannels != nNumChannels || swefh.nNumSamples != nNumSamples)
+         throw Exception("epoche dimensions of '" + usFileName + "' do not match current settings");
+      if (swefh.nIndexOffset)
+         pfs->Size = (__int64)swefh.nIndexOffset;
+      swefh.nNumEpoches    = 0;
+      swefh.nIndexOffset   = 0;
+      pfs->Seek(0, soBeginning);
+      pfs->WriteBuffer(&swefh, sizeof(swefh));
+      return swefh.nVersion;
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// finalizes an epoche file after writing: removes an incomplete last record
+/// (if any), appends index and writes number of epoches and index offset to
+/// header. The index is built from the records actually written (offset and
+/// nIndex of every record header). If records are invalid, missing or
+/// duplicate, the file is marked as broken and an exception is thrown
+//------------------------------------------------------------------------------
+void TSWEpocheFile::Finalize(UnicodeString usFileName)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenReadWrite | fmShareDenyWrite);
+   try
+      {
+      TSWEpocheFileHeader swefh;
+      pfs->ReadBuffer(&swefh, sizeof(swefh));
+      if (!CheckHeader(swefh))
+         throw Exception("'" + usFileName + "' is not an epoche file");
+      // already finalized?
+      if (swefh.nIndexOffset)
+         return;
+
+      unsigned __int64 nNumEpoches = (unsigned __int64)(pfs->Size - swefh.nHeaderSize) / swefh.nRecordSize;
+      unsigned __int64 nIndexOffset = swefh.nHeaderSize + nNumEpoches * swefh.nRecordSize;
+
+      // NOTE: offset 0 is never a valid record offset (file header), so it
+      // marks epoches not found yet. As many records as epoches are read, so
+      // without invalid or duplicate indices every epoche is found
+      std::vector<unsigned __int64 > vnOffsets((unsigned int)nNumEpoches, 0);
+      unsigned int nHeaderSize = GetRecordHeaderSize(swefh.nVersion);
+      TSWEpocheRecordHeader swerh;
+      ZeroMemory(&swerh, sizeof(swerh));
+      bool bValid = true;
+      unsigned __int64 nOffset;
+      for (nOffset = swefh.nHeaderSize; nOffset < nIndexOffset; nOffset += swefh.nRecordSize)
+         {
+         pfs->Seek((__int64)nOffset, soBeginning);
+         pfs->ReadBuffer(&swerh, (NativeInt)nHeaderSize);
+         if (  swerh.nMagic != SWEF_RECORDMAGIC
+            || swerh.nIndex >= vnOffsets.size()
+            || vnOffsets[swerh.nIndex]
+            )
+            {
+            bValid = false;
+            break;
+            }
+         vnOffsets[swerh.nIndex] = nOffset;
+         }
+      if (!bValid)
+         {
+         swefh.nFlags |= SWEF_FILEBROKEN;
+         pfs->Seek(0, soBeginning);
+         pfs->WriteBuffer(&swefh, sizeof(swefh));
+         throw Exception("epoche file '" + usFileName + "' contains invalid, missing or duplicate records and was marked as broken");
+         }
+
+      pfs->Size = (__int64)nIndexOffset;
+      pfs->Seek((__int64)nIndexOffset, soBeginning);
+      unsigned int nMagic = SWEF_INDEXMAGIC;
+      pfs->WriteBuffer(&nMagic, sizeof(nMagic));
+      pfs->WriteBuffer(&nNumEpoches, sizeof(nNumEpoches));
+      if (vnOffsets.size())
+         pfs->WriteBuffer(&vnOffsets[0], (NativeInt)(vnOffsets.size()*sizeof(unsigned __int64)));
+
+      swefh.nNumEpoches    = nNumEpoches;
+      swefh.nIndexOffset   = nIndexOffset;
+      pfs->Seek(0, soBeginning);
+      pfs->WriteBuffer(&swefh, sizeof(swefh));
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// marks an epoche file as broken instead of finalizing it (records are
+/// missing, so records cannot be located). Such files are refused by
+/// CheckHeader
+//------------------------------------------------------------------------------
+void TSWEpocheFile::MarkBroken(UnicodeString usFileName)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenReadWrite | fmShareDenyWrite);
+   try
+      {
+      TSWEpocheFileHeader swefh;
+      pfs->ReadBuffer(&swefh, sizeof(swefh));
+      if (!CheckHeader(swefh))
+         throw Exception("'" + usFileName + "' is not an epoche file");
+      swefh.nFlags |= SWEF_FILEBROKEN;
+      pfs->Seek(0, soBeginning);
+      pfs->WriteBuffer(&swefh, sizeof(swefh));
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// reads index of a finalized epoche file from passed stream: rvnOffsets
+/// contains offset of record of every epoche afterwards. Cleared for files
+/// without index. Throws an exception if index is invalid
+//------------------------------------------------------------------------------
+void TSWEpocheFile::ReadIndex(TStream* ps,
+                              const TSWEpocheFileHeader &rHeader,
+                              std::vector<unsigned __int64 >& rvnOffsets)
+{
+   rvnOffsets.clear();
+   if (!rHeader.nIndexOffset)
+      return;
+   unsigned int nMagic = 0;
+   unsigned __int64 nNumEpoches = 0;
+   ps->Seek((__int64)rHeader.nIndexOffset, soBeginning);
+   ps->ReadBuffer(&nMagic, sizeof(nMagic));
+   ps->ReadBuffer(&nNumEpoches, sizeof(nNumEpoches));
+   if (nMagic != SWEF_INDEXMAGIC || nNumEpoches != rHeader.nNumEpoches)
+      throw Exception("invalid index in epoche file");
+   rvnOffsets.resize((unsigned int)nNumEpoches);
+   if (rvnOffsets.size())
+      ps->ReadBuffer(&rvnOffsets[0], (NativeInt)(rvnOffsets.size()*sizeof(unsigned __int64)));
+   unsigned int n;
+   for (n = 0; n < rvnOffsets.size(); n++)
+      {
+      if (  rvnOffsets[n] < rHeader.nHeaderSize
+         || rvnOffsets[n] + rHeader.nRecordSize > rHeader.nIndexOffset
+         )
+         throw Exception("invalid index in epoche file");
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// overwrites thresholds of one epoche (or of all epoches if nEpoche is -1)
+//------------------------------------------------------------------------------
+void TSWEpocheFile::WriteThresholds(UnicodeString usFileName,
+                                    int nEpoche,
+                                    const std::vector<double >& rvdThreshold)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenReadWrite | fmShareDenyWrite);
+   try
+      {
+      TSWEpocheFileHeader swefh;
+      pfs->ReadBuffer(&swefh, sizeof(swefh));
+      if (!CheckHeader(swefh))
+         throw Exception("'" + usFileName + "' is not an epoche file");
+      if (rvdThreshold.size() != swefh.nNumChannels)
+         throw Exception("invalid number of thresholds passed");
+
+      // records of finalized files are located through the index
+      std::vector<unsigned __int64 > vnOffsets;
+      ReadIndex(pfs, swefh, vnOffsets);
+      unsigned int nNumEpoches = (unsigned int)vnOffsets.size();
+      if (!swefh.nIndexOffset)
+         nNumEpoches = (unsigned int)((pfs->Size - swefh.nHeaderSize) / swefh.nRecordSize);
+      unsigned int nFirst  = nEpoche < 0 ? 0 : (unsigned int)nEpoche;
+      unsigned int nLast   = nEpoche < 0 ? nNumEpoches : nFirst + 1;
+      if (nLast > nNumEpoches)
+         throw Exception("epoche index out of range in epoche file");
+      unsigned int n;
+      for (n = nFirst; n < nLast; n++)
+         {
+         __int64 nOffset = vnOffsets.size() ? (__int64)vnOffsets[n] : (__int64)swefh.nHeaderSize + (__int64)n*swefh.nRecordSize;
+         pfs->Seek(nOffset + (__int64)GetRecordHeaderSize(swefh.nVersion), soBeginning);
+         pfs->WriteBuffer(&rvdThreshold[0], (NativeInt)(rvdThreshold.size()*sizeof(double)));
+         }
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,147 @@
+//------------------------------------------------------------------------------
+/// \file SWEpocheFile.h
+///
+/// \author Berg
+/// \brief Definition of the AudioSpike epoche file format and implementation of
+/// class TSWEpocheFile for maintaining header and index
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWEpocheFileH
+#define SWEpocheFileH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+//------------------------------------------------------------------------------
+/// Layout of an epoche file (all values little endian):
+///   - TSWEpocheFileHeader
+///   - one record per epoche: TSWEpocheRecordHeader, followed by one threshold
+///     (double) per channel, followed by the samples (float) of all channels
+///     (channel by channel). Size of record header depends on file version
+///     (see TSWEpocheFile::GetRecordHeaderSize)
+///   - trailing index (written when file is closed): magic SWEF_INDEXMAGIC,
+///     number of epoches (unsigned __int64), file offset of every record
+///     (unsigned __int64) ordered by epoche index (TSWEpocheRecordHeader::nIndex)
+/// Records of closed files are located through the index. All records have the
+/// same size, so a file without index (e.g. after a crash) can still be read. A record that could not be written during
+/// recording (writer overflow) is written later with zero samples and flags
+/// SWEF_DROPPED and SWEF_NODATA, so no record is ever missing. If that is not
+/// possible the file is marked with SWEF_FILEBROKEN and is neither loaded nor
+/// appended. Legacy files (epoches.pcm) contain raw samples only and are read
+/// without metadata
+//------------------------------------------------------------------------------
+#define SWEF_FILENAME         "epoches.bin"
+#define SWEF_LEGACYFILENAME   "epoches.pcm"
+#define SWEF_MAGIC            "ASEPOCHE"
+#define SWEF_VERSION          2
+#define SWEF_RECORDMAGIC      0x48434F45  // 'EOCH'
+#define SWEF_INDEXMAGIC       0x58444E49  // 'INDX'
+/// size of record header of version 1 (without trigger offset)
+#define SWEF_RECORDHEADERSIZE_V1 24
+/// flags of an epoche record
+#define SWEF_TRIGGERERROR     0x00000001  // trigger distance out of tolerance
+#define SWEF_DROPPED          0x00000002  // excluded from spike detection
+#define SWEF_NODATA           0x00000004  // data lost while writing (zero samples)
+/// flags of an epoche file (TSWEpocheFileHeader::nFlags)
+#define SWEF_FILEBROKEN       0x00000001  // records are missing
+
+#pragma pack(push, 1)
+//------------------------------------------------------------------------------
+/// file header
+//------------------------------------------------------------------------------
+struct TSWEpocheFileHeader
+{
+   char              szMagic[8];
+   unsigned int      nVersion;
+   unsigned int      nHeaderSize;
+   unsigned int      nNumChannels;
+   unsigned int      nNumSamples;
+   double            dSampleRate;
+   double            dSampleRateDevider;
+   unsigned int      nRecordSize;
+   // flags of file (SWEF_FILEBROKEN), 0 in older files
+   unsigned int      nFlags;
+   // number of epoches and offset of index: both are 0 while file is written
+   unsigned __int64  nNumEpoches;
+   unsigned __int64  nIndexOffset;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// header of one epoche record
+//------------------------------------------------------------------------------
+struct TSWEpocheRecordHeader
+{
+   unsigned int      nMagic;
+   unsigned int      nIndex;
+   unsigned int      nStimIndex;
+   unsigned int      nRepetitionIndex;
+   // UTC time of recording as FILETIME
+   __int64           nTimeStamp;
+   // version 2 and later: flags (SWEF_TRIGGERERROR, SWEF_DROPPED) and sub-sample
+   // offset of interpolated trigger onset relative to trigger sample (see
+   // TSWEpoche::m_dTriggerOffset)
+   unsigned int      nFlags;
+   unsigned int      nReserved;
+   double            dTriggerOffset;
+};
+//------------------------------------------------------------------------------
+#pragma pack(pop)
+
+//------------------------------------------------------------------------------
+/// helper class for creating, appending and closing epoche files
+//------------------------------------------------------------------------------
+class TSWEpocheFile
+{
+   public:
+      static UnicodeString GetFileName(UnicodeString usPath);
+      static bool          IsEpocheFile(UnicodeString usFileName);
+      static unsigned int  GetRecordHeaderSize(unsigned int nVersion = SWEF_VERSION);
+      static unsigned int  GetRecordSize( unsigned int nNumChannels,
+                                          unsigned int nNumSamples,
+                                          unsigned int nVersion = SWEF_VERSION);
+      static unsigned int  GetRecordDataOffset( unsigned int nNumChannels,
+                                                unsigned int nVersion = SWEF_VERSION);
+      static void          InitHeader( TSWEpocheFileHeader &rHeader,
+                                       unsigned int nNumChannels,
+                                       unsigned int nNumSamples,
+                                       double dSampleRate,
+                                       double dSampleRateDevider);
+      static bool          CheckHeader(const TSWEpocheFileHeader &rHeader);
+      static unsigned int  PrepareAppend( UnicodeString usFileName,
+                                          unsigned int nNumChannels,
+                                          unsigned int nNumSamples);
+      static void          Finalize(UnicodeString usFileName);
+      static void          MarkBroken(UnicodeString usFileName);
+      static void          ReadIndex(  TStream* ps,
+                                       const TSWEpocheFileHeader &rHeader,
+                                       std::vector<unsigned __int64 >& rvnOffsets);
+      static void          WriteThresholds(  UnicodeString usFileName,
+                                             int nEpoche,
+                                             const std::vector<double >& rvdThreshold);
+};
+//------------------------------------------------------------------------------
+#endif
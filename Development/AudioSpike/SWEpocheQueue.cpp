@@ -0,0 +1,178 @@
+//------------------------------------------------------------------------------
+/// \file SWEpocheQueue.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWEpocheQueue, a lock-free queue for passing
+/// epoches from the recording callback to the GUI thread
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWEpocheQueue.h"
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor initializes members and sets a default capacity
+//------------------------------------------------------------------------------
+TSWEpocheQueue::TSWEpocheQueue()
+   : m_nMask(0), m_nHead(0), m_nTail(0), m_nOverflows(0), m_nHighWaterMark(0)
+{
+   SetCapacity(1024);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets capacity of the ring. Capacity is rounded up to next power of two.
+/// NOTE: queue must be empty and producer must not be running!
+//------------------------------------------------------------------------------
+void TSWEpocheQueue::SetCapacity(unsigned int nCapacity)
+{
+   if (Count())
+      throw Exception("capacity of epoche queue cannot be changed if epoches are pending");
+   if (nCapacity < 2 || nCapacity > 0x10000000)
+      throw Exception("invalid epoche queue capacity");
+
+   unsigned int nSize = 2;
+   while (nSize < nCapacity)
+      nSize <<= 1;
+
+   m_vpSlots.assign(nSize, (TSWEpoche*)NULL);
+   m_nMask = nSize - 1;
+   m_nHead.store(0);
+   m_nTail.store(0);
+   ResetStatistics();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns capacity of the ring
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheQueue::GetCapacity()
+{
+   return (unsigned int)m_vpSlots.size();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if one epoche can be pushed. Called by producer only before
+/// preparing an epoche: the following Push cannot fail, because the consumer
+/// only frees slots. Returns false (and counts overflow) if ring is full
+//------------------------------------------------------------------------------
+bool TSWEpocheQueue::Reserve()
+{
+   unsigned int nHead = m_nHead.load(std::memory_order_relaxed);
+   unsigned int nTail = m_nTail.load(std::memory_order_acquire);
+   if (nHead - nTail < m_vpSlots.size())
+      return true;
+   m_nOverflows.fetch_add(1, std::memory_order_relaxed);
+   return false;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// pushes an epoche to the ring. Called by producer only. Returns false (and
+/// counts overflow) if ring is full. Never blocks
+//------------------------------------------------------------------------------
+bool TSWEpocheQueue::Push(TSWEpoche* pswe)
+{
+   unsigned int nHead = m_nHead.load(std::memory_order_relaxed);
+   unsigned int nTail = m_nTail.load(std::memory_order_acquire);
+   if (nHead - nTail >= m_vpSlots.size())
+      {
+      m_nOverflows.fetch_add(1, std::memory_order_relaxed);
+      return false;
+      }
+   m_vpSlots[nHead & m_nMask] = pswe;
+   // publish slot to consumer
+   m_nHead.store(nHead + 1, std::memory_order_release);
+
+   // update statistics: written by producer only
+   unsigned int nDepth = nHead + 1 - nTail;
+   if (nDepth > m_nHighWaterMark.load(std::memory_order_relaxed))
+      m_nHighWaterMark.store(nDepth, std::memory_order_relaxed);
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// pops oldest epoche from ring. Called by consumer only. Returns NULL if ring
+/// is empty. Never blocks
+//------------------------------------------------------------------------------
+TSWEpoche* TSWEpocheQueue::Pop()
+{
+   unsigned int nTail = m_nTail.load(std::memory_order_relaxed);
+   unsigned int nHead = m_nHead.load(std::memory_order_acquire);
+   if (nTail == nHead)
+      return NULL;
+   TSWEpoche* pswe = m_vpSlots[nTail & m_nMask];
+   m_vpSlots[nTail & m_nMask] = NULL;
+   // release slot to producer
+   m_nTail.store(nTail + 1, std::memory_order_release);
+   return pswe;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of pending epoches (snapshot, may be outdated immediately if
+/// called while producer is running)
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheQueue::Count()
+{
+   unsigned int nTail = m_nTail.load(std::memory_order_acquire);
+   unsigned int nHead = m_nHead.load(std::memory_order_acquire);
+   return nHead - nTail;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of epoches that could not be pushed since last reset
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheQueue::GetOverflows()
+{
+   return m_nOverflows.load(std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns maximum number of pending epoches since last reset
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheQueue::GetHighWaterMark()
+{
+   return m_nHighWaterMark.load(std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// resets overflow counter and high-water-mark
+//------------------------------------------------------------------------------
+void TSWEpocheQueue::ResetStatistics()
+{
+   m_nOverflows.store(0);
+   m_nHighWaterMark.store(0);
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+/// \file SWEpocheQueue.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWEpocheQueue, a lock-free queue for passing
+/// epoches from the recording callback to the GUI thread
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWEpocheQueueH
+#define SWEpocheQueueH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <atomic>
+
+class TSWEpoche;
+
+//------------------------------------------------------------------------------
+/// bounded wait-free single-producer/single-consumer ring buffer of epoche
+/// pointers. The producer is the recording callback (TSWEpoches::SoundProc),
+/// the consumer is the GUI thread (TformSpikeWare::ProcessEpoches). Neither
+/// side ever blocks: if the ring is full Push fails and the overflow is counted.
+/// NOTE: capacity and statistics may only be changed while no producer is active
+//------------------------------------------------------------------------------
+class TSWEpocheQueue
+{
+   private:
+      std::vector<TSWEpoche* >   m_vpSlots;
+      unsigned int               m_nMask;
+      // head (written by producer only) and tail (written by consumer only) are
+      // free running counters. They are kept on separate cache lines to avoid
+      // false sharing between audio and GUI thread
+      std::atomic<unsigned int>  m_nHead;
+      char                       m_cPad1[64];
+      std::atomic<unsigned int>  m_nTail;
+      char                       m_cPad2[64];
+      std::atomic<unsigned int>  m_nOverflows;
+      std::atomic<unsigned int>  m_nHighWaterMark;
+   public:
+      TSWEpocheQueue();
+      void           SetCapacity(unsigned int nCapacity);
+      unsigned int   GetCapacity();
+      bool           Reserve();
+      bool           Push(TSWEpoche* pswe);
+      TSWEpoche*     Pop();
+      unsigned int   Count();
+      unsigned int   GetOverflows();
+      unsigned int   GetHighWaterMark();
+      void           ResetStatistics();
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,388 @@
+//------------------------------------------------------------------------------
+/// \file SWEpocheStore.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWEpocheStore for memory mapped random access
+/// to stored epoches
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWEpocheStore.h"
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+/// default size of a mapped view in bytes
+#define SWES_VIEWSIZE   (64*1024*1024)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Initializes members
+//------------------------------------------------------------------------------
+TSWEpocheStore::TSWEpocheStore()
+   :  m_hFile(INVALID_HANDLE_VALUE), m_hMapping(NULL), m_pView(NULL),
+      m_nViewOffset(0), m_nViewSize(0), m_nMappingSize(0),
+      m_nNumChannels(0), m_nNumSamples(0), m_bLegacy(true), m_nDataOffset(0),
+      m_nRecordSize(0), m_nRecordDataOffset(0)
+{
+   InitializeCriticalSection(&m_cs);
+   SYSTEM_INFO si;
+   GetSystemInfo(&si);
+   m_nGranularity = (unsigned int)si.dwAllocationGranularity;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// destructor. Closes file
+//------------------------------------------------------------------------------
+TSWEpocheStore::~TSWEpocheStore()
+{
+   Close();
+   DeleteCriticalSection(&m_cs);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// opens an epoche file (or a legacy file) for reading. The file may be opened
+/// for writing by others (e.g. TSWFileWriter) at the same time
+//------------------------------------------------------------------------------
+void TSWEpocheStore::Open( UnicodeString usFileName,
+                           unsigned int nNumChannels,
+                           unsigned int nNumSamples)
+{
+   if (!nNumChannels || !nNumSamples)
+      throw Exception("invalid epoche dimensions for epoche store");
+
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      Close();
+      m_hFile = CreateFileW(  usFileName.w_str(),
+                              GENERIC_READ,
+                              FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL,
+                              OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_RANDOM_ACCESS,
+                              NULL);
+      if (m_hFile == INVALID_HANDLE_VALUE)
+         throw Exception("Epoche file '" + usFileName + "' cannot be opened: " + SysErrorMessage((int)GetLastError()));
+      try
+         {
+         DWORD dwRead = 0;
+         if (  !ReadFile(m_hFile, &m_swefh, sizeof(m_swefh), &dwRead, NULL)
+            || dwRead != sizeof(m_swefh)
+            || !TSWEpocheFile::CheckHeader(m_swefh)
+            )
+            {
+            // legacy file: raw samples only
+            m_bLegacy            = true;
+            m_nDataOffset        = 0;
+            m_nRecordSize        = (__int64)nNumChannels * nNumSamples * (__int64)sizeof(float);
+            m_nRecordDataOffset  = 0;
+            }
+         else
+            {
+            if (m_swefh.nNumChannels != nNumChannels || m_swefh.nNumSamples != nNumSamples)
+               throw Exception("epoche dimensions of '" + usFileName + "' do not match current settings");
+            m_bLegacy            = false;
+            m_nDataOffset        = m_swefh.nHeaderSize;
+            m_nRecordSize        = m_swefh.nRecordSize;
+            m_nRecordDataOffset  = TSWEpocheFile::GetRecordDataOffset(nNumChannels, m_swefh.nVersion);
+            // NOTE: stream does not own the handle
+            THandleStream *phs = new THandleStream((THandle)m_hFile);
+            try
+               {
+               TSWEpocheFile::ReadIndex(phs, m_swefh, m_vnOffsets);
+               }
+            __finally
+               {
+               TRYDELETENULL(phs);
+               }
+            }
+         }
+      catch (...)
+         {
+         CloseHandle(m_hFile);
+         m_hFile = INVALID_HANDLE_VALUE;
+         throw;
+         }
+      m_usFileName   = usFileName;
+      m_nNumChannels = nNumChannels;
+      m_nNumSamples  = nNumSamples;
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// closes view, mapping and file
+//------------------------------------------------------------------------------
+void TSWEpocheStore::Close()
+{
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      CloseMapping();
+      if (m_hFile != INVALID_HANDLE_VALUE)
+         CloseHandle(m_hFile);
+      m_hFile = INVALID_HANDLE_VALUE;
+      m_usFileName = "";
+      m_vnOffsets.clear();
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// closes view and mapping (file stays open)
+//------------------------------------------------------------------------------
+void TSWEpocheStore::CloseMapping()
+{
+   if (m_pView)
+      UnmapViewOfFile(m_pView);
+   m_pView = NULL;
+   if (m_hMapping)
+      CloseHandle(m_hMapping);
+   m_hMapping     = NULL;
+   m_nViewOffset  = 0;
+   m_nViewSize    = 0;
+   m_nMappingSize = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// re-creates mapping if file has grown. Returns false if file is empty
+//------------------------------------------------------------------------------
+bool TSWEpocheStore::UpdateMapping()
+{
+   LARGE_INTEGER liSize;
+   if (!GetFileSizeEx(m_hFile, &liSize))
+      throw Exception("cannot determine size of epoche file: " + SysErrorMessage((int)GetLastError()));
+   if (liSize.QuadPart == m_nMappingSize && !!m_hMapping)
+      return true;
+   CloseMapping();
+   if (!liSize.QuadPart)
+      return false;
+   m_hMapping = CreateFileMappingW(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+   if (!m_hMapping)
+      throw Exception("cannot map epoche file: " + SysErrorMessage((int)GetLastError()));
+   m_nMappingSize = liSize.QuadPart;
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns pointer to passed byte range of the file. Maps a new view, if range
+/// is not within current view
+//------------------------------------------------------------------------------
+const char* TSWEpocheStore::MapRange(__int64 nOffset, __int64 nSize)
+{
+   if (!IsOpen())
+      throw Exception("epoche store not opened");
+   // range not within current mapping: file may have grown
+   if (nOffset + nSize > m_nMappingSize)
+      {
+      if (!UpdateMapping() || nOffset + nSize > m_nMappingSize)
+         throw Exception("cannot read epoche data: position exceeded");
+      }
+   if (!m_pView || nOffset < m_nViewOffset || nOffset + nSize > m_nViewOffset + m_nViewSize)
+      {
+      if (m_pView)
+         UnmapViewOfFile(m_pView);
+      m_pView = NULL;
+      __int64 nViewOffset = nOffset - (nOffset % m_nGranularity);
+      __int64 nViewSize   = nOffset + nSize - nViewOffset;
+      if (nViewSize < SWES_VIEWSIZE)
+         nViewSize = SWES_VIEWSIZE;
+      if (nViewOffset + nViewSize > m_nMappingSize)
+         nViewSize = m_nMappingSize - nViewOffset;
+      m_pView = (char*)MapViewOfFile(  m_hMapping,
+                                       FILE_MAP_READ,
+                                       (DWORD)(nViewOffset >> 32),
+                                       (DWORD)(nViewOffset & 0xFFFFFFFF),
+                                       (SIZE_T)nViewSize);
+      if (!m_pView)
+         throw Exception("cannot map epoche data: " + SysErrorMessage((int)GetLastError()));
+      m_nViewOffset  = nViewOffset;
+      m_nViewSize    = nViewSize;
+      }
+   return m_pView + (nOffset - m_nViewOffset);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns file offset of record of passed epoche: taken from index for
+/// finalized epoche files, calculated from record size otherwise
+//------------------------------------------------------------------------------
+__int64 TSWEpocheStore::GetRecordOffset(unsigned int nEpoche)
+{
+   if (m_vnOffsets.size())
+      {
+      if (nEpoche >= m_vnOffsets.size())
+         throw Exception("epoche index out of range in epoche store");
+      return (__int64)m_vnOffsets[nEpoche];
+      }
+   return m_nDataOffset + (__int64)nEpoche * m_nRecordSize;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if an epoche file is opened
+//------------------------------------------------------------------------------
+bool TSWEpocheStore::IsOpen()
+{
+   return m_hFile != INVALID_HANDLE_VALUE;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns name of opened file
+//------------------------------------------------------------------------------
+UnicodeString TSWEpocheStore::GetFileName()
+{
+   return m_usFileName;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if opened file is a legacy file without metadata
+//------------------------------------------------------------------------------
+bool TSWEpocheStore::IsLegacy()
+{
+   return m_bLegacy;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of complete epoches currently contained in file. For closed
+/// epoche files the number is taken from header, otherwise from file size
+//------------------------------------------------------------------------------
+unsigned int TSWEpocheStore::GetNumEpoches()
+{
+   if (!IsOpen())
+      return 0;
+   if (!m_bLegacy && m_swefh.nIndexOffset)
+      return (unsigned int)m_swefh.nNumEpoches;
+   LARGE_INTEGER liSize;
+   if (!GetFileSizeEx(m_hFile, &liSize))
+      throw Exception("cannot determine size of epoche file: " + SysErrorMessage((int)GetLastError()));
+   if (liSize.QuadPart < m_nDataOffset)
+      return 0;
+   return (unsigned int)((liSize.QuadPart - m_nDataOffset) / m_nRecordSize);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// reads metadata of one epoche. Returns false for legacy files (no metadata).
+/// Fields missing in older file versions are set to 0. Throws an exception if
+/// record does not belong to passed epoche
+//------------------------------------------------------------------------------
+bool TSWEpocheStore::ReadRecord( unsigned int nEpoche,
+                                 TSWEpocheRecordHeader &rswerh,
+                                 std::vector<double > &rvdThreshold)
+{
+   if (m_bLegacy)
+      return false;
+   rvdThreshold.resize(m_nNumChannels);
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      const char* pc = MapRange(GetRecordOffset(nEpoche), m_nRecordDataOffset);
+      unsigned int nHeaderSize = TSWEpocheFile::GetRecordHeaderSize(m_swefh.nVersion);
+      ZeroMemory(&rswerh, sizeof(rswerh));
+      CopyMemory(&rswerh, pc, nHeaderSize);
+      if (rswerh.nMagic != SWEF_RECORDMAGIC)
+         throw Exception("invalid epoche record " + IntToStr((int)nEpoche) + " in epoche file");
+      if (rswerh.nIndex != nEpoche)
+         throw Exception("epoche record " + IntToStr((int)nEpoche) + " contains epoche " + IntToStr((int)rswerh.nIndex) + " in epoche file");
+      CopyMemory(&rvdThreshold[0], pc + nHeaderSize, m_nNumChannels*sizeof(double));
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns pointer to the samples of one channel of one epoche (zero-copy).
+/// NOTE: pointer is only valid until next call of any member function, i.e.
+/// the store must only be used by one thread when using this function
+//------------------------------------------------------------------------------
+const float* TSWEpocheStore::GetChannel(unsigned int nEpoche, unsigned int nChannel)
+{
+   if (nChannel >= m_nNumChannels)
+      throw Exception("channel index out of range in epoche store");
+   __int64 nChannelSize = (__int64)m_nNumSamples * (__int64)sizeof(float);
+   const float* pf;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      __int64 nOffset = GetRecordOffset(nEpoche) + m_nRecordDataOffset + nChannel * nChannelSize;
+      pf = (const float*)MapRange(nOffset, nChannelSize);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return pf;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// copies all channels of one epoche to passed vector (resized if necessary).
+/// Thread safe
+//------------------------------------------------------------------------------
+void TSWEpocheStore::Read(unsigned int nEpoche, vvf &rvvfData)
+{
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      if (rvvfData.size() != m_nNumChannels)
+         rvvfData.resize(m_nNumChannels);
+      __int64 nEpocheSize = (__int64)m_nNumChannels * m_nNumSamples * (__int64)sizeof(float);
+      const float* pf = (const float*)MapRange(GetRecordOffset(nEpoche) + m_nRecordDataOffset, nEpocheSize);
+      unsigned int n;
+      for (n = 0; n < m_nNumChannels; n++)
+         {
+         if (rvvfData[n].size() != m_nNumSamples)
+            rvvfData[n].resize(m_nNumSamples);
+         CopyMemory(&rvvfData[n][0], pf + n*m_nNumSamples, m_nNumSamples*sizeof(float));
+         }
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+/// \file SWEpocheStore.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWEpocheStore for memory mapped random access
+/// to stored epoches
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWEpocheStoreH
+#define SWEpocheStoreH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include "SWTools.h"
+#include "SWEpocheFile.h"
+
+//------------------------------------------------------------------------------
+/// read-only random access to the epoche file. The file is opened once and
+/// mapped into memory in windows (to support large files in 32-bit builds as
+/// well). The mapping grows as the file grows, i.e. the file may still be
+/// written while being read. Epoche files (see SWEpocheFile.h) and legacy raw
+/// files are supported. Records of finalized epoche files are located through
+/// the index of the file.
+/// NOTE: file must be closed before the epoche file is re-created!
+//------------------------------------------------------------------------------
+class TSWEpocheStore
+{
+   private:
+      CRITICAL_SECTION  m_cs;
+      HANDLE            m_hFile;
+      HANDLE            m_hMapping;
+      char*             m_pView;
+      __int64           m_nViewOffset;
+      __int64           m_nViewSize;
+      __int64           m_nMappingSize;
+      unsigned int      m_nGranularity;
+      unsigned int      m_nNumChannels;
+      unsigned int      m_nNumSamples;
+      bool              m_bLegacy;
+      TSWEpocheFileHeader  m_swefh;
+      __int64           m_nDataOffset;
+      __int64           m_nRecordSize;
+      __int64           m_nRecordDataOffset;
+      std::vector<unsigned __int64 > m_vnOffsets;
+      UnicodeString     m_usFileName;
+      __int64           GetRecordOffset(unsigned int nEpoche);
+      void              CloseMapping();
+      bool              UpdateMapping();
+      const char*       MapRange(__int64 nOffset, __int64 nSize);
+   public:
+      TSWEpocheStore();
+      ~TSWEpocheStore();
+      void              Open( UnicodeString usFileName,
+                              unsigned int nNumChannels,
+                              unsigned int nNumSamples);
+      void              Close();
+      bool              IsOpen();
+      UnicodeString     GetFileName();
+      bool              IsLegacy();
+      unsigned int      GetNumEpoches();
+      bool              ReadRecord( unsigned int nEpoche,
+                                    TSWEpocheRecordHeader &rswerh,
+                                    std::vector<double > &rvdThreshold);
+      const float*      GetChannel(unsigned int nEpoche, unsigned int nChannel);
+      void              Read(unsigned int nEpoche, vvf &rvvfData);
+};
+//------------------------------------------------------------------------------
+#endif
@@ -49,66 +49,80 @@
 
 
 //------------------------------------------------------------------------------
-/// constructor initializes members
+/// constructor initializes members. If bAllocate is false, no data buffers are
+/// allocated, i.e. data are read on demand from epoche store of TSWEpoches
 //------------------------------------------------------------------------------
 TSWEpoche::TSWEpoche(unsigned int nNumChannels,
                      unsigned int nNumSamples,
                      unsigned int nStimIndex,
                      unsigned int nRepetitionIndex,
                      const std::vector<double >& rvdThreshold,
-                     UnicodeString usFileName)
-   : m_usFileName(usFileName), m_vvdData(nNumChannels, std::valarray<double>(nNumSamples))
+                     UnicodeString usFileName,
+                     bool bAllocate)
+   :  m_usFileName(usFileName), m_pEpoches(NULL), m_bPooled(false),
+      m_vvfData(bAllocate ? nNumChannels : 0, std::valarray<float>(nNumSamples))
 {
    m_nNumChannels       = nNumChannels;
    m_nNumSamples        = nNumSamples;
    m_nStimIndex         = nStimIndex;
    m_nRepetitionIndex   = nRepetitionIndex;
    m_vdThreshold        = rvdThreshold;
+   m_dTriggerOffset     = 0.0;
+   m_bTriggerError      = false;
+   m_bDropped           = false;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns epoch data. If m_vvdData is (still) empty it is read from file
+/// returns epoch data. If m_vvfData is (still) empty it is read from the epoche
+/// store of owning TSWEpoches. Data are kept as float (i.e. in the same format
+/// as recorded and stored in file)
 //------------------------------------------------------------------------------
-vvd TSWEpoche::GetData()
+vvf TSWEpoche::GetData()
 {
-   if (m_vvdData.size())
-      return m_vvdData;
+   if (m_vvfData.size())
+      return m_vvfData;
 
-   vvd vvdData(m_nNumChannels, std::valarray<double>(m_nNumSamples));
+   if (!m_pEpoches)
+      throw Exception("cannot read epoche data: no epoche store available");
 
-   std::valarray<float > vaf(m_nNumSamples);
-   TFileStream* pfs = NULL;
-   try
-      {
-      pfs = new TFileStream(m_usFileName, fmOpenRead | fmShareDenyNone);
-      __int64 nPos = m_nIndex * m_nNumChannels * m_nNumSamples * sizeof(float);
-      if (nPos > pfs->Size-1)
-         throw Exception("cannot read epoche data: position exceeded");
-      pfs->Seek(nPos, soBeginning);
-      unsigned int n, m;
-      for (n = 0; n < m_nNumChannels; n++)
-         {
-         pfs->ReadBuffer(&vaf[0], (NativeInt)(m_nNumSamples * sizeof(float)));
-         // convert floats to double
-         for (m = 0; m < m_nNumSamples; m++)
-            vvdData[n][m] = (double)vaf[m];
-         }
-      }
-   __finally
-      {
-      TRYDELETENULL(pfs);
-      }
-   return vvdData;
+   vvf vvfData;
+   m_pEpoches->ReadEpoche(this, vvfData);
+   return vvfData;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns samples of one channel held in memory (no copy). Must only be
+/// called if HasData() returns true, otherwise the channel has to be read from
+/// the epoche store
+//------------------------------------------------------------------------------
+const float* TSWEpoche::GetChannel(unsigned int nChannel)
+{
+   if (nChannel >= m_vvfData.size())
+      throw Exception("epoche data not in memory or channel index out of range");
+   return &m_vvfData[nChannel][0];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if epoche data are held in memory (i.e. are not read from
+/// epoche store by GetData)
+//------------------------------------------------------------------------------
+bool TSWEpoche::HasData()
+{
+   return m_vvfData.size() > 0;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------ 
-/// clears m_vvdData member
+/// clears m_vvfData member. NOTE: epoches owned by the pool of TSWEpoches keep
+/// their buffers, because they are recycled
 //------------------------------------------------------------------------------
 void TSWEpoche::ClearData()
 {
-   m_vvdData.clear();
+   if (!m_bPooled)
+      m_vvfData.clear();
 }
 //------------------------------------------------------------------------------
 
@@ -120,7 +134,15 @@ void TSWEpoche::ClearData()
 /// constructor initializes members
 //------------------------------------------------------------------------------
 TSWEpoches::TSWEpoches()
-   : m_pfsWrite(NULL), m_pfsWriteProbeMic(NULL)
+   : m_bSaveRecords(false), m_nSaveVersion(SWEF_VERSION),
+     m_nLostFirst(0), m_nLostProbeMics(0), m_bSaveBroken(false),
+     m_dRecTriggerOffset(0.0), m_bRecTriggerError(false),
+     m_bStreamAppend(false), m_nStreamChunkSamples(0), m_nStreamRun(0),
+     m_nStreamDiscarded(0), m_nStreamSamples(0), m_nStreamBufferStart(0),
+     m_nRecTriggerStreamPos(0),
+     m_dRecTriggerStreamOnset(0.0), m_nPreTriggerSamples(0), m_nHistoryPos(0),
+     m_nPoolAllocations(0), m_dPreTrigger(0.0), m_dLastTriggerOnset(0.0),
+     m_tpTriggerPolicy(SWTP_STOP), m_nTriggerTolerance(5)
 {
    InitializeCriticalSection(&m_cs);
    InitializeCriticalSection(&m_csReset);
@@ -133,6 +155,8 @@ TSWEpoches::TSWEpoches()
    m_nLastTriggerPos    = 0;
    m_nLastTriggerDistance = 0;
    m_bTriggerError      = false;
+   m_bQueueOverflow     = false;
+   m_bQueueStopped      = false;
    m_nFirstTriggerError = -1;
    m_nStimIndexAtStart  = 0;
 
@@ -147,9 +171,10 @@ TSWEpoches::TSWEpoches()
 TSWEpoches::~TSWEpoches()
 {
    Clear();
+   DeletePool();
    TRYDELETENULL(m_ptl);
-   TRYDELETENULL(m_pfsWrite);
-   TRYDELETENULL(m_pfsWriteProbeMic);
+   m_swfwEpoches.Close();
+   m_swfwProbeMics.Close();
    DeleteCriticalSection(&m_cs);
    DeleteCriticalSection(&m_csReset);
 }
@@ -177,6 +202,94 @@ void  TSWEpoches::Initialize(unsigned int nNumChannels, unsigned int nSize)
    unsigned int nChannel;
    for (nChannel = 0; nChannel < nNumChannels; nChannel++)
       m_vvfEpoche[nChannel].resize(nSize);
+   m_vdRecordThreshold.assign(nNumChannels, 0.0);
+
+   int nReservoirSize   = formSpikeWare->m_pIni->ReadInteger("Settings", "NoiseReservoirSize", SWNE_RESERVOIR_SIZE);
+   int nDecimation      = formSpikeWare->m_pIni->ReadInteger("Settings", "NoiseDecimation", SWNE_DECIMATION);
+   if (nReservoirSize < SWNE_MIN_SAMPLES)
+      nReservoirSize = SWNE_RESERVOIR_SIZE;
+   if (nDecimation < 1)
+      nDecimation = SWNE_DECIMATION;
+   m_swneNoise.Initialize(nNumChannels, (unsigned int)nReservoirSize, (unsigned int)nDecimation);
+
+   CreatePool(nNumChannels, nSize);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// creates the pool of preallocated epoches used by SoundProc. Size of the pool
+/// is read from INI. Must not be called while recording
+//------------------------------------------------------------------------------
+void TSWEpoches::CreatePool(unsigned int nNumChannels, unsigned int nSize)
+{
+   DeletePool();
+   int nPoolSize = formSpikeWare->m_pIni->ReadInteger("Settings", "EpochePoolSize", 32);
+   if (nPoolSize < 2)
+      nPoolSize = 2;
+   m_sweqFree.SetCapacity((unsigned int)nPoolSize);
+   std::vector<double > vdThreshold(nNumChannels);
+   int n;
+   for (n = 0; n < nPoolSize; n++)
+      {
+      TSWEpoche* pswe = new TSWEpoche(nNumChannels, nSize, 0, 0, vdThreshold, "");
+      pswe->m_pEpoches  = this;
+      pswe->m_bPooled   = true;
+      m_vpPool.push_back(pswe);
+      m_sweqFree.Push(pswe);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// deletes all epoches of the pool. Must not be called while recording
+//------------------------------------------------------------------------------
+void TSWEpoches::DeletePool()
+{
+   // empty free list first (we are the only thread accessing it here)
+   while (m_sweqFree.Pop() != NULL)
+      ;
+   unsigned int n;
+   for (n = 0; n < m_vpPool.size(); n++)
+      TRYDELETENULL(m_vpPool[n]);
+   m_vpPool.clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns a free epoche from the pool. Called in recording callback. Only if
+/// pool is exhausted, a new epoche is allocated and m_nPoolAllocations is
+/// increased
+//------------------------------------------------------------------------------
+TSWEpoche* TSWEpoches::Acquire()
+{
+   TSWEpoche* pswe = m_sweqFree.Pop();
+   if (!pswe)
+      {
+      m_nPoolAllocations++;
+      pswe = new TSWEpoche((unsigned int)m_vvfEpoche.size(),
+                           (unsigned int)m_vvfEpoche[0].size(),
+                           0,
+                           0,
+                           m_vdThreshold,
+                           m_usEpocheFile);
+      pswe->m_pEpoches = this;
+      }
+   else
+      pswe->m_usFileName = m_usEpocheFile;
+   return pswe;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// gives an epoche returned by Pop back to the pool (or deletes it, if it was
+/// not taken from the pool). Must only be called from GUI thread
+//------------------------------------------------------------------------------
+void TSWEpoches::Release(TSWEpoche* pswe)
+{
+   if (!pswe)
+      return;
+   if (!pswe->m_bPooled || !m_sweqFree.Push(pswe))
+      delete pswe;
 }
 //------------------------------------------------------------------------------
 
@@ -189,6 +302,26 @@ unsigned int TSWEpoches::GetNumChannels()
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// returns number of samples recorded before trigger at beginning of every
+/// epoche
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetPreTriggerSamples()
+{
+   return m_nPreTriggerSamples;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns stimulus onset within epoche in seconds, i.e. pre-stimulus (silence
+/// played before stimulus) plus pre-trigger (recorded before trigger)
+//------------------------------------------------------------------------------
+double TSWEpoches::GetStimulusOnset()
+{
+   return m_dPreStimulus + m_dPreTrigger;
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// returns threshold for a channel
 //------------------------------------------------------------------------------
@@ -222,12 +355,7 @@ void TSWEpoches::SetThreshold(unsigned int nChannelIndex, double dThreshold)
 //------------------------------------------------------------------------------
 void TSWEpoches::InitSave()
 {
-   TRYDELETENULL(m_pfsWrite);
-   TRYDELETENULL(m_pfsWriteProbeMic);
-   m_pfsWrite = new TFileStream(formSpikeWare->m_usResultPath + "epoches.pcm", fmCreate | fmShareDenyWrite);
-   // for insitu AND 'save probemics' create second write stream
-   if (formSpikeWare->IsInSitu() && formSpikeWare->m_smp.m_bSaveProbeMics)
-      m_pfsWriteProbeMic = new TFileStream(formSpikeWare->m_usResultPath + "probemics.pcm", fmCreate | fmShareDenyWrite);
+   OpenSave(false);
 }
 //------------------------------------------------------------------------------
 
@@ -236,30 +364,256 @@ void TSWEpoches::InitSave()
 //------------------------------------------------------------------------------
 void TSWEpoches::AppendSave()
 {
-   TRYDELETENULL(m_pfsWrite);
-   TRYDELETENULL(m_pfsWriteProbeMic);
-   m_pfsWrite = new TFileStream(formSpikeWare->m_usResultPath + "epoches.pcm", fmOpenWrite | fmShareDenyWrite);
-   m_pfsWrite->Seek(0, soFromEnd);
+   OpenSave(true);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// opens asynchronous writers for epoches and probe mic recording. Size and
+/// number of write blocks are read from INI. New results are always written as
+/// epoche file (see SWEpocheFile.h), legacy files are appended in legacy format
+//------------------------------------------------------------------------------
+void TSWEpoches::OpenSave(bool bAppend)
+{
+   DoneSave();
+   // NOTE: file cannot be re-created while it is mapped
+   m_swesStore.Close();
+   if (!m_vvfEpoche.size())
+      throw Exception("epoches not initialized");
+   m_vswerhLost.clear();
+   m_vswerhLost.reserve(SWE_MAXLOSTRECORDS);
+   m_nLostFirst      = 0;
+   m_nLostProbeMics  = 0;
+   m_bSaveBroken     = false;
+   unsigned int nNumChannels  = (unsigned int)m_vvfEpoche.size();
+   unsigned int nNumSamples   = (unsigned int)m_vvfEpoche[0].size();
+   unsigned int nBlockSize = 1024*(unsigned int)formSpikeWare->m_pIni->ReadInteger("Settings", "WriteBlockSizeKB", 1024);
+   unsigned int nNumBlocks = (unsigned int)formSpikeWare->m_pIni->ReadInteger("Settings", "WriteBlocks", 16);
+   if (bAppend)
+      {
+      m_usSaveFile   = TSWEpocheFile::GetFileName(formSpikeWare->m_usResultPath);
+      m_bSaveRecords = TSWEpocheFile::IsEpocheFile(m_usSaveFile);
+      if (m_bSaveRecords)
+         m_nSaveVersion = TSWEpocheFile::PrepareAppend(m_usSaveFile, nNumChannels, nNumSamples);
+      m_swfwEpoches.Open(m_usSaveFile, true, nBlockSize, nNumBlocks);
+      }
+   else
+      {
+      m_usSaveFile   = formSpikeWare->m_usResultPath + SWEF_FILENAME;
+      m_bSaveRecords = true;
+      m_nSaveVersion = SWEF_VERSION;
+      m_swfwEpoches.Open(m_usSaveFile, false, nBlockSize, nNumBlocks);
+      TSWEpocheFileHeader swefh;
+      TSWEpocheFile::InitHeader( swefh,
+                                 nNumChannels,
+                                 nNumSamples,
+                                 formSpikeWare->m_swsSpikes.GetSampleRate(),
+                                 formSpikeWare->m_swsSpikes.m_dSampleRateDevider);
+      m_swfwEpoches.Write(&swefh, sizeof(swefh));
+      }
    // for insitu AND 'save probemics' create second write stream
    if (formSpikeWare->IsInSitu() && formSpikeWare->m_smp.m_bSaveProbeMics)
+      m_swfwProbeMics.Open(formSpikeWare->m_usResultPath + "probemics.pcm", bAppend, nBlockSize, nNumBlocks);
+   // continuous stream is opened in Start(), because ASIO buffer size is needed
+   m_bStreamAppend = bAppend;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// opens asynchronous writers for continuous recording of all electrode
+/// channels (one chunk per ASIO buffer) and the corresponding trigger index
+/// (see SWStreamFile.h). Existing stream is appended, if saving was started in
+/// append mode
+//------------------------------------------------------------------------------
+void TSWEpoches::OpenStream()
+{
+   unsigned int nNumChannels  = (unsigned int)m_vvfEpoche.size();
+   unsigned int nBlockSize = 1024*(unsigned int)formSpikeWare->m_pIni->ReadInteger("Settings", "WriteBlockSizeKB", 1024);
+   unsigned int nNumBlocks = (unsigned int)formSpikeWare->m_pIni->ReadInteger("Settings", "WriteBlocks", 16);
+   UnicodeString usFileName      = TSWStreamFile::GetFileName(formSpikeWare->m_usResultPath);
+   UnicodeString usIndexFileName = TSWStreamFile::GetIndexFileName(formSpikeWare->m_usResultPath);
+
+   // SoundProc receives buffers downsampled by recording downsample factor
+   unsigned int nDevider   = (unsigned int)formSpikeWare->m_swsSpikes.m_dSampleRateDevider;
+   if (!nDevider)
+      nDevider = 1;
+   m_nStreamChunkSamples   = (formSpikeWare->m_smp.m_nBufferSize + nDevider - 1) / nDevider;
+   m_vfStreamPadding.assign(m_nStreamChunkSamples, 0.0f);
+   m_nStreamSamples        = 0;
+   m_nStreamBufferStart    = 0;
+   m_nStreamRun            = 0;
+   m_nStreamDiscarded      = 0;
+   bool bAppend = m_bStreamAppend && FileExists(usFileName) && FileExists(usIndexFileName);
+   if (bAppend)
+      {
+      TSWStreamFile::PrepareAppend(usFileName, nNumChannels, m_nStreamChunkSamples, m_nStreamSamples, m_nStreamRun);
+      TSWStreamFile::PrepareAppendIndex(usIndexFileName);
+      }
+   m_swfwStream.Open(usFileName, bAppend, nBlockSize, nNumBlocks);
+   // index is small: use small blocks
+   m_swfwStreamIndex.Open(usIndexFileName, bAppend, 64*1024, 4);
+   if (!bAppend)
+      {
+      TSWStreamFileHeader swsfh;
+      TSWStreamFile::InitHeader( swsfh,
+                                 nNumChannels,
+                                 m_nStreamChunkSamples,
+                                 formSpikeWare->m_swsSpikes.GetSampleRate(),
+                                 formSpikeWare->m_swsSpikes.m_dSampleRateDevider);
+      m_swfwStream.Write(&swsfh, sizeof(swsfh));
+      TSWStreamIndexHeader swsih;
+      TSWStreamFile::InitIndexHeader(swsih);
+      m_swfwStreamIndex.Write(&swsih, sizeof(swsih));
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes one chunk with all electrode channels of passed buffers to stream.
+/// Called by SoundProc: cost is independent of triggers (one write per channel)
+//------------------------------------------------------------------------------
+void TSWEpoches::WriteStream(vvf &vvfBuffers)
+{
+   unsigned int nNumSamples = (unsigned int)vvfBuffers[0].size();
+   // NOTE: all chunks have same size, shorter buffers are padded. Larger
+   // buffers should never happen, counted as write overflow (stops measurement)
+   if (nNumSamples > m_nStreamChunkSamples)
+      {
+      m_nStreamDiscarded++;
+      return;
+      }
+   m_nStreamBufferStart = m_nStreamSamples;
+   m_nStreamSamples    += m_nStreamChunkSamples;
+   // chunk is written completely or not at all
+   unsigned int nChannel;
+   unsigned int nNumElectrodes = 0;
+   for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
+      {
+      if (formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         nNumElectrodes++;
+      }
+   if (!m_swfwStream.Reserve(sizeof(TSWStreamChunkHeader) + (unsigned __int64)nNumElectrodes*m_nStreamChunkSamples*sizeof(float)))
+      return;
+   TSWStreamChunkHeader swsch;
+   swsch.nMagic         = SWSF_CHUNKMAGIC;
+   swsch.nRun           = m_nStreamRun;
+   swsch.nStartSample   = m_nStreamBufferStart;
+   swsch.nNumSamples    = nNumSamples;
+   swsch.nReserved      = 0;
+   m_swfwStream.Write(&swsch, sizeof(swsch));
+   unsigned int nNumPadding = m_nStreamChunkSamples - nNumSamples;
+   for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
       {
-      m_pfsWriteProbeMic = new TFileStream(formSpikeWare->m_usResultPath + "probemics.pcm", fmOpenWrite | fmShareDenyWrite);
-      m_pfsWriteProbeMic->Seek(0, soFromEnd);
+      if (!formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         continue;
+      if (nNumSamples)
+         m_swfwStream.Write(&vvfBuffers[nChannel][0], nNumSamples*(unsigned int)sizeof(float));
+      if (nNumPadding)
+         m_swfwStream.Write(&m_vfStreamPadding[0], nNumPadding*(unsigned int)sizeof(float));
       }
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// exits saving to file by closing/deleting TFileStreams
+/// writes all pending data to files without closing them (used on pause). Must
+/// not be called while recording
+//------------------------------------------------------------------------------
+void TSWEpoches::FlushSave()
+{
+   WriteLostEpoches(true);
+   WriteLostProbeMics(true);
+   m_swfwEpoches.Flush();
+   m_swfwProbeMics.Flush();
+   m_swfwStream.Flush();
+   m_swfwStreamIndex.Flush();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// exits saving to file by writing pending data and closing the writers. Epoche
+/// files are finalized (index is written) or marked as broken, if lost records
+/// could not be written
 //------------------------------------------------------------------------------
 void TSWEpoches::DoneSave()
 {
-   TRYDELETENULL(m_pfsWrite);
-   TRYDELETENULL(m_pfsWriteProbeMic);
+   bool bFinalize = m_swfwEpoches.IsOpen() && m_bSaveRecords;
+   if (!WriteLostEpoches(true))
+      m_bSaveBroken = true;
+   WriteLostProbeMics(true);
+   m_swfwEpoches.Close();
+   m_swfwProbeMics.Close();
+   m_swfwStream.Close();
+   m_swfwStreamIndex.Close();
+   if (bFinalize)
+      {
+      if (m_bSaveBroken)
+         TSWEpocheFile::MarkBroken(m_usSaveFile);
+      else
+         TSWEpocheFile::Finalize(m_usSaveFile);
+      }
    Application->ProcessMessages();
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// returns true, if writing of epoches or probe mic data failed
+//------------------------------------------------------------------------------
+bool TSWEpoches::GetSaveError(UnicodeString &usError)
+{
+   return   m_swfwEpoches.GetError(usError)
+         || m_swfwProbeMics.GetError(usError)
+         || m_swfwStream.GetError(usError)
+         || m_swfwStreamIndex.GetError(usError);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of writes to file, where data had to be discarded because
+/// disk could not keep up
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetSaveOverflows()
+{
+   return   m_swfwEpoches.GetOverflows()
+         +  m_swfwProbeMics.GetOverflows()
+         +  m_swfwStream.GetOverflows()
+         +  m_swfwStreamIndex.GetOverflows()
+         +  m_nStreamDiscarded;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of blocks currently waiting for being written to disk
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetSaveQueueDepth()
+{
+   return   m_swfwEpoches.GetQueueDepth()
+         +  m_swfwProbeMics.GetQueueDepth()
+         +  m_swfwStream.GetQueueDepth()
+         +  m_swfwStreamIndex.GetQueueDepth();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns maximum number of blocks of one writer, that were waiting for being
+/// written to disk
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetSaveMaxQueueDepth()
+{
+   return std::max(  std::max(m_swfwEpoches.GetMaxQueueDepth(), m_swfwProbeMics.GetMaxQueueDepth()),
+                     std::max(m_swfwStream.GetMaxQueueDepth(), m_swfwStreamIndex.GetMaxQueueDepth()));
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns worst-case time in ms for writing one block to disk
+//------------------------------------------------------------------------------
+double TSWEpoches::GetSaveMaxFlushLatency()
+{
+   return std::max(  std::max(m_swfwEpoches.GetMaxFlushLatency(), m_swfwProbeMics.GetMaxFlushLatency()),
+                     std::max(m_swfwStream.GetMaxFlushLatency(), m_swfwStreamIndex.GetMaxFlushLatency()));
+}
+//------------------------------------------------------------------------------
+
 #ifdef CHKCHNLS
 //------------------------------------------------------------------------------
 /// debug function for checking channels
@@ -286,6 +640,11 @@ void TSWEpoches::Clear()
          TRYDELETENULL(p);
          }
       m_ptl->Clear();
+      // drain pending epoches as well
+      TSWEpoche* pswe;
+      while ((pswe = m_sweqPending.Pop()) != NULL)
+         Release(pswe);
+      m_swesStore.Close();
       }
    __finally
       {
@@ -296,6 +655,91 @@ void TSWEpoches::Clear()
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// opens passed epoche file in epoche store and returns number of epoches
+/// contained in the file. Initialize must have been called before
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::OpenStore(UnicodeString usFileName)
+{
+   if (!m_vvfEpoche.size())
+      throw Exception("epoches not initialized");
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      m_swesStore.Open(usFileName, (unsigned int)m_vvfEpoche.size(), (unsigned int)m_vvfEpoche[0].size());
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return m_swesStore.GetNumEpoches();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if epoche store contains a legacy file without metadata
+//------------------------------------------------------------------------------
+bool TSWEpoches::IsStoreLegacy()
+{
+   return m_swesStore.IsLegacy();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// reads data of passed epoche from epoche store. Store is (re-)opened if it
+/// does not contain the file of the epoche
+//------------------------------------------------------------------------------
+void TSWEpoches::ReadEpoche(TSWEpoche* pswe, vvf &rvvfData)
+{
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      if (!m_swesStore.IsOpen() || m_swesStore.GetFileName() != pswe->m_usFileName)
+         m_swesStore.Open(pswe->m_usFileName, pswe->m_nNumChannels, pswe->m_nNumSamples);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   m_swesStore.Read(pswe->m_nIndex, rvvfData);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// reads metadata of an epoche from epoche file opened with OpenStore. Returns
+/// false, if file is a legacy file without metadata
+//------------------------------------------------------------------------------
+bool TSWEpoches::ReadEpocheInfo( unsigned int nEpoche,
+                                 unsigned int &rnStimIndex,
+                                 unsigned int &rnRepetitionIndex,
+                                 std::vector<double >& rvdThreshold,
+                                 double &rdTriggerOffset,
+                                 unsigned int &rnFlags)
+{
+   TSWEpocheRecordHeader swerh;
+   if (!m_swesStore.ReadRecord(nEpoche, swerh, rvdThreshold))
+      return false;
+   rnStimIndex       = swerh.nStimIndex;
+   rnRepetitionIndex = swerh.nRepetitionIndex;
+   rdTriggerOffset   = swerh.dTriggerOffset;
+   rnFlags           = swerh.nFlags;
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes changed thresholds of one epoche (or all epoches if nEpoche is -1) to
+/// epoche file opened with OpenStore. Nothing is done for legacy files or if
+/// file is currently opened for saving
+//------------------------------------------------------------------------------
+void TSWEpoches::WriteEpocheThresholds(int nEpoche, const std::vector<double >& rvdThreshold)
+{
+   if (!m_swesStore.IsOpen() || m_swesStore.IsLegacy() || m_swfwEpoches.IsOpen())
+      return;
+   TSWEpocheFile::WriteThresholds(m_swesStore.GetFileName(), nEpoche, rvdThreshold);
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// resets epoche data
 //------------------------------------------------------------------------------
@@ -310,6 +754,7 @@ void TSWEpoches::Reset()
       m_nRecEpochePos = 0;
       m_nTriggersDetected = 0;
       m_nTriggerTestTriggersPlayed = 0;
+      m_swtdTrigger.Reset();
       }
    __finally
       {
@@ -319,9 +764,10 @@ void TSWEpoches::Reset()
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// starts recording of epoches
+/// starts recording of epoches. Statistics are kept when resuming a paused
+/// measurement
 //------------------------------------------------------------------------------
-void TSWEpoches::Start()
+void TSWEpoches::Start(bool bResume)
 {
    m_nRecEpochePos      = -1;
    m_nTriggersDetected  = 0;
@@ -330,8 +776,34 @@ void TSWEpoches::Start()
    m_nLastTriggerPos    = 0;
    m_nLastTriggerDistance = 0;
    m_bTriggerError      = false;
+   m_bQueueOverflow     = false;
+   m_bQueueStopped      = false;
+   if (!bResume)
+      {
+      m_sweqPending.ResetStatistics();
+      m_nPoolAllocations   = 0;
+      }
+   m_usEpocheFile       = TSWEpocheFile::GetFileName(formSpikeWare->m_usResultPath);
    m_nFirstTriggerError = -1;
    m_nDoubleTriggerDistance = 4*formSpikeWare->m_smp.m_nTriggerLength / (int)formSpikeWare->m_swsSpikes.m_dSampleRateDevider;
+   m_dLastTriggerOnset  = 0.0;
+   m_dRecTriggerOffset  = 0.0;
+   m_bRecTriggerError   = false;
+   // telemetry covers the whole measurement
+   if (!bResume)
+      m_swttTiming.Initialize(m_nRepetitionPeriod, m_nTriggerTolerance);
+   m_swneNoise.Reset();
+   InitFilter();
+   // continuous recording of all electrode channels (only if epoches are saved).
+   // Every start/resume starts a new run within stream
+   if (m_swfwStream.IsOpen())
+      m_nStreamRun++;
+   else if (m_swfwEpoches.IsOpen() && formSpikeWare->m_pIni->ReadBool("Settings", "ContinuousRecording", false))
+      OpenStream();
+   // dead time of trigger detector: skip trigger pulse and second pulse of
+   // special double trigger (plus one trigger length for safety)
+   m_swtdTrigger.Initialize(TRIGGER_THRESHOLD,
+                            (unsigned int)(m_nDoubleTriggerDistance + 2*formSpikeWare->m_smp.m_nTriggerLength / (int)formSpikeWare->m_swsSpikes.m_dSampleRateDevider));
    m_nTriggerTestTriggersPlayed = 0;
    m_nStimIndexAtStart = formSpikeWare->m_nStimPlayIndex;
    // finally initialize buffers for probemics
@@ -343,48 +815,201 @@ void TSWEpoches::Start()
       for (n = 0; n < m_vvfEpocheProbeMic.size(); n++)
          m_vvfEpocheProbeMic[n].resize(m_vvfEpoche[0].size());
       }
+   // history of all recorded channels (electrodes first, then probemics) for
+   // samples before trigger
+   m_nPreTriggerSamples = (unsigned int)floor(m_dPreTrigger * formSpikeWare->m_swsSpikes.GetSampleRate());
+   if (m_nPreTriggerSamples >= m_vvfEpoche[0].size())
+      throw Exception("'PreTrigger' must be shorter than 'EpocheLength'");
+   m_nHistoryPos = 0;
+   m_vvfHistory.resize(m_nPreTriggerSamples ? m_vvfEpoche.size() + m_vvfEpocheProbeMic.size() : 0);
+   unsigned int nHistory;
+   for (nHistory = 0; nHistory < m_vvfHistory.size(); nHistory++)
+      {
+      m_vvfHistory[nHistory].resize(m_nPreTriggerSamples);
+      m_vvfHistory[nHistory] = 0.0f;
+      }
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// pushes passed data as new epoche to own buffer
+/// writes epoche records lost due to writer overflow as records with zero
+/// thresholds and samples (legacy files: zero samples only). If bWait is false
+/// (recording callback) only records fitting into the writer are written,
+/// otherwise the writer is flushed if necessary (must not be called while
+/// recording). Returns true, if no lost records are pending
 //------------------------------------------------------------------------------
-TSWEpoche* TSWEpoches::Push(  vvf& rvvfData,
+bool TSWEpoches::WriteLostEpoches(bool bWait)
+{
+   if (m_nLostFirst == m_vswerhLost.size())
+      return true;
+   unsigned __int64 nDataSize = (unsigned __int64)m_vvfEpoche.size()*m_vvfEpoche[0].size()*sizeof(float);
+   unsigned int nHeaderSize = TSWEpocheFile::GetRecordHeaderSize(m_nSaveVersion);
+   unsigned __int64 nRecordSize = nDataSize;
+   if (m_bSaveRecords)
+      nRecordSize += nHeaderSize + m_vdRecordThreshold.size()*sizeof(double);
+   while (m_nLostFirst < m_vswerhLost.size())
+      {
+      if (!m_swfwEpoches.Reserve(nRecordSize, false))
+         {
+         if (!bWait)
+            return false;
+         m_swfwEpoches.Flush();
+         if (!m_swfwEpoches.Reserve(nRecordSize, false))
+            return false;
+         }
+      if (m_bSaveRecords)
+         {
+         m_swfwEpoches.Write(&m_vswerhLost[m_nLostFirst], nHeaderSize);
+         m_swfwEpoches.WriteZeros(m_vdRecordThreshold.size()*sizeof(double));
+         }
+      m_swfwEpoches.WriteZeros(nDataSize);
+      m_nLostFirst++;
+      }
+   // NOTE: clear() keeps the reserved capacity
+   m_vswerhLost.clear();
+   m_nLostFirst = 0;
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes probe mic records lost due to writer overflow as zero samples (see
+/// WriteLostEpoches). Returns true, if no lost records are pending
+//------------------------------------------------------------------------------
+bool TSWEpoches::WriteLostProbeMics(bool bWait)
+{
+   if (!m_nLostProbeMics)
+      return true;
+   unsigned __int64 nRecordSize = 0;
+   unsigned int n;
+   for (n = 0; n < m_vvfEpocheProbeMic.size(); n++)
+      nRecordSize += m_vvfEpocheProbeMic[n].size()*sizeof(float);
+   while (m_nLostProbeMics)
+      {
+      if (!m_swfwProbeMics.Reserve(nRecordSize, false))
+         {
+         if (!bWait)
+            return false;
+         m_swfwProbeMics.Flush();
+         if (!m_swfwProbeMics.Reserve(nRecordSize, false))
+            return false;
+         }
+      m_swfwProbeMics.WriteZeros(nRecordSize);
+      m_nLostProbeMics--;
+      }
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// fills passed epoche with passed data, assigns next epoche index and writes
+/// data to file (if saving is active). Does not allocate memory if size of
+/// passed epoche matches passed data
+//------------------------------------------------------------------------------
+void TSWEpoches::FillEpoche(  TSWEpoche* pswe,
+                              vvf& rvvfData,
                               const std::vector<double >& rvdThreshold,
                               unsigned int nStimIndex,
                               unsigned int nRepetitionIndex)
 {
-   if (!rvvfData.size())
+   pswe->m_nStimIndex         = nStimIndex;
+   pswe->m_nRepetitionIndex   = nRepetitionIndex;
+   pswe->m_vdThreshold        = rvdThreshold;
+   pswe->m_dTriggerOffset     = m_dRecTriggerOffset;
+   pswe->m_bTriggerError      = m_bRecTriggerError;
+   pswe->m_bDropped           = m_bRecTriggerError && m_tpTriggerPolicy == SWTP_DROP;
+   pswe->m_nIndex = m_nEpochesTotal++;
+   unsigned int n;
+   TSWEpocheRecordHeader swerh;
+   swerh.nMagic            = SWEF_RECORDMAGIC;
+   swerh.nIndex            = pswe->m_nIndex;
+   swerh.nStimIndex        = nStimIndex;
+   swerh.nRepetitionIndex  = nRepetitionIndex;
+   FILETIME ft;
+   GetSystemTimeAsFileTime(&ft);
+   swerh.nTimeStamp = (__int64)(((unsigned __int64)ft.dwHighDateTime << 32) | ft.dwLowDateTime);
+   swerh.nFlags            = 0;
+   if (pswe->m_bTriggerError)
+      swerh.nFlags |= SWEF_TRIGGERERROR;
+   if (pswe->m_bDropped)
+      swerh.nFlags |= SWEF_DROPPED;
+   swerh.nReserved         = 0;
+   swerh.dTriggerOffset    = pswe->m_dTriggerOffset;
+   // record is written completely or not at all
+   unsigned __int64 nRecordSize = 0;
+   for (n = 0; n < rvvfData.size(); n++)
+      nRecordSize += rvvfData[n].size()*sizeof(float);
+   unsigned int nHeaderSize = TSWEpocheFile::GetRecordHeaderSize(m_nSaveVersion);
+   if (m_bSaveRecords)
+      nRecordSize += nHeaderSize + m_vdRecordThreshold.size()*sizeof(double);
+   bool bWrite = false;
+   if (m_swfwEpoches.IsOpen() && !m_bSaveBroken)
+      {
+      // NOTE: records are located by their position in the file, so a record
+      // must never be skipped: if it does not fit (or older lost records are
+      // still pending) it is kept and written zero-filled later. If too many
+      // records are lost, writing stops and file is marked as broken
+      bool bLostWritten = WriteLostEpoches(false);
+      bWrite = m_swfwEpoches.Reserve(nRecordSize) && bLostWritten;
+      if (!bWrite)
+         {
+         if (m_vswerhLost.size() < m_vswerhLost.capacity())
+            {
+            swerh.nFlags |= SWEF_DROPPED | SWEF_NODATA;
+            m_vswerhLost.push_back(swerh);
+            }
+         else
+            m_bSaveBroken = true;
+         }
+      }
+   if (bWrite && m_bSaveRecords)
+      {
+      // NOTE: header of older versions (appended files) is shorter
+      m_swfwEpoches.Write(&swerh, nHeaderSize);
+      // NOTE: no allocation here: m_vdRecordThreshold is sized in Initialize
+      for (n = 0; n < m_vdRecordThreshold.size(); n++)
+         m_vdRecordThreshold[n] = n < rvdThreshold.size() ? rvdThreshold[n] : 0.0;
+      if (m_vdRecordThreshold.size())
+         m_swfwEpoches.Write(&m_vdRecordThreshold[0], (unsigned int)(m_vdRecordThreshold.size()*sizeof(double)));
+      }
+   for (n = 0; n < rvvfData.size(); n++)
+      {
+      // save data as raw floats
+      if (bWrite)
+         m_swfwEpoches.Write(&rvvfData[n][0], (unsigned int)(rvvfData[n].size()*sizeof(float)));
+      // NOTE: sizes are identical, so no reallocation takes place
+      pswe->m_vvfData[n] = rvvfData[n];
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// pushes next epoche of epoche file opened with OpenStore to own buffer. No
+/// data are held in memory: they are read from the store on demand
+//------------------------------------------------------------------------------
+TSWEpoche* TSWEpoches::Push(  const std::vector<double >& rvdThreshold,
+                              unsigned int nStimIndex,
+                              unsigned int nRepetitionIndex)
+{
+   if (!m_vvfEpoche.size())
       return NULL;
 
    TSWEpoche *pswe = NULL;
-   vvd vvdData(rvvfData.size(), std::valarray<double>(rvvfData[0].size()));
 
    EnterCriticalSection(&m_cs);
    try
       {
       try
          {
-         pswe = new TSWEpoche((unsigned int)rvvfData.size(),
-                              (unsigned int)rvvfData[0].size(),
+         pswe = new TSWEpoche((unsigned int)m_vvfEpoche.size(),
+                              (unsigned int)m_vvfEpoche[0].size(),
                               nStimIndex,
                               nRepetitionIndex,
                               rvdThreshold,
-                              formSpikeWare->m_usResultPath + "epoches.pcm");
-
-
-         pswe->m_nIndex = m_nEpochesTotal++;
-         unsigned int n, m;
-         for (n = 0; n < rvvfData.size(); n++)
-            {
-            // save data as raw floats
-            if (!!m_pfsWrite)
-               m_pfsWrite->WriteBuffer(&rvvfData[n][0], (NativeInt)(rvvfData[n].size()*sizeof(float)));
-            // convert floats to double
-            for (m = 0; m < rvvfData[n].size(); m++)
-               pswe->m_vvdData[n][m] = (double)rvvfData[n][m];
-            }
-
+                              m_swesStore.GetFileName(),
+                              false);
+         pswe->m_pEpoches  = this;
+         pswe->m_nIndex    = m_nEpochesTotal++;
          m_ptl->Add(pswe);
          }
       catch (...)
@@ -403,25 +1028,63 @@ TSWEpoche* TSWEpoches::Push(  vvf& rvvfData,
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns oldest epoche from stored data and removes it
+/// passes data as new epoche to the pending queue. Called from SoundProc (i.e.
+/// within the recording callback) and therefore does not take m_cs: the GUI
+/// thread is the only consumer of m_sweqPending (see Pop). Queue space is
+/// checked before an epoche is taken from the pool, an index is assigned or
+/// anything is written: if the queue is full, the epoche is discarded
+/// completely, m_bQueueOverflow is set and all following epoches are discarded
+/// as well until next Start. So file, stream index and XML (epoches marked
+/// done by GUI) always contain the same epoches and stimulus indices of
+/// recorded epoches stay correct. Returns true, if epoche was enqueued
 //------------------------------------------------------------------------------
-TSWEpoche*  TSWEpoches::Pop(bool &bLast)
+bool TSWEpoches::Enqueue(  vvf& rvvfData,
+                           const std::vector<double >& rvdThreshold,
+                           unsigned int nStimIndex,
+                           unsigned int nRepetitionIndex)
 {
-   TSWEpoche* p = NULL;
-   EnterCriticalSection(&m_cs);
-   try
+   if (!rvvfData.size() || m_bQueueStopped)
+      return false;
+   if (!m_sweqPending.Reserve())
       {
-      if (m_ptl->Count)
-         {
-         p = (TSWEpoche*)m_ptl->Items[0];
-         m_ptl->Delete(0);
-         bLast = m_ptl->Count == 0;
-         }
+      m_bQueueStopped = true;
+      m_bQueueOverflow = true;
+      return false;
       }
-   __finally
+
+   TSWEpoche *pswe = Acquire();
+   FillEpoche(pswe, rvvfData, rvdThreshold, nStimIndex, nRepetitionIndex);
+   // add epoche to trigger index of continuous stream
+   if (m_swfwStreamIndex.IsOpen())
       {
-      LeaveCriticalSection(&m_cs);
+      TSWStreamTrigger swst;
+      swst.nEpoche            = pswe->m_nIndex;
+      swst.nStimIndex         = nStimIndex;
+      swst.nRepetitionIndex   = nRepetitionIndex;
+      swst.nFlags             = 0;
+      if (pswe->m_bTriggerError)
+         swst.nFlags |= SWSF_TRIGGERERROR;
+      if (pswe->m_bDropped)
+         swst.nFlags |= SWSF_DROPPED;
+      swst.nPosition          = m_nRecTriggerStreamPos;
+      swst.dOnset             = m_dRecTriggerStreamOnset;
+      m_swfwStreamIndex.Write(&swst, sizeof(swst));
       }
+   // NOTE: cannot fail after successful Reserve
+   m_sweqPending.Push(pswe);
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns oldest pending epoche from queue and removes it. Must only be called
+/// from GUI thread. The caller must pass the returned epoche to Release()
+//------------------------------------------------------------------------------
+TSWEpoche*  TSWEpoches::Pop(bool &bLast)
+{
+   TSWEpoche* p = m_sweqPending.Pop();
+   if (p)
+      bLast = m_sweqPending.Count() == 0;
    return p;
 }
 //------------------------------------------------------------------------------
@@ -457,6 +1120,70 @@ unsigned int TSWEpoches::Count()
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// returns number of epoches pushed by SoundProc and not yet popped
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::Pending()
+{
+   return m_sweqPending.Count();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets number of slots of pending queue. Only allowed if not recording
+//------------------------------------------------------------------------------
+void TSWEpoches::SetQueueCapacity(unsigned int nCapacity)
+{
+   m_sweqPending.SetCapacity(nCapacity);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of slots of pending queue
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetQueueCapacity()
+{
+   return m_sweqPending.GetCapacity();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of epoches discarded due to a full pending queue since Start()
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetQueueOverflows()
+{
+   return m_sweqPending.GetOverflows();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns maximum number of pending epoches since Start()
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetQueueHighWaterMark()
+{
+   return m_sweqPending.GetHighWaterMark();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of preallocated epoches
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetPoolSize()
+{
+   return (unsigned int)m_vpPool.size();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of epoches allocated in recording callback during current
+/// measurement because the pool was exhausted. Should be 0
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::GetPoolAllocations()
+{
+   return m_nPoolAllocations;
+}
+//------------------------------------------------------------------------------
+
 //******************************************************************************
 /// BELOW: sound callbacks called on runtme on audio buffers for different purposes
 //******************************************************************************
@@ -491,10 +1218,15 @@ void TSWEpoches::SoundProc(vvf &vvfBuffers, bool bTriggerTest)
 
       try
          {
-         unsigned int   nEpocheLen = (unsigned int)m_vvfEpoche[0].size();
-         unsigned int   nSourceStartSample   = 0;
-         unsigned int   nNumCopySamples      = 0;
+         // optional IIR band-pass of electrodes: everything below works on
+         // filtered data
+         FilterElectrodes(vvfBuffers);
+
+         // continuous recording: write complete buffer to stream
+         if (m_swfwStream.IsOpen())
+            WriteStream(vvfBuffers);
 
+         UpdateNoise(vvfBuffers);
 
          // here we first have to check for the 'special double-trigger':
          // if m_nFirstTriggerError is still < 0, then the second peak is
@@ -550,173 +1282,368 @@ void TSWEpoches::SoundProc(vvf &vvfBuffers, bool bTriggerTest)
             }
 
 
-         // NOTE: the measurement constraints guarantee, that not more than one trigger
-         // can be found within one buffer (epoche size < ASIO buffer size is forbidden)
-         // But what might happen is, that in the beginning of the buffer we have data related
-         // to the last epoche, the epoche ends, AND we find the next trigger + beginning of
-         // next epoche in the same buffer.
-         // we manage this here by doing the following:
-         //    do the loop 'look for trigger' - 'copy data' twice. Break conditions are commented below
-         unsigned int n;
-         for (n = 0; n < 2; n++)
+         // detect all triggers within this buffer. NOTE: the detector keeps its
+         // state across buffers, so any number of triggers per buffer (and
+         // epoches shorter than the buffer) are handled
+         unsigned int nNumTriggers = m_swtdTrigger.Process(&vvfBuffers[nTriggerChannel][0], nNumCopySamplesInBuf);
+         __int64 nBufferStart = m_nSamplesPlayed - nNumCopySamplesInBuf;
+         unsigned int nBufferPos = 0;
+         unsigned int nTrigger = 0;
+         while (nBufferPos < nNumCopySamplesInBuf)
             {
-            // do we have to look for a trigger (first OR second loop)?
+            // do we have to look for a trigger?
             if (m_nRecEpochePos < 0)
                {
-               // find maximum
-               float* pf = std::max_element(&vvfBuffers[nTriggerChannel][0], &vvfBuffers[nTriggerChannel][vvfBuffers[nTriggerChannel].size()]);
-               // if below trigger threshold: nothing to do: break condiditon for BOTH loops
-               if (*pf < TRIGGER_THRESHOLD)
-                  return;
-
-               m_nTriggersDetected++;
-
-               // get index of sample were trigger was found
-               nSourceStartSample = (unsigned int)(std::distance(&vvfBuffers[nTriggerChannel][0], pf));
-               m_nLastTriggerDistance = (int)(m_nSamplesPlayed - nNumCopySamplesInBuf + nSourceStartSample - m_nLastTriggerPos);
-               if (m_nTriggersDetected > 1 && abs(m_nLastTriggerDistance - m_nRepetitionPeriod) > 5)
-                  {
-                  m_usTriggerError = "expected/measured distance: " + IntToStr(m_nRepetitionPeriod) + "/" + IntToStr(m_nLastTriggerDistance);
-                  m_bTriggerError = true;
-                  }
-               m_nLastTriggerPos = m_nSamplesPlayed - nNumCopySamplesInBuf + nSourceStartSample;
-               nNumCopySamplesInBuf -= nSourceStartSample;
-               m_nRecEpochePos = 0;
-
-               // on the very first trigger we have to look for the special 'double-trigger'. This second
-               // pulse may be found within this buffer (if enough room behind detected trigger) or
-               // in the next buffer. Here we only look for ONE sample to exceed trigger threshold within
-               // expected distance!
-               // NOTE: we do NOT search the special trigger in free search (generator does
-               // not create the special trigger)
-               if (!formSpikeWare->m_bFreeSearchRunning)
-                  {
-                  if (m_nTriggersDetected == 1)
-                     {
-                     if ((int)nNumCopySamplesInBuf >= m_nDoubleTriggerDistance)
-                        {
-                        // NOTE: here we check for TRIGGER_THRESHOLD/2.0 because the second pulse only has half the amplitude of first!
-                        if (vvfBuffers[nTriggerChannel][nSourceStartSample+(unsigned int)m_nDoubleTriggerDistance] >= TRIGGER_THRESHOLD/2.0f)
-                           {
-                           // set flag, that first trigger was fine!
-                           m_nFirstTriggerError = 0;
-                           // OutputDebugStringW(("trig OK A"  + IntToStr(nDistance)).w_str());
-                           }
-                        else
-                           {
-                           // set error flag
-                           m_nFirstTriggerError = 1;
-                           // OutputDebugStringW(("trig NOT OK A"  + IntToStr(nDistance)).w_str());
-                           }
-                        }
-                     }
-                  }
-               else
-                  m_nFirstTriggerError = 0;
-
+               // NOTE: triggers within an epoche that is still recorded are ignored
+               while (nTrigger < nNumTriggers && m_swtdTrigger.GetTrigger(nTrigger).nPos < nBufferPos)
+                  nTrigger++;
+               // no (more) triggers in this buffer: nothing to do
+               if (nTrigger == nNumTriggers)
+                  break;
+               const TSWTrigger& rswt = m_swtdTrigger.GetTrigger(nTrigger++);
+               nBufferPos = rswt.nPos;
+               ProcessTrigger(vvfBuffers[nTriggerChannel], rswt, nBufferStart);
+               CopyPreTrigger(vvfBuffers, nBufferPos);
                }
+            nBufferPos += RecordEpoche(vvfBuffers, nBufferPos);
+            }
+         // store end of buffer for samples before next trigger(s)
+         UpdateHistory(vvfBuffers);
+         }
+      __finally
+         {
+         LeaveCriticalSection(&m_csReset);
+         }
+      }
+   catch(Exception &e)
+      {
+      OutputDebugStringW((UnicodeString(__FUNC__) + ": " + e.Message).w_str());
+      formSpikeWare->m_smp.Stop();
+      throw;
+      }
+}
+//------------------------------------------------------------------------------
 
-            if (m_nRecEpochePos >= 0)
+//------------------------------------------------------------------------------
+/// handles a detected trigger: checks trigger distance, checks special double
+/// trigger and starts recording of a new epoche. Called by SoundProc
+//------------------------------------------------------------------------------
+void TSWEpoches::ProcessTrigger( std::valarray<float>& rvafTrigger,
+                                 const TSWTrigger& rswt,
+                                 __int64 nBufferStart)
+{
+   unsigned int nNumSamples = (unsigned int)rvafTrigger.size();
+   m_nTriggersDetected++;
+
+   m_nLastTriggerDistance = (int)(nBufferStart + rswt.nPos - m_nLastTriggerPos);
+   // trigger errors are always stored in telemetry, only stop policy raises
+   // m_bTriggerError (GUI stops measurement then). Otherwise the epoche
+   // started by this trigger is flagged
+   m_bRecTriggerError = m_swttTiming.AddTrigger(m_nEpochesTotal,
+                                                nBufferStart + rswt.nPos,
+                                                m_nLastTriggerDistance,
+                                                rswt.nPos,
+                                                nNumSamples,
+                                                m_nTriggersDetected == 1);
+   if (m_bRecTriggerError && m_tpTriggerPolicy == SWTP_STOP)
+      {
+      m_usTriggerError = "expected/measured distance: " + IntToStr(m_nRepetitionPeriod) + "/" + IntToStr(m_nLastTriggerDistance);
+      m_bTriggerError = true;
+      }
+   m_nLastTriggerPos    = nBufferStart + rswt.nPos;
+   m_dLastTriggerOnset  = (double)nBufferStart + rswt.dOnset;
+   // sub-sample offset of trigger onset relative to first sample of epoche
+   m_dRecTriggerOffset  = rswt.dOnset - (double)rswt.nPos;
+   // position of trigger in continuous stream (WriteStream was already called
+   // for this buffer)
+   m_nRecTriggerStreamPos     = m_nStreamBufferStart + rswt.nPos - m_nPreTriggerSamples;
+   m_dRecTriggerStreamOnset   = (double)m_nStreamBufferStart + rswt.dOnset;
+   m_nRecEpochePos      = 0;
+
+   // on the very first trigger we have to look for the special 'double-trigger'. This second
+   // pulse may be found within this buffer (if enough room behind detected trigger) or
+   // in the next buffer. Here we only look for ONE sample to exceed trigger threshold within
+   // expected distance!
+   // NOTE: we do NOT search the special trigger in free search (generator does
+   // not create the special trigger)
+   if (!formSpikeWare->m_bFreeSearchRunning)
+      {
+      if (m_nTriggersDetected == 1)
+         {
+         if ((int)(nNumSamples - rswt.nPos) > m_nDoubleTriggerDistance)
+            {
+            // NOTE: here we check for TRIGGER_THRESHOLD/2.0 because the second pulse only has half the amplitude of first!
+            if (rvafTrigger[rswt.nPos+(unsigned int)m_nDoubleTriggerDistance] >= TRIGGER_THRESHOLD/2.0f)
                {
-               // how many still to record?
-               nNumCopySamples = nEpocheLen - (unsigned int)m_nRecEpochePos;
-               if (nNumCopySamples > nNumCopySamplesInBuf)
-                  nNumCopySamples = nNumCopySamplesInBuf;
-
-
-               unsigned int nChannel;
-               unsigned int nEpocheChannel = 0;
-               #ifdef CHKCHNLS
-               static bool bShown2 = false;
-               UnicodeString us1, us2;
-               #endif
-               for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
-                  {
-                  if (!formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
-                     continue;
+               // set flag, that first trigger was fine!
+               m_nFirstTriggerError = 0;
+               }
+            else
+               {
+               // set error flag
+               m_nFirstTriggerError = 1;
+               }
+            }
+         }
+      }
+   else
+      m_nFirstTriggerError = 0;
+}
+//------------------------------------------------------------------------------
 
-                  #ifdef CHKCHNLS
-                  us2 += IntToStr((int)nChannel) + ", ";
-                  if (nChannel != nTriggerChannel)
-                     us1 += IntToStr((int)nChannel) + ", ";
-                  #endif
+//------------------------------------------------------------------------------
+/// copies samples before trigger to beginning of current epoche: first from
+/// history (preceding buffers), then from current buffer. Called by SoundProc
+//------------------------------------------------------------------------------
+void TSWEpoches::CopyPreTrigger(vvf &vvfBuffers, unsigned int nTriggerPos)
+{
+   if (!m_nPreTriggerSamples)
+      return;
+   unsigned int nNumFromBuffer   = std::min(nTriggerPos, m_nPreTriggerSamples);
+   unsigned int nNumFromHistory  = m_nPreTriggerSamples - nNumFromBuffer;
+   // start of most recent nNumFromHistory samples in ring
+   unsigned int nHistoryStart    = (m_nHistoryPos + m_nPreTriggerSamples - nNumFromHistory) % m_nPreTriggerSamples;
+   unsigned int nNumFirst        = std::min(nNumFromHistory, m_nPreTriggerSamples - nHistoryStart);
 
-                  CopyMemory(&m_vvfEpoche[nEpocheChannel++][(unsigned int)m_nRecEpochePos], &vvfBuffers[nChannel][nSourceStartSample], nNumCopySamples*sizeof(float));
-                  }
+   unsigned int nChannel;
+   unsigned int nElectrode = 0;
+   unsigned int nProbeMic  = 0;
+   for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
+      {
+      std::valarray<float>* pvafEpoche;
+      std::valarray<float>* pvafHistory;
+      if (formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         {
+         pvafHistory = &m_vvfHistory[nElectrode];
+         pvafEpoche  = &m_vvfEpoche[nElectrode++];
+         }
+      else if (m_vvfEpocheProbeMic.size() && formSpikeWare->m_smp.m_swcUsedChannels.IsProbeMic(nChannel))
+         {
+         pvafHistory = &m_vvfHistory[m_vvfEpoche.size() + nProbeMic];
+         pvafEpoche  = &m_vvfEpocheProbeMic[nProbeMic++];
+         }
+      else
+         continue;
+
+      if (nNumFirst)
+         CopyMemory(&(*pvafEpoche)[0], &(*pvafHistory)[nHistoryStart], nNumFirst*sizeof(float));
+      if (nNumFromHistory > nNumFirst)
+         CopyMemory(&(*pvafEpoche)[nNumFirst], &(*pvafHistory)[0], (nNumFromHistory - nNumFirst)*sizeof(float));
+      if (nNumFromBuffer)
+         CopyMemory(&(*pvafEpoche)[nNumFromHistory], &vvfBuffers[nChannel][nTriggerPos - nNumFromBuffer], nNumFromBuffer*sizeof(float));
+      }
+   m_nRecEpochePos = (int)m_nPreTriggerSamples;
+}
+//------------------------------------------------------------------------------
 
-               if (formSpikeWare->IsInSitu() && formSpikeWare->m_smp.m_bSaveProbeMics)
-                  {
+//------------------------------------------------------------------------------
+/// writes last samples of passed buffers to history ring buffers. Called by
+/// SoundProc after all triggers of the buffers were processed
+//------------------------------------------------------------------------------
+void TSWEpoches::UpdateHistory(vvf &vvfBuffers)
+{
+   if (!m_nPreTriggerSamples)
+      return;
+   unsigned int nNumSamples   = (unsigned int)vvfBuffers[0].size();
+   // only last m_nPreTriggerSamples samples are needed
+   unsigned int nSourceStart  = nNumSamples > m_nPreTriggerSamples ? nNumSamples - m_nPreTriggerSamples : 0;
+   unsigned int nNumCopy      = nNumSamples - nSourceStart;
+   unsigned int nNumFirst     = std::min(nNumCopy, m_nPreTriggerSamples - m_nHistoryPos);
 
-                  // do ProbeMics in separate loop. Slightly inefficient, but easier to maintain (and number
-                  // of channels is always small!)
-                  unsigned int nProbeMicChannel = 0;
-                  for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
-                     {
-                     if (!formSpikeWare->m_smp.m_swcUsedChannels.IsProbeMic(nChannel))
-                        continue;
-                     CopyMemory(&m_vvfEpocheProbeMic[nProbeMicChannel++][(unsigned int)m_nRecEpochePos], &vvfBuffers[nChannel][nSourceStartSample], nNumCopySamples*sizeof(float));
-                     }
-                  }
+   unsigned int nChannel;
+   unsigned int nHistory = 0;
+   unsigned int nProbeMic = 0;
+   // NOTE: electrodes first, then probe mics (see CopyPreTrigger)
+   for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
+      {
+      std::valarray<float>* pvafHistory;
+      if (formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         pvafHistory = &m_vvfHistory[nHistory++];
+      else if (m_vvfEpocheProbeMic.size() && formSpikeWare->m_smp.m_swcUsedChannels.IsProbeMic(nChannel))
+         pvafHistory = &m_vvfHistory[m_vvfEpoche.size() + nProbeMic++];
+      else
+         continue;
+      CopyMemory(&(*pvafHistory)[m_nHistoryPos], &vvfBuffers[nChannel][nSourceStart], nNumFirst*sizeof(float));
+      if (nNumCopy > nNumFirst)
+         CopyMemory(&(*pvafHistory)[0], &vvfBuffers[nChannel][nSourceStart + nNumFirst], (nNumCopy - nNumFirst)*sizeof(float));
+      }
+   m_nHistoryPos = (m_nHistoryPos + nNumCopy) % m_nPreTriggerSamples;
+}
+//------------------------------------------------------------------------------
 
-               #ifdef CHKCHNLS
-               if (us1 != us2)
-                  {
-                  if (!bShown2)
-                     ShowMessage("error 2 " + UnicodeString(__FUNC__));
-                  bShown2 = true;
-                  }
-               #endif
+//------------------------------------------------------------------------------
+/// initializes IIR band-pass filters of electrode channels with the edge
+/// frequencies of their band-pass settings, if enabled in INI (Settings/
+/// ElectrodeIIRFilter). Otherwise electrodes are filtered by SMP plugins only
+//------------------------------------------------------------------------------
+void TSWEpoches::InitFilter()
+{
+   m_swfbFilter.Clear();
+   m_vpfFilter.clear();
+   if (!formSpikeWare->m_pIni->ReadBool("Settings", "ElectrodeIIRFilter", false))
+      return;
+
+   SWSMPHWChannels& rswc = formSpikeWare->m_smp.m_swcUsedChannels;
+   std::vector<float > vfLoFreq, vfHiFreq;
+   float fLoFreq, fHiFreq;
+   unsigned int nChannel;
+   for (nChannel = 0; nChannel < rswc.GetNumChannels(SWSMPHWCDIR_IN); nChannel++)
+      {
+      if (!rswc.IsElectrode(nChannel))
+         continue;
+      formSpikeWare->m_swfFilters->GetBandPass(rswc.GetChannelName(nChannel, SWSMPHWCDIR_IN), fLoFreq, fHiFreq);
+      vfLoFreq.push_back(fLoFreq);
+      vfHiFreq.push_back(fHiFreq);
+      }
+   m_swfbFilter.Initialize(vfLoFreq,
+                           vfHiFreq,
+                           formSpikeWare->m_swsSpikes.GetSampleRate(),
+                           TSWFilterBank::OrderFromSlope(formSpikeWare->m_pIni->ReadInteger("Settings", "FilterdBperOctaveInput", 12)));
+   m_vpfFilter.resize(vfLoFreq.size());
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// filters all electrode channels of passed buffers in place (one pass for all
+/// channels). Called by SoundProc
+//------------------------------------------------------------------------------
+void TSWEpoches::FilterElectrodes(vvf &vvfBuffers)
+{
+   if (!m_vpfFilter.size())
+      return;
+   unsigned int nChannel;
+   unsigned int nFilterChannel = 0;
+   for (nChannel = 0; nChannel < vvfBuffers.size() && nFilterChannel < m_vpfFilter.size(); nChannel++)
+      {
+      if (formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         m_vpfFilter[nFilterChannel++] = &vvfBuffers[nChannel][0];
+      }
+   if (nFilterChannel == m_vpfFilter.size())
+      m_swfbFilter.Process(&m_vpfFilter[0], (unsigned int)vvfBuffers[0].size());
+}
+//------------------------------------------------------------------------------
 
-               m_nRecEpochePos += nNumCopySamples;
+//------------------------------------------------------------------------------
+/// passes complete buffers of all electrode channels to noise estimator (used
+/// for automatic thresholds). Called by SoundProc
+//------------------------------------------------------------------------------
+void TSWEpoches::UpdateNoise(vvf &vvfBuffers)
+{
+   unsigned int nNumSamples = (unsigned int)vvfBuffers[0].size();
+   unsigned int nChannel;
+   unsigned int nEpocheChannel = 0;
+   for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
+      {
+      if (!formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         continue;
+      m_swneNoise.Process(nEpocheChannel++, &vvfBuffers[nChannel][0], nNumSamples);
+      }
+}
+//------------------------------------------------------------------------------
 
-               // done storing epoche?
-               if (m_nRecEpochePos >= (int)nEpocheLen)
-                  {
-                  //
-                  // add epoche. NOTE: in search modes m_viRepetitionSequence is empty and we always
-                  // write '0' as RepetitionIndex
-                  unsigned int nRepetitionIndex = 0;
-                  if (formSpikeWare->m_viRepetitionSequence.size() > m_nEpochesTotal)
-                     nRepetitionIndex = (unsigned int)formSpikeWare->m_viRepetitionSequence[m_nEpochesTotal];
-                  Push(m_vvfEpoche, formSpikeWare->GetThresholds(), formSpikeWare->GetCurrentStimulus(m_nEpochesTotal), nRepetitionIndex);
-
-                  unsigned int m;
-                  for (m = 0; m < m_vvfEpoche.size(); m++)
-                     m_vvfEpoche[m] = 0.0f;
-
-                  if (!!m_pfsWriteProbeMic && formSpikeWare->IsInSitu() && formSpikeWare->m_smp.m_bSaveProbeMics)
-                     {
-                     // NOTE: here we do the sorting in a way, that the order of epoche data and probemic data
-                     // is identical, i.e. first channel in probemic contains the data recorded by the probmic
-                     // connected to first output channel! This order is stored in m_viProbeMicOutChannels!!
-                     for (m = 0; m < m_vvfEpocheProbeMic.size(); m++)
-                        {
-                        m_pfsWriteProbeMic->WriteBuffer( &m_vvfEpocheProbeMic[(unsigned int)formSpikeWare->m_smp.m_viProbeMicOutChannels[m]][0], 
-                                                         (NativeInt)(m_vvfEpocheProbeMic[m].size()*sizeof(float)));
-                        m_vvfEpocheProbeMic[m] = 0.0f;
-                        }
-                     }
-                  // reset m_nRecEpochePos:
-                  m_nRecEpochePos = -1;
-                  }
-               // this break condition is needed, if we have copied data, but epoche is NOT complete within this ASIO
-               // buffer: then we DON'T want the loop to be executed again with copying data again!!
-               if (m_nRecEpochePos >= 0)
-                  return;
-               }
-            }
-         }
-      __finally
+//------------------------------------------------------------------------------
+/// copies data of current epoche starting at passed buffer position and passes
+/// epoche to pending queue, if it is complete. Returns number of samples copied.
+/// Called by SoundProc
+//------------------------------------------------------------------------------
+unsigned int TSWEpoches::RecordEpoche(vvf &vvfBuffers, unsigned int nSourceStartSample)
+{
+   unsigned int nEpocheLen = (unsigned int)m_vvfEpoche[0].size();
+   unsigned int nNumSamplesInBuf = (unsigned int)vvfBuffers[0].size() - nSourceStartSample;
+
+   // how many still to record?
+   unsigned int nNumCopySamples = nEpocheLen - (unsigned int)m_nRecEpochePos;
+   if (nNumCopySamples > nNumSamplesInBuf)
+      nNumCopySamples = nNumSamplesInBuf;
+
+   unsigned int nChannel;
+   unsigned int nEpocheChannel = 0;
+   #ifdef CHKCHNLS
+   static bool bShown2 = false;
+   unsigned int nTriggerChannel = (unsigned int)formSpikeWare->m_smp.m_swcUsedChannels.GetTrigger(SWSMPHWCDIR_IN);
+   UnicodeString us1, us2;
+   #endif
+   for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
+      {
+      if (!formSpikeWare->m_smp.m_swcUsedChannels.IsElectrode(nChannel))
+         continue;
+
+      #ifdef CHKCHNLS
+      us2 += IntToStr((int)nChannel) + ", ";
+      if (nChannel != nTriggerChannel)
+         us1 += IntToStr((int)nChannel) + ", ";
+      #endif
+
+      CopyMemory(&m_vvfEpoche[nEpocheChannel++][(unsigned int)m_nRecEpochePos], &vvfBuffers[nChannel][nSourceStartSample], nNumCopySamples*sizeof(float));
+      }
+
+   if (formSpikeWare->IsInSitu() && formSpikeWare->m_smp.m_bSaveProbeMics)
+      {
+      // do ProbeMics in separate loop. Slightly inefficient, but easier to maintain (and number
+      // of channels is always small!)
+      unsigned int nProbeMicChannel = 0;
+      for (nChannel = 0; nChannel < vvfBuffers.size(); nChannel++)
          {
-         LeaveCriticalSection(&m_csReset);
+         if (!formSpikeWare->m_smp.m_swcUsedChannels.IsProbeMic(nChannel))
+            continue;
+         CopyMemory(&m_vvfEpocheProbeMic[nProbeMicChannel++][(unsigned int)m_nRecEpochePos], &vvfBuffers[nChannel][nSourceStartSample], nNumCopySamples*sizeof(float));
          }
       }
-   catch(Exception &e)
+
+   #ifdef CHKCHNLS
+   if (us1 != us2)
       {
-      OutputDebugStringW((UnicodeString(__FUNC__) + ": " + e.Message).w_str());
-      formSpikeWare->m_smp.Stop();
-      throw;
+      if (!bShown2)
+         ShowMessage("error 2 " + UnicodeString(__FUNC__));
+      bShown2 = true;
+      }
+   #endif
+
+   m_nRecEpochePos += nNumCopySamples;
+
+   // done storing epoche?
+   if (m_nRecEpochePos >= (int)nEpocheLen)
+      {
+      //
+      // add epoche. NOTE: in search modes m_viRepetitionSequence is empty and we always
+      // write '0' as RepetitionIndex
+      unsigned int nRepetitionIndex = 0;
+      if (formSpikeWare->m_viRepetitionSequence.size() > m_nEpochesTotal)
+         nRepetitionIndex = (unsigned int)formSpikeWare->m_viRepetitionSequence[m_nEpochesTotal];
+      bool bEnqueued = Enqueue(m_vvfEpoche, formSpikeWare->GetThresholds(), formSpikeWare->GetCurrentStimulus(m_nEpochesTotal), nRepetitionIndex);
+
+      unsigned int m;
+      for (m = 0; m < m_vvfEpoche.size(); m++)
+         m_vvfEpoche[m] = 0.0f;
+
+      // NOTE: probe mic data of a discarded epoche are discarded as well
+      if (bEnqueued && m_swfwProbeMics.IsOpen() && formSpikeWare->IsInSitu() && formSpikeWare->m_smp.m_bSaveProbeMics)
+         {
+         // NOTE: here we do the sorting in a way, that the order of epoche data and probemic data
+         // is identical, i.e. first channel in probemic contains the data recorded by the probmic
+         // connected to first output channel! This order is stored in m_viProbeMicOutChannels!!
+         unsigned __int64 nProbeMicSize = 0;
+         for (m = 0; m < m_vvfEpocheProbeMic.size(); m++)
+            nProbeMicSize += m_vvfEpocheProbeMic[m].size()*sizeof(float);
+         // NOTE: as for epoches, records are located by position, so lost
+         // records are written zero-filled later (see WriteLostProbeMics)
+         bool bLostWritten = WriteLostProbeMics(false);
+         bool bWrite = m_swfwProbeMics.Reserve(nProbeMicSize) && bLostWritten;
+         if (!bWrite)
+            m_nLostProbeMics++;
+         for (m = 0; m < m_vvfEpocheProbeMic.size(); m++)
+            {
+            if (bWrite)
+               m_swfwProbeMics.Write(  &m_vvfEpocheProbeMic[(unsigned int)formSpikeWare->m_smp.m_viProbeMicOutChannels[m]][0],
+                                       (unsigned int)(m_vvfEpocheProbeMic[m].size()*sizeof(float)));
+            }
+         }
+      for (m = 0; m < m_vvfEpocheProbeMic.size(); m++)
+         m_vvfEpocheProbeMic[m] = 0.0f;
+      // reset m_nRecEpochePos:
+      m_nRecEpochePos = -1;
       }
+   return nNumCopySamples;
 }
 //------------------------------------------------------------------------------
 
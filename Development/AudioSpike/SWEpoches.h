@@ -35,7 +35,19 @@
 #include <vector>
 #include <valarray>
 #include <SWTools.h>
+#include "SWEpocheQueue.h"
+#include "SWFileWriter.h"
+#include "SWEpocheStore.h"
+#include "SWEpocheFile.h"
+#include "SWTriggerDetector.h"
+#include "SWTriggerTiming.h"
+#include "SWStreamFile.h"
+#include "SWNoiseEstimator.h"
+#include "SWFilterBank.h"
 
+/// maximum number of epoche records lost due to writer overflow that are kept
+/// for writing them zero-filled later (see TSWEpoches::WriteLostEpoches)
+#define SWE_MAXLOSTRECORDS 4096
 
 class TSWEpoches;
 
@@ -51,18 +63,32 @@ class TSWEpoche
                   unsigned int nStimIndex,
                   unsigned int nRepetitionIndex,
                   const std::vector<double >& rvdThreshold,
-                  UnicodeString usFileName);
+                  UnicodeString usFileName,
+                  bool bAllocate = true);
       unsigned int      m_nNumChannels;
       unsigned int      m_nNumSamples;
       unsigned int      m_nStimIndex;
       unsigned int      m_nIndex;
       unsigned int      m_nRepetitionIndex;
+      /// sub-sample offset of interpolated trigger onset relative to trigger
+      /// sample (in samples, between -1 and 0). NOTE: trigger sample is
+      /// sample TSWEpoches::GetPreTriggerSamples() of epoche. Saved in epoche
+      /// record (epoche files version 2 and later)
+      double            m_dTriggerOffset;
+      /// trigger distance of epoche was out of tolerance
+      bool              m_bTriggerError;
+      /// epoche is to be excluded from spike detection (trigger policy SWTP_DROP)
+      bool              m_bDropped;
       UnicodeString     m_usFileName;
       std::vector<double >    m_vdThreshold;
-      vvd            GetData();
+      vvf            GetData();
+      const float*   GetChannel(unsigned int nChannel);
+      bool           HasData();
       void           ClearData();
    private:
-      vvd            m_vvdData;
+      TSWEpoches*    m_pEpoches;
+      bool           m_bPooled;
+      vvf            m_vvfData;
 };
 //------------------------------------------------------------------------------
 
@@ -82,14 +108,77 @@ class TSWEpoches
       unsigned int            m_nNumTriggerSamplesInNextBuffer;
       unsigned int            m_nNumTriggerSamplesInNextBufferPlay;
       int                     m_nDoubleTriggerDistance;
-      TFileStream*            m_pfsWrite;
-      TFileStream*            m_pfsWriteProbeMic;
+      TSWFileWriter           m_swfwEpoches;
+      TSWFileWriter           m_swfwProbeMics;
+      TSWEpocheStore          m_swesStore;
+      UnicodeString           m_usSaveFile;
+      bool                    m_bSaveRecords;
+      unsigned int            m_nSaveVersion;
+      std::vector<double >    m_vdRecordThreshold;
+      // records lost due to writer overflow, that still have to be written
+      // zero-filled: m_vswerhLost is reserved in OpenSave (no allocation in
+      // recording callback), entries before m_nLostFirst are written already
+      std::vector<TSWEpocheRecordHeader > m_vswerhLost;
+      unsigned int            m_nLostFirst;
+      unsigned int            m_nLostProbeMics;
+      bool                    m_bSaveBroken;
+      TSWTriggerDetector      m_swtdTrigger;
+      double                  m_dRecTriggerOffset;
+      bool                    m_bRecTriggerError;
+      TSWFileWriter           m_swfwStream;
+      TSWFileWriter           m_swfwStreamIndex;
+      bool                    m_bStreamAppend;
+      unsigned int            m_nStreamChunkSamples;
+      unsigned int            m_nStreamRun;
+      unsigned int            m_nStreamDiscarded;
+      __int64                 m_nStreamSamples;
+      __int64                 m_nStreamBufferStart;
+      std::vector<float >     m_vfStreamPadding;
+      __int64                 m_nRecTriggerStreamPos;
+      double                  m_dRecTriggerStreamOnset;
+      unsigned int            m_nPreTriggerSamples;
+      vvf                     m_vvfHistory;
+      unsigned int            m_nHistoryPos;
+      TSWFilterBank           m_swfbFilter;
+      std::vector<float* >    m_vpfFilter;
+      TSWEpocheQueue          m_sweqPending;
+      TSWEpocheQueue          m_sweqFree;
+      std::vector<TSWEpoche* > m_vpPool;
+      UnicodeString           m_usEpocheFile;
+      unsigned int            m_nPoolAllocations;
+      void           CreatePool(unsigned int nNumChannels, unsigned int nSize);
+      void           DeletePool();
+      TSWEpoche*     Acquire();
+      void           OpenSave(bool bAppend);
+      void           OpenStream();
+      void           WriteStream(vvf &vvfBuffers);
+      bool           WriteLostEpoches(bool bWait);
+      bool           WriteLostProbeMics(bool bWait);
+      void           InitFilter();
+      void           FilterElectrodes(vvf &vvfBuffers);
+      void           FillEpoche(TSWEpoche* pswe,
+                                vvf& rvvfData,
+                                const std::vector<double >& rvdThreshold,
+                                unsigned int nStimIndex,
+                                unsigned int nRepetitionIndex);
+      void           ProcessTrigger(std::valarray<float>& rvafTrigger,
+                                    const TSWTrigger& rswt,
+                                    __int64 nBufferStart);
+      unsigned int   RecordEpoche(vvf &vvfBuffers, unsigned int nSourceStartSample);
+      void           CopyPreTrigger(vvf &vvfBuffers, unsigned int nTriggerPos);
+      void           UpdateHistory(vvf &vvfBuffers);
+      void           UpdateNoise(vvf &vvfBuffers);
+      bool           Enqueue( vvf& rvvfData,
+                              const std::vector<double >& rvdThreshold,
+                              unsigned int nStimIndex,
+                              unsigned int nRepetitionIndex);
    public:
       TList*                  m_ptl;
       vvf            m_vvfEpoche;
       vvf            m_vvfEpocheProbeMic;
       double         m_dEpocheLength;
       double         m_dPreStimulus;
+      double         m_dPreTrigger;
       int            m_nRepetitionPeriod;
       double         m_dStimulusPause;
       unsigned int   m_nEpochesTotal;
@@ -100,7 +189,16 @@ class TSWEpoches
       __int64        m_nSamplesPlayed;
       __int64        m_nLastTriggerPos;
       int            m_nLastTriggerDistance;
+      double         m_dLastTriggerOnset;
       bool           m_bTriggerError;
+      bool           m_bQueueOverflow;
+      /// set by recording callback on queue overflow: no more epoches are
+      /// recorded until next Start (written by recording callback only)
+      bool           m_bQueueStopped;
+      TSWTriggerPolicy  m_tpTriggerPolicy;
+      int            m_nTriggerTolerance;
+      TSWTriggerTiming  m_swttTiming;
+      TSWNoiseEstimator m_swneNoise;
       int            m_nFirstTriggerError;
       UnicodeString  m_usTriggerError;
       std::vector<double >    m_vdThreshold;
@@ -110,25 +208,50 @@ class TSWEpoches
       void           AssertIndex(unsigned int nChannelIndex);
       void           Reset();
       void           Clear();
-      void           Start();
+      void           Start(bool bResume = false);
       void           Initialize(unsigned int nNumChannels, unsigned int nSize);
       void           InitSave();
       void           AppendSave();
+      void           FlushSave();
       void           DoneSave();
+      bool           GetSaveError(UnicodeString &usError);
+      unsigned int   GetSaveOverflows();
+      unsigned int   GetSaveQueueDepth();
+      unsigned int   GetSaveMaxQueueDepth();
+      double         GetSaveMaxFlushLatency();
       unsigned int   GetNumChannels();
+      unsigned int   GetPreTriggerSamples();
+      double         GetStimulusOnset();
       double         GetThreshold(unsigned int nChannelIndex);
       void           SetThreshold(unsigned int nChannelIndex, double dThreshold);
       #ifdef CHKCHNLS
       void           SetTriggerChannel(unsigned int nTriggerChannel);
       #endif
-      TSWEpoche*     Push( vvf& rvvfData,
-                           const std::vector<double >& rvdThreshold,
+      unsigned int   OpenStore(UnicodeString usFileName);
+      bool           IsStoreLegacy();
+      void           ReadEpoche(TSWEpoche* pswe, vvf &rvvfData);
+      bool           ReadEpocheInfo(unsigned int nEpoche,
+                                    unsigned int &rnStimIndex,
+                                    unsigned int &rnRepetitionIndex,
+                                    std::vector<double >& rvdThreshold,
+                                    double &rdTriggerOffset,
+                                    unsigned int &rnFlags);
+      void           WriteEpocheThresholds(int nEpoche, const std::vector<double >& rvdThreshold);
+      TSWEpoche*     Push( const std::vector<double >& rvdThreshold,
                            unsigned int nStimIndex,
                            unsigned int nRepetitionIndex);
       TSWEpoche*     Pop(bool &bLast);
+      void           Release(TSWEpoche* pswe);
       TSWEpoche*     Get(int nIndex = -1);
 
       unsigned int   Count();
+      unsigned int   Pending();
+      void           SetQueueCapacity(unsigned int nCapacity);
+      unsigned int   GetQueueCapacity();
+      unsigned int   GetQueueOverflows();
+      unsigned int   GetQueueHighWaterMark();
+      unsigned int   GetPoolSize();
+      unsigned int   GetPoolAllocations();
       void           SoundProc(vvf &vvfBuffers, bool bTriggerTest);
       void           SoundProcTriggerTest(vvf &vvfBuffers);
       void           SoundProcTriggerTestPlay(vvf &vvfBuffers);
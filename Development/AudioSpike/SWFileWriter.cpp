@@ -0,0 +1,430 @@
+//------------------------------------------------------------------------------
+/// \file SWFileWriter.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWFileWriter for asynchronous writing of
+/// recorded data to file
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWFileWriter.h"
+#include <malloc.h>
+#include "SWTools.h"
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+/// alignment of blocks (and block sizes) in bytes
+#define SWFW_ALIGNMENT 4096
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// CLASS TSWFileWriterThread
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Creates thread running
+//------------------------------------------------------------------------------
+__fastcall TSWFileWriterThread::TSWFileWriterThread(TSWFileWriter* pWriter)
+   : TThread(false), m_pWriter(pWriter)
+{
+   FreeOnTerminate = false;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// thread function: waits for filled blocks and writes them. Remaining blocks
+/// are written on termination
+//------------------------------------------------------------------------------
+void __fastcall TSWFileWriterThread::Execute()
+{
+   while (!Terminated)
+      {
+      WaitForSingleObject(m_pWriter->m_hDataEvent, 100);
+      m_pWriter->WriteBlocks();
+      }
+   m_pWriter->WriteBlocks();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// CLASS TSWFileWriter
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Initializes members and creates events
+//------------------------------------------------------------------------------
+TSWFileWriter::TSWFileWriter()
+   :  m_pfs(NULL), m_pThread(NULL), m_nBlockSize(0), m_nBlockPos(0),
+      m_nFilled(0), m_nWritten(0), m_nMaxQueueDepth(0), m_nOverflows(0),
+      m_nMaxFlushLatencyUs(0), m_bError(false)
+{
+   m_hDataEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+   m_hDoneEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+   if (!m_hDataEvent || !m_hDoneEvent)
+      throw Exception("cannot create events for file writer");
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// destructor. Closes file and events
+//------------------------------------------------------------------------------
+TSWFileWriter::~TSWFileWriter()
+{
+   try
+      {
+      Close();
+      }
+   catch (...)
+      {
+      }
+   CloseHandle(m_hDataEvent);
+   CloseHandle(m_hDoneEvent);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// opens passed file for writing (overwrites existing file or appends to it),
+/// allocates blocks and starts writer thread
+//------------------------------------------------------------------------------
+void TSWFileWriter::Open(  UnicodeString usFileName,
+                           bool bAppend,
+                           unsigned int nBlockSize,
+                           unsigned int nNumBlocks)
+{
+   Close();
+   if (nNumBlocks < 2)
+      nNumBlocks = 2;
+   // round block size up to alignment
+   nBlockSize = ((nBlockSize + SWFW_ALIGNMENT - 1) / SWFW_ALIGNMENT) * SWFW_ALIGNMENT;
+   if (!nBlockSize)
+      nBlockSize = SWFW_ALIGNMENT;
+
+   try
+      {
+      if (bAppend)
+         {
+         m_pfs = new TFileStream(usFileName, fmOpenWrite | fmShareDenyWrite);
+         m_pfs->Seek(0, soFromEnd);
+         }
+      else
+         m_pfs = new TFileStream(usFileName, fmCreate | fmShareDenyWrite);
+
+      m_vpBlocks.resize(nNumBlocks, (char*)NULL);
+      m_vnBlockBytes.assign(nNumBlocks, 0);
+      unsigned int n;
+      for (n = 0; n < nNumBlocks; n++)
+         {
+         m_vpBlocks[n] = (char*)_aligned_malloc(nBlockSize, SWFW_ALIGNMENT);
+         if (!m_vpBlocks[n])
+            throw Exception("cannot allocate blocks for file writer");
+         }
+      m_nBlockSize   = nBlockSize;
+      m_nBlockPos    = 0;
+      m_nFilled.store(0);
+      m_nWritten.store(0);
+      m_bError.store(false);
+      m_usError      = "";
+      ResetStatistics();
+      ResetEvent(m_hDataEvent);
+      ResetEvent(m_hDoneEvent);
+
+      m_pThread = new TSWFileWriterThread(this);
+      }
+   catch (...)
+      {
+      TRYDELETENULL(m_pfs);
+      FreeBlocks();
+      throw;
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes all pending data, stops writer thread and closes file
+//------------------------------------------------------------------------------
+void TSWFileWriter::Close()
+{
+   if (m_pThread)
+      {
+      if (m_nBlockPos)
+         Commit();
+      m_pThread->Terminate();
+      SetEvent(m_hDataEvent);
+      m_pThread->WaitFor();
+      TRYDELETENULL(m_pThread);
+      }
+   TRYDELETENULL(m_pfs);
+   FreeBlocks();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// frees all blocks
+//------------------------------------------------------------------------------
+void TSWFileWriter::FreeBlocks()
+{
+   unsigned int n;
+   for (n = 0; n < m_vpBlocks.size(); n++)
+      {
+      if (m_vpBlocks[n])
+         _aligned_free(m_vpBlocks[n]);
+      }
+   m_vpBlocks.clear();
+   m_vnBlockBytes.clear();
+   m_nBlockSize = 0;
+   m_nBlockPos  = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if a file is opened
+//------------------------------------------------------------------------------
+bool TSWFileWriter::IsOpen()
+{
+   return m_pThread != NULL;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of bytes, that can currently be written without overflow
+/// (free part of current block and all blocks not owned by writer thread)
+//------------------------------------------------------------------------------
+unsigned __int64 TSWFileWriter::GetFreeBytes()
+{
+   unsigned int nNumBlocks = (unsigned int)m_vpBlocks.size();
+   unsigned int nUsed = m_nFilled.load(std::memory_order_relaxed) - m_nWritten.load(std::memory_order_acquire);
+   if (nUsed >= nNumBlocks)
+      return 0;
+   return (unsigned __int64)(nNumBlocks - nUsed) * m_nBlockSize - m_nBlockPos;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if a record of passed size can be written completely. Must be
+/// called before writing the first part of a record consisting of multiple
+/// Write() calls: if false is returned, the overflow counter is increased (if
+/// bCountOverflow is true) and the whole record must be skipped (space can only
+/// grow until the record is written, because the writer thread only releases
+/// blocks)
+//------------------------------------------------------------------------------
+bool TSWFileWriter::Reserve(unsigned __int64 nBytes, bool bCountOverflow)
+{
+   if (!m_pThread)
+      return false;
+   if (GetFreeBytes() >= nBytes)
+      return true;
+   if (bCountOverflow)
+      m_nOverflows.fetch_add(1, std::memory_order_relaxed);
+   return false;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// copies passed data to current block. Never blocks: called from recording
+/// callback. Full blocks are handed over to writer thread. If there is not
+/// enough room for all data, nothing is written and overflow counter is
+/// increased
+//------------------------------------------------------------------------------
+void TSWFileWriter::Write(const void* pData, unsigned int nBytes)
+{
+   if (!Reserve(nBytes))
+      return;
+
+   const char* pc = (const char*)pData;
+   unsigned int nNumBlocks = (unsigned int)m_vpBlocks.size();
+   while (nBytes)
+      {
+      unsigned int nFilled = m_nFilled.load(std::memory_order_relaxed);
+      unsigned int nCopy = m_nBlockSize - m_nBlockPos;
+      if (nCopy > nBytes)
+         nCopy = nBytes;
+      CopyMemory(m_vpBlocks[nFilled % nNumBlocks] + m_nBlockPos, pc, nCopy);
+      m_nBlockPos += nCopy;
+      pc          += nCopy;
+      nBytes      -= nCopy;
+      if (m_nBlockPos == m_nBlockSize)
+         Commit();
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes passed number of zero bytes (e.g. placeholder of a lost record).
+/// Same behaviour as Write()
+//------------------------------------------------------------------------------
+void TSWFileWriter::WriteZeros(unsigned __int64 nBytes)
+{
+   if (!Reserve(nBytes))
+      return;
+
+   unsigned int nNumBlocks = (unsigned int)m_vpBlocks.size();
+   while (nBytes)
+      {
+      unsigned int nFilled = m_nFilled.load(std::memory_order_relaxed);
+      unsigned int nCopy = m_nBlockSize - m_nBlockPos;
+      if (nCopy > nBytes)
+         nCopy = (unsigned int)nBytes;
+      ZeroMemory(m_vpBlocks[nFilled % nNumBlocks] + m_nBlockPos, nCopy);
+      m_nBlockPos += nCopy;
+      nBytes      -= nCopy;
+      if (m_nBlockPos == m_nBlockSize)
+         Commit();
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// hands over current block to writer thread
+//------------------------------------------------------------------------------
+void TSWFileWriter::Commit()
+{
+   unsigned int nFilled = m_nFilled.load(std::memory_order_relaxed);
+   m_vnBlockBytes[nFilled % m_vpBlocks.size()] = m_nBlockPos;
+   m_nBlockPos = 0;
+   m_nFilled.store(nFilled + 1, std::memory_order_release);
+
+   unsigned int nDepth = nFilled + 1 - m_nWritten.load(std::memory_order_relaxed);
+   if (nDepth > m_nMaxQueueDepth.load(std::memory_order_relaxed))
+      m_nMaxQueueDepth.store(nDepth, std::memory_order_relaxed);
+   SetEvent(m_hDataEvent);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// hands over a partially filled block and waits until all data are written.
+/// Must only be called if no data are written concurrently (i.e. when recording
+/// is stopped)
+//------------------------------------------------------------------------------
+void TSWFileWriter::Flush()
+{
+   if (!m_pThread)
+      return;
+   if (m_nBlockPos)
+      Commit();
+   while (m_nWritten.load(std::memory_order_acquire) != m_nFilled.load(std::memory_order_relaxed))
+      WaitForSingleObject(m_hDoneEvent, 100);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes all filled blocks to file. Called by writer thread only. On errors
+/// blocks are discarded (to keep the producer running) and the error is stored
+//------------------------------------------------------------------------------
+void TSWFileWriter::WriteBlocks()
+{
+   LARGE_INTEGER liFreq, liStart, liStop;
+   QueryPerformanceFrequency(&liFreq);
+   unsigned int nNumBlocks = (unsigned int)m_vpBlocks.size();
+   unsigned int nWritten = m_nWritten.load(std::memory_order_relaxed);
+   while (nWritten != m_nFilled.load(std::memory_order_acquire))
+      {
+      unsigned int nIndex = nWritten % nNumBlocks;
+      if (!m_bError.load())
+         {
+         QueryPerformanceCounter(&liStart);
+         try
+            {
+            m_pfs->WriteBuffer(m_vpBlocks[nIndex], (NativeInt)m_vnBlockBytes[nIndex]);
+            }
+         catch (Exception &e)
+            {
+            m_usError = e.Message;
+            m_bError.store(true);
+            }
+         QueryPerformanceCounter(&liStop);
+         unsigned int nLatencyUs = (unsigned int)((liStop.QuadPart - liStart.QuadPart) * 1000000 / liFreq.QuadPart);
+         if (nLatencyUs > m_nMaxFlushLatencyUs.load(std::memory_order_relaxed))
+            m_nMaxFlushLatencyUs.store(nLatencyUs, std::memory_order_relaxed);
+         }
+      nWritten++;
+      m_nWritten.store(nWritten, std::memory_order_release);
+      SetEvent(m_hDoneEvent);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of filled blocks not yet written to disk
+//------------------------------------------------------------------------------
+unsigned int TSWFileWriter::GetQueueDepth()
+{
+   return m_nFilled.load() - m_nWritten.load();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns maximum number of blocks waiting for writing since last
+/// ResetStatistics()
+//------------------------------------------------------------------------------
+unsigned int TSWFileWriter::GetMaxQueueDepth()
+{
+   return m_nMaxQueueDepth.load();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns worst-case time in ms needed for writing one block since last
+/// ResetStatistics()
+//------------------------------------------------------------------------------
+double TSWFileWriter::GetMaxFlushLatency()
+{
+   return (double)m_nMaxFlushLatencyUs.load() / 1000.0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of Write() calls, where data had to be discarded
+//------------------------------------------------------------------------------
+unsigned int TSWFileWriter::GetOverflows()
+{
+   return m_nOverflows.load();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if writing to file failed and stores error message in passed
+/// string
+//------------------------------------------------------------------------------
+bool TSWFileWriter::GetError(UnicodeString &usError)
+{
+   if (!m_bError.load())
+      return false;
+   usError = m_usError;
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// resets statistics
+//------------------------------------------------------------------------------
+void TSWFileWriter::ResetStatistics()
+{
+   m_nMaxQueueDepth.store(0);
+   m_nOverflows.store(0);
+   m_nMaxFlushLatencyUs.store(0);
+}
+//------------------------------------------------------------------------------
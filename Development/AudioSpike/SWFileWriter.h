@@ -0,0 +1,114 @@
+//------------------------------------------------------------------------------
+/// \file SWFileWriter.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWFileWriter for asynchronous writing of
+/// recorded data to file
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWFileWriterH
+#define SWFileWriterH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <atomic>
+
+class TSWFileWriter;
+
+//------------------------------------------------------------------------------
+/// thread writing filled blocks of a TSWFileWriter to disk
+//------------------------------------------------------------------------------
+class TSWFileWriterThread : public TThread
+{
+   private:
+      TSWFileWriter* m_pWriter;
+   protected:
+      void __fastcall Execute();
+   public:
+      __fastcall TSWFileWriterThread(TSWFileWriter* pWriter);
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// asynchronous file writer. Data passed to Write() (called from recording
+/// callback) are gathered in large aligned blocks. Filled blocks are handed
+/// over lock-free to a dedicated thread that writes them to disk, so file I/O
+/// never blocks the recording callback. If all blocks are in use data are
+/// discarded and the overflow is counted. Data of one Write() call are written
+/// completely or not at all, records consisting of multiple Write() calls are
+/// checked with Reserve() before writing the first part.
+/// NOTE: Write() and Flush() must only be called from one thread at a time
+//------------------------------------------------------------------------------
+class TSWFileWriter
+{
+   friend class TSWFileWriterThread;
+   private:
+      TFileStream*               m_pfs;
+      TSWFileWriterThread*       m_pThread;
+      HANDLE                     m_hDataEvent;
+      HANDLE                     m_hDoneEvent;
+      std::vector<char* >        m_vpBlocks;
+      std::vector<unsigned int > m_vnBlockBytes;
+      unsigned int               m_nBlockSize;
+      unsigned int               m_nBlockPos;
+      // number of filled (written by producer only) and number of written
+      // (written by writer thread only) blocks. Both are free running counters
+      // kept on separate cache lines
+      std::atomic<unsigned int>  m_nFilled;
+      char                       m_cPad1[64];
+      std::atomic<unsigned int>  m_nWritten;
+      char                       m_cPad2[64];
+      std::atomic<unsigned int>  m_nMaxQueueDepth;
+      std::atomic<unsigned int>  m_nOverflows;
+      std::atomic<unsigned int>  m_nMaxFlushLatencyUs;
+      std::atomic<bool>          m_bError;
+      UnicodeString              m_usError;
+      void           Commit();
+      unsigned __int64  GetFreeBytes();
+      void           WriteBlocks();
+      void           FreeBlocks();
+   public:
+      TSWFileWriter();
+      ~TSWFileWriter();
+      void           Open( UnicodeString usFileName,
+                           bool bAppend,
+                           unsigned int nBlockSize,
+                           unsigned int nNumBlocks);
+      void           Close();
+      bool           IsOpen();
+      bool           Reserve(unsigned __int64 nBytes, bool bCountOverflow = true);
+      void           Write(const void* pData, unsigned int nBytes);
+      void           WriteZeros(unsigned __int64 nBytes);
+      void           Flush();
+      unsigned int   GetQueueDepth();
+      unsigned int   GetMaxQueueDepth();
+      double         GetMaxFlushLatency();
+      unsigned int   GetOverflows();
+      bool           GetError(UnicodeString &usError);
+      void           ResetStatistics();
+};
+//------------------------------------------------------------------------------
+#endif
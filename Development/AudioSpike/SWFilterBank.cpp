@@ -0,0 +1,334 @@
+//------------------------------------------------------------------------------
+/// \file SWFilterBank.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWFilterBank: real-time IIR band-pass filtering
+/// of electrode channels
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWFilterBank.h"
+#include <math.h>
+#include <algorithm>
+#if defined(__SSE__) || defined(_M_X64) || defined(__x86_64__)
+   #define SWFB_SSE
+   #include <xmmintrin.h>
+#endif
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members (no channels: Process does nothing)
+//------------------------------------------------------------------------------
+TSWFilterBank::TSWFilterBank()
+   : m_nNumChannels(0), m_nNumSections(0)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// initializes filters for passed edge frequencies (one pair per channel) with
+/// nOrder (even, 2..SWFB_MAX_SECTIONS) for high-pass and low-pass. Lower edges
+/// <= 0 disable high-pass, upper edges <= 0 or not below Nyquist frequency
+/// disable low-pass of a channel. Resets all filter states
+//------------------------------------------------------------------------------
+void TSWFilterBank::Initialize(  const std::vector<float >& rvfLoFreq,
+                                 const std::vector<float >& rvfHiFreq,
+                                 double dSampleRate,
+                                 unsigned int nOrder)
+{
+   if (rvfLoFreq.size() != rvfHiFreq.size())
+      throw Exception("number of lower and upper filter edges differ");
+   if (nOrder < 2 || nOrder > SWFB_MAX_SECTIONS || (nOrder % 2))
+      throw Exception("invalid filter order " + IntToStr((int)nOrder));
+   if (dSampleRate <= 0.0)
+      throw Exception("invalid samplerate for filters");
+
+   m_nNumChannels = (unsigned int)rvfLoFreq.size();
+   m_nNumSections = nOrder;
+   unsigned int nSize = m_nNumChannels * m_nNumSections;
+   m_vfB0.assign(nSize, 1.0f);
+   m_vfB1.assign(nSize, 0.0f);
+   m_vfB2.assign(nSize, 0.0f);
+   m_vfA1.assign(nSize, 0.0f);
+   m_vfA2.assign(nSize, 0.0f);
+   m_vfZ1.assign(nSize, 0.0f);
+   m_vfZ2.assign(nSize, 0.0f);
+
+   // Butterworth filter of order N: cascade of N/2 sections with
+   // Q = 1/(2*sin((2k-1)*pi/(2N)))
+   unsigned int nNumPairs = nOrder / 2;
+   unsigned int nChannel, nPair;
+   for (nChannel = 0; nChannel < m_nNumChannels; nChannel++)
+      {
+      for (nPair = 0; nPair < nNumPairs; nPair++)
+         {
+         double dQ = 1.0 / (2.0 * sin((2.0 * nPair + 1.0) * M_PI / (2.0 * nOrder)));
+         if (rvfLoFreq[nChannel] > 0.0f)
+            SetSection(nPair, nChannel, rvfLoFreq[nChannel], dQ, dSampleRate, true);
+         if (rvfHiFreq[nChannel] > 0.0f && rvfHiFreq[nChannel] < dSampleRate / 2.0)
+            SetSection(nNumPairs + nPair, nChannel, rvfHiFreq[nChannel], dQ, dSampleRate, false);
+         }
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all filters (Process does nothing afterwards)
+//------------------------------------------------------------------------------
+void TSWFilterBank::Clear()
+{
+   m_nNumChannels = 0;
+   m_nNumSections = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// resets all filter states to 0
+//------------------------------------------------------------------------------
+void TSWFilterBank::Reset()
+{
+   std::fill(m_vfZ1.begin(), m_vfZ1.end(), 0.0f);
+   std::fill(m_vfZ2.begin(), m_vfZ2.end(), 0.0f);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of channels
+//------------------------------------------------------------------------------
+unsigned int TSWFilterBank::GetNumChannels()
+{
+   return m_nNumChannels;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of second order sections per channel
+//------------------------------------------------------------------------------
+unsigned int TSWFilterBank::GetNumSections()
+{
+   return m_nNumSections;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns filter order for a slope in dB per octave (6 dB per order, rounded
+/// up to even order and limited to SWFB_MAX_SECTIONS)
+//------------------------------------------------------------------------------
+unsigned int TSWFilterBank::OrderFromSlope(int ndBPerOctave)
+{
+   int nOrder = (ndBPerOctave + 5) / 6;
+   nOrder += nOrder % 2;
+   if (nOrder < 2)
+      nOrder = 2;
+   if (nOrder > SWFB_MAX_SECTIONS)
+      nOrder = SWFB_MAX_SECTIONS;
+   return (unsigned int)nOrder;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets coefficients of one section to high-pass or low-pass (bilinear
+/// transform with prewarping, normalized to a0 = 1)
+//------------------------------------------------------------------------------
+void TSWFilterBank::SetSection(  unsigned int nSection,
+                                 unsigned int nChannel,
+                                 double dFreq,
+                                 double dQ,
+                                 double dSampleRate,
+                                 bool bHighPass)
+{
+   double dW0     = 2.0 * M_PI * dFreq / dSampleRate;
+   double dCos    = cos(dW0);
+   double dAlpha  = sin(dW0) / (2.0 * dQ);
+   double dA0     = 1.0 + dAlpha;
+   double dB1     = bHighPass ? -(1.0 + dCos) : 1.0 - dCos;
+   unsigned int nIndex = nSection * m_nNumChannels + nChannel;
+   m_vfB0[nIndex] = (float)(fabs(dB1) / 2.0 / dA0);
+   m_vfB1[nIndex] = (float)(dB1 / dA0);
+   m_vfB2[nIndex] = m_vfB0[nIndex];
+   m_vfA1[nIndex] = (float)(-2.0 * dCos / dA0);
+   m_vfA2[nIndex] = (float)((1.0 - dAlpha) / dA0);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// filters passed buffers in place: ppfData must contain one pointer to
+/// nNumSamples samples for every channel. Denormals are flushed to zero while
+/// filtering (decaying states would slow down processing otherwise)
+//------------------------------------------------------------------------------
+void TSWFilterBank::Process(float* const* ppfData, unsigned int nNumSamples)
+{
+   if (!m_nNumChannels || !nNumSamples)
+      return;
+   unsigned int nChannel = 0;
+   #if defined(SWFB_SSE)
+   unsigned int nCSR = _mm_getcsr();
+   // flush-to-zero and denormals-are-zero
+   _mm_setcsr(nCSR | 0x8040);
+   for (; nChannel + SWFB_LANES <= m_nNumChannels; nChannel += SWFB_LANES)
+      ProcessLanes(nChannel, ppfData + nChannel, nNumSamples);
+   #endif
+   for (; nChannel < m_nNumChannels; nChannel++)
+      ProcessChannel(nChannel, ppfData[nChannel], nNumSamples);
+   #if defined(SWFB_SSE)
+   _mm_setcsr(nCSR);
+   #endif
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// filters one channel
+//------------------------------------------------------------------------------
+void TSWFilterBank::ProcessChannel(unsigned int nChannel, float* pfData, unsigned int nNumSamples)
+{
+   unsigned int nSection, nIndex, n;
+   for (nSection = 0; nSection < m_nNumSections; nSection++)
+      {
+      nIndex = nSection * m_nNumChannels + nChannel;
+      float fB0 = m_vfB0[nIndex];
+      float fB1 = m_vfB1[nIndex];
+      float fB2 = m_vfB2[nIndex];
+      float fA1 = m_vfA1[nIndex];
+      float fA2 = m_vfA2[nIndex];
+      float fZ1 = m_vfZ1[nIndex];
+      float fZ2 = m_vfZ2[nIndex];
+      float fX, fY;
+      for (n = 0; n < nNumSamples; n++)
+         {
+         fX = pfData[n];
+         fY = fB0 * fX + fZ1;
+         fZ1 = fB1 * fX - fA1 * fY + fZ2;
+         fZ2 = fB2 * fX - fA2 * fY;
+         pfData[n] = fY;
+         }
+      m_vfZ1[nIndex] = fZ1;
+      m_vfZ2[nIndex] = fZ2;
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// filters SWFB_LANES channels starting at nChannel in one pass (one channel
+/// per SSE lane). Blocks of 4 samples of the 4 channels are transposed, so
+/// every vector holds one sample of all channels and all sections are applied
+/// to it, before the block is transposed back
+//------------------------------------------------------------------------------
+#if defined(SWFB_SSE)
+void TSWFilterBank::ProcessLanes(unsigned int nChannel, float* const* ppfData, unsigned int nNumSamples)
+{
+   __m128 am128B0[SWFB_MAX_SECTIONS], am128B1[SWFB_MAX_SECTIONS], am128B2[SWFB_MAX_SECTIONS];
+   __m128 am128A1[SWFB_MAX_SECTIONS], am128A2[SWFB_MAX_SECTIONS];
+   __m128 am128Z1[SWFB_MAX_SECTIONS], am128Z2[SWFB_MAX_SECTIONS];
+   unsigned int nSection, nIndex;
+   for (nSection = 0; nSection < m_nNumSections; nSection++)
+      {
+      nIndex = nSection * m_nNumChannels + nChannel;
+      am128B0[nSection] = _mm_loadu_ps(&m_vfB0[nIndex]);
+      am128B1[nSection] = _mm_loadu_ps(&m_vfB1[nIndex]);
+      am128B2[nSection] = _mm_loadu_ps(&m_vfB2[nIndex]);
+      am128A1[nSection] = _mm_loadu_ps(&m_vfA1[nIndex]);
+      am128A2[nSection] = _mm_loadu_ps(&m_vfA2[nIndex]);
+      am128Z1[nSection] = _mm_loadu_ps(&m_vfZ1[nIndex]);
+      am128Z2[nSection] = _mm_loadu_ps(&m_vfZ2[nIndex]);
+      }
+
+   float* pf0 = ppfData[0];
+   float* pf1 = ppfData[1];
+   float* pf2 = ppfData[2];
+   float* pf3 = ppfData[3];
+   __m128 am128[4];
+   __m128 m128X, m128Y;
+   unsigned int n, m;
+   for (n = 0; n < nNumSamples; n += 4)
+      {
+      unsigned int nBlock = nNumSamples - n < 4 ? nNumSamples - n : 4;
+      if (nBlock == 4)
+         {
+         am128[0] = _mm_loadu_ps(pf0 + n);
+         am128[1] = _mm_loadu_ps(pf1 + n);
+         am128[2] = _mm_loadu_ps(pf2 + n);
+         am128[3] = _mm_loadu_ps(pf3 + n);
+         _MM_TRANSPOSE4_PS(am128[0], am128[1], am128[2], am128[3]);
+         }
+      else
+         {
+         for (m = 0; m < nBlock; m++)
+            am128[m] = _mm_set_ps(pf3[n+m], pf2[n+m], pf1[n+m], pf0[n+m]);
+         }
+      for (m = 0; m < nBlock; m++)
+         {
+         m128X = am128[m];
+         for (nSection = 0; nSection < m_nNumSections; nSection++)
+            {
+            m128Y = _mm_add_ps(_mm_mul_ps(am128B0[nSection], m128X), am128Z1[nSection]);
+            am128Z1[nSection] = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(am128B1[nSection], m128X),
+                                                      _mm_mul_ps(am128A1[nSection], m128Y)),
+                                           am128Z2[nSection]);
+            am128Z2[nSection] = _mm_sub_ps(_mm_mul_ps(am128B2[nSection], m128X),
+                                           _mm_mul_ps(am128A2[nSection], m128Y));
+            m128X = m128Y;
+            }
+         am128[m] = m128X;
+         }
+      if (nBlock == 4)
+         {
+         _MM_TRANSPOSE4_PS(am128[0], am128[1], am128[2], am128[3]);
+         _mm_storeu_ps(pf0 + n, am128[0]);
+         _mm_storeu_ps(pf1 + n, am128[1]);
+         _mm_storeu_ps(pf2 + n, am128[2]);
+         _mm_storeu_ps(pf3 + n, am128[3]);
+         }
+      else
+         {
+         float af[4];
+         for (m = 0; m < nBlock; m++)
+            {
+            _mm_storeu_ps(af, am128[m]);
+            pf0[n+m] = af[0];
+            pf1[n+m] = af[1];
+            pf2[n+m] = af[2];
+            pf3[n+m] = af[3];
+            }
+         }
+      }
+
+   for (nSection = 0; nSection < m_nNumSections; nSection++)
+      {
+      nIndex = nSection * m_nNumChannels + nChannel;
+      _mm_storeu_ps(&m_vfZ1[nIndex], am128Z1[nSection]);
+      _mm_storeu_ps(&m_vfZ2[nIndex], am128Z2[nSection]);
+      }
+}
+#else
+#pragma argsused
+void TSWFilterBank::ProcessLanes(unsigned int nChannel, float* const* ppfData, unsigned int nNumSamples)
+{
+}
+#endif
+//------------------------------------------------------------------------------
@@ -0,0 +1,88 @@
+//------------------------------------------------------------------------------
+/// \file SWFilterBank.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWFilterBank: real-time IIR band-pass filtering
+/// of electrode channels
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWFilterBankH
+#define SWFilterBankH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+/// maximum number of second order sections per channel
+#define SWFB_MAX_SECTIONS  8
+/// number of channels processed in parallel by SIMD path
+#define SWFB_LANES         4
+
+//------------------------------------------------------------------------------
+/// bank of IIR band-pass filters (one per channel), each a cascade of second
+/// order sections (transposed direct form II): Butterworth high-pass at lower
+/// and Butterworth low-pass at upper edge frequency. All channels use the same
+/// number of sections, so SWFB_LANES channels are processed in one pass with
+/// SSE (one channel per lane, if available at compile time, scalar fallback
+/// otherwise). Filter states are kept across buffers.
+/// NOTE: Process is called by the recording callback, Initialize and Reset
+/// must not be called while it is running
+//------------------------------------------------------------------------------
+class TSWFilterBank
+{
+   private:
+      unsigned int         m_nNumChannels;
+      unsigned int         m_nNumSections;
+      /// coefficients and states: index is section * m_nNumChannels + channel
+      std::vector<float >  m_vfB0;
+      std::vector<float >  m_vfB1;
+      std::vector<float >  m_vfB2;
+      std::vector<float >  m_vfA1;
+      std::vector<float >  m_vfA2;
+      std::vector<float >  m_vfZ1;
+      std::vector<float >  m_vfZ2;
+      void                 SetSection( unsigned int nSection,
+                                       unsigned int nChannel,
+                                       double dFreq,
+                                       double dQ,
+                                       double dSampleRate,
+                                       bool bHighPass);
+      void                 ProcessChannel(unsigned int nChannel, float* pfData, unsigned int nNumSamples);
+      void                 ProcessLanes(unsigned int nChannel, float* const* ppfData, unsigned int nNumSamples);
+   public:
+      TSWFilterBank();
+      void           Initialize( const std::vector<float >& rvfLoFreq,
+                                 const std::vector<float >& rvfHiFreq,
+                                 double dSampleRate,
+                                 unsigned int nOrder);
+      void           Clear();
+      void           Reset();
+      unsigned int   GetNumChannels();
+      unsigned int   GetNumSections();
+      void           Process(float* const* ppfData, unsigned int nNumSamples);
+      static unsigned int OrderFromSlope(int ndBPerOctave);
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,297 @@
+//------------------------------------------------------------------------------
+/// \file SWGridIndex.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWGridIndex: 2-D grid index for rectangle
+/// queries on point sets (cluster plots)
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWGridIndex.h"
+#include <math.h>
+#include <cmath>
+#include <limits.h>
+#include <algorithm>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWGridIndex::TSWGridIndex()
+{
+   Clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all points
+//------------------------------------------------------------------------------
+void TSWGridIndex::Clear()
+{
+   m_nNumPoints   = 0;
+   m_nCellsX      = 0;
+   m_nCellsY      = 0;
+   m_dMinX        = 0.0;
+   m_dMinY        = 0.0;
+   m_dCellWidth   = 1.0;
+   m_dCellHeight  = 1.0;
+   m_vnCellStart.clear();
+   m_vnIndex.clear();
+   m_vdX.clear();
+   m_vdY.clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns cell column of an x value (clipped to grid)
+//------------------------------------------------------------------------------
+unsigned int TSWGridIndex::CellX(double dX)
+{
+   double d = (dX - m_dMinX) / m_dCellWidth;
+   if (d <= 0.0)
+      return 0;
+   if (d >= (double)(m_nCellsX - 1))
+      return m_nCellsX - 1;
+   return (unsigned int)d;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns cell row of an y value (clipped to grid)
+//------------------------------------------------------------------------------
+unsigned int TSWGridIndex::CellY(double dY)
+{
+   double d = (dY - m_dMinY) / m_dCellHeight;
+   if (d <= 0.0)
+      return 0;
+   if (d >= (double)(m_nCellsY - 1))
+      return m_nCellsY - 1;
+   return (unsigned int)d;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns range of cells overlapping a rectangle (corners may be passed in
+/// any order)
+//------------------------------------------------------------------------------
+void TSWGridIndex::CellRange( double dX0, double dX1, double dY0, double dY1,
+                              unsigned int &rnX0, unsigned int &rnX1,
+                              unsigned int &rnY0, unsigned int &rnY1)
+{
+   rnX0 = CellX(std::min(dX0, dX1));
+   rnX1 = CellX(std::max(dX0, dX1));
+   rnY0 = CellY(std::min(dY0, dY1));
+   rnY1 = CellY(std::max(dY0, dY1));
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// builds index for passed points (counting sort of points by cell). Returned
+/// indices of queries are indices into passed arrays
+//------------------------------------------------------------------------------
+void TSWGridIndex::Build(const double* pdX, const double* pdY, unsigned int nNumPoints)
+{
+   Clear();
+   m_nNumPoints = nNumPoints;
+   if (!nNumPoints)
+      return;
+
+   double dMaxX = 0.0;
+   double dMaxY = 0.0;
+   bool bFirst = true;
+   unsigned int n;
+   for (n = 0; n < nNumPoints; n++)
+      {
+      if (!std::isfinite(pdX[n]) || !std::isfinite(pdY[n]))
+         continue;
+      if (bFirst)
+         {
+         m_dMinX = dMaxX = pdX[n];
+         m_dMinY = dMaxY = pdY[n];
+         bFirst = false;
+         }
+      m_dMinX = std::min(m_dMinX, pdX[n]);
+      dMaxX   = std::max(dMaxX, pdX[n]);
+      m_dMinY = std::min(m_dMinY, pdY[n]);
+      dMaxY   = std::max(dMaxY, pdY[n]);
+      }
+   if (bFirst)
+      return;
+
+   unsigned int nCells = (unsigned int)sqrt((double)nNumPoints / SWGI_POINTS_PER_CELL);
+   nCells = std::max(1U, std::min(nCells, (unsigned int)SWGI_MAX_CELLS));
+   m_nCellsX = nCells;
+   m_nCellsY = nCells;
+   m_dCellWidth   = dMaxX > m_dMinX ? (dMaxX - m_dMinX) / nCells : 1.0;
+   m_dCellHeight  = dMaxY > m_dMinY ? (dMaxY - m_dMinY) / nCells : 1.0;
+
+   // count points per cell, prefix sum, then scatter points to their cells
+   std::vector<unsigned int > vnCell(nNumPoints, UINT_MAX);
+   m_vnCellStart.assign(m_nCellsX * m_nCellsY + 1, 0);
+   for (n = 0; n < nNumPoints; n++)
+      {
+      if (!std::isfinite(pdX[n]) || !std::isfinite(pdY[n]))
+         continue;
+      vnCell[n] = CellY(pdY[n]) * m_nCellsX + CellX(pdX[n]);
+      m_vnCellStart[vnCell[n] + 1]++;
+      }
+   for (n = 1; n < m_vnCellStart.size(); n++)
+      m_vnCellStart[n] += m_vnCellStart[n-1];
+   unsigned int nIndexed = m_vnCellStart.back();
+   m_vnIndex.resize(nIndexed);
+   m_vdX.resize(nIndexed);
+   m_vdY.resize(nIndexed);
+   std::vector<unsigned int > vnPos(m_vnCellStart.begin(), m_vnCellStart.end() - 1);
+   for (n = 0; n < nNumPoints; n++)
+      {
+      if (vnCell[n] == UINT_MAX)
+         continue;
+      unsigned int nPos = vnPos[vnCell[n]]++;
+      m_vnIndex[nPos] = n;
+      m_vdX[nPos] = pdX[n];
+      m_vdY[nPos] = pdY[n];
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of points passed to Build
+//------------------------------------------------------------------------------
+unsigned int TSWGridIndex::GetNumPoints()
+{
+   return m_nNumPoints;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// appends indices of all points within passed rectangle (borders included,
+/// corners may be passed in any order) to passed vector. Order of returned
+/// indices is unspecified
+//------------------------------------------------------------------------------
+void TSWGridIndex::QueryRect( double dX0, double dX1,
+                              double dY0, double dY1,
+                              std::vector<unsigned int >& rvnIndices)
+{
+   if (!m_nCellsX || std::isnan(dX0) || std::isnan(dX1) || std::isnan(dY0) || std::isnan(dY1))
+      return;
+   if (dX0 > dX1)
+      std::swap(dX0, dX1);
+   if (dY0 > dY1)
+      std::swap(dY0, dY1);
+
+   unsigned int nX0 = CellX(dX0);
+   unsigned int nX1 = CellX(dX1);
+   unsigned int nY0 = CellY(dY0);
+   unsigned int nY1 = CellY(dY1);
+   unsigned int nX, nY, n;
+   for (nY = nY0; nY <= nY1; nY++)
+      {
+      // cells between the cells of the corners are completely inside (cell
+      // is a monotonic function of the coordinate), points of all other
+      // cells have to be tested
+      bool bInsideY = nY > nY0 && nY < nY1;
+      for (nX = nX0; nX <= nX1; nX++)
+         {
+         bool bInsideX = nX > nX0 && nX < nX1;
+         unsigned int nCell   = nY * m_nCellsX + nX;
+         unsigned int nStart  = m_vnCellStart[nCell];
+         unsigned int nEnd    = m_vnCellStart[nCell + 1];
+         if (bInsideX && bInsideY)
+            rvnIndices.insert(rvnIndices.end(), m_vnIndex.begin() + nStart, m_vnIndex.begin() + nEnd);
+         else
+            {
+            for (n = nStart; n < nEnd; n++)
+               {
+               if (m_vdX[n] >= dX0 && m_vdX[n] <= dX1 && m_vdY[n] >= dY0 && m_vdY[n] <= dY1)
+                  rvnIndices.push_back(m_vnIndex[n]);
+               }
+            }
+         }
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// appends indices of all points, that may be inside of one of two rectangles
+/// (old and new position of a dragged rectangle) but not inside of the other
+/// one: all points of cells overlapping one of the rectangles except the cells
+/// that are completely inside of both. Points are not tested, i.e. the number
+/// of returned points is proportional to the changed area and the borders of
+/// the rectangles, not to their size. Order of returned indices is unspecified
+//------------------------------------------------------------------------------
+void TSWGridIndex::QueryChanged( double dX0Old, double dX1Old,
+                                 double dY0Old, double dY1Old,
+                                 double dX0, double dX1,
+                                 double dY0, double dY1,
+                                 std::vector<unsigned int >& rvnIndices)
+{
+   if (  !m_nCellsX
+      || std::isnan(dX0Old) || std::isnan(dX1Old) || std::isnan(dY0Old) || std::isnan(dY1Old)
+      || std::isnan(dX0) || std::isnan(dX1) || std::isnan(dY0) || std::isnan(dY1)
+      )
+      return;
+
+   unsigned int nOldX0, nOldX1, nOldY0, nOldY1;
+   unsigned int nX0, nX1, nY0, nY1;
+   CellRange(dX0Old, dX1Old, dY0Old, dY1Old, nOldX0, nOldX1, nOldY0, nOldY1);
+   CellRange(dX0, dX1, dY0, dY1, nX0, nX1, nY0, nY1);
+
+   // cells strictly between the corner cells are completely inside (see
+   // QueryRect): columns completely inside of both rectangles
+   unsigned int nInnerX0 = std::max(nOldX0, nX0) + 1;
+   unsigned int nInnerX1 = std::min(nOldX1, nX1);
+
+   unsigned int nX, nY;
+   for (nY = std::min(nOldY0, nY0); nY <= std::max(nOldY1, nY1); nY++)
+      {
+      bool bInOld = nY >= nOldY0 && nY <= nOldY1;
+      bool bIn    = nY >= nY0 && nY <= nY1;
+      if (!bInOld && !bIn)
+         continue;
+      bool bInnerY = nY > nOldY0 && nY < nOldY1 && nY > nY0 && nY < nY1;
+      for (nX = std::min(nOldX0, nX0); nX <= std::max(nOldX1, nX1); nX++)
+         {
+         // skip cells completely inside of both rectangles
+         if (bInnerY && nX >= nInnerX0 && nX < nInnerX1)
+            {
+            nX = nInnerX1 - 1;
+            continue;
+            }
+         if (  !(bInOld && nX >= nOldX0 && nX <= nOldX1)
+            && !(bIn && nX >= nX0 && nX <= nX1)
+            )
+            continue;
+         unsigned int nCell = nY * m_nCellsX + nX;
+         rvnIndices.insert(rvnIndices.end(),
+                           m_vnIndex.begin() + m_vnCellStart[nCell],
+                           m_vnIndex.begin() + m_vnCellStart[nCell + 1]);
+         }
+      }
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+/// \file SWGridIndex.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWGridIndex: 2-D grid index for rectangle
+/// queries on point sets (cluster plots)
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWGridIndexH
+#define SWGridIndexH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+/// mean number of points per grid cell
+#define SWGI_POINTS_PER_CELL  8
+/// maximum number of cells per dimension
+#define SWGI_MAX_CELLS        1024
+
+//------------------------------------------------------------------------------
+/// uniform 2-D grid over a set of points (bounding box of the points divided
+/// in cells holding SWGI_POINTS_PER_CELL points on average). Points are stored
+/// sorted by cell, so a rectangle query only reads the cells overlapping the
+/// rectangle: points of cells completely inside are returned without any test,
+/// only points of cells on the border are tested. Points with non-finite
+/// coordinates are not indexed (never returned). For a rectangle that is
+/// dragged, QueryChanged returns the candidates, that may have changed their
+/// state between two positions of the rectangle
+//------------------------------------------------------------------------------
+class TSWGridIndex
+{
+   private:
+      unsigned int               m_nNumPoints;
+      unsigned int               m_nCellsX;
+      unsigned int               m_nCellsY;
+      double                     m_dMinX;
+      double                     m_dMinY;
+      double                     m_dCellWidth;
+      double                     m_dCellHeight;
+      std::vector<unsigned int > m_vnCellStart;
+      std::vector<unsigned int > m_vnIndex;
+      std::vector<double >       m_vdX;
+      std::vector<double >       m_vdY;
+      unsigned int   CellX(double dX);
+      unsigned int   CellY(double dY);
+      void           CellRange(double dX0, double dX1, double dY0, double dY1,
+                               unsigned int &rnX0, unsigned int &rnX1,
+                               unsigned int &rnY0, unsigned int &rnY1);
+   public:
+      TSWGridIndex();
+      void           Clear();
+      void           Build(const double* pdX, const double* pdY, unsigned int nNumPoints);
+      unsigned int   GetNumPoints();
+      void           QueryRect(double dX0, double dX1,
+                               double dY0, double dY1,
+                               std::vector<unsigned int >& rvnIndices);
+      void           QueryChanged(double dX0Old, double dX1Old,
+                                  double dY0Old, double dY1Old,
+                                  double dX0, double dX1,
+                                  double dY0, double dY1,
+                                  std::vector<unsigned int >& rvnIndices);
+};
+//------------------------------------------------------------------------------
+#endif
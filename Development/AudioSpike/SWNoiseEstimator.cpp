@@ -0,0 +1,239 @@
+//------------------------------------------------------------------------------
+/// \file SWNoiseEstimator.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWNoiseEstimator: online estimation of noise
+/// level of electrode channels for automatic thresholds
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWNoiseEstimator.h"
+#include <algorithm>
+#include <math.h>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWNoiseEstimator::TSWNoiseEstimator()
+   : m_nReservoirSize(SWNE_RESERVOIR_SIZE), m_nDecimation(SWNE_DECIMATION)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// destructor, does cleanup
+//------------------------------------------------------------------------------
+TSWNoiseEstimator::~TSWNoiseEstimator()
+{
+   DeleteLocks();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// deletes the locks of all channels
+//------------------------------------------------------------------------------
+void TSWNoiseEstimator::DeleteLocks()
+{
+   unsigned int nChannel;
+   for (nChannel = 0; nChannel < m_vpcs.size(); nChannel++)
+      {
+      DeleteCriticalSection(m_vpcs[nChannel]);
+      TRYDELETENULL(m_vpcs[nChannel]);
+      }
+   m_vpcs.clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// allocates reservoirs and locks for passed number of channels and discards all
+/// samples.
+/// NOTE: must not be called while recording callback is running
+//------------------------------------------------------------------------------
+void TSWNoiseEstimator::Initialize( unsigned int nNumChannels,
+                                    unsigned int nReservoirSize,
+                                    unsigned int nDecimation)
+{
+   if (nReservoirSize < SWNE_MIN_SAMPLES)
+      throw Exception("noise reservoir size must be at least " + IntToStr(SWNE_MIN_SAMPLES));
+   if (!nDecimation)
+      throw Exception("invalid noise decimation");
+
+   DeleteLocks();
+   m_nReservoirSize  = nReservoirSize;
+   m_nDecimation     = nDecimation;
+   m_vvfReservoir.resize(nNumChannels);
+   unsigned int nChannel;
+   for (nChannel = 0; nChannel < nNumChannels; nChannel++)
+      {
+      m_vvfReservoir[nChannel].resize(nReservoirSize);
+      m_vpcs.push_back(new CRITICAL_SECTION);
+      InitializeCriticalSection(m_vpcs.back());
+      }
+   m_vnWritePos.assign(nNumChannels, 0);
+   m_vnNumSamples.assign(nNumChannels, 0);
+   m_vnPhase.assign(nNumChannels, 0);
+   m_vfScratch.reserve(nReservoirSize);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// discards all samples of all channels
+//------------------------------------------------------------------------------
+void TSWNoiseEstimator::Reset()
+{
+   unsigned int nChannel;
+   for (nChannel = 0; nChannel < m_vpcs.size(); nChannel++)
+      {
+      EnterCriticalSection(m_vpcs[nChannel]);
+      try
+         {
+         m_vnWritePos[nChannel]     = 0;
+         m_vnNumSamples[nChannel]   = 0;
+         m_vnPhase[nChannel]        = 0;
+         }
+      __finally
+         {
+         LeaveCriticalSection(m_vpcs[nChannel]);
+         }
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds samples of one channel to its reservoir (called by recording callback).
+/// Decimation phase is kept across buffers, oldest samples are overwritten
+//------------------------------------------------------------------------------
+void TSWNoiseEstimator::Process(unsigned int nChannel, const float* pfData, unsigned int nNumSamples)
+{
+   if (nChannel >= m_vvfReservoir.size())
+      return;
+   if (!TryEnterCriticalSection(m_vpcs[nChannel]))
+      return;
+   try
+      {
+      std::valarray<float>& rvaf = m_vvfReservoir[nChannel];
+      unsigned int nWritePos  = m_vnWritePos[nChannel];
+      unsigned int nNumStored = 0;
+      unsigned int nSample;
+      for (nSample = m_vnPhase[nChannel]; nSample < nNumSamples; nSample += m_nDecimation)
+         {
+         rvaf[nWritePos++] = pfData[nSample];
+         if (nWritePos == m_nReservoirSize)
+            nWritePos = 0;
+         nNumStored++;
+         }
+      m_vnPhase[nChannel]     = nSample - nNumSamples;
+      m_vnWritePos[nChannel]  = nWritePos;
+      m_vnNumSamples[nChannel] = std::min(m_vnNumSamples[nChannel] + nNumStored, m_nReservoirSize);
+      }
+   __finally
+      {
+      LeaveCriticalSection(m_vpcs[nChannel]);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of channels
+//------------------------------------------------------------------------------
+unsigned int TSWNoiseEstimator::GetNumChannels()
+{
+   return (unsigned int)m_vvfReservoir.size();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of samples currently held in reservoir of a channel
+//------------------------------------------------------------------------------
+unsigned int TSWNoiseEstimator::GetNumSamples(unsigned int nChannel)
+{
+   if (nChannel >= m_vnNumSamples.size())
+      throw Exception("noise channel index exceeded");
+   unsigned int nNumSamples;
+   EnterCriticalSection(m_vpcs[nChannel]);
+   try
+      {
+      nNumSamples = m_vnNumSamples[nChannel];
+      }
+   __finally
+      {
+      LeaveCriticalSection(m_vpcs[nChannel]);
+      }
+   return nNumSamples;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns estimated standard deviation of noise of a channel: median absolute
+/// deviation from median of reservoir scaled by SWNE_MAD_TO_SIGMA. Returns 0 if
+/// less than SWNE_MIN_SAMPLES samples were recorded
+//------------------------------------------------------------------------------
+double TSWNoiseEstimator::GetSigma(unsigned int nChannel)
+{
+   if (nChannel >= m_vvfReservoir.size())
+      throw Exception("noise channel index exceeded");
+
+   // copy samples and release reservoir as fast as possible: recording callback
+   // skips the channel as long as we hold its lock
+   EnterCriticalSection(m_vpcs[nChannel]);
+   try
+      {
+      const std::valarray<float>& rvaf = m_vvfReservoir[nChannel];
+      m_vfScratch.assign(&rvaf[0], &rvaf[0] + m_vnNumSamples[nChannel]);
+      }
+   __finally
+      {
+      LeaveCriticalSection(m_vpcs[nChannel]);
+      }
+
+   if (m_vfScratch.size() < SWNE_MIN_SAMPLES)
+      return 0.0;
+
+   std::vector<float >::iterator itMiddle = m_vfScratch.begin() + (std::ptrdiff_t)(m_vfScratch.size() / 2);
+   std::nth_element(m_vfScratch.begin(), itMiddle, m_vfScratch.end());
+   float fMedian = *itMiddle;
+   std::vector<float >::iterator it;
+   for (it = m_vfScratch.begin(); it != m_vfScratch.end(); ++it)
+      *it = (float)fabs(*it - fMedian);
+   std::nth_element(m_vfScratch.begin(), itMiddle, m_vfScratch.end());
+   return SWNE_MAD_TO_SIGMA * (double)*itMiddle;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns automatic threshold of a channel: dFactor times estimated standard
+/// deviation of noise. Negative factors return negative thresholds (detection
+/// of samples below threshold). Returns 0 if no estimate is available yet
+//------------------------------------------------------------------------------
+double TSWNoiseEstimator::GetThreshold(unsigned int nChannel, double dFactor)
+{
+   return dFactor * GetSigma(nChannel);
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,93 @@
+//------------------------------------------------------------------------------
+/// \file SWNoiseEstimator.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWNoiseEstimator: online estimation of noise
+/// level of electrode channels for automatic thresholds
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWNoiseEstimatorH
+#define SWNoiseEstimatorH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <valarray>
+#include <SWTools.h>
+
+/// default number of samples kept per channel
+#define SWNE_RESERVOIR_SIZE   8192
+/// default decimation: every SWNE_DECIMATION'th sample is kept
+#define SWNE_DECIMATION       16
+/// minimum number of samples needed for an estimate
+#define SWNE_MIN_SAMPLES      256
+/// factor converting median absolute deviation to standard deviation of
+/// gaussian noise (1/0.6745)
+#define SWNE_MAD_TO_SIGMA     1.4826
+/// minimum interval in ms between two updates of tracking automatic thresholds
+#define SWNE_TRACKING_INTERVAL   1000
+/// minimum relative change of a tracking automatic threshold to be applied
+#define SWNE_TRACKING_HYSTERESIS 0.05
+
+//------------------------------------------------------------------------------
+/// online estimation of the noise level of electrode channels. The recording
+/// callback passes every buffer to Process(), which keeps every n'th sample in
+/// a ring buffer (reservoir) per channel, i.e. the reservoir always holds the
+/// most recent ReservoirSize * Decimation samples. GetSigma() returns a robust
+/// estimate of the standard deviation from the median absolute deviation (MAD)
+/// of the reservoir, which is hardly affected by spikes. Costs of an estimate
+/// only depend on the reservoir size, not on the amount of recorded data.
+/// NOTE: Process is called by the recording callback and never waits: every
+/// channel has its own lock, if the GUI thread is just reading the reservoir of
+/// a channel, the buffer is skipped for that channel only. All other functions
+/// are called by the GUI thread
+//------------------------------------------------------------------------------
+class TSWNoiseEstimator
+{
+   private:
+      std::vector<CRITICAL_SECTION* > m_vpcs;
+      unsigned int                  m_nReservoirSize;
+      unsigned int                  m_nDecimation;
+      vvf                           m_vvfReservoir;
+      std::vector<unsigned int >    m_vnWritePos;
+      std::vector<unsigned int >    m_vnNumSamples;
+      std::vector<unsigned int >    m_vnPhase;
+      std::vector<float >           m_vfScratch;
+      void           DeleteLocks();
+   public:
+      TSWNoiseEstimator();
+      ~TSWNoiseEstimator();
+      void           Initialize(unsigned int nNumChannels,
+                                unsigned int nReservoirSize = SWNE_RESERVOIR_SIZE,
+                                unsigned int nDecimation = SWNE_DECIMATION);
+      void           Reset();
+      void           Process(unsigned int nChannel, const float* pfData, unsigned int nNumSamples);
+      unsigned int   GetNumChannels();
+      unsigned int   GetNumSamples(unsigned int nChannel);
+      double         GetSigma(unsigned int nChannel);
+      double         GetThreshold(unsigned int nChannel, double dFactor);
+};
+//------------------------------------------------------------------------------
+#endif
@@ -218,7 +218,7 @@ int  SWSMP::GetXRuns()
 //------------------------------------------------------------------------------
 /// does some init-checking, sets starup values and calls "start" in SMP
 //------------------------------------------------------------------------------
-bool SWSMP::Start(int nEpocheSize)
+bool SWSMP::Start(int nEpocheSize, bool bResume)
 {
    if (!nEpocheSize)
       {
@@ -226,17 +226,17 @@ bool SWSMP::Start(int nEpocheSize)
          throw Exception("epoches not initialized");
       nEpocheSize = (int)formSpikeWare->m_sweEpoches.m_vvfEpoche[0].size();
       }
+   // NOTE: epoches may be shorter than ASIO buffer: multiple triggers per buffer
+   // are handled by trigger detector of TSWEpoches
    if (nEpocheSize < 0)
       nEpocheSize = (int)m_nBufferSize;
-   else if (nEpocheSize < (int)m_nBufferSize)
-      throw Exception("epoche size must not be smaller than ASIO buffer size");
 
    m_nFreeSearchSamplesPlayed    = 0;
    m_nFreeSearchWindowPos        = -1;
    m_nFreeSearchSchroederPos     = 0;
    m_nFreeSearchTriggerPos       = -1;
 
-   formSpikeWare->m_sweEpoches.Start();
+   formSpikeWare->m_sweEpoches.Start(bResume);
    m_bStopping = false;
    return Command("start");
 }
@@ -1147,12 +1147,14 @@ bool SWSMP::Init(int nMode)
             }
 
          // load bandpass for inputs. NOTE: vi contains all inputs including trigger and insitu.
+         // Electrodes are filtered by TSWEpoches instead, if IIR filter is enabled
+         bool bElectrodeIIRFilter = formSpikeWare->m_pIni->ReadBool("Settings", "ElectrodeIIRFilter", false);
          UnicodeString usFilter;
          for (n = 0; n < vi.size(); n++)
             {
             // NOTE: for trigger wo load plugin as well to keep channels aligned but
             // always use identity filter!
-            if (vi[n] == nTriggerInChannel)
+            if (vi[n] == nTriggerInChannel || (bElectrodeIIRFilter && m_swcHWChannels.IsElectrode((unsigned int)vi[n])))
                usFilter = "";
             else
                {
@@ -261,7 +261,7 @@ class SWSMP
       #else
       void  InitFreeSearch();
       #endif
-      bool  Start(int nEpocheSize = 0);
+      bool  Start(int nEpocheSize = 0, bool bResume = false);
       void  SoundFreeSearchSignalGenerator(vvf &vvfBuffers);
       void  SoundClipDetector(vvf &vvfBuffers);
       void  SoundCalibrationSignalGenerator(vvf &vvfBuffers);
@@ -2,7 +2,8 @@
 /// \file SWSpike.cpp
 ///
 /// \author Berg
-/// \brief Implementation of classes TSWSpike and TSWSpikes to store spike data
+/// \brief Implementation of classes TSWSpikeChannel and TSWSpikes to store spike
+/// data
 ///
 /// Project AudioSpike
 /// Module  AudioSpike.exe
@@ -34,6 +35,7 @@
 #include "SpikeWareMain.h"
 #include "SWEpoches.h"
 #include <math.h>
+#include <algorithm>
 #include "Encddecd.hpp"
 
 //------------------------------------------------------------------------------
@@ -42,6 +44,441 @@
 
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// CLASS TSWSpikeChannel containing all spikes of one channel
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor initializes members
+//------------------------------------------------------------------------------
+TSWSpikeChannel::TSWSpikeChannel()
+   : m_nSpikeLength(0)
+{
+   // principal components are not stored (see TSWSpikeSnapshot)
+   m_vvdParams.resize(SP_PC1);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of spikes
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeChannel::Size()
+{
+   return (unsigned int)m_vnSpikePos.size();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all spikes
+//------------------------------------------------------------------------------
+void TSWSpikeChannel::Clear()
+{
+   m_vdSpikeTime.clear();
+   m_vnSpikePos.clear();
+   m_vnStimIndex.clear();
+   m_vnEpocheIndex.clear();
+   m_vnRepetitionIndex.clear();
+   m_vnGroupIndex.clear();
+   m_vdThreshold.clear();
+   unsigned int n;
+   for (n = 0; n < m_vvdParams.size(); n++)
+      m_vvdParams[n].clear();
+   m_vdData.clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets length of spike data, only allowed if empty
+//------------------------------------------------------------------------------
+void TSWSpikeChannel::SetSpikeLength(unsigned int nSpikeLength)
+{
+   if (nSpikeLength == m_nSpikeLength)
+      return;
+   if (Size())
+      throw Exception("spike length cannot be changed if spikes are stored");
+   m_nSpikeLength = nSpikeLength;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// appends a new spike (group -1, empty parameters) and returns pointer to its
+/// data row to be filled by caller, who has to call InitParams afterwards.
+/// NOTE: pointer is only valid until next spike is appended
+//------------------------------------------------------------------------------
+double* TSWSpikeChannel::Push(double dSpikeTime,
+                              unsigned int nSpikePos,
+                              unsigned int nStimIndex,
+                              unsigned int nEpocheIndex,
+                              unsigned int nRepetitionIndex,
+                              double dThreshold)
+{
+   m_vdSpikeTime.push_back(dSpikeTime);
+   m_vnSpikePos.push_back(nSpikePos);
+   m_vnStimIndex.push_back(nStimIndex);
+   m_vnEpocheIndex.push_back(nEpocheIndex);
+   m_vnRepetitionIndex.push_back(nRepetitionIndex);
+   m_vnGroupIndex.push_back(-1);
+   m_vdThreshold.push_back(dThreshold);
+   unsigned int n;
+   for (n = 0; n < m_vvdParams.size(); n++)
+      m_vvdParams[n].push_back(0.0);
+   size_t nRow = m_vdData.size();
+   m_vdData.resize(nRow + m_nSpikeLength);
+   return m_nSpikeLength ? &m_vdData[nRow] : NULL;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// determines all spike parameters of a spike from its data. dTrigT is time of
+/// threshold crossing within spike data in seconds
+//------------------------------------------------------------------------------
+void TSWSpikeChannel::InitParams(unsigned int nIndex, double dSampleRate, double dTrigT)
+{
+   // determine general spike parameters
+   double dPeakUA = 0.0;
+   double dPeakDA = 0.0;
+   double dPeakUT = 0.0;
+   double dPeakDT = 0.0;
+   const double* pdData = GetData(nIndex);
+   unsigned int n;
+   double d;
+   for (n = 0; n < m_nSpikeLength; n++)
+      {
+      d = pdData[n];
+      if (d > dPeakUA)
+         {
+         dPeakUA = d;
+         dPeakUT = (double)n / dSampleRate;
+         }
+      else if (d < dPeakDA)
+         {
+         dPeakDA = d;
+         dPeakDT = (double)n / dSampleRate;
+         }
+      }
+   // total action potential amplitude
+   m_vvdParams[SP_TOTALAMPLITUDE][nIndex] = fabs(dPeakUA) + fabs(dPeakDA);
+   // amplitude of the 1st and 2nd component ('phase')
+   m_vvdParams[SP_PEAK1][nIndex]          = dPeakUT < dPeakDT ? dPeakUA : dPeakDA;
+   m_vvdParams[SP_PEAK2][nIndex]          = dPeakUT > dPeakDT ? dPeakUA : dPeakDA;
+   m_vvdParams[SP_PEAKPOS][nIndex]        = dPeakUA;
+   m_vvdParams[SP_PEAKNEG][nIndex]        = dPeakDA;
+   // peak to peak time in microseconds
+   m_vvdParams[SP_PEAK2PEAK][nIndex]      = fabs(dPeakUT - dPeakDT)*1000000.0;
+   // threshold to peak 2 time in microseconds
+   m_vvdParams[SP_THRS2PEAK2][nIndex]     = (dPeakUT > dPeakDT ? fabs(dPeakUT - dTrigT) : fabs(dPeakDT - dTrigT))*1000000.0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// appends all spikes of passed instance
+//------------------------------------------------------------------------------
+void TSWSpikeChannel::Append(const TSWSpikeChannel& rswsc)
+{
+   if (rswsc.m_vnSpikePos.empty())
+      return;
+   if (rswsc.m_nSpikeLength != m_nSpikeLength)
+      throw Exception("cannot append spikes with different spike length");
+   m_vdSpikeTime.insert(m_vdSpikeTime.end(), rswsc.m_vdSpikeTime.begin(), rswsc.m_vdSpikeTime.end());
+   m_vnSpikePos.insert(m_vnSpikePos.end(), rswsc.m_vnSpikePos.begin(), rswsc.m_vnSpikePos.end());
+   m_vnStimIndex.insert(m_vnStimIndex.end(), rswsc.m_vnStimIndex.begin(), rswsc.m_vnStimIndex.end());
+   m_vnEpocheIndex.insert(m_vnEpocheIndex.end(), rswsc.m_vnEpocheIndex.begin(), rswsc.m_vnEpocheIndex.end());
+   m_vnRepetitionIndex.insert(m_vnRepetitionIndex.end(), rswsc.m_vnRepetitionIndex.begin(), rswsc.m_vnRepetitionIndex.end());
+   m_vnGroupIndex.insert(m_vnGroupIndex.end(), rswsc.m_vnGroupIndex.begin(), rswsc.m_vnGroupIndex.end());
+   m_vdThreshold.insert(m_vdThreshold.end(), rswsc.m_vdThreshold.begin(), rswsc.m_vdThreshold.end());
+   unsigned int n;
+   for (n = 0; n < m_vvdParams.size(); n++)
+      m_vvdParams[n].insert(m_vvdParams[n].end(), rswsc.m_vvdParams[n].begin(), rswsc.m_vvdParams[n].end());
+   m_vdData.insert(m_vdData.end(), rswsc.m_vdData.begin(), rswsc.m_vdData.end());
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if a spike belonging to passed epoche is stored
+//------------------------------------------------------------------------------
+bool TSWSpikeChannel::ContainsEpoche(unsigned int nEpocheIndex)
+{
+   return std::find(m_vnEpocheIndex.begin(), m_vnEpocheIndex.end(), nEpocheIndex) != m_vnEpocheIndex.end();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all spikes belonging to a particular epoche (in a single pass
+/// compacting all columns)
+//------------------------------------------------------------------------------
+void TSWSpikeChannel::RemoveEpoche(unsigned int nEpocheIndex)
+{
+   unsigned int n, nParam, nDst = 0;
+   unsigned int nSize = Size();
+   for (n = 0; n < nSize; n++)
+      {
+      if (m_vnEpocheIndex[n] == nEpocheIndex)
+         continue;
+      if (nDst != n)
+         {
+         m_vdSpikeTime[nDst]        = m_vdSpikeTime[n];
+         m_vnSpikePos[nDst]         = m_vnSpikePos[n];
+         m_vnStimIndex[nDst]        = m_vnStimIndex[n];
+         m_vnEpocheIndex[nDst]      = m_vnEpocheIndex[n];
+         m_vnRepetitionIndex[nDst]  = m_vnRepetitionIndex[n];
+         m_vnGroupIndex[nDst]       = m_vnGroupIndex[n];
+         m_vdThreshold[nDst]        = m_vdThreshold[n];
+         for (nParam = 0; nParam < m_vvdParams.size(); nParam++)
+            m_vvdParams[nParam][nDst] = m_vvdParams[nParam][n];
+         std::copy(  m_vdData.begin() + (int)(n*m_nSpikeLength),
+                     m_vdData.begin() + (int)((n+1)*m_nSpikeLength),
+                     m_vdData.begin() + (int)(nDst*m_nSpikeLength));
+         }
+      nDst++;
+      }
+   if (nDst == nSize)
+      return;
+   m_vdSpikeTime.resize(nDst);
+   m_vnSpikePos.resize(nDst);
+   m_vnStimIndex.resize(nDst);
+   m_vnEpocheIndex.resize(nDst);
+   m_vnRepetitionIndex.resize(nDst);
+   m_vnGroupIndex.resize(nDst);
+   m_vdThreshold.resize(nDst);
+   for (nParam = 0; nParam < m_vvdParams.size(); nParam++)
+      m_vvdParams[nParam].resize(nDst);
+   m_vdData.resize(nDst*m_nSpikeLength);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns pointer to data of one spike (m_nSpikeLength values)
+//------------------------------------------------------------------------------
+const double* TSWSpikeChannel::GetData(unsigned int nIndex)
+{
+   return &m_vdData[nIndex*m_nSpikeLength];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// CLASS TSWSpikeSnapshot containing a versioned view to spikes of one channel
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor initializes members
+//------------------------------------------------------------------------------
+TSWSpikeSnapshot::TSWSpikeSnapshot()
+   : m_nNumSpikes(0), m_nVersion(0)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// updates index of first spike of every chunk and total number of spikes
+//------------------------------------------------------------------------------
+void TSWSpikeSnapshot::UpdateIndex()
+{
+   m_vnChunkStart.resize(m_vpChunks.size());
+   m_nNumSpikes = 0;
+   unsigned int n;
+   for (n = 0; n < m_vpChunks.size(); n++)
+      {
+      m_vnChunkStart[n] = m_nNumSpikes;
+      m_nNumSpikes += m_vpChunks[n]->Size();
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns chunk containing spike with passed index and converts index to
+/// index within that chunk
+//------------------------------------------------------------------------------
+TSWSpikeChannel& TSWSpikeSnapshot::Locate(unsigned int &rnIndex)
+{
+   if (rnIndex >= m_nNumSpikes)
+      throw Exception("spike index exceeded");
+   unsigned int nChunk = (unsigned int)(std::upper_bound(m_vnChunkStart.begin(), m_vnChunkStart.end(), rnIndex) - m_vnChunkStart.begin()) - 1;
+   rnIndex -= m_vnChunkStart[nChunk];
+   return *m_vpChunks[nChunk];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of spikes
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetNumSpikes()
+{
+   return m_nNumSpikes;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns version of snapshot: it is incremented every time the spikes of the
+/// channel are changed (groups excluded)
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetVersion()
+{
+   return m_nVersion;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns a spike parameter by index and parameter type
+//------------------------------------------------------------------------------
+double TSWSpikeSnapshot::GetSpikeParam(unsigned int nIndex, TSpikeParam sp)
+{
+   if (sp >= SP_LAST)
+      throw Exception("unknown spike patrameter requested");
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   if (sp >= SP_PC1)
+      return m_pBasis ? m_pBasis->Project(rswsc.GetData(nIndex), (unsigned int)(sp - SP_PC1)) : 0.0;
+   return rswsc.m_vvdParams[sp][nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// copies one spike parameter of nCount spikes starting at spike nStart to
+/// passed buffer (must hold nCount values). Returns number of copied values,
+/// which is less than nCount, if less spikes are available
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetSpikeParams( TSpikeParam sp,
+                                                double* pdValues,
+                                                unsigned int nStart,
+                                                unsigned int nCount)
+{
+   if (sp >= SP_LAST)
+      throw Exception("unknown spike patrameter requested");
+   if (nStart >= m_nNumSpikes)
+      return 0;
+   if (nCount > m_nNumSpikes - nStart)
+      nCount = m_nNumSpikes - nStart;
+   unsigned int nCopied = 0;
+   unsigned int nIndex = nStart;
+   while (nCopied < nCount)
+      {
+      TSWSpikeChannel& rswsc = Locate(nIndex);
+      unsigned int nNum = rswsc.Size() - nIndex;
+      if (nNum > nCount - nCopied)
+         nNum = nCount - nCopied;
+      if (sp < SP_PC1)
+         CopyMemory(pdValues + nCopied, &rswsc.m_vvdParams[sp][nIndex], nNum*sizeof(double));
+      else
+         {
+         unsigned int n;
+         for (n = 0; n < nNum; n++)
+            pdValues[nCopied + n] = m_pBasis ? m_pBasis->Project(rswsc.GetData(nIndex + n), (unsigned int)(sp - SP_PC1)) : 0.0;
+         }
+      nCopied += nNum;
+      nIndex = nStart + nCopied;
+      }
+   return nCount;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// copies spike groups of nCount spikes starting at spike nStart to passed
+/// buffer (must hold nCount values). Returns number of copied values
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetSpikeGroups( int* pnGroups,
+                                                unsigned int nStart,
+                                                unsigned int nCount)
+{
+   if (nStart >= m_nNumSpikes)
+      return 0;
+   if (nCount > m_nNumSpikes - nStart)
+      nCount = m_nNumSpikes - nStart;
+   unsigned int nCopied = 0;
+   unsigned int nIndex = nStart;
+   while (nCopied < nCount)
+      {
+      TSWSpikeChannel& rswsc = Locate(nIndex);
+      unsigned int nNum = rswsc.Size() - nIndex;
+      if (nNum > nCount - nCopied)
+         nNum = nCount - nCopied;
+      CopyMemory(pnGroups + nCopied, &rswsc.m_vnGroupIndex[nIndex], nNum*sizeof(int));
+      nCopied += nNum;
+      nIndex = nStart + nCopied;
+      }
+   return nCount;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike time by index
+//------------------------------------------------------------------------------
+double TSWSpikeSnapshot::GetSpikeTime(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vdSpikeTime[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike threshold by index
+//------------------------------------------------------------------------------
+double TSWSpikeSnapshot::GetThreshold(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vdThreshold[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike position by index
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetSpikePosition(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vnSpikePos[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike group by index
+//------------------------------------------------------------------------------
+int TSWSpikeSnapshot::GetSpikeGroup(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vnGroupIndex[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike stimulus index by index
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetStimIndex(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vnStimIndex[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike epoche index by index
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetEpocheIndex(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vnEpocheIndex[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns spike repetition index by index
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeSnapshot::GetRepetitionIndex(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.m_vnRepetitionIndex[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns pointer to data of a spike. Pointer is valid as long as the
+/// snapshot exists
+//------------------------------------------------------------------------------
+const double* TSWSpikeSnapshot::GetSpike(unsigned int nIndex)
+{
+   TSWSpikeChannel& rswsc = Locate(nIndex);
+   return rswsc.GetData(nIndex);
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// CLASS TSWSpikes containing info about multiple spikes with identical
 /// parameters
@@ -53,11 +490,14 @@
 TSWSpikes::TSWSpikes()
 {
    InitializeCriticalSection(&m_cs);
+   InitializeCriticalSection(&m_csWrite);
    m_bInitialized = false;
    m_dSampleRate = 44100.0;
    m_dSampleRateDevider = 1.0;
    m_nPostThreshold = 0;
    m_dPostThreshold = 0.0;
+   m_nPreThreshold = 0;
+   m_nSpikeLength = 0;
    SetNumChannels(1);
 }
 //------------------------------------------------------------------------------
@@ -68,6 +508,7 @@ TSWSpikes::TSWSpikes()
 TSWSpikes::~TSWSpikes()
 {
    Clear();
+   DeleteCriticalSection(&m_csWrite);
    DeleteCriticalSection(&m_cs);
 }
 //------------------------------------------------------------------------------
@@ -78,21 +519,111 @@ TSWSpikes::~TSWSpikes()
 bool TSWSpikes::IsEmpty()
 {
    unsigned int n;
-   for (n = 0; n < m_vvSpikes.size(); n++)
+   for (n = 0; n < m_vswssChannels.size(); n++)
       {
-      if (m_vvSpikes[n].size())
+      if (m_vswssChannels[n].GetNumSpikes())
          return false;
       }
    return true;
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// publishes a new chunk of spikes for a channel. Trailing chunks are merged,
+/// as long as the previous chunk is not larger than twice the last one, which
+/// keeps the number of chunks logarithmic. Merging is done without holding the
+/// lock (readers hold references to the old chunks and are not affected),
+/// only the new chunk list is swapped in under the lock
+//------------------------------------------------------------------------------
+void TSWSpikes::Publish(unsigned int nChannelIndex, TSWSpikeChunk pswsc)
+{
+   if (!pswsc->Size())
+      return;
+   if (pswsc->m_nSpikeLength)
+      m_vswsfFeatures[nChannelIndex].Add(pswsc->GetData(0), pswsc->Size(), pswsc->m_nSpikeLength);
+   // NOTE: detected spikes have no group yet, only spikes read with groups
+   // are counted here
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      unsigned int n;
+      for (n = 0; n < pswsc->Size(); n++)
+         {
+         if (pswsc->m_vnGroupIndex[n] >= 0)
+            AddGroupedSpike(nChannelIndex, *pswsc, n);
+         }
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   std::vector<TSWSpikeChunk > vpChunks = m_vswssChannels[nChannelIndex].m_vpChunks;
+   vpChunks.push_back(pswsc);
+   size_t nSize = vpChunks.size();
+   while (nSize > 1 && vpChunks[nSize-2]->Size() <= 2*vpChunks[nSize-1]->Size())
+      {
+      TSWSpikeChunk pswscMerged(new TSWSpikeChannel(*vpChunks[nSize-2]));
+      pswscMerged->Append(*vpChunks[nSize-1]);
+      vpChunks.pop_back();
+      vpChunks.back() = pswscMerged;
+      nSize--;
+      }
+   Publish(nChannelIndex, vpChunks);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets new chunk list of a channel with current principal components and
+/// increments version of channel. NOTE: caller has to update the features of
+/// the channel (m_vswsfFeatures) before
+//------------------------------------------------------------------------------
+void TSWSpikes::Publish(unsigned int nChannelIndex, const std::vector<TSWSpikeChunk >& rvpChunks)
+{
+   // components are updated without holding the lock
+   TSWSpikeBasisPtr pBasis = m_vswsfFeatures[nChannelIndex].GetBasis();
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      TSWSpikeSnapshot& rswss = m_vswssChannels[nChannelIndex];
+      rswss.m_vpChunks = rvpChunks;
+      rswss.m_pBasis = pBasis;
+      rswss.UpdateIndex();
+      rswss.m_nVersion++;
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns a snapshot of the spikes of one channel. The snapshot can be read
+/// without locking and is not affected by adding or removing spikes
+//------------------------------------------------------------------------------
+TSWSpikeSnapshot TSWSpikes::GetSnapshot(unsigned int nChannelIndex)
+{
+   AssertIndex(nChannelIndex);
+   TSWSpikeSnapshot swss;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      swss = m_vswssChannels[nChannelIndex];
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return swss;
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// assertion for channel index, raises exception on assertion error
 //------------------------------------------------------------------------------
 void TSWSpikes::AssertIndex(unsigned int nChannelIndex)
 {
-   if (nChannelIndex > m_vvSpikes.size())
+   if (nChannelIndex >= m_vswssChannels.size())
       throw Exception("spike channel index exceeded");
 }
 //------------------------------------------------------------------------------
@@ -102,7 +633,7 @@ void TSWSpikes::AssertIndex(unsigned int nChannelIndex)
 //------------------------------------------------------------------------------
 unsigned int TSWSpikes::GetNumChannels()
 {
-   return (unsigned int)m_vvSpikes.size();
+   return (unsigned int)m_vswssChannels.size();
 }
 //------------------------------------------------------------------------------
 
@@ -113,11 +644,16 @@ void TSWSpikes::SetNumChannels(unsigned int nNum)
 {
    if (!IsEmpty())
       throw Exception("number of channels cannot be set if spikes are not empty!");
+   Clear();
    EnterCriticalSection(&m_cs);
    try
       {
-      Clear();
-      m_vvSpikes.resize(nNum);
+      m_vswssChannels.resize(nNum);
+      m_vswsdDetection.assign(nNum, TSWSpikeDetection());
+      m_vswsfFeatures.assign(nNum, TSWSpikeFeatures());
+      m_vpTemplates.assign(nNum, TSWSpikeTemplatesPtr());
+      m_vswshHistograms.assign(nNum, TSWSpikeHistogram());
+      m_vswsrResponses.assign(nNum, TSWSpikeResponse());
       }
    __finally
       {
@@ -152,6 +688,12 @@ void TSWSpikes::SetSampleRate(double dSampleRate, double dSampleRateDevider)
       m_nPreThreshold   = (int)(m_dPreThreshold * m_dSampleRate);
       m_nSpikeLength    = (int)(m_dSpikeLength * m_dSampleRate);
       m_nPostThreshold  = (int)(m_dPostThreshold * m_dSampleRate);
+      unsigned int n;
+      for (n = 0; n < m_vswsdDetection.size(); n++)
+         {
+         ResetDetection(n);
+         m_vpTemplates[n].reset();
+         }
       }
    __finally
       {
@@ -181,6 +723,12 @@ void TSWSpikes::SetSpikeLength(double dPreThreshold, double dPostThreshold, doub
 
       // set displayed total peak length in microseconds
       m_swspSpikePars.SetPeakLength(m_dSpikeLength * 1000000.0);
+      unsigned int n;
+      for (n = 0; n < m_vswsdDetection.size(); n++)
+         {
+         ResetDetection(n);
+         m_vpTemplates[n].reset();
+         }
       }
    __finally
       {
@@ -194,19 +742,67 @@ void TSWSpikes::SetSpikeLength(double dPreThreshold, double dPostThreshold, doub
 //------------------------------------------------------------------------------
 void TSWSpikes::Clear()
 {
-   EnterCriticalSection(&m_cs);
+   EnterCriticalSection(&m_csWrite);
    try
       {
-      unsigned int n, m;
-      for (n = 0; n < m_vvSpikes.size(); n++)
+      unsigned int n;
+      for (n = 0; n < m_vswssChannels.size(); n++)
          {
-         for (m = 0; m < m_vvSpikes[n].size(); m++)
-            {
-            TRYDELETENULL(m_vvSpikes[n][m]);
-            }
-         m_vvSpikes[n].clear();
+         m_vswsfFeatures[n].Clear();
+         ClearHistogram(n);
+         Publish(n, std::vector<TSWSpikeChunk >());
+         ResetDetection(n);
          }
       }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// clears all spikes of one channel
+//------------------------------------------------------------------------------
+void TSWSpikes::Clear(unsigned int nChannelIndex)
+{
+   AssertIndex(nChannelIndex);
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      m_vswsfFeatures[nChannelIndex].Clear();
+      ClearHistogram(nChannelIndex);
+      Publish(nChannelIndex, std::vector<TSWSpikeChunk >());
+      ResetDetection(nChannelIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// resets thresholds of scanned epoches of a channel (nothing scanned)
+//------------------------------------------------------------------------------
+void TSWSpikes::ResetDetection(unsigned int nChannelIndex)
+{
+   m_vswsdDetection[nChannelIndex] = TSWSpikeDetection();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all spikes from spike time histogram and stimulus responses of a
+/// channel
+//------------------------------------------------------------------------------
+void TSWSpikes::ClearHistogram(unsigned int nChannelIndex)
+{
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      m_vswshHistograms[nChannelIndex].Clear();
+      m_vswsrResponses[nChannelIndex].Clear();
+      }
    __finally
       {
       LeaveCriticalSection(&m_cs);
@@ -214,13 +810,217 @@ void TSWSpikes::Clear()
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// adds a spike, that was added to a group, to spike time histogram and
+/// stimulus responses of a channel. NOTE: caller must hold m_cs
+//------------------------------------------------------------------------------
+void TSWSpikes::AddGroupedSpike(unsigned int nChannelIndex, const TSWSpikeChannel& rswsc, unsigned int nIndex)
+{
+   m_vswshHistograms[nChannelIndex].Add(rswsc.m_vdSpikeTime[nIndex]);
+   m_vswsrResponses[nChannelIndex].Add(rswsc.m_vnStimIndex[nIndex], rswsc.m_vdSpikeTime[nIndex]);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes a spike, that was removed from all groups, from spike time
+/// histogram and stimulus responses of a channel. NOTE: caller must hold m_cs
+//------------------------------------------------------------------------------
+void TSWSpikes::RemoveGroupedSpike(unsigned int nChannelIndex, const TSWSpikeChannel& rswsc, unsigned int nIndex)
+{
+   m_vswshHistograms[nChannelIndex].Subtract(rswsc.m_vdSpikeTime[nIndex]);
+   m_vswsrResponses[nChannelIndex].Subtract(rswsc.m_vnStimIndex[nIndex], rswsc.m_vdSpikeTime[nIndex]);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// registers that one epoche was scanned for spikes of a channel with passed
+/// threshold. Called for every epoche added to the spikes: by Add(TSWEpoche*),
+/// by TSWSpikeRescan and by owner for spikes read from XML
+//------------------------------------------------------------------------------
+void TSWSpikes::RegisterDetection(unsigned int nChannelIndex, double dThreshold)
+{
+   AssertIndex(nChannelIndex);
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      TSWSpikeDetection& rswsd = m_vswsdDetection[nChannelIndex];
+      #pragma clang diagnostic push
+      #pragma clang diagnostic ignored "-Wfloat-equal"
+      if (!rswsd.nNumEpoches)
+         {
+         rswsd.dThreshold  = dThreshold;
+         rswsd.bUniform    = true;
+         }
+      else if (dThreshold != rswsd.dThreshold)
+         rswsd.bUniform    = false;
+      #pragma clang diagnostic pop
+      rswsd.nNumEpoches++;
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true, if at least one epoche was scanned for spikes of a channel and
+/// all scanned epoches were scanned with passed threshold, i.e. if scanning
+/// again with this threshold would not change the spikes of the channel
+//------------------------------------------------------------------------------
+bool TSWSpikes::IsDetected(unsigned int nChannelIndex, double dThreshold)
+{
+   AssertIndex(nChannelIndex);
+   bool bDetected;
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      const TSWSpikeDetection& rswsd = m_vswsdDetection[nChannelIndex];
+      #pragma clang diagnostic push
+      #pragma clang diagnostic ignored "-Wfloat-equal"
+      bDetected = rswsd.nNumEpoches && rswsd.bUniform && rswsd.dThreshold == dThreshold;
+      #pragma clang diagnostic pop
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+   return bDetected;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets templates for detecting spikes of a channel by template matching.
+/// Empty pointer (or no templates) switches back to threshold detection. The
+/// scan information of the channel is reset, so it is scanned again on next
+/// rescan.
+/// NOTE: must not be called while spikes are detected by TSWSpikeRescan
+//------------------------------------------------------------------------------
+void TSWSpikes::SetTemplates(unsigned int nChannelIndex, TSWSpikeTemplatesPtr pTemplates)
+{
+   AssertIndex(nChannelIndex);
+   if (!!pTemplates && pTemplates->GetLength() != (unsigned int)m_nSpikeLength)
+      throw Exception("template length does not match spike length");
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      if (!!pTemplates && !pTemplates->GetNumTemplates())
+         pTemplates.reset();
+      m_vpTemplates[nChannelIndex] = pTemplates;
+      ResetDetection(nChannelIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets the mean spikes of all spike groups of a channel, that contain at
+/// least SWST_MIN_SPIKES spikes, as templates of the channel (see
+/// TSWSpikeTemplates for minimum score and scale). Returns number of
+/// templates, if no group has enough spikes, threshold detection is used
+//------------------------------------------------------------------------------
+unsigned int TSWSpikes::SetGroupTemplates(unsigned int nChannelIndex, double dMinScore, double dMinScale)
+{
+   TSWSpikeSnapshot swss = GetSnapshot(nChannelIndex);
+   unsigned int nSpikeLength = (unsigned int)m_nSpikeLength;
+   // sums of spikes and number of spikes per group
+   std::vector<std::vector<double > > vvdSum;
+   std::vector<unsigned int > vnCount;
+   unsigned int n, m;
+   int nGroup;
+   for (n = 0; n < swss.GetNumSpikes(); n++)
+      {
+      nGroup = swss.GetSpikeGroup(n);
+      if (nGroup < 0)
+         continue;
+      if ((unsigned int)nGroup >= vnCount.size())
+         {
+         vvdSum.resize((unsigned int)nGroup+1, std::vector<double >(nSpikeLength, 0.0));
+         vnCount.resize((unsigned int)nGroup+1, 0);
+         }
+      const double* pdSpike = swss.GetSpike(n);
+      for (m = 0; m < nSpikeLength; m++)
+         vvdSum[(unsigned int)nGroup][m] += pdSpike[m];
+      vnCount[(unsigned int)nGroup]++;
+      }
+
+   std::shared_ptr<TSWSpikeTemplates > pTemplates(new TSWSpikeTemplates(nSpikeLength, dMinScore, dMinScale));
+   for (n = 0; n < vnCount.size(); n++)
+      {
+      if (vnCount[n] < SWST_MIN_SPIKES)
+         continue;
+      for (m = 0; m < nSpikeLength; m++)
+         vvdSum[n][m] /= (double)vnCount[n];
+      pTemplates->Add(&vvdSum[n][0]);
+      }
+   SetTemplates(nChannelIndex, pTemplates);
+   return pTemplates->GetNumTemplates();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns templates of a channel (empty pointer: threshold detection). The
+/// returned templates are immutable and stay valid, even if the templates
+/// of the channel are replaced meanwhile
+//------------------------------------------------------------------------------
+TSWSpikeTemplatesPtr TSWSpikes::GetTemplates(unsigned int nChannelIndex)
+{
+   AssertIndex(nChannelIndex);
+   TSWSpikeTemplatesPtr pTemplates;
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      pTemplates = m_vpTemplates[nChannelIndex];
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+   return pTemplates;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of templates of a channel (0: threshold detection)
+//------------------------------------------------------------------------------
+unsigned int TSWSpikes::GetNumTemplates(unsigned int nChannelIndex)
+{
+   AssertIndex(nChannelIndex);
+   unsigned int nNum = 0;
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      if (!!m_vpTemplates[nChannelIndex])
+         nNum = m_vpTemplates[nChannelIndex]->GetNumTemplates();
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
+      }
+   return nNum;
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// returns number of spikes stored for one channel
 //------------------------------------------------------------------------------
 unsigned int TSWSpikes::GetNumSpikes(unsigned int nChannelIndex)
 {
    AssertIndex(nChannelIndex);
-   return (unsigned int)m_vvSpikes[nChannelIndex].size();
+   unsigned int n;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      n = m_vswssChannels[nChannelIndex].GetNumSpikes();
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return n;
 }
 //------------------------------------------------------------------------------
 
@@ -234,9 +1034,13 @@ void TSWSpikes::SpikeGroupReset(unsigned int nChannelIndex)
    EnterCriticalSection(&m_cs);
    try
       {
+      // NOTE: groups are not versioned, they are changed in published chunks
+      std::vector<TSWSpikeChunk >& rvpChunks = m_vswssChannels[nChannelIndex].m_vpChunks;
       unsigned int n;
-      for (n = 0; n < m_vvSpikes[nChannelIndex].size(); n++)
-         m_vvSpikes[nChannelIndex][n]->m_nGroupIndex = -1;
+      for (n = 0; n < rvpChunks.size(); n++)
+         std::fill(rvpChunks[n]->m_vnGroupIndex.begin(), rvpChunks[n]->m_vnGroupIndex.end(), -1);
+      m_vswshHistograms[nChannelIndex].Clear();
+      m_vswsrResponses[nChannelIndex].Clear();
       }
    __finally
       {
@@ -261,18 +1065,53 @@ void TSWSpikes::Remove(unsigned int nEpocheIndex)
 //------------------------------------------------------------------------------
 void TSWSpikes::Remove(unsigned int nChannelIndex, unsigned int nEpocheIndex)
 {
-   if (m_vvSpikes.size() <= nChannelIndex)
+   if (m_vswssChannels.size() <= nChannelIndex)
       throw Exception("channel index error in " + UnicodeString(__FUNC__));
-   unsigned int n, nIndex;
-   unsigned int nNumSpikes = (unsigned int)m_vvSpikes[nChannelIndex].size();
-   for (n = 0; n < nNumSpikes; n++)
+   EnterCriticalSection(&m_csWrite);
+   try
       {
-      TSWSpike *psms = m_vvSpikes[nChannelIndex][nNumSpikes - n - 1];
-      if (psms->m_nEpocheIndex == nEpocheIndex)
+      // copy-on-write: chunks containing the epoche are replaced by copies
+      // without its spikes
+      std::vector<TSWSpikeChunk > vpChunks;
+      bool bChanged = false;
+      unsigned int n;
+      for (n = 0; n < m_vswssChannels[nChannelIndex].m_vpChunks.size(); n++)
          {
-         m_vvSpikes[nChannelIndex].erase(m_vvSpikes[nChannelIndex].begin() + (int)(nNumSpikes - n - 1));
-         TRYDELETENULL(psms);
+         TSWSpikeChunk pswsc = m_vswssChannels[nChannelIndex].m_vpChunks[n];
+         if (pswsc->ContainsEpoche(nEpocheIndex))
+            {
+            bChanged = true;
+            unsigned int nSpike;
+            EnterCriticalSection(&m_cs);
+            try
+               {
+               for (nSpike = 0; nSpike < pswsc->Size(); nSpike++)
+                  {
+                  if (pswsc->m_vnEpocheIndex[nSpike] != nEpocheIndex)
+                     continue;
+                  if (pswsc->m_nSpikeLength)
+                     m_vswsfFeatures[nChannelIndex].Subtract(pswsc->GetData(nSpike), 1, pswsc->m_nSpikeLength);
+                  if (pswsc->m_vnGroupIndex[nSpike] >= 0)
+                     RemoveGroupedSpike(nChannelIndex, *pswsc, nSpike);
+                  }
+               }
+            __finally
+               {
+               LeaveCriticalSection(&m_cs);
+               }
+            pswsc.reset(new TSWSpikeChannel(*pswsc));
+            pswsc->RemoveEpoche(nEpocheIndex);
+            if (!pswsc->Size())
+               continue;
+            }
+         vpChunks.push_back(pswsc);
          }
+      if (bChanged)
+         Publish(nChannelIndex, vpChunks);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
       }
 }
 //------------------------------------------------------------------------------
@@ -281,54 +1120,116 @@ void TSWSpikes::Remove(unsigned int nChannelIndex, unsigned int nEpocheIndex)
 /// adds spikes from one epoche by threshold evaluation. if a pointer to epoche
 /// audio pcm data is passed, it is used instead of passed epoches data
 //------------------------------------------------------------------------------
-void TSWSpikes::Add(TSWEpoche *pswe, vvd *pvvd)
+void TSWSpikes::Add(TSWEpoche *pswe, vvf *pvvf)
 {
-   vvd vvdData = pvvd ? *pvvd : pswe->GetData();
-   if (!vvdData.size())
+   // NOTE: passed data are used without copying
+   vvf vvfRead;
+   if (!pvvf)
+      {
+      vvfRead = pswe->GetData();
+      pvvf = &vvfRead;
+      }
+   vvf& vvfData = *pvvf;
+   if (!vvfData.size())
       return;
-   EnterCriticalSection(&m_cs);
+   // detection is done without holding any lock, the spikes of every channel
+   // are published as a new chunk
+   EnterCriticalSection(&m_csWrite);
    try
       {
-      unsigned int n, nChannel;
-      // use fix PostThreshold if set at all
-      unsigned int nPostThreshold = (unsigned int)m_nPostThreshold;
-      // otherwise use spikelength and prethreshold to calculate it
-      if (!nPostThreshold)
-         nPostThreshold =(unsigned int)( m_nSpikeLength - m_nPreThreshold);
-      unsigned int nSize = (unsigned int)vvdData[0].size();
-      unsigned int nStopLoop = nSize - (unsigned int)(m_nSpikeLength - m_nPreThreshold);
-      for (nChannel = 0; nChannel < vvdData.size(); nChannel++)
+      unsigned int nChannel;
+      unsigned int nSize = (unsigned int)vvfData[0].size();
+      for (nChannel = 0; nChannel < vvfData.size() && nChannel < m_vswssChannels.size(); nChannel++)
          {
-         // decide only once about pos or neg threshold...
-         if (pswe->m_vdThreshold[nChannel] > 0)
-            {
-            for (n = (unsigned int)m_nPreThreshold; n < nStopLoop; n++)
-               {
-               if (vvdData[nChannel][n] > pswe->m_vdThreshold[nChannel])
-                  {
-                  TSWSpike *psms = new TSWSpike(this, pswe, vvdData, n, nChannel);
-                  m_vvSpikes[nChannel].push_back(psms);
-                  n += nPostThreshold;
-                  }
-               }
-            }
-         else
-            {
-            for (n = (unsigned int)m_nPreThreshold; n < nStopLoop; n++)
-               {
-               if (vvdData[nChannel][n] < pswe->m_vdThreshold[nChannel])
-                  {
-                  TSWSpike *psms = new TSWSpike(this, pswe, vvdData, n, nChannel);
-                  m_vvSpikes[nChannel].push_back(psms);
-                  n += nPostThreshold;
-                  }
-               }
-            }
+         TSWSpikeChunk pswsc(new TSWSpikeChannel());
+         DetectChannel(pswe, &vvfData[nChannel][0], nSize, nChannel, m_vnSpikePositions, *pswsc);
+         Publish(nChannel, pswsc);
+         RegisterDetection(nChannel, pswe->m_vdThreshold[nChannel]);
          }
       }
    __finally
       {
-      LeaveCriticalSection(&m_cs);
+      LeaveCriticalSection(&m_csWrite);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// detects spikes in data of one channel of an epoche and appends new spikes
+/// to passed spike channel (by template matching, if templates are set for
+/// the channel). Passed positions vector is used as scratch buffer.
+/// NOTE: does not access stored spikes and only locks for taking a reference
+/// to the templates, so it may be called from multiple threads concurrently
+/// (with own instances), as long as spike length and sample rate are not
+/// changed
+//------------------------------------------------------------------------------
+void TSWSpikes::DetectChannel(TSWEpoche *pswe,
+                              const float* pfData,
+                              unsigned int nNumSamples,
+                              unsigned int nChannelIndex,
+                              std::vector<unsigned int >& rvnPositions,
+                              TSWSpikeChannel& rswscSpikes)
+{
+   // use fix PostThreshold if set at all
+   unsigned int nPostThreshold = (unsigned int)m_nPostThreshold;
+   // otherwise use spikelength and prethreshold to calculate it
+   if (!nPostThreshold)
+      nPostThreshold =(unsigned int)( m_nSpikeLength - m_nPreThreshold);
+   unsigned int nStopLoop = nNumSamples - (unsigned int)(m_nSpikeLength - m_nPreThreshold);
+   TSWSpikeTemplatesPtr pTemplates = GetTemplates(nChannelIndex);
+   // template matching: templates are aligned like spikes, i.e. threshold
+   // crossing is m_nPreThreshold samples behind window start
+   if (!!pTemplates)
+      pTemplates->Detect(pfData, nNumSamples, (unsigned int)m_nPreThreshold, nPostThreshold, rvnPositions);
+   else
+      {
+      // vectorized scan for threshold crossings, applies nPostThreshold as
+      // dead time after every spike
+      TSWSpikeDetector::Detect(  pfData,
+                                 (unsigned int)m_nPreThreshold,
+                                 nStopLoop,
+                                 pswe->m_vdThreshold[nChannelIndex],
+                                 nPostThreshold,
+                                 rvnPositions);
+      }
+   rswscSpikes.SetSpikeLength((unsigned int)m_nSpikeLength);
+   double dTrigT = (double)m_nPreThreshold / m_dSampleRate;
+   unsigned int n, m, nPos;
+   for (n = 0; n < rvnPositions.size(); n++)
+      {
+      nPos = rvnPositions[n];
+      double* pdData = rswscSpikes.Push(  (double)nPos / m_dSampleRate,
+                                          nPos,
+                                          pswe->m_nStimIndex,
+                                          pswe->m_nIndex,
+                                          pswe->m_nRepetitionIndex,
+                                          pswe->m_vdThreshold[nChannelIndex]);
+      // copy the pure spike data (converted to double)
+      const float* pfSpike = &pfData[nPos-(unsigned int)m_nPreThreshold];
+      for (m = 0; m < (unsigned int)m_nSpikeLength; m++)
+         pdData[m] = (double)pfSpike[m];
+      rswscSpikes.InitParams(rswscSpikes.Size()-1, m_dSampleRate, dTrigT);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// appends passed spikes to spikes of one channel (as new chunk). Passed
+/// spikes are moved, the passed instance is empty afterwards
+//------------------------------------------------------------------------------
+void TSWSpikes::AddSpikes(unsigned int nChannelIndex, TSWSpikeChannel& rswscSpikes)
+{
+   AssertIndex(nChannelIndex);
+   EnterCriticalSection(&m_csWrite);
+   try
+      {
+      TSWSpikeChunk pswsc(new TSWSpikeChannel(std::move(rswscSpikes)));
+      rswscSpikes = TSWSpikeChannel();
+      Publish(nChannelIndex, pswsc);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_csWrite);
       }
 }
 //------------------------------------------------------------------------------
@@ -338,43 +1239,51 @@ void TSWSpikes::Add(TSWEpoche *pswe, vvd *pvvd)
 //------------------------------------------------------------------------------
 void TSWSpikes::Add(_di_IXMLNode xmlSpikes)
 {
-   EnterCriticalSection(&m_cs);
+   EnterCriticalSection(&m_csWrite);
    try
       {
+      // read spikes to one new chunk per channel
+      std::vector<TSWSpikeChunk > vpChunks(m_vswssChannels.size());
+      unsigned int nChunk;
+      for (nChunk = 0; nChunk < vpChunks.size(); nChunk++)
+         {
+         vpChunks[nChunk].reset(new TSWSpikeChannel());
+         vpChunks[nChunk]->SetSpikeLength((unsigned int)m_nSpikeLength);
+         }
       AnsiString asData;
-      double d;
+      double d, dSpikeTime, dThreshold;
       int n, nSpike;
+      unsigned int nSpikePos, nStimIndex, nEpocheIndex, nRepetitionIndex, nChannelIndex;
       for (nSpike = 0; nSpike < xmlSpikes->ChildNodes->Count; nSpike++)
          {
          _di_IXMLNode xmlSpike = xmlSpikes->ChildNodes->Nodes[nSpike];
 
-         TSWSpike *psms = new TSWSpike(this);
          if (!TryStrToDouble(GetXMLValue(xmlSpike, "SpikeTime"), d))
             {
             throw Exception("invalid SpikeTime found in a spike");
             }
 
          // NOTE: values were written 1-based !!!
-         psms->m_dSpikeTime = d;
+         dSpikeTime = d;
 
          if (!TryStrToInt(GetXMLValue(xmlSpike, "SpikePosition"), n))
             throw Exception("invalid SpikePosition found in a spike");
-         psms->m_nSpikePos = (unsigned int)n-1;
+         nSpikePos = (unsigned int)n-1;
          if (!TryStrToInt(GetXMLValue(xmlSpike, "StimIndex"), n))
             throw Exception("invalid StimIndex found in a spike");
-         psms->m_nStimIndex = (unsigned int)n-1;
+         nStimIndex = (unsigned int)n-1;
          if (!TryStrToInt(GetXMLValue(xmlSpike, "EpocheIndex"), n))
             throw Exception("invalid EpocheIndex found in a spike");
-         psms->m_nEpocheIndex = (unsigned int)n-1;
+         nEpocheIndex = (unsigned int)n-1;
          if (!TryStrToInt(GetXMLValue(xmlSpike, "RepetitionIndex"), n))
             throw Exception("invalid Repetition found in a spike");
-         psms->m_nRepetitionIndex = (unsigned int)n-1;
-         if (!TryStrToInt(GetXMLValue(xmlSpike, "Channel"), n))
+         nRepetitionIndex = (unsigned int)n-1;
+         if (!TryStrToInt(GetXMLValue(xmlSpike, "Channel"), n) || n < 1 || n > (int)vpChunks.size())
             throw Exception("invalid Channel found in a spike");
-         psms->m_nChannelIndex = (unsigned int)n-1;
+         nChannelIndex = (unsigned int)n-1;
          if (!TryStrToDouble(GetXMLValue(xmlSpike, "Threshold"), d))
             throw Exception("invalid Threshold found in a spike");
-         psms->m_dThreshold = d;
+         dThreshold = d;
 
          // decode data
          asData = GetXMLValue(xmlSpike, "Data");
@@ -388,275 +1297,399 @@ void TSWSpikes::Add(_di_IXMLNode xmlSpikes)
                      ", current length: " +
                      IntToStr((int)tbData.Length)
             );
-         CopyMemory(&psms->m_vadData[0], &tbData[0], (unsigned int)m_nSpikeLength*sizeof(double));
-         psms->Init(m_dSampleRate);
-         m_vvSpikes[psms->m_nChannelIndex].push_back(psms);
+         TSWSpikeChannel& rswsc = *vpChunks[nChannelIndex];
+         double* pdData = rswsc.Push(dSpikeTime, nSpikePos, nStimIndex, nEpocheIndex, nRepetitionIndex, dThreshold);
+         CopyMemory(pdData, &tbData[0], (unsigned int)m_nSpikeLength*sizeof(double));
+         rswsc.InitParams(rswsc.Size()-1, m_dSampleRate, (double)m_nPreThreshold / m_dSampleRate);
          }
+      for (nChunk = 0; nChunk < vpChunks.size(); nChunk++)
+         Publish(nChunk, vpChunks[nChunk]);
       }
    __finally
       {
-      LeaveCriticalSection(&m_cs);
+      LeaveCriticalSection(&m_csWrite);
       }
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns a spike by channel and index
-//------------------------------------------------------------------------------
-std::valarray<double>& TSWSpikes::GetSpike(unsigned int nChannelIndex, unsigned int nIndex)
-{
-   AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_vadData;
-}
-//------------------------------------------------------------------------------
-
-//------------------------------------------------------------------------------
-/// returns a spike parameter bei channel, index and parameter type
+/// returns a spike by channel and index. NOTE: returned pointer is only valid
+/// until spikes are changed, use GetSnapshot() to keep data
 //------------------------------------------------------------------------------
-double   TSWSpikes::GetSpikeParam(unsigned int nChannelIndex, unsigned int nIndex, TSpikeParam sp)
+const double* TSWSpikes::GetSpike(unsigned int nChannelIndex, unsigned int nIndex)
 {
    AssertIndex(nChannelIndex);
+   const double* pd;
    EnterCriticalSection(&m_cs);
-   double d = 0.0;
    try
       {
-      // SP_LAST not handled by purpose
-      #pragma clang diagnostic push
-      #pragma clang diagnostic ignored "-Wswitch-enum"
-      switch (sp)
-         {
-         case SP_TOTALAMPLITUDE: d = m_vvSpikes[nChannelIndex][nIndex]->TotalAmplitude(); break;
-         case SP_PEAK1:          d = m_vvSpikes[nChannelIndex][nIndex]->Peak1(); break;
-         case SP_PEAK2:          d = m_vvSpikes[nChannelIndex][nIndex]->Peak2(); break;
-         case SP_PEAKPOS:        d = m_vvSpikes[nChannelIndex][nIndex]->PeakPos(); break;
-         case SP_PEAKNEG:        d = m_vvSpikes[nChannelIndex][nIndex]->PeakNeg(); break;
-         case SP_PEAK2PEAK:      d = m_vvSpikes[nChannelIndex][nIndex]->PeakToPeak(); break;
-         case SP_THRS2PEAK2:     d = m_vvSpikes[nChannelIndex][nIndex]->ThresholdToPeak2(); break;
-         default: throw Exception("unknown spike patrameter requested");
-         }
-      #pragma clang diagnostic pop
+      pd = m_vswssChannels[nChannelIndex].GetSpike(nIndex);
       }
    __finally
       {
       LeaveCriticalSection(&m_cs);
       }
-   return d;
+   return pd;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns spike time by channel and index
+/// returns number of samples of each spike
 //------------------------------------------------------------------------------
-double   TSWSpikes::GetSpikeTime(unsigned int nChannelIndex, unsigned int nIndex)
+unsigned int TSWSpikes::GetSpikeLength()
 {
-   AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_dSpikeTime;
+   return (unsigned int)m_nSpikeLength;
 }
 //------------------------------------------------------------------------------
 
-
 //------------------------------------------------------------------------------
-/// returns spike threshold by channel and index
+/// returns a spike parameter bei channel, index and parameter type
 //------------------------------------------------------------------------------
-double   TSWSpikes::GetThreshold(unsigned int nChannelIndex, unsigned int nIndex)
+double   TSWSpikes::GetSpikeParam(unsigned int nChannelIndex, unsigned int nIndex, TSpikeParam sp)
 {
    AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_dThreshold;
+   double d;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      d = m_vswssChannels[nChannelIndex].GetSpikeParam(nIndex, sp);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return d;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns spike position by channel and index
+/// copies one spike parameter of nCount spikes of a channel starting at spike
+/// nStart to passed buffer (must hold nCount values). Returns number of copied
+/// values, which is less than nCount, if less spikes are available
 //------------------------------------------------------------------------------
-unsigned int TSWSpikes::GetSpikePosition(unsigned int nChannelIndex, unsigned int nIndex)
+unsigned int TSWSpikes::GetSpikeParams(unsigned int nChannelIndex,
+                                       TSpikeParam sp,
+                                       double* pdValues,
+                                       unsigned int nStart,
+                                       unsigned int nCount)
 {
-   AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_nSpikePos;
+   return GetSnapshot(nChannelIndex).GetSpikeParams(sp, pdValues, nStart, nCount);
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns spike group by channel and index
+/// copies spike groups of nCount spikes of a channel starting at spike nStart
+/// to passed buffer (must hold nCount values). Returns number of copied values
 //------------------------------------------------------------------------------
-int      TSWSpikes::GetSpikeGroup(unsigned int nChannelIndex, unsigned int nIndex)
+unsigned int TSWSpikes::GetSpikeGroups(unsigned int nChannelIndex,
+                                       int* pnGroups,
+                                       unsigned int nStart,
+                                       unsigned int nCount)
 {
-   AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_nGroupIndex;
+   return GetSnapshot(nChannelIndex).GetSpikeGroups(pnGroups, nStart, nCount);
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// sets spike group by channel and index
+/// returns spike time by channel and index
 //------------------------------------------------------------------------------
-void     TSWSpikes::SetSpikeGroup(unsigned int nChannelIndex, unsigned int nIndex, int nGroup)
+double   TSWSpikes::GetSpikeTime(unsigned int nChannelIndex, unsigned int nIndex)
 {
    AssertIndex(nChannelIndex);
-   m_vvSpikes[nChannelIndex][nIndex]->m_nGroupIndex = nGroup;
+   double d;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      d = m_vswssChannels[nChannelIndex].GetSpikeTime(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return d;
 }
 //------------------------------------------------------------------------------
 
-//------------------------------------------------------------------------------
-/// returns spike stimulus index by channel and index
-//------------------------------------------------------------------------------
-unsigned int TSWSpikes::GetStimIndex(unsigned int nChannelIndex, unsigned int nIndex)
-{
-   AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_nStimIndex;
-}
-//------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns spike epoche index by channel and index
+/// returns spike threshold by channel and index
 //------------------------------------------------------------------------------
-unsigned int TSWSpikes::GetEpocheIndex(unsigned int nChannelIndex, unsigned int nIndex)
+double   TSWSpikes::GetThreshold(unsigned int nChannelIndex, unsigned int nIndex)
 {
    AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_nEpocheIndex;
+   double d;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      d = m_vswssChannels[nChannelIndex].GetThreshold(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return d;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns spike repetition index by channel and index
+/// returns spike position by channel and index
 //------------------------------------------------------------------------------
-unsigned int TSWSpikes::GetRepetitionIndex(unsigned int nChannelIndex, unsigned int nIndex)
+unsigned int TSWSpikes::GetSpikePosition(unsigned int nChannelIndex, unsigned int nIndex)
 {
    AssertIndex(nChannelIndex);
-   return m_vvSpikes[nChannelIndex][nIndex]->m_nRepetitionIndex;
+   unsigned int n;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      n = m_vswssChannels[nChannelIndex].GetSpikePosition(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return n;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// CLASS TSWSpike containing info about one spike
-//------------------------------------------------------------------------------
-
-//------------------------------------------------------------------------------
-/// constructor. Initializes members, copies passed data
+/// returns spike group by channel and index
 //------------------------------------------------------------------------------
-TSWSpike::TSWSpike(  TSWSpikes* pSpikes,
-                     TSWEpoche *pswe,
-                     vvd   &rvvdEpocheData,
-                     unsigned int nPos,
-                     unsigned int nChannelIndex)
-   : m_nGroupIndex(-1)
+int      TSWSpikes::GetSpikeGroup(unsigned int nChannelIndex, unsigned int nIndex)
 {
-   m_nStimIndex         = pswe->m_nStimIndex;
-   m_nEpocheIndex       = pswe->m_nIndex;
-   m_nRepetitionIndex   = pswe->m_nRepetitionIndex;
-   m_dThreshold      = pswe->m_vdThreshold[nChannelIndex];
-   m_nChannelIndex   = nChannelIndex;
-   m_nSpikePos       = nPos;
-   // copy the pure spike data
-   m_vadData.resize((unsigned int)pSpikes->m_nSpikeLength);
-   CopyMemory(&m_vadData[0], &rvvdEpocheData[nChannelIndex][nPos-(unsigned int)pSpikes->m_nPreThreshold], (unsigned int)pSpikes->m_nSpikeLength*sizeof(double));
-   m_dTrigT          = (double)pSpikes->m_nPreThreshold / pSpikes->m_dSampleRate;
-   m_dSpikeTime      = (double)nPos / pSpikes->m_dSampleRate;
-
-   Init(pSpikes->m_dSampleRate);
+   AssertIndex(nChannelIndex);
+   int n;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      n = m_vswssChannels[nChannelIndex].GetSpikeGroup(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return n;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// constructor creating an empty spike
+/// sets spike group by channel and index. NOTE: groups are not versioned, they
+/// are changed in the published chunks (visible in existing snapshots)
 //------------------------------------------------------------------------------
-TSWSpike::TSWSpike(TSWSpikes* pSpikes)
-   : m_nGroupIndex(-1)
+void     TSWSpikes::SetSpikeGroup(unsigned int nChannelIndex, unsigned int nIndex, int nGroup)
 {
-   m_vadData.resize((unsigned int)pSpikes->m_nSpikeLength);
-   m_dTrigT = (double)pSpikes->m_nPreThreshold / pSpikes->m_dSampleRate;
+   AssertIndex(nChannelIndex);
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      TSWSpikeChannel& rswsc = m_vswssChannels[nChannelIndex].Locate(nIndex);
+      if (rswsc.m_vnGroupIndex[nIndex] < 0 && nGroup >= 0)
+         AddGroupedSpike(nChannelIndex, rswsc, nIndex);
+      else if (rswsc.m_vnGroupIndex[nIndex] >= 0 && nGroup < 0)
+         RemoveGroupedSpike(nChannelIndex, rswsc, nIndex);
+      rswsc.m_vnGroupIndex[nIndex] = nGroup;
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// Init routine: determines spike parameters
+/// sets spike groups of nCount spikes starting at spike nStart from passed
+/// buffer (must hold nCount values). Returns number of set groups, which is
+/// less than nCount, if less spikes are available
 //------------------------------------------------------------------------------
-void TSWSpike::Init(double dSampleRate)
+unsigned int TSWSpikes::SetSpikeGroups(unsigned int nChannelIndex,
+                                       const int* pnGroups,
+                                       unsigned int nStart,
+                                       unsigned int nCount)
 {
-   // determine general spike parameters
-   m_dPeakUA = 0.0;
-   m_dPeakDA = 0.0;
-   m_dPeakUT = 0.0;
-   m_dPeakDT = 0.0;
-   unsigned int n;
-   double d;
-   for (n = 0; n < m_vadData.size(); n++)
+   AssertIndex(nChannelIndex);
+   EnterCriticalSection(&m_cs);
+   try
       {
-      d = m_vadData[n];
-      if (d > m_dPeakUA)
-         {
-         m_dPeakUA = d;
-         m_dPeakUT = (double)n / dSampleRate;
-         }
-      else if (m_vadData[n] < m_dPeakDA)
+      TSWSpikeSnapshot& rswss = m_vswssChannels[nChannelIndex];
+      if (nStart >= rswss.GetNumSpikes())
+         nCount = 0;
+      else if (nCount > rswss.GetNumSpikes() - nStart)
+         nCount = rswss.GetNumSpikes() - nStart;
+      unsigned int nCopied = 0;
+      unsigned int nIndex = nStart;
+      unsigned int n;
+      while (nCopied < nCount)
          {
-         m_dPeakDA = d;
-         m_dPeakDT = (double)n / dSampleRate;
+         TSWSpikeChannel& rswsc = rswss.Locate(nIndex);
+         unsigned int nNum = rswsc.Size() - nIndex;
+         if (nNum > nCount - nCopied)
+            nNum = nCount - nCopied;
+         // update histogram and responses for spikes added to or removed
+         // from all groups
+         const int* pnOld = &rswsc.m_vnGroupIndex[nIndex];
+         const int* pnNew = pnGroups + nCopied;
+         for (n = 0; n < nNum; n++)
+            {
+            if (pnOld[n] < 0 && pnNew[n] >= 0)
+               AddGroupedSpike(nChannelIndex, rswsc, nIndex + n);
+            else if (pnOld[n] >= 0 && pnNew[n] < 0)
+               RemoveGroupedSpike(nChannelIndex, rswsc, nIndex + n);
+            }
+         CopyMemory(&rswsc.m_vnGroupIndex[nIndex], pnGroups + nCopied, nNum*sizeof(int));
+         nCopied += nNum;
+         nIndex = nStart + nCopied;
          }
       }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return nCount;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns total amplitude of spike
-//------------------------------------------------------------------------------
-double   TSWSpike::TotalAmplitude()
-{
-   return fabs(m_dPeakUA) + fabs(m_dPeakDA);
-}
-//------------------------------------------------------------------------------
-
-//------------------------------------------------------------------------------
-/// returns amplitude of the 1st component (phase).
+/// writes histogram of spike times of all grouped spikes of a channel with
+/// nNumBins bins of width dBinSize (seconds) to rvnBins (see
+/// TSWSpikeHistogram::GetBins). Returns number of grouped spikes. Costs do not
+/// depend on the number of spikes
 //------------------------------------------------------------------------------
-double   TSWSpike::Peak1()
+unsigned int TSWSpikes::GetHistogram(unsigned int nChannelIndex,
+                                     double dBinSize,
+                                     unsigned int nNumBins,
+                                     std::vector<unsigned int >& rvnBins)
 {
-   return m_dPeakUT < m_dPeakDT ? m_dPeakUA : m_dPeakDA;
+   AssertIndex(nChannelIndex);
+   unsigned int nNum;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      m_vswshHistograms[nChannelIndex].GetBins(dBinSize, nNumBins, rvnBins);
+      nNum = m_vswshHistograms[nChannelIndex].GetNumSpikes();
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return nNum;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns amplitude of the 2nd component (phase).
+/// sets PSTH windows and stimulus frequencies for the stimulus responses of
+/// all channels (see GetResponse). If they changed, the responses are rebuilt from all grouped
+/// spikes (once per change) and true is returned
 //------------------------------------------------------------------------------
-double   TSWSpike::Peak2()
+bool TSWSpikes::SetResponseSettings(const TSWResponseSettings& rswrs)
 {
-   return m_dPeakUT > m_dPeakDT ? m_dPeakUA : m_dPeakDA;
+   bool bChanged = false;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      unsigned int nChannel, nChunk, n;
+      for (nChannel = 0; nChannel < m_vswsrResponses.size(); nChannel++)
+         {
+         TSWSpikeResponse& rswsr = m_vswsrResponses[nChannel];
+         if (rswsr.GetSettings().IsEqual(rswrs))
+            continue;
+         bChanged = true;
+         rswsr.SetSettings(rswrs);
+         const std::vector<TSWSpikeChunk >& rvpChunks = m_vswssChannels[nChannel].m_vpChunks;
+         for (nChunk = 0; nChunk < rvpChunks.size(); nChunk++)
+            {
+            const TSWSpikeChannel& rswsc = *rvpChunks[nChunk];
+            for (n = 0; n < rswsc.m_vnGroupIndex.size(); n++)
+               {
+               if (rswsc.m_vnGroupIndex[n] >= 0)
+                  rswsr.Add(rswsc.m_vnStimIndex[n], rswsc.m_vdSpikeTime[n]);
+               }
+            }
+         }
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return bChanged;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns amplitude of positive peak
+/// writes spike counts and spike phases of all stimuli of a channel (with
+/// settings passed to SetResponseSettings) to rvswsr. Costs do not depend on
+/// the number of spikes
 //------------------------------------------------------------------------------
-double   TSWSpike::PeakPos()
+void TSWSpikes::GetResponse(unsigned int nChannelIndex, std::vector<TSWStimulusResponse >& rvswsr)
 {
-   return m_dPeakUA;
+   AssertIndex(nChannelIndex);
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      rvswsr = m_vswsrResponses[nChannelIndex].GetStimuli();
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// returns amplitude of negative peak
+/// returns spike stimulus index by channel and index
 //------------------------------------------------------------------------------
-double   TSWSpike::PeakNeg()
+unsigned int TSWSpikes::GetStimIndex(unsigned int nChannelIndex, unsigned int nIndex)
 {
-   return m_dPeakDA;
+   AssertIndex(nChannelIndex);
+   unsigned int n;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      n = m_vswssChannels[nChannelIndex].GetStimIndex(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return n;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// peak to peak time in microseconds
+/// returns spike epoche index by channel and index
 //------------------------------------------------------------------------------
-double   TSWSpike::PeakToPeak()
+unsigned int TSWSpikes::GetEpocheIndex(unsigned int nChannelIndex, unsigned int nIndex)
 {
-   return fabs(m_dPeakUT - m_dPeakDT)*1000000.0;
+   AssertIndex(nChannelIndex);
+   unsigned int n;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      n = m_vswssChannels[nChannelIndex].GetEpocheIndex(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return n;
 }
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// peak to threshold to peak 2 time in microseconds
+/// returns spike repetition index by channel and index
 //------------------------------------------------------------------------------
-double   TSWSpike::ThresholdToPeak2()
+unsigned int TSWSpikes::GetRepetitionIndex(unsigned int nChannelIndex, unsigned int nIndex)
 {
-   double d = m_dPeakUT > m_dPeakDT ? fabs(m_dPeakUT - m_dTrigT) : fabs(m_dPeakDT - m_dTrigT);
-
-   return d*1000000.0;
+   AssertIndex(nChannelIndex);
+   unsigned int n;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      n = m_vswssChannels[nChannelIndex].GetRepetitionIndex(nIndex);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return n;
 }
 //------------------------------------------------------------------------------
 
@@ -2,7 +2,8 @@
 /// \file SWSpike.h
 ///
 /// \author Berg
-/// \brief Implementation of classes TSWSpike and TSWSpikes to store spike data
+/// \brief Implementation of classes TSWSpikeChannel and TSWSpikes to store spike
+/// data
 ///
 /// Project AudioSpike
 /// Module  AudioSpike.exe
@@ -38,27 +39,163 @@
 #include <XMLIntf.hpp>
 #include <vector>
 #include <valarray>
+#include <limits.h>
+#include <memory>
 #include "SWSpikeParameters.h"
 #include "SWStimParameters.h"
 #include "SWTools.h"
+#include "SWSpikeDetector.h"
+#include "SWSpikeFeatures.h"
+#include "SWSpikeTemplates.h"
+#include "SWSpikeHistogram.h"
+#include "SWSpikeResponse.h"
 
 //------------------------------------------------------------------------------
 
-class TSWSpike;
 class TSWEpoche;
+//------------------------------------------------------------------------------
+/// class storing spikes of one channel column-wise (structure of arrays):
+/// one contiguous array per spike property and one contiguous matrix holding
+/// the data of all spikes (one row of m_nSpikeLength values per spike).
+/// Spike parameters (TSpikeParam) are computed once, when a spike is added,
+/// and stored as columns as well (except principal components, which depend
+/// on all spikes of the channel, see TSWSpikeFeatures). NOTE: data of a spike are never changed
+/// after InitParams was called, so parameters never have to be recomputed.
+/// TSWSpikes stores the spikes of a channel as a list of published instances
+/// ('chunks'), that are never changed afterwards (except the spike groups)
+//------------------------------------------------------------------------------
+class TSWSpikeChannel
+{
+   friend class TSWSpikes;
+   friend class TSWSpikeSnapshot;
+   private:
+      unsigned int               m_nSpikeLength;
+      std::vector<double >       m_vdSpikeTime;
+      std::vector<unsigned int > m_vnSpikePos;
+      std::vector<unsigned int > m_vnStimIndex;
+      std::vector<unsigned int > m_vnEpocheIndex;
+      std::vector<unsigned int > m_vnRepetitionIndex;
+      std::vector<int >          m_vnGroupIndex;
+      std::vector<double >       m_vdThreshold;
+      std::vector<std::vector<double > > m_vvdParams;
+      std::vector<double >       m_vdData;
+   public:
+      TSWSpikeChannel();
+      unsigned int   Size();
+      void           Clear();
+      void           SetSpikeLength(unsigned int nSpikeLength);
+      double*        Push( double dSpikeTime,
+                           unsigned int nSpikePos,
+                           unsigned int nStimIndex,
+                           unsigned int nEpocheIndex,
+                           unsigned int nRepetitionIndex,
+                           double dThreshold);
+      void           InitParams(unsigned int nIndex, double dSampleRate, double dTrigT);
+      void           Append(const TSWSpikeChannel& rswsc);
+      bool           ContainsEpoche(unsigned int nEpocheIndex);
+      void           RemoveEpoche(unsigned int nEpocheIndex);
+      const double*  GetData(unsigned int nIndex);
+};
+//------------------------------------------------------------------------------
+
+/// published chunk of spikes of one channel
+typedef std::shared_ptr<TSWSpikeChannel > TSWSpikeChunk;
+
+//------------------------------------------------------------------------------
+/// consistent, versioned view to the spikes of one channel. A snapshot holds
+/// references to the published chunks of the channel, so it stays valid and
+/// unchanged while new spikes are added (or removed) and can be read without
+/// any locking. Principal components (SP_PC1 ...) are projections to the
+/// components that were current when the snapshot was taken.
+/// NOTE: spike groups are not versioned
+//------------------------------------------------------------------------------
+class TSWSpikeSnapshot
+{
+   friend class TSWSpikes;
+   private:
+      std::vector<TSWSpikeChunk >   m_vpChunks;
+      std::vector<unsigned int >    m_vnChunkStart;
+      unsigned int                  m_nNumSpikes;
+      unsigned int                  m_nVersion;
+      TSWSpikeBasisPtr              m_pBasis;
+      void                          UpdateIndex();
+      TSWSpikeChannel&              Locate(unsigned int &rnIndex);
+   public:
+      TSWSpikeSnapshot();
+      unsigned int   GetNumSpikes();
+      unsigned int   GetVersion();
+      double         GetSpikeParam(unsigned int nIndex, TSpikeParam sp);
+      unsigned int   GetSpikeParams(TSpikeParam sp,
+                                    double* pdValues,
+                                    unsigned int nStart = 0,
+                                    unsigned int nCount = UINT_MAX);
+      unsigned int   GetSpikeGroups(int* pnGroups,
+                                    unsigned int nStart = 0,
+                                    unsigned int nCount = UINT_MAX);
+      double         GetSpikeTime(unsigned int nIndex);
+      double         GetThreshold(unsigned int nIndex);
+      unsigned int   GetSpikePosition(unsigned int nIndex);
+      int            GetSpikeGroup(unsigned int nIndex);
+      unsigned int   GetStimIndex(unsigned int nIndex);
+      unsigned int   GetEpocheIndex(unsigned int nIndex);
+      unsigned int   GetRepetitionIndex(unsigned int nIndex);
+      const double*  GetSpike(unsigned int nIndex);
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// thresholds that produced the spikes of one channel
+//------------------------------------------------------------------------------
+struct TSWSpikeDetection
+{
+   /// number of epoches scanned
+   unsigned int   nNumEpoches;
+   /// threshold of first epoche scanned
+   double         dThreshold;
+   /// all epoches were scanned with dThreshold
+   bool           bUniform;
+};
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// class for storing multiple multiple spikes with identical
-/// parameters
+/// parameters. New spikes are published as immutable chunks (and trailing
+/// chunks are merged to keep their number logarithmic), readers (plotting)
+/// should use GetSnapshot() and read from the snapshot without locking.
+/// For every channel the thresholds of the scanned epoches are tracked (see
+/// IsDetected), so after changing thresholds only affected channels have to
+/// be scanned again. Spike length and samplerate cannot be changed while
+/// spikes are stored, changing them resets this information (and removes
+/// templates). If templates are set for a channel (see SetTemplates),
+/// spikes of the channel are detected by template matching instead of
+/// threshold crossing. A histogram of the spike times of all grouped spikes
+/// (group >= 0) and the spike counts and spike phases of all stimuli (see
+/// GetResponse) are maintained for every channel.
+/// NOTE: all functions changing spikes must be called from one thread at a
+/// time
 //------------------------------------------------------------------------------
 class TSWSpikes
 {
-   friend class TSWSpike;
    private:
       CRITICAL_SECTION        m_cs;
+      CRITICAL_SECTION        m_csWrite;
       int                     m_nPreThreshold;
       double                  m_dSampleRate;
       bool                    m_bInitialized;
+      std::vector<unsigned int > m_vnSpikePositions;
+      std::vector<TSWSpikeSnapshot > m_vswssChannels;
+      std::vector<TSWSpikeDetection > m_vswsdDetection;
+      std::vector<TSWSpikeFeatures > m_vswsfFeatures;
+      std::vector<TSWSpikeTemplatesPtr > m_vpTemplates;
+      std::vector<TSWSpikeHistogram > m_vswshHistograms;
+      std::vector<TSWSpikeResponse > m_vswsrResponses;
       bool                    IsEmpty();
+      void                    ResetDetection(unsigned int nChannelIndex);
+      void                    ClearHistogram(unsigned int nChannelIndex);
+      void                    AddGroupedSpike(unsigned int nChannelIndex, const TSWSpikeChannel& rswsc, unsigned int nIndex);
+      void                    RemoveGroupedSpike(unsigned int nChannelIndex, const TSWSpikeChannel& rswsc, unsigned int nIndex);
+      void                    Publish(unsigned int nChannelIndex, TSWSpikeChunk pswsc);
+      void                    Publish(unsigned int nChannelIndex, const std::vector<TSWSpikeChunk >& rvpChunks);
    public:
       TSWSpikes();
       ~TSWSpikes();
@@ -70,8 +207,8 @@ class TSWSpikes
       int                     m_nPostThreshold;
       double                  m_dSampleRateDevider;
       void                    AssertIndex(unsigned int nChannelIndex);
-      std::vector<std::vector<TSWSpike* > > m_vvSpikes;
       void     Clear();
+      void     Clear(unsigned int nChannelIndex);
       double   GetSampleRate();
       void     SetSampleRate(double dSampleRate, double dSampleRateDevider);
       void     SetSpikeLength(double dPreThreshold, double dPostThreshold, double dSpikeLength);
@@ -81,10 +218,33 @@ class TSWSpikes
 
       void     Remove(unsigned int nEpocheIndex);
       void     Remove(unsigned int nChannelIndex, unsigned int nEpocheIndex);
-      void     Add(TSWEpoche *pswe, vvd *pvvd = NULL);
+      void     Add(TSWEpoche *pswe, vvf *pvvf = NULL);
       void     Add(_di_IXMLNode xmlSpikes);
+      void     AddSpikes(unsigned int nChannelIndex, TSWSpikeChannel& rswscSpikes);
+      void     DetectChannel( TSWEpoche *pswe,
+                              const float* pfData,
+                              unsigned int nNumSamples,
+                              unsigned int nChannelIndex,
+                              std::vector<unsigned int >& rvnPositions,
+                              TSWSpikeChannel& rswscSpikes);
+      void     RegisterDetection(unsigned int nChannelIndex, double dThreshold);
+      void     SetTemplates(unsigned int nChannelIndex, TSWSpikeTemplatesPtr pTemplates);
+      unsigned int SetGroupTemplates(unsigned int nChannelIndex, double dMinScore, double dMinScale);
+      unsigned int GetNumTemplates(unsigned int nChannelIndex);
+      TSWSpikeTemplatesPtr GetTemplates(unsigned int nChannelIndex);
+      bool     IsDetected(unsigned int nChannelIndex, double dThreshold);
+      TSWSpikeSnapshot GetSnapshot(unsigned int nChannelIndex);
       unsigned int GetNumSpikes(unsigned int nChannelIndex);
       double   GetSpikeParam(unsigned int nChannelIndex, unsigned int nIndex, TSpikeParam sp);
+      unsigned int GetSpikeParams(  unsigned int nChannelIndex,
+                                    TSpikeParam sp,
+                                    double* pdValues,
+                                    unsigned int nStart = 0,
+                                    unsigned int nCount = UINT_MAX);
+      unsigned int GetSpikeGroups(  unsigned int nChannelIndex,
+                                    int* pnGroups,
+                                    unsigned int nStart = 0,
+                                    unsigned int nCount = UINT_MAX);
       double   GetSpikeTime(unsigned int nChannelIndex, unsigned int nIndex);
       double   GetThreshold(unsigned int nChannelIndex, unsigned int nIndex);
       unsigned int GetSpikePosition(unsigned int nChannelIndex, unsigned int nIndex);
@@ -93,49 +253,19 @@ class TSWSpikes
       unsigned int GetEpocheIndex(unsigned int nChannelIndex, unsigned int nIndex);
       unsigned int GetRepetitionIndex(unsigned int nChannelIndex, unsigned int nIndex);
       void     SetSpikeGroup(unsigned int nChannelIndex, unsigned int nIndex, int nGroup);
+      unsigned int SetSpikeGroups(  unsigned int nChannelIndex,
+                                    const int* pnGroups,
+                                    unsigned int nStart = 0,
+                                    unsigned int nCount = UINT_MAX);
+      unsigned int GetHistogram(unsigned int nChannelIndex,
+                                double dBinSize,
+                                unsigned int nNumBins,
+                                std::vector<unsigned int >& rvnBins);
+      bool     SetResponseSettings(const TSWResponseSettings& rswrs);
+      void     GetResponse(unsigned int nChannelIndex, std::vector<TSWStimulusResponse >& rvswsr);
       void     SpikeGroupReset(unsigned int nChannelIndex);
-      std::valarray<double>& GetSpike(unsigned int nChannelIndex, unsigned int nIndex);
-};
-//------------------------------------------------------------------------------
-
-//------------------------------------------------------------------------------
-/// class for storing properties of one spike
-//------------------------------------------------------------------------------
-class TSWSpike
-{
-   friend class TSWSpikes;
-   public:
-      TSWSpike(TSWSpikes* pSpikes,
-               TSWEpoche *pswe,
-               vvd   &rvvdEpocheData,
-               unsigned int nPos,
-               unsigned int nChannelIndex
-               );
-      TSWSpike(TSWSpikes* pSpikes);
-   private:
-      int      m_nGroupIndex;
-      double   m_dThreshold;
-      double   m_dPeakUA;
-      double   m_dPeakDA;
-      double   m_dPeakUT;
-      double   m_dPeakDT;
-      double   m_dTrigT;
-      double   m_dSpikeTime;
-      unsigned int  m_nSpikePos;
-      unsigned int   m_nStimIndex;
-      unsigned int   m_nEpocheIndex;
-      unsigned int   m_nRepetitionIndex;
-      unsigned int   m_nChannelIndex;
-      std::valarray<double >  m_vadData;
-      void     Init(double dSampleRate);
-   public:
-      double   TotalAmplitude();
-      double   Peak1();
-      double   Peak2();
-      double   PeakPos();
-      double   PeakNeg();
-      double   PeakToPeak();
-      double   ThresholdToPeak2();
+      const double* GetSpike(unsigned int nChannelIndex, unsigned int nIndex);
+      unsigned int GetSpikeLength();
 };
 //------------------------------------------------------------------------------
 
@@ -0,0 +1,583 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeCluster.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeCluster: automatic clustering of spikes
+/// by k-means++ or gaussian mixture models on a pool of worker threads
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeCluster.h"
+#include "SWTools.h"
+#include <algorithm>
+#include <math.h>
+#include <float.h>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+//------------------------------------------------------------------------------
+/// CLASS TSWClusterFit
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. NOTE: passed data are referenced, not copied
+//------------------------------------------------------------------------------
+TSWClusterFit::TSWClusterFit( const std::vector<double >& rvdData,
+                              unsigned int nDim,
+                              unsigned int nSeed,
+                              const std::atomic<bool>* pbCancel)
+   : m_rvdData(rvdData), m_nNum(0), m_nDim(nDim), m_rng(nSeed), m_pbCancel(pbCancel)
+{
+   if (!m_nDim)
+      throw Exception("no features passed for clustering");
+   m_nNum = (unsigned int)(m_rvdData.size() / m_nDim);
+   m_vdDist.resize(m_nNum);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if cancel flag is set
+//------------------------------------------------------------------------------
+bool TSWClusterFit::Cancelled()
+{
+   return m_pbCancel && *m_pbCancel;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns uniform random number in [0, 1). NOTE: std distributions are not
+/// used, because their results are implementation defined
+//------------------------------------------------------------------------------
+double TSWClusterFit::Random()
+{
+   return (double)(m_rng() >> 5) / 134217728.0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns squared euclidean distance of two rows
+//------------------------------------------------------------------------------
+double TSWClusterFit::Distance(const double* pd1, const double* pd2)
+{
+   double d = 0.0;
+   unsigned int n;
+   for (n = 0; n < m_nDim; n++)
+      d += (pd1[n] - pd2[n]) * (pd1[n] - pd2[n]);
+   return d;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// k-means++ seeding: first center is a random row, every further center is
+/// a row chosen with probability proportional to its squared distance to the
+/// nearest center chosen so far
+//------------------------------------------------------------------------------
+void TSWClusterFit::Seed(unsigned int nClusters, std::vector<double >& rvdCenters)
+{
+   rvdCenters.resize(nClusters * m_nDim);
+   const double* pdData = &m_rvdData[0];
+   unsigned int nRow = (unsigned int)(Random() * m_nNum);
+   std::copy(pdData + nRow*m_nDim, pdData + (nRow+1)*m_nDim, rvdCenters.begin());
+   unsigned int n, nCluster;
+   double dSum = 0.0;
+   for (n = 0; n < m_nNum; n++)
+      {
+      m_vdDist[n] = Distance(pdData + n*m_nDim, &rvdCenters[0]);
+      dSum += m_vdDist[n];
+      }
+   for (nCluster = 1; nCluster < nClusters; nCluster++)
+      {
+      double dTarget = Random() * dSum;
+      nRow = m_nNum - 1;
+      for (n = 0; n < m_nNum; n++)
+         {
+         dTarget -= m_vdDist[n];
+         if (dTarget < 0.0)
+            {
+            nRow = n;
+            break;
+            }
+         }
+      double* pdCenter = &rvdCenters[nCluster * m_nDim];
+      std::copy(pdData + nRow*m_nDim, pdData + (nRow+1)*m_nDim, pdCenter);
+      dSum = 0.0;
+      for (n = 0; n < m_nNum; n++)
+         {
+         m_vdDist[n] = std::min(m_vdDist[n], Distance(pdData + n*m_nDim, pdCenter));
+         dSum += m_vdDist[n];
+         }
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// Lloyd iterations starting with passed centers until labels do not change
+/// any more. Empty clusters are moved to the row farthest from its center.
+/// Returns sum of squared distances of rows to their centers
+//------------------------------------------------------------------------------
+double TSWClusterFit::Lloyd(  unsigned int nClusters,
+                              std::vector<double >& rvdCenters,
+                              std::vector<int >& rvnLabels)
+{
+   const double* pdData = &m_rvdData[0];
+   rvnLabels.assign(m_nNum, -1);
+   std::vector<unsigned int > vnCount(nClusters);
+   double dSSE = 0.0;
+   unsigned int nIteration, n, m, nCluster;
+   for (nIteration = 0; nIteration < SWSC_MAX_ITERATIONS && !Cancelled(); nIteration++)
+      {
+      bool bChanged = false;
+      dSSE = 0.0;
+      for (n = 0; n < m_nNum; n++)
+         {
+         const double* pdRow = pdData + n*m_nDim;
+         int nBest = 0;
+         double dBest = DBL_MAX;
+         for (nCluster = 0; nCluster < nClusters; nCluster++)
+            {
+            double d = Distance(pdRow, &rvdCenters[nCluster * m_nDim]);
+            if (d < dBest)
+               {
+               dBest = d;
+               nBest = (int)nCluster;
+               }
+            }
+         if (rvnLabels[n] != nBest)
+            {
+            rvnLabels[n] = nBest;
+            bChanged = true;
+            }
+         m_vdDist[n] = dBest;
+         dSSE += dBest;
+         }
+      if (!bChanged)
+         break;
+      std::fill(rvdCenters.begin(), rvdCenters.end(), 0.0);
+      std::fill(vnCount.begin(), vnCount.end(), 0);
+      for (n = 0; n < m_nNum; n++)
+         {
+         double* pdCenter = &rvdCenters[(unsigned int)rvnLabels[n] * m_nDim];
+         for (m = 0; m < m_nDim; m++)
+            pdCenter[m] += pdData[n*m_nDim + m];
+         vnCount[(unsigned int)rvnLabels[n]]++;
+         }
+      for (nCluster = 0; nCluster < nClusters; nCluster++)
+         {
+         double* pdCenter = &rvdCenters[nCluster * m_nDim];
+         if (vnCount[nCluster])
+            {
+            for (m = 0; m < m_nDim; m++)
+               pdCenter[m] /= (double)vnCount[nCluster];
+            }
+         else
+            {
+            unsigned int nFar = (unsigned int)(std::max_element(m_vdDist.begin(), m_vdDist.end()) - m_vdDist.begin());
+            std::copy(pdData + nFar*m_nDim, pdData + (nFar+1)*m_nDim, pdCenter);
+            m_vdDist[nFar] = 0.0;
+            }
+         }
+      }
+   return dSSE;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// k-means clustering with k-means++ seeding (best of SWSC_KMEANS_RUNS runs)
+//------------------------------------------------------------------------------
+double TSWClusterFit::KMeans(unsigned int nClusters, std::vector<int >& rvnLabels)
+{
+   if (nClusters < 1 || nClusters > m_nNum)
+      throw Exception("invalid number of clusters");
+   std::vector<double > vdCenters;
+   std::vector<int > vnLabels;
+   double dBestSSE = DBL_MAX;
+   unsigned int nRun, n;
+   for (nRun = 0; nRun < SWSC_KMEANS_RUNS; nRun++)
+      {
+      Seed(nClusters, vdCenters);
+      double dSSE = Lloyd(nClusters, vdCenters, vnLabels);
+      if (Cancelled())
+         return DBL_MAX;
+      if (dSSE < dBestSSE)
+         {
+         dBestSSE = dSSE;
+         rvnLabels.swap(vnLabels);
+         }
+      // with one cluster all runs are identical
+      if (nClusters == 1)
+         break;
+      }
+
+   // likelihood of the hard assignment with diagonal variances per cluster:
+   // spherical variances would favour splitting clusters, that are elongated
+   // in standardized feature space
+   const double* pdData = &m_rvdData[0];
+   std::vector<unsigned int > vnCount(nClusters, 0);
+   std::vector<double > vdMean(nClusters * m_nDim, 0.0);
+   std::vector<double > vdVar(nClusters * m_nDim, 0.0);
+   unsigned int m, nCluster;
+   for (n = 0; n < m_nNum; n++)
+      {
+      nCluster = (unsigned int)rvnLabels[n];
+      vnCount[nCluster]++;
+      for (m = 0; m < m_nDim; m++)
+         vdMean[nCluster*m_nDim + m] += pdData[n*m_nDim + m];
+      }
+   for (nCluster = 0; nCluster < nClusters; nCluster++)
+      {
+      for (m = 0; m < m_nDim && vnCount[nCluster]; m++)
+         vdMean[nCluster*m_nDim + m] /= (double)vnCount[nCluster];
+      }
+   for (n = 0; n < m_nNum; n++)
+      {
+      nCluster = (unsigned int)rvnLabels[n];
+      for (m = 0; m < m_nDim; m++)
+         {
+         double d = pdData[n*m_nDim + m] - vdMean[nCluster*m_nDim + m];
+         vdVar[nCluster*m_nDim + m] += d * d;
+         }
+      }
+   double dNum = (double)m_nNum;
+   double dLogL = 0.0;
+   for (nCluster = 0; nCluster < nClusters; nCluster++)
+      {
+      if (!vnCount[nCluster])
+         continue;
+      double dCount = (double)vnCount[nCluster];
+      dLogL += dCount * log(dCount / dNum) - 0.5 * dCount * (double)m_nDim;
+      for (m = 0; m < m_nDim; m++)
+         {
+         double dVar = std::max(vdVar[nCluster*m_nDim + m] / dCount, SWSC_MIN_VARIANCE);
+         dLogL -= 0.5 * dCount * log(2.0 * M_PI * dVar);
+         }
+      }
+   double dParams = (double)(nClusters * 2 * m_nDim + nClusters - 1);
+   return -2.0 * dLogL + dParams * log(dNum);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// gaussian mixture with diagonal covariances, initialized by k-means and
+/// fitted by expectation maximization. Rows are labeled with the cluster of
+/// highest responsibility
+//------------------------------------------------------------------------------
+double TSWClusterFit::GMM(unsigned int nClusters, std::vector<int >& rvnLabels)
+{
+   KMeans(nClusters, rvnLabels);
+   if (Cancelled())
+      return DBL_MAX;
+   const double* pdData = &m_rvdData[0];
+   unsigned int nDim = m_nDim;
+   std::vector<double > vdWeight(nClusters, 0.0);
+   std::vector<double > vdMean(nClusters * nDim, 0.0);
+   std::vector<double > vdVar(nClusters * nDim, 0.0);
+   std::vector<double > vdResp(m_nNum * nClusters, 0.0);
+   std::vector<double > vdLogNorm(nClusters);
+   unsigned int n, m, nCluster, nIteration;
+
+   // start with hard assignment of k-means
+   for (n = 0; n < m_nNum; n++)
+      vdResp[n * nClusters + (unsigned int)rvnLabels[n]] = 1.0;
+
+   double dLogL = -DBL_MAX;
+   for (nIteration = 0; nIteration < SWSC_MAX_ITERATIONS; nIteration++)
+      {
+      if (Cancelled())
+         return DBL_MAX;
+      // M-step
+      std::fill(vdWeight.begin(), vdWeight.end(), 0.0);
+      std::fill(vdMean.begin(), vdMean.end(), 0.0);
+      std::fill(vdVar.begin(), vdVar.end(), 0.0);
+      for (n = 0; n < m_nNum; n++)
+         {
+         const double* pdRow = pdData + n*nDim;
+         for (nCluster = 0; nCluster < nClusters; nCluster++)
+            {
+            double dResp = vdResp[n * nClusters + nCluster];
+            vdWeight[nCluster] += dResp;
+            for (m = 0; m < nDim; m++)
+               vdMean[nCluster*nDim + m] += dResp * pdRow[m];
+            }
+         }
+      for (nCluster = 0; nCluster < nClusters; nCluster++)
+         {
+         double dNorm = vdWeight[nCluster] > DBL_MIN ? 1.0 / vdWeight[nCluster] : 0.0;
+         for (m = 0; m < nDim; m++)
+            vdMean[nCluster*nDim + m] *= dNorm;
+         }
+      for (n = 0; n < m_nNum; n++)
+         {
+         const double* pdRow = pdData + n*nDim;
+         for (nCluster = 0; nCluster < nClusters; nCluster++)
+            {
+            double dResp = vdResp[n * nClusters + nCluster];
+            for (m = 0; m < nDim; m++)
+               {
+               double d = pdRow[m] - vdMean[nCluster*nDim + m];
+               vdVar[nCluster*nDim + m] += dResp * d * d;
+               }
+            }
+         }
+      for (nCluster = 0; nCluster < nClusters; nCluster++)
+         {
+         double dNorm = vdWeight[nCluster] > DBL_MIN ? 1.0 / vdWeight[nCluster] : 0.0;
+         vdLogNorm[nCluster] = vdWeight[nCluster] > DBL_MIN ? log(vdWeight[nCluster] / (double)m_nNum) : -DBL_MAX;
+         for (m = 0; m < nDim; m++)
+            {
+            double& rdVar = vdVar[nCluster*nDim + m];
+            rdVar = std::max(rdVar * dNorm, SWSC_MIN_VARIANCE);
+            vdLogNorm[nCluster] -= 0.5 * log(2.0 * M_PI * rdVar);
+            }
+         }
+
+      // E-step
+      double dLogLNew = 0.0;
+      for (n = 0; n < m_nNum; n++)
+         {
+         const double* pdRow = pdData + n*nDim;
+         double* pdResp = &vdResp[n * nClusters];
+         double dMax = -DBL_MAX;
+         for (nCluster = 0; nCluster < nClusters; nCluster++)
+            {
+            double d = vdLogNorm[nCluster];
+            if (d > -DBL_MAX)
+               {
+               for (m = 0; m < nDim; m++)
+                  {
+                  double dDiff = pdRow[m] - vdMean[nCluster*nDim + m];
+                  d -= 0.5 * dDiff * dDiff / vdVar[nCluster*nDim + m];
+                  }
+               }
+            pdResp[nCluster] = d;
+            dMax = std::max(dMax, d);
+            }
+         double dSum = 0.0;
+         for (nCluster = 0; nCluster < nClusters; nCluster++)
+            {
+            pdResp[nCluster] = pdResp[nCluster] > -DBL_MAX ? exp(pdResp[nCluster] - dMax) : 0.0;
+            dSum += pdResp[nCluster];
+            }
+         for (nCluster = 0; nCluster < nClusters; nCluster++)
+            pdResp[nCluster] /= dSum;
+         dLogLNew += dMax + log(dSum);
+         }
+      bool bConverged = dLogLNew - dLogL < SWSC_EM_TOLERANCE * (double)m_nNum;
+      dLogL = dLogLNew;
+      if (bConverged)
+         break;
+      }
+
+   for (n = 0; n < m_nNum; n++)
+      {
+      const double* pdResp = &vdResp[n * nClusters];
+      rvnLabels[n] = (int)(std::max_element(pdResp, pdResp + nClusters) - pdResp);
+      }
+   double dParams = (double)(nClusters * 2 * nDim + nClusters - 1);
+   return -2.0 * dLogL + dParams * log((double)m_nNum);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// CLASS TSWSpikeCluster
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Takes snapshots of all channels to be clustered and starts
+/// worker threads. If nNumThreads is 0 the number of processors is used. If
+/// pvnChannels is NULL all channels are clustered, otherwise only the passed
+/// channels
+//------------------------------------------------------------------------------
+TSWSpikeCluster::TSWSpikeCluster(TSWSpikes* pSpikes,
+                                 const std::vector<TSpikeParam >& rvspFeatures,
+                                 TSWClusterMethod cmMethod,
+                                 unsigned int nMaxClusters,
+                                 unsigned int nNumThreads,
+                                 const std::vector<unsigned int >* pvnChannels)
+   :  m_pSpikes(pSpikes), m_vspFeatures(rvspFeatures), m_cmMethod(cmMethod),
+      m_nMaxClusters(nMaxClusters)
+{
+   if (!m_vspFeatures.size())
+      throw Exception("no spike parameters passed for clustering");
+   if (m_nMaxClusters < 1)
+      m_nMaxClusters = 1;
+
+   unsigned int n;
+   for (n = 0; n < m_pSpikes->GetNumChannels(); n++)
+      {
+      if (!pvnChannels || std::find(pvnChannels->begin(), pvnChannels->end(), n) != pvnChannels->end())
+         {
+         m_vnChannels.push_back(n);
+         m_vswssSnapshots.push_back(m_pSpikes->GetSnapshot(n));
+         }
+      }
+   unsigned int nNumItems = (unsigned int)m_vnChannels.size();
+   m_vvnGroups.resize(nNumItems);
+   m_vnNumClusters.assign(nNumItems, 0);
+
+   Start(nNumItems, nNumThreads);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// destructor. Stops threads
+//------------------------------------------------------------------------------
+TSWSpikeCluster::~TSWSpikeCluster()
+{
+   StopThreads();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// worker function (called by all threads): pulls and processes items
+//------------------------------------------------------------------------------
+void TSWSpikeCluster::DoWork()
+{
+   unsigned int nItem;
+   while (NextItem(nItem))
+      {
+      ProcessItem(nItem);
+      if (!m_bCancel)
+         ItemDone();
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// clusters spikes of one channel: reads and standardizes features, fits
+/// models with 1 to m_nMaxClusters clusters and keeps the one with lowest BIC
+//------------------------------------------------------------------------------
+void TSWSpikeCluster::ProcessItem(unsigned int nItem)
+{
+   TSWSpikeSnapshot& rswss = m_vswssSnapshots[nItem];
+   unsigned int nNum = rswss.GetNumSpikes();
+   if (nNum < SWSC_MIN_SPIKES)
+      return;
+
+   // read feature columns to rows of standardized features
+   unsigned int nDim = (unsigned int)m_vspFeatures.size();
+   std::vector<double > vdColumn(nNum);
+   std::vector<double > vdData(nNum * nDim);
+   unsigned int n, nFeature;
+   for (nFeature = 0; nFeature < nDim; nFeature++)
+      {
+      rswss.GetSpikeParams(m_vspFeatures[nFeature], &vdColumn[0], 0, nNum);
+      double dMean = 0.0;
+      for (n = 0; n < nNum; n++)
+         dMean += vdColumn[n];
+      dMean /= (double)nNum;
+      double dVar = 0.0;
+      for (n = 0; n < nNum; n++)
+         dVar += (vdColumn[n] - dMean) * (vdColumn[n] - dMean);
+      dVar /= (double)nNum;
+      double dScale = dVar > DBL_MIN ? 1.0 / sqrt(dVar) : 1.0;
+      for (n = 0; n < nNum; n++)
+         vdData[n*nDim + nFeature] = (vdColumn[n] - dMean) * dScale;
+      }
+
+   TSWClusterFit swcf(vdData, nDim, 0x5eed + m_vnChannels[nItem], &m_bCancel);
+   std::vector<int > vnLabels;
+   std::vector<int >& rvnBest = m_vvnGroups[nItem];
+   double dBestBIC = DBL_MAX;
+   unsigned int nClusters, nBestClusters = 0;
+   unsigned int nMaxClusters = std::min(m_nMaxClusters, nNum / SWSC_MIN_SPIKES);
+   for (nClusters = 1; nClusters <= nMaxClusters && !m_bCancel; nClusters++)
+      {
+      double dBIC = m_cmMethod == SWCM_GMM ? swcf.GMM(nClusters, vnLabels) : swcf.KMeans(nClusters, vnLabels);
+      if (dBIC < dBestBIC)
+         {
+         dBestBIC = dBIC;
+         nBestClusters = nClusters;
+         rvnBest.swap(vnLabels);
+         }
+      }
+   if (m_bCancel)
+      return;
+
+   // sort clusters by size: largest one is group 0
+   std::vector<std::pair<unsigned int, int > > vnSize(nBestClusters);
+   for (n = 0; n < nBestClusters; n++)
+      vnSize[n] = std::make_pair(0U, -(int)n);
+   for (n = 0; n < nNum; n++)
+      vnSize[(unsigned int)rvnBest[n]].first++;
+   std::sort(vnSize.rbegin(), vnSize.rend());
+   std::vector<int > vnMap(nBestClusters);
+   unsigned int nNonEmpty = 0;
+   for (n = 0; n < nBestClusters; n++)
+      {
+      vnMap[(unsigned int)-vnSize[n].second] = (int)n;
+      if (vnSize[n].first)
+         nNonEmpty++;
+      }
+   for (n = 0; n < nNum; n++)
+      rvnBest[n] = vnMap[(unsigned int)rvnBest[n]];
+   m_vnNumClusters[nItem] = nNonEmpty;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// waits for workers and writes the groups of all clustered channels to the
+/// spikes. Channels, whose spikes were changed after construction, are left
+/// unchanged (see GetNumClusters). Returns false (and writes nothing) if
+/// clustering was cancelled. Raises an exception if an error occurred in a
+/// worker
+//------------------------------------------------------------------------------
+bool TSWSpikeCluster::Finish()
+{
+   StopThreads();
+   if (!GetError().IsEmpty())
+      throw Exception("error during spike clustering: " + GetError());
+   if (!IsComplete())
+      return false;
+   unsigned int n;
+   for (n = 0; n < m_vnChannels.size(); n++)
+      {
+      if (!m_vnNumClusters[n])
+         continue;
+      if (m_pSpikes->GetSnapshot(m_vnChannels[n]).GetVersion() != m_vswssSnapshots[n].GetVersion())
+         {
+         m_vnNumClusters[n] = 0;
+         continue;
+         }
+      m_pSpikes->SetSpikeGroups(m_vnChannels[n], &m_vvnGroups[n][0], 0, (unsigned int)m_vvnGroups[n].size());
+      }
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of groups written to a channel after Finish(): 0 if the
+/// channel was not clustered (too few spikes or spikes changed meanwhile),
+/// -1 if the channel was not requested at all
+//------------------------------------------------------------------------------
+int TSWSpikeCluster::GetNumClusters(unsigned int nChannelIndex)
+{
+   std::vector<unsigned int >::iterator it = std::find(m_vnChannels.begin(), m_vnChannels.end(), nChannelIndex);
+   if (it == m_vnChannels.end())
+      return -1;
+   return (int)m_vnNumClusters[(unsigned int)(it - m_vnChannels.begin())];
+}
+//------------------------------------------------------------------------------
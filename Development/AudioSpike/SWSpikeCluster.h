@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeCluster.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeCluster: automatic clustering of spikes
+/// by k-means++ or gaussian mixture models on a pool of worker threads
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeClusterH
+#define SWSpikeClusterH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <atomic>
+#include <random>
+#include "SWSpike.h"
+#include "SWWorkerPool.h"
+
+/// minimum number of spikes of a channel to be clustered
+#define SWSC_MIN_SPIKES       20
+/// number of k-means++ runs per number of clusters (best one is used)
+#define SWSC_KMEANS_RUNS      3
+/// maximum number of iterations of k-means and EM
+#define SWSC_MAX_ITERATIONS   200
+/// EM stops if log likelihood per spike improves less than this
+#define SWSC_EM_TOLERANCE     1e-7
+/// lower limit for variances of standardized features (GMM)
+#define SWSC_MIN_VARIANCE     1e-4
+
+//------------------------------------------------------------------------------
+/// clustering methods
+//------------------------------------------------------------------------------
+enum TSWClusterMethod
+{
+   SWCM_KMEANS = 0,  ///< k-means with k-means++ seeding
+   SWCM_GMM          ///< gaussian mixture (diagonal covariances) fitted by EM
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// fits cluster models to the (standardized) features of one channel: n rows
+/// of nDim values. All functions return the bayesian information criterion
+/// (BIC) of the fitted model and the cluster index of every row. If a cancel
+/// flag is passed, it is checked in every iteration: if it is set, the
+/// functions return DBL_MAX and the labels are invalid
+//------------------------------------------------------------------------------
+class TSWClusterFit
+{
+   private:
+      const std::vector<double >&   m_rvdData;
+      unsigned int                  m_nNum;
+      unsigned int                  m_nDim;
+      std::mt19937                  m_rng;
+      std::vector<double >          m_vdDist;
+      const std::atomic<bool>*      m_pbCancel;
+      bool           Cancelled();
+      double         Random();
+      double         Distance(const double* pd1, const double* pd2);
+      void           Seed(unsigned int nClusters, std::vector<double >& rvdCenters);
+      double         Lloyd(unsigned int nClusters, std::vector<double >& rvdCenters, std::vector<int >& rvnLabels);
+   public:
+      TSWClusterFit(const std::vector<double >& rvdData, unsigned int nDim, unsigned int nSeed,
+                    const std::atomic<bool>* pbCancel = NULL);
+      double         KMeans(unsigned int nClusters, std::vector<int >& rvnLabels);
+      double         GMM(unsigned int nClusters, std::vector<int >& rvnLabels);
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// class for automatic clustering of the spikes of multiple channels on a pool
+/// of worker threads (one work item per channel). The spikes of a channel are
+/// clustered in the space of the passed spike parameters (standardized to zero
+/// mean and unit variance) read column-wise from a snapshot. Models with 1 to
+/// nMaxClusters clusters are fitted and the one with the lowest bayesian
+/// information criterion (BIC) is used. Clusters are sorted by size, the
+/// largest one becomes spike group 0. Random numbers are seeded per channel,
+/// so results do not depend on number of threads and scheduling.
+/// Usage (GUI thread): see TSWWorkerPool, finally call Finish() to write the
+/// groups
+//------------------------------------------------------------------------------
+class TSWSpikeCluster : public TSWWorkerPool
+{
+   private:
+      TSWSpikes*                 m_pSpikes;
+      std::vector<TSpikeParam >  m_vspFeatures;
+      TSWClusterMethod           m_cmMethod;
+      unsigned int               m_nMaxClusters;
+      std::vector<unsigned int > m_vnChannels;
+      std::vector<TSWSpikeSnapshot > m_vswssSnapshots;
+      std::vector<std::vector<int > > m_vvnGroups;
+      std::vector<unsigned int > m_vnNumClusters;
+      void           ProcessItem(unsigned int nItem);
+   protected:
+      void           DoWork();
+   public:
+      TSWSpikeCluster(TSWSpikes* pSpikes,
+                      const std::vector<TSpikeParam >& rvspFeatures,
+                      TSWClusterMethod cmMethod,
+                      unsigned int nMaxClusters,
+                      unsigned int nNumThreads = 0,
+                      const std::vector<unsigned int >* pvnChannels = NULL);
+      ~TSWSpikeCluster();
+      bool           Finish();
+      int            GetNumClusters(unsigned int nChannelIndex);
+};
+//------------------------------------------------------------------------------
+#endif
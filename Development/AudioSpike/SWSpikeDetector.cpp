@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeDetector.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeDetector: vectorized threshold crossing
+/// detection of spikes
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeDetector.h"
+#include <math.h>
+#if defined(__AVX2__)
+   #define SWSD_AVX2
+   #include <immintrin.h>
+#elif defined(__SSE__) || defined(_M_X64) || defined(__x86_64__)
+   #define SWSD_SSE
+   #include <xmmintrin.h>
+#endif
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns float threshold for comparing float samples, that gives exactly
+/// the same result as comparing the samples converted to double with the
+/// passed double threshold: for positive thresholds the largest float not
+/// above, for negative thresholds the smallest float not below threshold
+//------------------------------------------------------------------------------
+float TSWSpikeDetector::GetFloatThreshold(double dThreshold)
+{
+   float fThreshold = (float)dThreshold;
+   if (dThreshold > 0 && (double)fThreshold > dThreshold)
+      fThreshold = nextafterf(fThreshold, -HUGE_VALF);
+   else if (dThreshold <= 0 && (double)fThreshold < dThreshold)
+      fThreshold = nextafterf(fThreshold, HUGE_VALF);
+   return fThreshold;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes positions in [nStart, nEnd) with samples above (bPositive) or below
+/// threshold to pnCandidates (must hold SWSD_BATCHSIZE values). Returns number
+/// of candidates. rnNext returns position to continue scanning (nEnd, if all
+/// samples were scanned)
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeDetector::Scan(const float* pfData,
+                                    unsigned int nStart,
+                                    unsigned int nEnd,
+                                    float fThreshold,
+                                    bool bPositive,
+                                    unsigned int* pnCandidates,
+                                    unsigned int &rnNext)
+{
+   unsigned int nNumCandidates = 0;
+   unsigned int n = nStart;
+   int nMask;
+   #if defined(SWSD_AVX2)
+   __m256 m256Thr = _mm256_set1_ps(fThreshold);
+   // NOTE: stop if batch cannot take all candidates of next vector
+   for (; n + 8 <= nEnd && nNumCandidates + 8 <= SWSD_BATCHSIZE; n += 8)
+      {
+      __m256 m256 = _mm256_loadu_ps(pfData + n);
+      nMask = _mm256_movemask_ps(bPositive   ? _mm256_cmp_ps(m256, m256Thr, _CMP_GT_OQ)
+                                             : _mm256_cmp_ps(m256, m256Thr, _CMP_LT_OQ));
+      while (nMask)
+         {
+         pnCandidates[nNumCandidates++] = n + (unsigned int)__builtin_ctz((unsigned int)nMask);
+         nMask &= nMask - 1;
+         }
+      }
+   #elif defined(SWSD_SSE)
+   __m128 m128Thr = _mm_set1_ps(fThreshold);
+   for (; n + 4 <= nEnd && nNumCandidates + 4 <= SWSD_BATCHSIZE; n += 4)
+      {
+      __m128 m128 = _mm_loadu_ps(pfData + n);
+      nMask = _mm_movemask_ps(bPositive ? _mm_cmpgt_ps(m128, m128Thr) : _mm_cmplt_ps(m128, m128Thr));
+      while (nMask)
+         {
+         pnCandidates[nNumCandidates++] = n + (unsigned int)__builtin_ctz((unsigned int)nMask);
+         nMask &= nMask - 1;
+         }
+      }
+   #endif
+   for (; n < nEnd && nNumCandidates < SWSD_BATCHSIZE; n++)
+      {
+      if (bPositive ? pfData[n] > fThreshold : pfData[n] < fThreshold)
+         pnCandidates[nNumCandidates++] = n;
+      }
+   rnNext = n;
+   return nNumCandidates;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// detects spikes in [nStart, nEnd) and returns their positions: every
+/// candidate that is more than nDeadTime samples behind previous spike is a
+/// spike. Identical to scalar loop 'if beyond threshold: add spike and skip
+/// nDeadTime samples'
+//------------------------------------------------------------------------------
+void TSWSpikeDetector::Detect(const float* pfData,
+                              unsigned int nStart,
+                              unsigned int nEnd,
+                              double dThreshold,
+                              unsigned int nDeadTime,
+                              std::vector<unsigned int >& rvnPositions)
+{
+   rvnPositions.clear();
+   if (nStart >= nEnd)
+      return;
+   bool bPositive    = dThreshold > 0;
+   float fThreshold  = GetFloatThreshold(dThreshold);
+   unsigned int anCandidates[SWSD_BATCHSIZE];
+   unsigned int nNumCandidates, nCandidate;
+   unsigned int nPos = nStart;
+   while (nPos < nEnd)
+      {
+      nNumCandidates = Scan(pfData, nPos, nEnd, fThreshold, bPositive, anCandidates, nPos);
+      for (nCandidate = 0; nCandidate < nNumCandidates; nCandidate++)
+         {
+         if (rvnPositions.size() && anCandidates[nCandidate] <= rvnPositions.back() + nDeadTime)
+            continue;
+         rvnPositions.push_back(anCandidates[nCandidate]);
+         }
+      // continue behind dead time of last spike (skips samples of the spike
+      // itself that are beyond threshold as well)
+      if (rvnPositions.size() && nPos <= rvnPositions.back() + nDeadTime)
+         nPos = rvnPositions.back() + nDeadTime + 1;
+      }
+}
+//------------------------------------------------------------------------------
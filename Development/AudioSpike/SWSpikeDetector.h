@@ -0,0 +1,69 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeDetector.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeDetector: vectorized threshold crossing
+/// detection of spikes
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeDetectorH
+#define SWSpikeDetectorH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+/// maximum number of candidate positions returned by one call of
+/// TSWSpikeDetector::Scan
+#define SWSD_BATCHSIZE  256
+
+//------------------------------------------------------------------------------
+/// threshold crossing detection of spikes in float epoche data. Scan() returns
+/// batches of candidates (samples beyond threshold) using AVX2 or SSE (if
+/// available at compile time, scalar fallback otherwise). Detect() applies the
+/// dead time to candidates. Positive thresholds detect samples above, negative
+/// thresholds samples below threshold.
+/// NOTE: all functions are static and thread safe
+//------------------------------------------------------------------------------
+class TSWSpikeDetector
+{
+   public:
+      static float         GetFloatThreshold(double dThreshold);
+      static unsigned int  Scan( const float* pfData,
+                                 unsigned int nStart,
+                                 unsigned int nEnd,
+                                 float fThreshold,
+                                 bool bPositive,
+                                 unsigned int* pnCandidates,
+                                 unsigned int &rnNext);
+      static void          Detect(  const float* pfData,
+                                    unsigned int nStart,
+                                    unsigned int nEnd,
+                                    double dThreshold,
+                                    unsigned int nDeadTime,
+                                    std::vector<unsigned int >& rvnPositions);
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,392 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeFeatures.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeFeatures: principal components of spike
+/// waveforms as spike parameters
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeFeatures.h"
+#include <algorithm>
+#include <math.h>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns projection of a spike to one component
+//------------------------------------------------------------------------------
+double TSWSpikeBasis::Project(const double* pdSpike, unsigned int nComponent) const
+{
+   const double* pdComponent = &m_vdComponents[nComponent * m_nSpikeLength];
+   double d = 0.0;
+   unsigned int n;
+   for (n = 0; n < m_nSpikeLength; n++)
+      d += (pdSpike[n] - m_vdMean[n]) * pdComponent[n];
+   return d;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWSpikeFeatures::TSWSpikeFeatures()
+   : m_nSpikeLength(0), m_nNumSpikes(0), m_bChanged(false)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all spikes and components
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::Clear()
+{
+   m_nSpikeLength = 0;
+   m_nNumSpikes = 0;
+   m_bChanged = false;
+   m_vdSum.clear();
+   m_vdScatter.clear();
+   m_vdCovariance.clear();
+   m_vdComponents.clear();
+   m_pBasis.reset();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds spikes (nNumSpikes rows of nSpikeLength values)
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::Add(const double* pdData, unsigned int nNumSpikes, unsigned int nSpikeLength)
+{
+   if (!nNumSpikes)
+      return;
+   if (nSpikeLength != m_nSpikeLength)
+      {
+      if (m_nNumSpikes)
+         throw Exception("spike length cannot be changed if spikes are stored");
+      Clear();
+      m_nSpikeLength = nSpikeLength;
+      m_vdSum.assign(nSpikeLength, 0.0);
+      m_vdScatter.assign(nSpikeLength*nSpikeLength, 0.0);
+      }
+   Accumulate(pdData, nNumSpikes, nSpikeLength, 1.0);
+   m_nNumSpikes += nNumSpikes;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes spikes, that were added before
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::Subtract(const double* pdData, unsigned int nNumSpikes, unsigned int nSpikeLength)
+{
+   if (!nNumSpikes)
+      return;
+   if (nSpikeLength != m_nSpikeLength || nNumSpikes > m_nNumSpikes)
+      throw Exception("spikes to subtract were never added");
+   m_nNumSpikes -= nNumSpikes;
+   // start from exact zero rather than accumulating rounding errors
+   if (!m_nNumSpikes)
+      {
+      std::fill(m_vdSum.begin(), m_vdSum.end(), 0.0);
+      std::fill(m_vdScatter.begin(), m_vdScatter.end(), 0.0);
+      m_bChanged = true;
+      }
+   else
+      Accumulate(pdData, nNumSpikes, nSpikeLength, -1.0);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds (dSign = 1) or subtracts (dSign = -1) spikes to sum and upper triangle
+/// of scatter matrix. Spikes are processed in blocks of four, so every row of
+/// the scatter matrix is read and written once per four spikes
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::Accumulate(  const double* pdData,
+                                    unsigned int nNumSpikes,
+                                    unsigned int nSpikeLength,
+                                    double dSign)
+{
+   unsigned int nSpike, i, j;
+   for (nSpike = 0; nSpike + 4 <= nNumSpikes; nSpike += 4)
+      {
+      const double* pd0 = pdData + nSpike * nSpikeLength;
+      const double* pd1 = pd0 + nSpikeLength;
+      const double* pd2 = pd1 + nSpikeLength;
+      const double* pd3 = pd2 + nSpikeLength;
+      for (i = 0; i < nSpikeLength; i++)
+         {
+         double d0 = dSign * pd0[i];
+         double d1 = dSign * pd1[i];
+         double d2 = dSign * pd2[i];
+         double d3 = dSign * pd3[i];
+         double* pdRow = &m_vdScatter[i * nSpikeLength];
+         for (j = i; j < nSpikeLength; j++)
+            pdRow[j] += d0 * pd0[j] + d1 * pd1[j] + d2 * pd2[j] + d3 * pd3[j];
+         m_vdSum[i] += d0 + d1 + d2 + d3;
+         }
+      }
+   for (; nSpike < nNumSpikes; nSpike++)
+      {
+      const double* pd = pdData + nSpike * nSpikeLength;
+      for (i = 0; i < nSpikeLength; i++)
+         {
+         double d = dSign * pd[i];
+         double* pdRow = &m_vdScatter[i * nSpikeLength];
+         for (j = i; j < nSpikeLength; j++)
+            pdRow[j] += d * pd[j];
+         m_vdSum[i] += d;
+         }
+      }
+   m_bChanged = true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of spikes
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeFeatures::GetNumSpikes()
+{
+   return m_nNumSpikes;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns current components, updates them if spikes were added or removed
+/// since last call. Returns an empty pointer, if less than SWSF_MIN_SPIKES
+/// spikes are stored
+//------------------------------------------------------------------------------
+TSWSpikeBasisPtr TSWSpikeFeatures::GetBasis()
+{
+   if (m_bChanged)
+      {
+      UpdateBasis();
+      m_bChanged = false;
+      }
+   return m_pBasis;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// orthonormalizes passed rows (SWSF_NUM_COMPONENTS rows of m_nSpikeLength
+/// values) by modified Gram-Schmidt. Rows, that are (nearly) linear dependent
+/// on previous rows, are set to zero
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::Orthonormalize(std::vector<double >& rvdRows)
+{
+   unsigned int nRow, nPrev, n;
+   unsigned int nLen = m_nSpikeLength;
+   for (nRow = 0; nRow < SWSF_NUM_COMPONENTS; nRow++)
+      {
+      double* pdRow = &rvdRows[nRow * nLen];
+      double dNormIn = 0.0;
+      for (n = 0; n < nLen; n++)
+         dNormIn += pdRow[n] * pdRow[n];
+      for (nPrev = 0; nPrev < nRow; nPrev++)
+         {
+         const double* pdPrev = &rvdRows[nPrev * nLen];
+         double dDot = 0.0;
+         for (n = 0; n < nLen; n++)
+            dDot += pdRow[n] * pdPrev[n];
+         for (n = 0; n < nLen; n++)
+            pdRow[n] -= dDot * pdPrev[n];
+         }
+      double dNorm = 0.0;
+      for (n = 0; n < nLen; n++)
+         dNorm += pdRow[n] * pdRow[n];
+      if (dNorm <= 1e-24 * dNormIn || dNorm <= 0.0)
+         {
+         std::fill(pdRow, pdRow + nLen, 0.0);
+         continue;
+         }
+      dNorm = 1.0 / sqrt(dNorm);
+      for (n = 0; n < nLen; n++)
+         pdRow[n] *= dNorm;
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// initializes components without previous components: unit vectors at the
+/// samples with largest variance (slightly disturbed, so they are not exactly
+/// orthogonal to an eigenvector)
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::InitComponents()
+{
+   unsigned int nLen = m_nSpikeLength;
+   unsigned int n, nRow;
+   std::vector<bool > vbUsed(nLen, false);
+   m_vdComponents.assign(SWSF_NUM_COMPONENTS * nLen, 0.0);
+   for (nRow = 0; nRow < SWSF_NUM_COMPONENTS; nRow++)
+      {
+      unsigned int nMax = 0;
+      double dMax = -1.0;
+      for (n = 0; n < nLen; n++)
+         {
+         if (!vbUsed[n] && m_vdCovariance[n*nLen+n] > dMax)
+            {
+            dMax = m_vdCovariance[n*nLen+n];
+            nMax = n;
+            }
+         }
+      vbUsed[nMax] = true;
+      double* pdRow = &m_vdComponents[nRow * nLen];
+      for (n = 0; n < nLen; n++)
+         pdRow[n] = 1e-3 * (double)((n * (nRow + 2)) % 7 + 1) / (double)nLen;
+      pdRow[nMax] += 1.0;
+      }
+   Orthonormalize(m_vdComponents);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// one step of orthogonal iteration: multiplies components with covariance
+/// and orthonormalizes them. Returns largest change of a (non-zero) component
+/// as 1 - |cos| of angle between old and new component
+//------------------------------------------------------------------------------
+double TSWSpikeFeatures::Iterate()
+{
+   unsigned int nLen = m_nSpikeLength;
+   unsigned int nRow, i, j;
+   m_vdProduct.assign(SWSF_NUM_COMPONENTS * nLen, 0.0);
+   for (nRow = 0; nRow < SWSF_NUM_COMPONENTS; nRow++)
+      {
+      const double* pdIn = &m_vdComponents[nRow * nLen];
+      double* pdOut = &m_vdProduct[nRow * nLen];
+      for (i = 0; i < nLen; i++)
+         {
+         const double* pdCov = &m_vdCovariance[i * nLen];
+         double d = 0.0;
+         for (j = 0; j < nLen; j++)
+            d += pdCov[j] * pdIn[j];
+         pdOut[i] = d;
+         }
+      }
+   Orthonormalize(m_vdProduct);
+   double dChange = 0.0;
+   for (nRow = 0; nRow < SWSF_NUM_COMPONENTS; nRow++)
+      {
+      const double* pdOld = &m_vdComponents[nRow * nLen];
+      const double* pdNew = &m_vdProduct[nRow * nLen];
+      double dDot = 0.0;
+      double dNorm = 0.0;
+      for (i = 0; i < nLen; i++)
+         {
+         dDot  += pdOld[i] * pdNew[i];
+         dNorm += pdNew[i] * pdNew[i];
+         }
+      if (dNorm > 0.0)
+         dChange = std::max(dChange, 1.0 - fabs(dDot));
+      }
+   m_vdComponents.swap(m_vdProduct);
+   return dChange;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// computes covariance from sum and scatter matrix, updates components and
+/// publishes them as new basis
+//------------------------------------------------------------------------------
+void TSWSpikeFeatures::UpdateBasis()
+{
+   if (m_nNumSpikes < SWSF_MIN_SPIKES || m_nSpikeLength < SWSF_NUM_COMPONENTS)
+      {
+      m_pBasis.reset();
+      return;
+      }
+   unsigned int nLen = m_nSpikeLength;
+   unsigned int nRow, i, j;
+   double dNum = (double)m_nNumSpikes;
+
+   std::shared_ptr<TSWSpikeBasis > pBasis(new TSWSpikeBasis());
+   pBasis->m_nSpikeLength = nLen;
+   pBasis->m_vdMean.resize(nLen);
+   for (i = 0; i < nLen; i++)
+      pBasis->m_vdMean[i] = m_vdSum[i] / dNum;
+
+   // covariance: (S - n * mean * mean') / (n - 1), full matrix
+   m_vdCovariance.resize(nLen * nLen);
+   const std::vector<double >& rvdMean = pBasis->m_vdMean;
+   for (i = 0; i < nLen; i++)
+      {
+      for (j = i; j < nLen; j++)
+         {
+         double d = (m_vdScatter[i * nLen + j] - dNum * rvdMean[i] * rvdMean[j]) / (dNum - 1.0);
+         m_vdCovariance[i * nLen + j] = d;
+         m_vdCovariance[j * nLen + i] = d;
+         }
+      }
+
+   // start with previous components, if available and complete
+   bool bCold = m_vdComponents.size() != SWSF_NUM_COMPONENTS * nLen;
+   for (nRow = 0; !bCold && nRow < SWSF_NUM_COMPONENTS; nRow++)
+      {
+      const double* pdRow = &m_vdComponents[nRow * nLen];
+      double dNorm = 0.0;
+      for (i = 0; i < nLen; i++)
+         dNorm += pdRow[i] * pdRow[i];
+      bCold = dNorm < 0.5;
+      }
+   if (bCold)
+      InitComponents();
+
+   unsigned int nMaxIterations = bCold ? SWSF_MAX_ITERATIONS_COLD : SWSF_MAX_ITERATIONS;
+   unsigned int nIteration;
+   for (nIteration = 0; nIteration < nMaxIterations; nIteration++)
+      {
+      if (Iterate() < SWSF_TOLERANCE)
+         break;
+      }
+
+   // sign of eigenvectors is arbitrary: new components are oriented with
+   // largest element positive, later updates keep orientation (iteration
+   // with positive semidefinite matrix does not flip components)
+   if (bCold)
+      {
+      for (nRow = 0; nRow < SWSF_NUM_COMPONENTS; nRow++)
+         {
+         double* pdRow = &m_vdComponents[nRow * nLen];
+         double dMax = 0.0;
+         for (i = 0; i < nLen; i++)
+            {
+            if (fabs(pdRow[i]) > fabs(dMax))
+               dMax = pdRow[i];
+            }
+         if (dMax < 0.0)
+            {
+            for (i = 0; i < nLen; i++)
+               pdRow[i] = -pdRow[i];
+            }
+         }
+      }
+
+   double dScale = 1.0 / sqrt((double)nLen);
+   pBasis->m_vdComponents.resize(m_vdComponents.size());
+   for (i = 0; i < m_vdComponents.size(); i++)
+      pBasis->m_vdComponents[i] = dScale * m_vdComponents[i];
+   m_pBasis = pBasis;
+}
+//------------------------------------------------------------------------------
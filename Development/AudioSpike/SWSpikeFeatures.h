@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeFeatures.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeFeatures: principal components of spike
+/// waveforms as spike parameters
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeFeaturesH
+#define SWSpikeFeaturesH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <memory>
+#include "SWSpikeParameters.h"
+
+/// number of principal components exposed as spike parameters (SP_PC1 ...)
+#define SWSF_NUM_COMPONENTS   (SP_LAST - SP_PC1)
+/// minimum number of spikes needed for computing components
+#define SWSF_MIN_SPIKES       10
+/// maximum number of iterations, if previous components are used as start
+#define SWSF_MAX_ITERATIONS   30
+/// maximum number of iterations, if no previous components are available
+#define SWSF_MAX_ITERATIONS_COLD 300
+/// convergence criterion: 1 - |cos| of angle between old and new component
+#define SWSF_TOLERANCE        1e-10
+
+//------------------------------------------------------------------------------
+/// principal components of the spikes of one channel as published with a
+/// spike snapshot. Never changed after publishing
+//------------------------------------------------------------------------------
+class TSWSpikeBasis
+{
+   public:
+      unsigned int            m_nSpikeLength;
+      /// mean spike
+      std::vector<double >    m_vdMean;
+      /// components: one row of m_nSpikeLength values per component. Rows
+      /// are scaled by 1/sqrt(m_nSpikeLength), so projections are rms values
+      /// in units of the spike data
+      std::vector<double >    m_vdComponents;
+      double         Project(const double* pdSpike, unsigned int nComponent) const;
+};
+//------------------------------------------------------------------------------
+
+/// published principal components
+typedef std::shared_ptr<const TSWSpikeBasis > TSWSpikeBasisPtr;
+
+//------------------------------------------------------------------------------
+/// incremental principal component analysis of the spikes of one channel.
+/// Sum and scatter matrix (sum of outer products) of all spikes are updated
+/// with every added or removed spike, so costs of an update of the components
+/// only depend on spike length, not on the number of spikes: covariance is
+/// derived from the scatter matrix and the top SWSF_NUM_COMPONENTS
+/// eigenvectors are computed by orthogonal (subspace) iteration started with
+/// the previous components, which usually converges within few iterations.
+/// NOTE: components change while spikes are added, so the feature values of
+/// a spike are not constant (other than the stored spike parameters)
+//------------------------------------------------------------------------------
+class TSWSpikeFeatures
+{
+   private:
+      unsigned int            m_nSpikeLength;
+      unsigned int            m_nNumSpikes;
+      bool                    m_bChanged;
+      std::vector<double >    m_vdSum;
+      std::vector<double >    m_vdScatter;
+      std::vector<double >    m_vdCovariance;
+      std::vector<double >    m_vdComponents;
+      std::vector<double >    m_vdProduct;
+      TSWSpikeBasisPtr        m_pBasis;
+      void           Accumulate(const double* pdData, unsigned int nNumSpikes, unsigned int nSpikeLength, double dSign);
+      void           InitComponents();
+      void           Orthonormalize(std::vector<double >& rvdRows);
+      double         Iterate();
+      void           UpdateBasis();
+   public:
+      TSWSpikeFeatures();
+      void           Clear();
+      void           Add(const double* pdData, unsigned int nNumSpikes, unsigned int nSpikeLength);
+      void           Subtract(const double* pdData, unsigned int nNumSpikes, unsigned int nSpikeLength);
+      unsigned int   GetNumSpikes();
+      TSWSpikeBasisPtr GetBasis();
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,206 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeHistogram.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeHistogram: spike time histogram at fine
+/// base resolution for PSTH
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeHistogram.h"
+#include <math.h>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWSpikeHistogram::TSWSpikeHistogram()
+   : m_nNumSpikes(0)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all spikes
+//------------------------------------------------------------------------------
+void TSWSpikeHistogram::Clear()
+{
+   m_vnBins.clear();
+   m_vnTree.clear();
+   m_nNumSpikes = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns base bin of a spike time (negative times are counted in first bin)
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeHistogram::GetBaseBin(double dTime)
+{
+   if (!(dTime > 0.0))
+      return 0;
+   return (unsigned int)floor(dTime / SWSH_BASE_BINSIZE);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// ensures that base bin nBin exists. The tree is grown to powers of two and
+/// rebuilt from the base bins, so growing costs O(1) amortized per spike
+//------------------------------------------------------------------------------
+void TSWSpikeHistogram::Reserve(unsigned int nBin)
+{
+   if (nBin < m_vnBins.size())
+      return;
+   unsigned int nSize = m_vnBins.size() ? (unsigned int)m_vnBins.size() : 1024;
+   while (nSize <= nBin)
+      nSize *= 2;
+   m_vnBins.resize(nSize, 0);
+   // rebuild tree in O(n): every node passes its sum to its parent
+   m_vnTree.assign(nSize + 1, 0);
+   unsigned int n, nParent;
+   for (n = 1; n <= nSize; n++)
+      {
+      m_vnTree[n] += m_vnBins[n-1];
+      nParent = n + (n & (0 - n));
+      if (nParent <= nSize)
+         m_vnTree[nParent] += m_vnTree[n];
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds nDelta to base bin nBin in tree
+//------------------------------------------------------------------------------
+void TSWSpikeHistogram::UpdateTree(unsigned int nBin, int nDelta)
+{
+   unsigned int n;
+   for (n = nBin + 1; n < m_vnTree.size(); n += n & (0 - n))
+      m_vnTree[n] += (unsigned int)nDelta;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns sum of the first nNumBaseBins base bins
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeHistogram::GetPrefixSum(unsigned int nNumBaseBins) const
+{
+   if (nNumBaseBins > m_vnBins.size())
+      nNumBaseBins = (unsigned int)m_vnBins.size();
+   unsigned int nSum = 0;
+   unsigned int n;
+   for (n = nNumBaseBins; n > 0; n -= n & (0 - n))
+      nSum += m_vnTree[n];
+   return nSum;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns first base bin counted in bin nBin, if bins are dScale base bins
+/// wide (i.e. first base bin with its center not left of the bin)
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeHistogram::GetFirstBaseBin(unsigned int nBin, double dScale)
+{
+   double dFirst = ceil((double)nBin / dScale - 0.5);
+   unsigned int nFirst = dFirst > 0.0 ? (unsigned int)dFirst : 0;
+   // correct rounding errors of the division: must match the assignment
+   // floor((base bin + 0.5) * dScale) exactly
+   while (nFirst > 0 && floor(((double)nFirst - 0.5) * dScale) >= (double)nBin)
+      nFirst--;
+   while (floor(((double)nFirst + 0.5) * dScale) < (double)nBin)
+      nFirst++;
+   return nFirst;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds a spike
+//------------------------------------------------------------------------------
+void TSWSpikeHistogram::Add(double dTime)
+{
+   unsigned int nBin = GetBaseBin(dTime);
+   Reserve(nBin);
+   m_vnBins[nBin]++;
+   UpdateTree(nBin, 1);
+   m_nNumSpikes++;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes a spike, that was added before
+//------------------------------------------------------------------------------
+void TSWSpikeHistogram::Subtract(double dTime)
+{
+   unsigned int nBin = GetBaseBin(dTime);
+   if (nBin >= m_vnBins.size() || !m_vnBins[nBin])
+      throw Exception("spike histogram does not contain spike to remove");
+   m_vnBins[nBin]--;
+   UpdateTree(nBin, -1);
+   m_nNumSpikes--;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of spikes
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeHistogram::GetNumSpikes() const
+{
+   return m_nNumSpikes;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes histogram with nNumBins bins of width dBinSize (seconds, first bin
+/// starts at 0) to rvnBins by summing up base bins: every base bin is counted
+/// in the bin containing its center, so bin borders are accurate to half a
+/// base bin. Spikes behind last bin are ignored. Each bin is the difference of
+/// two prefix sums, so costs are O(nNumBins * log(number of base bins))
+//------------------------------------------------------------------------------
+void TSWSpikeHistogram::GetBins(double dBinSize,
+                                unsigned int nNumBins,
+                                std::vector<unsigned int >& rvnBins) const
+{
+   rvnBins.assign(nNumBins, 0);
+   if (!nNumBins || !(dBinSize > 0.0) || !m_nNumSpikes)
+      return;
+   double dScale = SWSH_BASE_BINSIZE / dBinSize;
+   unsigned int nSum = 0;
+   unsigned int nNext, nNextSum, n;
+   for (n = 0; n < nNumBins; n++)
+      {
+      nNext = GetFirstBaseBin(n+1, dScale);
+      if (nNext > m_vnBins.size())
+         nNext = (unsigned int)m_vnBins.size();
+      nNextSum = GetPrefixSum(nNext);
+      rvnBins[n] = nNextSum - nSum;
+      nSum = nNextSum;
+      // no base bins left
+      if (nNext == m_vnBins.size())
+         break;
+      }
+}
+//------------------------------------------------------------------------------
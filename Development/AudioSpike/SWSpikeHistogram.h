@@ -0,0 +1,72 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeHistogram.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeHistogram: spike time histogram at fine
+/// base resolution for PSTH
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeHistogramH
+#define SWSpikeHistogramH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+/// width of the base bins of spike time histograms in seconds
+#define SWSH_BASE_BINSIZE  0.00005
+
+//------------------------------------------------------------------------------
+/// histogram of spike times of one channel with bins of SWSH_BASE_BINSIZE.
+/// Updated, whenever a spike is added or removed, so histograms with
+/// coarser bins (PSTH) are computed from the base bins (see GetBins) without
+/// accessing the spikes at all. Base bins are stored in a binary indexed
+/// (Fenwick) tree, so adding/removing a spike and summing up a range of base
+/// bins both cost O(log(number of base bins)), and GetBins does not depend
+/// on the length of the histogram
+//------------------------------------------------------------------------------
+class TSWSpikeHistogram
+{
+   private:
+      std::vector<unsigned int > m_vnBins;
+      std::vector<unsigned int > m_vnTree;
+      unsigned int               m_nNumSpikes;
+      static unsigned int        GetBaseBin(double dTime);
+      void           Reserve(unsigned int nBin);
+      void           UpdateTree(unsigned int nBin, int nDelta);
+      unsigned int   GetPrefixSum(unsigned int nNumBaseBins) const;
+      static unsigned int GetFirstBaseBin(unsigned int nBin, double dScale);
+   public:
+      TSWSpikeHistogram();
+      void           Clear();
+      void           Add(double dTime);
+      void           Subtract(double dTime);
+      unsigned int   GetNumSpikes() const;
+      void           GetBins(double dBinSize,
+                             unsigned int nNumBins,
+                             std::vector<unsigned int >& rvnBins) const;
+};
+//------------------------------------------------------------------------------
+#endif
@@ -48,6 +48,9 @@ SWSpikeParameters::SWSpikeParameters()
    Add("PeakNeg", "-ve Peak", "rel.", -1.0, 1.0);
    Add("PeakToPeak", "Peak to Peak", "s", 0.0, 2000.0);
    Add("TrigToPeak", "Trig to Peak", "s", 0.0, 2000.0);
+   Add("PC1", "PC 1", "rel.", -1.0, 1.0);
+   Add("PC2", "PC 2", "rel.", -1.0, 1.0);
+   Add("PC3", "PC 3", "rel.", -1.0, 1.0);
 
    if (m_vusNames.size() != SP_LAST)
       throw Exception("inconsistant spike paramater sizes");
@@ -48,6 +48,9 @@ enum TSpikeParam
    SP_PEAKNEG,             ///< amplitude of the negative peak.
    SP_PEAK2PEAK,           ///< time in sec between the 1st and 2nd component
    SP_THRS2PEAK2,          ///< time in sec between the trigger (threshold crossing) and 2nd component
+   SP_PC1,                 ///< projection to 1st principal component of spikes of channel
+   SP_PC2,                 ///< projection to 2nd principal component of spikes of channel
+   SP_PC3,                 ///< projection to 3rd principal component of spikes of channel
    SP_LAST                 ///< dummy to mark last entry
 };
 //------------------------------------------------------------------------------
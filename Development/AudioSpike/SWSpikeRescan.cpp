@@ -0,0 +1,190 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeRescan.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeRescan: parallel spike detection on
+/// stored epoches
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeRescan.h"
+#include "SWTools.h"
+#include <algorithm>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+//------------------------------------------------------------------------------
+/// CLASS TSWSpikeRescan
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Partitions work and starts worker threads. If nNumThreads is 0
+/// the number of processors is used. If pvnChannels is NULL all channels are
+/// scanned, otherwise only the passed channels
+//------------------------------------------------------------------------------
+TSWSpikeRescan::TSWSpikeRescan(  TSWSpikes* pSpikes,
+                                 const std::vector<TSWEpoche* >& rvpEpoches,
+                                 unsigned int nNumThreads,
+                                 const std::vector<unsigned int >* pvnChannels)
+   :  m_pSpikes(pSpikes), m_vpEpoches(rvpEpoches), m_nNumChannels(0), m_nNumItems(0)
+{
+   unsigned int nNumEpocheChannels = 0;
+   if (m_vpEpoches.size())
+      nNumEpocheChannels = m_vpEpoches[0]->m_nNumChannels;
+   if (nNumEpocheChannels > m_pSpikes->GetNumChannels())
+      nNumEpocheChannels = m_pSpikes->GetNumChannels();
+   unsigned int n;
+   for (n = 0; n < nNumEpocheChannels; n++)
+      {
+      if (!pvnChannels || std::find(pvnChannels->begin(), pvnChannels->end(), n) != pvnChannels->end())
+         m_vnChannels.push_back(n);
+      }
+   m_nNumChannels = (unsigned int)m_vnChannels.size();
+   unsigned int nNumChunks = ((unsigned int)m_vpEpoches.size() + SWSR_CHUNKSIZE - 1) / SWSR_CHUNKSIZE;
+   m_nNumItems = nNumChunks * m_nNumChannels;
+   m_vswscResults.resize(m_nNumItems);
+
+   try
+      {
+      Start(m_nNumItems, nNumThreads);
+      }
+   catch (...)
+      {
+      ClearResults();
+      throw;
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// destructor. Stops threads and deletes spikes that were not merged
+//------------------------------------------------------------------------------
+TSWSpikeRescan::~TSWSpikeRescan()
+{
+   StopThreads();
+   ClearResults();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// deletes all spikes in item results
+//------------------------------------------------------------------------------
+void TSWSpikeRescan::ClearResults()
+{
+   unsigned int n;
+   for (n = 0; n < m_vswscResults.size(); n++)
+      m_vswscResults[n].Clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// worker function (called by all threads): pulls and processes items. Every
+/// worker uses an own epoche store, so data can be accessed zero-copy and
+/// workers do not compete for one mapped view
+//------------------------------------------------------------------------------
+void TSWSpikeRescan::DoWork()
+{
+   TSWEpocheStore swes;
+   std::vector<unsigned int > vnPositions;
+   unsigned int nItem;
+   while (NextItem(nItem))
+      {
+      ProcessItem(nItem, swes, vnPositions);
+      ItemDone();
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// detects spikes of one item (one channel of a range of epoches). Epoches
+/// holding their data in memory are processed from memory, all others are read
+/// from passed store. Only the channel of the item is accessed (no copy)
+//------------------------------------------------------------------------------
+void TSWSpikeRescan::ProcessItem(unsigned int nItem,
+                                 TSWEpocheStore &rswes,
+                                 std::vector<unsigned int >& rvnPositions)
+{
+   unsigned int nChannel   = m_vnChannels[nItem % m_nNumChannels];
+   unsigned int nFirst     = (nItem / m_nNumChannels) * SWSR_CHUNKSIZE;
+   unsigned int nLast      = nFirst + SWSR_CHUNKSIZE;
+   if (nLast > m_vpEpoches.size())
+      nLast = (unsigned int)m_vpEpoches.size();
+
+   TSWSpikeChannel& rswscSpikes = m_vswscResults[nItem];
+   const float* pfData;
+   unsigned int n;
+   for (n = nFirst; n < nLast && !m_bCancel; n++)
+      {
+      TSWEpoche* pswe = m_vpEpoches[n];
+      if (pswe->HasData())
+         pfData = pswe->GetChannel(nChannel);
+      else
+         {
+         if (!rswes.IsOpen() || rswes.GetFileName() != pswe->m_usFileName)
+            rswes.Open(pswe->m_usFileName, pswe->m_nNumChannels, pswe->m_nNumSamples);
+         pfData = rswes.GetChannel(pswe->m_nIndex, nChannel);
+         }
+      m_pSpikes->DetectChannel(pswe, pfData, pswe->m_nNumSamples, nChannel, rvnPositions, rswscSpikes);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// waits for workers and replaces spikes of all scanned channels by the spikes
+/// of all items and registers the thresholds of all scanned epoches. Returns
+/// false (and discards all detected spikes) if rescan was cancelled: spikes of
+/// the channels are kept unchanged then. Raises an exception if an error
+/// occurred in a worker
+//------------------------------------------------------------------------------
+bool TSWSpikeRescan::Finish()
+{
+   StopThreads();
+   if (!GetError().IsEmpty())
+      {
+      ClearResults();
+      throw Exception("error during spike rescan: " + GetError());
+      }
+   if (!IsComplete())
+      {
+      ClearResults();
+      return false;
+      }
+   unsigned int n, nChannel;
+   for (nChannel = 0; nChannel < m_nNumChannels; nChannel++)
+      m_pSpikes->Clear(m_vnChannels[nChannel]);
+   // items of one channel are ordered by epoche ranges
+   for (n = 0; n < m_nNumItems; n++)
+      m_pSpikes->AddSpikes(m_vnChannels[n % m_nNumChannels], m_vswscResults[n]);
+   for (nChannel = 0; nChannel < m_nNumChannels; nChannel++)
+      {
+      for (n = 0; n < m_vpEpoches.size(); n++)
+         m_pSpikes->RegisterDetection(m_vnChannels[nChannel], m_vpEpoches[n]->m_vdThreshold[m_vnChannels[nChannel]]);
+      }
+   return true;
+}
+//------------------------------------------------------------------------------
+
@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeRescan.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeRescan: parallel spike detection on
+/// stored epoches
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeRescanH
+#define SWSpikeRescanH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include "SWSpike.h"
+#include "SWEpoches.h"
+#include "SWWorkerPool.h"
+
+/// number of epoches processed by one work item
+#define SWSR_CHUNKSIZE  32
+
+//------------------------------------------------------------------------------
+/// class for detecting spikes of many stored epoches on a pool of worker
+/// threads. Work is partitioned in items of SWSR_CHUNKSIZE epoches and one
+/// channel, the workers pull items lock-free and read epoche data zero-copy
+/// from their own TSWEpocheStore. Every item collects its spikes in an own
+/// list, Finish() merges them in item order, so the result is identical to a
+/// serial scan (epoche order, position order within epoches) independent of
+/// number of threads and scheduling. Optionally only a subset of channels is
+/// scanned.
+/// Usage (GUI thread): see TSWWorkerPool, finally call Finish()
+//------------------------------------------------------------------------------
+class TSWSpikeRescan : public TSWWorkerPool
+{
+   private:
+      TSWSpikes*                 m_pSpikes;
+      std::vector<TSWEpoche* >   m_vpEpoches;
+      std::vector<unsigned int > m_vnChannels;
+      unsigned int               m_nNumChannels;
+      unsigned int               m_nNumItems;
+      std::vector<TSWSpikeChannel > m_vswscResults;
+      void           ProcessItem(unsigned int nItem,
+                                 TSWEpocheStore &rswes,
+                                 std::vector<unsigned int >& rvnPositions);
+      void           ClearResults();
+   protected:
+      void           DoWork();
+   public:
+      TSWSpikeRescan(TSWSpikes* pSpikes,
+                     const std::vector<TSWEpoche* >& rvpEpoches,
+                     unsigned int nNumThreads = 0,
+                     const std::vector<unsigned int >* pvnChannels = NULL);
+      ~TSWSpikeRescan();
+      bool           Finish();
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,263 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeResponse.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeResponse: spike counts and spike
+/// phases of all stimuli of one channel for bubble plots
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeResponse.h"
+#include <math.h>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// computes cosine and sine of the phases 2*pi*cycle of nNum spike cycles.
+/// Cycles are reduced to quarter periods and cosine and sine of the remaining
+/// angle (at most pi/4) are computed by Taylor polynomials (error < 1e-13).
+/// The loop contains no branches and no calls, so it can be vectorized
+//------------------------------------------------------------------------------
+static void SinCosCycles(const double* pdCycles, double* pdCos, double* pdSin, unsigned int nNum)
+{
+   unsigned int n;
+   for (n = 0; n < nNum; n++)
+      {
+      // number of quarter periods (rounded) and remaining angle
+      double dQuarters  = 4.0*(pdCycles[n] - floor(pdCycles[n]));
+      double dQuadrant  = floor(dQuarters + 0.5);
+      double dX         = (dQuarters - dQuadrant) * (0.5*M_PI);
+      double dX2        = dX*dX;
+      double dSin = dX*(1.0 + dX2*(-1.0/6.0 + dX2*(1.0/120.0 + dX2*(-1.0/5040.0
+                  + dX2*(1.0/362880.0 + dX2*(-1.0/39916800.0 + dX2*(1.0/6227020800.0)))))));
+      double dCos = 1.0 + dX2*(-0.5 + dX2*(1.0/24.0 + dX2*(-1.0/720.0 + dX2*(1.0/40320.0
+                  + dX2*(-1.0/3628800.0 + dX2*(1.0/479001600.0 + dX2*(-1.0/87178291200.0)))))));
+      // rotate by quadrant (0 ... 4, 4 is identical to 0)
+      int nQuadrant     = (int)dQuadrant & 3;
+      double dCosSign   = (nQuadrant == 1 || nQuadrant == 2) ? -1.0 : 1.0;
+      double dSinSign   = (nQuadrant >= 2) ? -1.0 : 1.0;
+      bool bSwap        = (nQuadrant & 1) != 0;
+      pdCos[n] = dCosSign * (bSwap ? dSin : dCos);
+      pdSin[n] = dSinSign * (bSwap ? dCos : dSin);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members (nothing selected)
+//------------------------------------------------------------------------------
+TSWResponseSettings::TSWResponseSettings()
+   :  dMin(0.0), dMax(0.0), bSelected(false),
+      dNoiseMin(0.0), dNoiseMax(0.0), bNoiseSelected(false),
+      dOnset(0.0)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if passed settings are identical
+//------------------------------------------------------------------------------
+bool TSWResponseSettings::IsEqual(const TSWResponseSettings& rswrs) const
+{
+   return   dMin == rswrs.dMin
+         && dMax == rswrs.dMax
+         && bSelected == rswrs.bSelected
+         && dNoiseMin == rswrs.dNoiseMin
+         && dNoiseMax == rswrs.dNoiseMax
+         && bNoiseSelected == rswrs.bNoiseSelected
+         && dOnset == rswrs.dOnset
+         && vdFrequency == rswrs.vdFrequency;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWStimulusResponse::TSWStimulusResponse()
+   :  nNumSpikes(0), nNumSelected(0), nNumNoise(0),
+      nNumCycles(0), dSumCos(0.0), dSumSin(0.0)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWSpikeResponse::TSWSpikeResponse()
+   : m_nNumPending(0)
+{
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes all spikes
+//------------------------------------------------------------------------------
+void TSWSpikeResponse::Clear()
+{
+   m_nNumPending = 0;
+   m_vswsr.clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets settings and removes all spikes
+//------------------------------------------------------------------------------
+void TSWSpikeResponse::SetSettings(const TSWResponseSettings& rswrs)
+{
+   m_swrs = rswrs;
+   Clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns current settings
+//------------------------------------------------------------------------------
+const TSWResponseSettings& TSWSpikeResponse::GetSettings() const
+{
+   return m_swrs;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds a spike of a stimulus
+//------------------------------------------------------------------------------
+void TSWSpikeResponse::Add(unsigned int nStimIndex, double dTime)
+{
+   if (nStimIndex >= m_vswsr.size())
+      m_vswsr.resize(nStimIndex + 1);
+   TSWStimulusResponse& rswsr = m_vswsr[nStimIndex];
+   rswsr.nNumSpikes++;
+   if (m_swrs.bSelected && dTime >= m_swrs.dMin && dTime <= m_swrs.dMax)
+      {
+      rswsr.nNumSelected++;
+      AddCycle(nStimIndex, dTime, 1.0);
+      }
+   if (m_swrs.bNoiseSelected && dTime >= m_swrs.dNoiseMin && dTime <= m_swrs.dNoiseMax)
+      rswsr.nNumNoise++;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// removes a spike of a stimulus, that was added before
+//------------------------------------------------------------------------------
+void TSWSpikeResponse::Subtract(unsigned int nStimIndex, double dTime)
+{
+   if (nStimIndex >= m_vswsr.size() || !m_vswsr[nStimIndex].nNumSpikes)
+      throw Exception("spike response does not contain spike to remove");
+   TSWStimulusResponse& rswsr = m_vswsr[nStimIndex];
+   rswsr.nNumSpikes--;
+   if (m_swrs.bSelected && dTime >= m_swrs.dMin && dTime <= m_swrs.dMax)
+      {
+      rswsr.nNumSelected--;
+      AddCycle(nStimIndex, dTime, -1.0);
+      }
+   if (m_swrs.bNoiseSelected && dTime >= m_swrs.dNoiseMin && dTime <= m_swrs.dNoiseMax)
+      rswsr.nNumNoise--;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds (dSign = 1) or removes (dSign = -1) the phase of a spike of a stimulus
+/// with a frequency. Number of phases and period histogram are updated at
+/// once, the sums of cosine and sine when the batch is processed (see Flush)
+//------------------------------------------------------------------------------
+void TSWSpikeResponse::AddCycle(unsigned int nStimIndex, double dTime, double dSign)
+{
+   if (nStimIndex >= m_swrs.vdFrequency.size() || !(m_swrs.vdFrequency[nStimIndex] > 0.0))
+      return;
+   TSWStimulusResponse& rswsr = m_vswsr[nStimIndex];
+   double dCycle = (dTime - m_swrs.dOnset) * m_swrs.vdFrequency[nStimIndex];
+   // phase in [0, 1): negative cycles (spikes before stimulus onset) are
+   // wrapped as well
+   unsigned int nBin = (unsigned int)floor((dCycle - floor(dCycle)) * SWSR_PHASE_BINS);
+   if (nBin >= SWSR_PHASE_BINS)
+      nBin = SWSR_PHASE_BINS - 1;
+   if (dSign > 0.0)
+      {
+      if (rswsr.vnPhaseBins.empty())
+         rswsr.vnPhaseBins.resize(SWSR_PHASE_BINS, 0);
+      rswsr.vnPhaseBins[nBin]++;
+      rswsr.nNumCycles++;
+      }
+   else
+      {
+      if (!rswsr.nNumCycles || rswsr.vnPhaseBins.empty() || !rswsr.vnPhaseBins[nBin])
+         throw Exception("spike response does not contain spike phase to remove");
+      rswsr.vnPhaseBins[nBin]--;
+      rswsr.nNumCycles--;
+      }
+
+   m_anPendingStimuli[m_nNumPending] = nStimIndex;
+   m_adPendingCycles[m_nNumPending]  = dCycle;
+   m_adPendingSigns[m_nNumPending]   = dSign;
+   m_nNumPending++;
+   if (m_nNumPending == SWSR_BATCHSIZE)
+      Flush();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds cosine and sine of pending phases to the sums of their stimuli.
+/// Sums of stimuli without phases are reset to exactly 0 (no rounding errors
+/// of removed phases are kept)
+//------------------------------------------------------------------------------
+void TSWSpikeResponse::Flush()
+{
+   double adCos[SWSR_BATCHSIZE];
+   double adSin[SWSR_BATCHSIZE];
+   SinCosCycles(m_adPendingCycles, adCos, adSin, m_nNumPending);
+   unsigned int n;
+   for (n = 0; n < m_nNumPending; n++)
+      {
+      TSWStimulusResponse& rswsr = m_vswsr[m_anPendingStimuli[n]];
+      rswsr.dSumCos += m_adPendingSigns[n] * adCos[n];
+      rswsr.dSumSin += m_adPendingSigns[n] * adSin[n];
+      }
+   for (n = 0; n < m_nNumPending; n++)
+      {
+      TSWStimulusResponse& rswsr = m_vswsr[m_anPendingStimuli[n]];
+      if (!rswsr.nNumCycles)
+         {
+         rswsr.dSumCos = 0.0;
+         rswsr.dSumSin = 0.0;
+         }
+      }
+   m_nNumPending = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// processes pending phases and returns responses of all stimuli (stimuli
+/// behind the last one with spikes are missing)
+//------------------------------------------------------------------------------
+const std::vector<TSWStimulusResponse >& TSWSpikeResponse::GetStimuli()
+{
+   Flush();
+   return m_vswsr;
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,120 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeResponse.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeResponse: spike counts and spike
+/// phases of all stimuli of one channel for bubble plots
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeResponseH
+#define SWSpikeResponseH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+/// number of base bins of the period histogram of a stimulus
+#define SWSR_PHASE_BINS 400
+/// number of spike phases processed at once by TSWSpikeResponse
+#define SWSR_BATCHSIZE  256
+
+//------------------------------------------------------------------------------
+/// windows of the PSTH, that define the response of a stimulus, and
+/// stimulus frequencies for spike phases
+//------------------------------------------------------------------------------
+struct TSWResponseSettings
+{
+   /// PSTH selection in seconds (spikes counted as response)
+   double         dMin;
+   double         dMax;
+   bool           bSelected;
+   /// PSTH noise selection in seconds (spikes counted as spontaneous activity)
+   double         dNoiseMin;
+   double         dNoiseMax;
+   bool           bNoiseSelected;
+   /// stimulus onset in seconds (phase 0)
+   double         dOnset;
+   /// frequency of every stimulus in Hz (0 or missing: no phases)
+   std::vector<double > vdFrequency;
+   TSWResponseSettings();
+   bool           IsEqual(const TSWResponseSettings& rswrs) const;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// spike counts of one stimulus and phases of its spikes within the PSTH
+/// selection (sums of cosine and sine for vector strength and period
+/// histogram)
+//------------------------------------------------------------------------------
+struct TSWStimulusResponse
+{
+   /// number of grouped spikes
+   unsigned int   nNumSpikes;
+   /// number of grouped spikes within PSTH selection
+   unsigned int   nNumSelected;
+   /// number of grouped spikes within PSTH noise selection
+   unsigned int   nNumNoise;
+   /// number of spike phases (spikes within PSTH selection, if stimulus has
+   /// a frequency)
+   unsigned int   nNumCycles;
+   double         dSumCos;
+   double         dSumSin;
+   /// period histogram with SWSR_PHASE_BINS bins (empty, if no phases)
+   std::vector<unsigned int > vnPhaseBins;
+   TSWStimulusResponse();
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// spike counts and spike phases of all stimuli of one channel. Updated,
+/// whenever a spike is added to or removed from all groups (like
+/// TSWSpikeHistogram), so bubble plots only have to sum up the stimuli of a
+/// bubble. Phases are collected and processed in batches of SWSR_BATCHSIZE:
+/// cosine and sine of all phases of a batch are computed in one loop, that
+/// the compiler can vectorize (see Flush). Changing the settings removes all
+/// spikes, owner has to add them again
+//------------------------------------------------------------------------------
+class TSWSpikeResponse
+{
+   private:
+      TSWResponseSettings              m_swrs;
+      std::vector<TSWStimulusResponse > m_vswsr;
+      unsigned int                     m_nNumPending;
+      unsigned int                     m_anPendingStimuli[SWSR_BATCHSIZE];
+      double                           m_adPendingCycles[SWSR_BATCHSIZE];
+      double                           m_adPendingSigns[SWSR_BATCHSIZE];
+      void           AddCycle(unsigned int nStimIndex, double dTime, double dSign);
+   public:
+      TSWSpikeResponse();
+      void           Clear();
+      void           SetSettings(const TSWResponseSettings& rswrs);
+      const TSWResponseSettings& GetSettings() const;
+      void           Add(unsigned int nStimIndex, double dTime);
+      void           Subtract(unsigned int nStimIndex, double dTime);
+      void           Flush();
+      const std::vector<TSWStimulusResponse >& GetStimuli();
+};
+//------------------------------------------------------------------------------
+#endif
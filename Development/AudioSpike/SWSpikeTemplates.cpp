@@ -0,0 +1,324 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeTemplates.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeTemplates: matched filter detection of
+/// spikes by normalized FFT cross correlation with waveform templates
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWSpikeTemplates.h"
+#include "HtFFT3.h"
+#include "SWTools.h"
+#include <algorithm>
+#include <math.h>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// creating and destroying FFTW plans is not thread safe, so all CHtFFT
+/// instances used by templates are created and deleted holding this lock
+//------------------------------------------------------------------------------
+class TSWFFTPlanLock
+{
+   private:
+      CRITICAL_SECTION  m_cs;
+   public:
+      TSWFFTPlanLock()  { InitializeCriticalSection(&m_cs); }
+      ~TSWFFTPlanLock() { DeleteCriticalSection(&m_cs); }
+      CHtFFT*  Create(unsigned int nFFTLen);
+      void     Delete(CHtFFT* &rpfft);
+};
+//------------------------------------------------------------------------------
+
+static TSWFFTPlanLock g_swfplLock;
+
+//------------------------------------------------------------------------------
+/// creates a CHtFFT instance
+//------------------------------------------------------------------------------
+CHtFFT* TSWFFTPlanLock::Create(unsigned int nFFTLen)
+{
+   CHtFFT* pfft = NULL;
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      pfft = new CHtFFT(nFFTLen);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+   return pfft;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// deletes a CHtFFT instance and sets passed pointer to NULL
+//------------------------------------------------------------------------------
+void TSWFFTPlanLock::Delete(CHtFFT* &rpfft)
+{
+   EnterCriticalSection(&m_cs);
+   try
+      {
+      TRYDELETENULL(rpfft);
+      }
+   __finally
+      {
+      LeaveCriticalSection(&m_cs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members. FFT length is the next power of two, that
+/// is at least SWST_FFTLEN_FACTOR times the template length (and at least
+/// SWST_MIN_FFTLEN): each block yields FFT length - template length + 1
+/// correlation values
+//------------------------------------------------------------------------------
+TSWSpikeTemplates::TSWSpikeTemplates(unsigned int nLength, double dMinScore, double dMinScale)
+   : m_nLength(nLength), m_dMinScore(dMinScore), m_dMinScale(dMinScale)
+{
+   if (m_nLength < 2)
+      throw Exception("template length must be >= 2");
+   if (m_dMinScore <= 0.0 || m_dMinScore > 1.0)
+      throw Exception("template score must be > 0 and <= 1");
+   if (m_dMinScale < 0.0)
+      throw Exception("template scale must be >= 0");
+   m_nFFTLen = SWST_MIN_FFTLEN;
+   while (m_nFFTLen < SWST_FFTLEN_FACTOR * m_nLength)
+      m_nFFTLen *= 2;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds a template (m_nLength values). Mean is removed, so scores do not
+/// depend on the offset of the data
+//------------------------------------------------------------------------------
+void TSWSpikeTemplates::Add(const double* pdTemplate)
+{
+   unsigned int n;
+   double dMean = 0.0;
+   for (n = 0; n < m_nLength; n++)
+      dMean += pdTemplate[n];
+   dMean /= (double)m_nLength;
+
+   double dEnergy = 0.0;
+   vvaf vvafTemplate(1, vaf(0.0f, m_nFFTLen));
+   std::vector<double > vdTemplate(m_nLength);
+   for (n = 0; n < m_nLength; n++)
+      {
+      vdTemplate[n]     = pdTemplate[n] - dMean;
+      vvafTemplate[0][n]= (float)vdTemplate[n];
+      dEnergy += vdTemplate[n]*vdTemplate[n];
+      }
+   if (dEnergy <= 0.0)
+      throw Exception("constant waveform cannot be used as template");
+
+   vvac vvacSpectrum(1, vac(m_nFFTLen/2 + 1));
+   CHtFFT* pfft = g_swfplLock.Create(m_nFFTLen);
+   try
+      {
+      pfft->Wave2Spec(vvafTemplate, vvacSpectrum, false);
+      }
+   __finally
+      {
+      g_swfplLock.Delete(pfft);
+      }
+   // Wave2Spec scales by 1/FFT length: multiplying two spectra and
+   // transforming back (unscaled) needs a factor FFT length for the
+   // correlation. Conjugation turns convolution to correlation
+   float fScale = (float)m_nFFTLen;
+   for (n = 0; n < vvacSpectrum[0].size(); n++)
+      vvacSpectrum[0][n] = fScale * std::conj(vvacSpectrum[0][n]);
+
+   m_vdTemplates.insert(m_vdTemplates.end(), vdTemplate.begin(), vdTemplate.end());
+   m_vdEnergy.push_back(dEnergy);
+   m_vvacSpectra.push_back(vvacSpectrum[0]);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of templates
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeTemplates::GetNumTemplates() const
+{
+   return (unsigned int)m_vdEnergy.size();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns template length
+//------------------------------------------------------------------------------
+unsigned int TSWSpikeTemplates::GetLength() const
+{
+   return m_nLength;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns one template (with mean removed, GetLength() values). Adding the
+/// returned templates to a new instance reproduces the detection exactly
+//------------------------------------------------------------------------------
+const double* TSWSpikeTemplates::GetTemplate(unsigned int nIndex) const
+{
+   if (nIndex >= GetNumTemplates())
+      throw Exception("template index exceeded");
+   return &m_vdTemplates[nIndex * m_nLength];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns minimum score of matches
+//------------------------------------------------------------------------------
+double TSWSpikeTemplates::GetMinScore() const
+{
+   return m_dMinScore;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns minimum scale of matches
+//------------------------------------------------------------------------------
+double TSWSpikeTemplates::GetMinScale() const
+{
+   return m_dMinScale;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// detects template matches in data and returns their positions: position of
+/// best matching window (window start) plus nAlign, i.e. positions are
+/// comparable to threshold crossings, if nAlign is the number of samples
+/// before threshold crossing in the templates. A window matches, if score
+/// and scale of at least one template reach minimum values. Within a run of
+/// matching windows the window with the best score is taken and no further
+/// window is taken within nDeadTime samples behind it
+//------------------------------------------------------------------------------
+void TSWSpikeTemplates::Detect(  const float* pfData,
+                                 unsigned int nNumSamples,
+                                 unsigned int nAlign,
+                                 unsigned int nDeadTime,
+                                 std::vector<unsigned int >& rvnPositions) const
+{
+   rvnPositions.clear();
+   unsigned int nNumTemplates = GetNumTemplates();
+   if (!nNumTemplates || nNumSamples < m_nLength)
+      return;
+   unsigned int nNumWindows = nNumSamples - m_nLength + 1;
+
+   // running sums for mean and energy of windows
+   std::vector<double > vdSum(nNumSamples + 1, 0.0);
+   std::vector<double > vdSum2(nNumSamples + 1, 0.0);
+   unsigned int n;
+   for (n = 0; n < nNumSamples; n++)
+      {
+      vdSum[n+1]  = vdSum[n]  + (double)pfData[n];
+      vdSum2[n+1] = vdSum2[n] + (double)pfData[n] * (double)pfData[n];
+      }
+
+   std::vector<double > vdNorm(nNumTemplates);
+   for (n = 0; n < nNumTemplates; n++)
+      vdNorm[n] = sqrt(m_vdEnergy[n]);
+
+   // best score of all matching templates per window (0: no match)
+   std::vector<float > vfScore(nNumWindows, 0.0f);
+
+   // overlap-save: every block of FFT length yields the correlation of the
+   // windows starting within the first nHop samples of the block
+   unsigned int nHop = m_nFFTLen - m_nLength + 1;
+   vvaf vvafBlock(1, vaf(0.0f, m_nFFTLen));
+   vvac vvacBlock(1, vac(m_nFFTLen/2 + 1));
+   vvac vvacProduct(nNumTemplates, vac(m_nFFTLen/2 + 1));
+   vvaf vvafCorrelation(nNumTemplates, vaf(0.0f, m_nFFTLen));
+   unsigned int nBlock, nNum, nWindow, nTemplate;
+   double dEnergy, dWindowNorm, dCorrelation, dScore;
+   CHtFFT* pfft = g_swfplLock.Create(m_nFFTLen);
+   try
+      {
+      for (nBlock = 0; nBlock < nNumWindows; nBlock += nHop)
+         {
+         nNum = std::min(m_nFFTLen, nNumSamples - nBlock);
+         for (n = 0; n < nNum; n++)
+            vvafBlock[0][n] = pfData[nBlock + n];
+         for (; n < m_nFFTLen; n++)
+            vvafBlock[0][n] = 0.0f;
+         pfft->Wave2Spec(vvafBlock, vvacBlock, false);
+         for (nTemplate = 0; nTemplate < nNumTemplates; nTemplate++)
+            vvacProduct[nTemplate] = vvacBlock[0] * m_vvacSpectra[nTemplate];
+         pfft->Spec2Wave(vvacProduct, vvafCorrelation);
+
+         nNum = std::min(nHop, nNumWindows - nBlock);
+         for (n = 0; n < nNum; n++)
+            {
+            nWindow = nBlock + n;
+            dEnergy = vdSum2[nWindow + m_nLength] - vdSum2[nWindow];
+            dCorrelation = vdSum[nWindow + m_nLength] - vdSum[nWindow];
+            dEnergy -= dCorrelation * dCorrelation / (double)m_nLength;
+            if (dEnergy <= 0.0)
+               continue;
+            dWindowNorm = sqrt(dEnergy);
+            for (nTemplate = 0; nTemplate < nNumTemplates; nTemplate++)
+               {
+               // templates have zero mean, so correlation with the data is
+               // identical to correlation with the window minus its mean
+               dCorrelation = (double)vvafCorrelation[nTemplate][n];
+               if (dCorrelation < m_dMinScale * m_vdEnergy[nTemplate])
+                  continue;
+               dScore = dCorrelation / (vdNorm[nTemplate] * dWindowNorm);
+               if (dScore >= m_dMinScore && dScore > (double)vfScore[nWindow])
+                  vfScore[nWindow] = (float)dScore;
+               }
+            }
+         }
+      }
+   __finally
+      {
+      g_swfplLock.Delete(pfft);
+      }
+
+   // peak picking
+   unsigned int nPeak;
+   nWindow = 0;
+   while (nWindow < nNumWindows)
+      {
+      if (vfScore[nWindow] <= 0.0f)
+         {
+         nWindow++;
+         continue;
+         }
+      nPeak = nWindow;
+      for (n = nWindow + 1; n < nNumWindows && n <= nWindow + nDeadTime && vfScore[n] > 0.0f; n++)
+         {
+         if (vfScore[n] > vfScore[nPeak])
+            nPeak = n;
+         }
+      rvnPositions.push_back(nPeak + nAlign);
+      nWindow = nPeak + nDeadTime + 1;
+      }
+}
+//------------------------------------------------------------------------------
@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+/// \file SWSpikeTemplates.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWSpikeTemplates: matched filter detection of
+/// spikes by normalized FFT cross correlation with waveform templates
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWSpikeTemplatesH
+#define SWSpikeTemplatesH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <valarray>
+#include <complex>
+#include <memory>
+
+/// minimum number of spikes of a group for using its mean as template
+#define SWST_MIN_SPIKES       5
+/// minimum FFT length used for block correlation
+#define SWST_MIN_FFTLEN       512
+/// FFT length is at least SWST_FFTLEN_FACTOR times the template length
+#define SWST_FFTLEN_FACTOR    8
+
+//------------------------------------------------------------------------------
+/// matched filter detection of spikes with waveform templates (e.g. the mean
+/// waveforms of the spike groups of a channel). Data are cross correlated with
+/// all templates blockwise (overlap-save) by FFT (CHtFFT). The score of a
+/// window is the normalized correlation (Pearson correlation coefficient of
+/// window and template, -1 ... 1), so it does not depend on amplitude. To
+/// reject noise resembling a template by chance, the amplitude of the matched
+/// template (least squares scale of the template fitting the window) must not
+/// be below a minimum scale as well. Detected positions are the score peaks
+/// passing both limits, a dead time is applied after each peak.
+/// NOTE: templates cannot be changed after publishing (see
+/// TSWSpikeTemplatesPtr), Detect() is thread safe
+//------------------------------------------------------------------------------
+class TSWSpikeTemplates
+{
+   private:
+      unsigned int            m_nLength;
+      unsigned int            m_nFFTLen;
+      double                  m_dMinScore;
+      double                  m_dMinScale;
+      /// templates with mean removed, one row of m_nLength values per template
+      std::vector<double >    m_vdTemplates;
+      /// energy (sum of squares) of the templates
+      std::vector<double >    m_vdEnergy;
+      /// conjugated spectra of templates (zero padded to m_nFFTLen)
+      std::vector<std::valarray<std::complex<float > > > m_vvacSpectra;
+   public:
+      TSWSpikeTemplates(unsigned int nLength, double dMinScore, double dMinScale);
+      void           Add(const double* pdTemplate);
+      unsigned int   GetNumTemplates() const;
+      unsigned int   GetLength() const;
+      const double*  GetTemplate(unsigned int nIndex) const;
+      double         GetMinScore() const;
+      double         GetMinScale() const;
+      void           Detect(  const float* pfData,
+                              unsigned int nNumSamples,
+                              unsigned int nAlign,
+                              unsigned int nDeadTime,
+                              std::vector<unsigned int >& rvnPositions) const;
+};
+//------------------------------------------------------------------------------
+
+/// published templates
+typedef std::shared_ptr<const TSWSpikeTemplates > TSWSpikeTemplatesPtr;
+
+//------------------------------------------------------------------------------
+#endif
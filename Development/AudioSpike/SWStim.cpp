@@ -34,6 +34,8 @@
 #include "SWTools.h"
 #include <math.h>
 #include <algorithm>
+#include <map>
+#include <limits.h>
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wundef"
 #include "sndfile.h"
@@ -63,6 +65,7 @@ void TSWStimuli::Clear()
    m_swspStimPars.Clear();
    m_swstStimuli.clear();
    m_vSWAudioData.clear();
+   m_vnValueIndex.clear();
 }
 //------------------------------------------------------------------------------
 
@@ -429,7 +432,7 @@ void TSWStimuli::AddStimuli(_di_IXMLNode xmlStimuli, double dAvailableLength, in
          if (nNumChannels != 1 && nNumChannels != m_nNumChannels)
             throw Exception("Sound file '" + usFileName + "' has " + IntToStr((int)nNumChannels) + " channels (expected channels: " + IntToStr((int)m_nNumChannels) +  ")");
          if (dStimLength > dAvailableLength)
-            throw Exception("Sound file '" + usFileName + "' too long: " + DoubleToStr(dStimLength) + " seconds (maximum allowed seconds: " + DoubleToStr(dAvailableLength) +  " ( == EpocheLength - PreStimulus))");
+            throw Exception("Sound file '" + usFileName + "' too long: " + DoubleToStr(dStimLength) + " seconds (maximum allowed seconds: " + DoubleToStr(dAvailableLength) +  " ( == EpocheLength - PreStimulus - PreTrigger))");
 
          // read optional passed RMS (if empty, i.e. 0.0, then LoadAudioData will calculate RMS)
          vved vvedRMS;
@@ -488,6 +491,51 @@ void TSWStimuli::AddStimuli(_di_IXMLNode xmlStimuli, double dAvailableLength, in
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// returns index of the value of a parameter of a stimulus within the values
+/// of the parameter (m_swspStimPars.m_vvdValues[nParam]), i.e. the bubble
+/// coordinate of the stimulus on an axis showing this parameter. Returns
+/// UINT_MAX if the value is not found (should not happen). Indices are
+/// rebuilt, if number of stimuli or parameters changed
+//------------------------------------------------------------------------------
+unsigned int TSWStimuli::GetValueIndex(unsigned int nStimIndex, unsigned int nParam)
+{
+   unsigned int nNumPars = (unsigned int)m_swspStimPars.m_vvdValues.size();
+   if (m_vnValueIndex.size() != m_swstStimuli.size() * nNumPars)
+      UpdateValueIndex();
+   if (nStimIndex >= m_swstStimuli.size() || nParam >= nNumPars)
+      throw Exception("stimulus or parameter index out of range");
+   return m_vnValueIndex[nStimIndex * nNumPars + nParam];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// builds value indices of all stimuli (see GetValueIndex). For doublette
+/// values the first index is used (identical to searching the values)
+//------------------------------------------------------------------------------
+void TSWStimuli::UpdateValueIndex()
+{
+   unsigned int nNumPars = (unsigned int)m_swspStimPars.m_vvdValues.size();
+   m_vnValueIndex.assign(m_swstStimuli.size() * nNumPars, UINT_MAX);
+   unsigned int nPar, nValue, nStim;
+   for (nPar = 0; nPar < nNumPars; nPar++)
+      {
+      const std::vector<double >& rvdValues = m_swspStimPars.m_vvdValues[nPar];
+      std::map<double, unsigned int > mIndices;
+      for (nValue = 0; nValue < rvdValues.size(); nValue++)
+         mIndices.insert(std::make_pair(rvdValues[nValue], nValue));
+      for (nStim = 0; nStim < m_swstStimuli.size(); nStim++)
+         {
+         if (nPar >= m_swstStimuli[nStim].m_vdParams.size())
+            continue;
+         std::map<double, unsigned int >::const_iterator it = mIndices.find(m_swstStimuli[nStim].m_vdParams[nPar]);
+         if (it != mIndices.end())
+            m_vnValueIndex[nStim * nNumPars + nPar] = it->second;
+         }
+      }
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// returns pointer do TSWAudioData by filename
 //------------------------------------------------------------------------------
@@ -61,7 +61,11 @@ class TSWAudioData
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// class for handling multiple instances of TSWStimulus and TSWAudioData
+/// class for handling multiple instances of TSWStimulus and TSWAudioData.
+/// For every stimulus the indices of its parameter values within the value
+/// lists of the parameters (m_swspStimPars.m_vvdValues) are built once (see
+/// GetValueIndex), so the bubble of a stimulus for any parameter pair is
+/// found without searching
 //------------------------------------------------------------------------------
 class TSWStimuli
 {
@@ -91,7 +95,11 @@ class TSWStimuli
                                           double         &dSampleRate
                                           );
       TSWAudioData*  GetAudioData(UnicodeString usFileName);
+      unsigned int   GetValueIndex(unsigned int nStimIndex, unsigned int nParam);
    private:
+      /// value indices: one row of parameters per stimulus
+      std::vector<unsigned int > m_vnValueIndex;
+      void UpdateValueIndex();
       void LoadAudioData(UnicodeString usFileName, vved& rvvedRMS);
       void AddParams(_di_IXMLNode xmlParams);
       void AddStimuli(_di_IXMLNode xmlStimuli, double dAvailableLength, int nMode);
@@ -0,0 +1,184 @@
+//------------------------------------------------------------------------------
+/// \file SWStreamFile.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWStreamFile for continuous recording of all
+/// electrode channels with a trigger index
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWStreamFile.h"
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns stream file of a result in passed path
+//------------------------------------------------------------------------------
+UnicodeString TSWStreamFile::GetFileName(UnicodeString usPath)
+{
+   return IncludeTrailingBackslash(usPath) + SWSF_FILENAME;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns trigger index file of a result in passed path
+//------------------------------------------------------------------------------
+UnicodeString TSWStreamFile::GetIndexFileName(UnicodeString usPath)
+{
+   return IncludeTrailingBackslash(usPath) + SWSF_INDEXFILENAME;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns size of one chunk in bytes
+//------------------------------------------------------------------------------
+unsigned int TSWStreamFile::GetChunkSize(unsigned int nNumChannels, unsigned int nChunkSamples)
+{
+   return (unsigned int)sizeof(TSWStreamChunkHeader) + nNumChannels*nChunkSamples*(unsigned int)sizeof(float);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// initializes passed header for a new stream file
+//------------------------------------------------------------------------------
+void TSWStreamFile::InitHeader(  TSWStreamFileHeader &rHeader,
+                                 unsigned int nNumChannels,
+                                 unsigned int nChunkSamples,
+                                 double dSampleRate,
+                                 double dSampleRateDevider)
+{
+   ZeroMemory(&rHeader, sizeof(rHeader));
+   CopyMemory(rHeader.szMagic, SWSF_MAGIC, sizeof(rHeader.szMagic));
+   rHeader.nVersion           = SWSF_VERSION;
+   rHeader.nHeaderSize        = (unsigned int)sizeof(rHeader);
+   rHeader.nNumChannels       = nNumChannels;
+   rHeader.nChunkSamples      = nChunkSamples;
+   rHeader.dSampleRate        = dSampleRate;
+   rHeader.dSampleRateDevider = dSampleRateDevider;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// initializes passed header for a new trigger index file
+//------------------------------------------------------------------------------
+void TSWStreamFile::InitIndexHeader(TSWStreamIndexHeader &rHeader)
+{
+   ZeroMemory(&rHeader, sizeof(rHeader));
+   CopyMemory(rHeader.szMagic, SWSF_INDEXMAGIC, sizeof(rHeader.szMagic));
+   rHeader.nVersion     = SWSF_VERSION;
+   rHeader.nHeaderSize  = (unsigned int)sizeof(rHeader);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// checks passed stream file header, throws an exception if it is invalid
+//------------------------------------------------------------------------------
+void TSWStreamFile::CheckHeader(const TSWStreamFileHeader &rHeader)
+{
+   if (memcmp(rHeader.szMagic, SWSF_MAGIC, sizeof(rHeader.szMagic)))
+      throw Exception("invalid stream file");
+   if (rHeader.nVersion > SWSF_VERSION)
+      throw Exception("stream file version " + IntToStr((int)rHeader.nVersion) + " not supported");
+   if (  rHeader.nHeaderSize < sizeof(TSWStreamFileHeader)
+      || !rHeader.nNumChannels
+      || !rHeader.nChunkSamples
+      )
+      throw Exception("invalid stream file header");
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// prepares a stream file for appending: checks that channels and chunk size
+/// match, removes incomplete trailing chunk (e.g. after a crash) and returns
+/// number of samples in stream and run index to be used for appended chunks
+//------------------------------------------------------------------------------
+void TSWStreamFile::PrepareAppend(  UnicodeString usFileName,
+                                    unsigned int nNumChannels,
+                                    unsigned int nChunkSamples,
+                                    __int64 &rnNumSamples,
+                                    unsigned int &rnRun)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenReadWrite | fmShareDenyWrite);
+   try
+      {
+      TSWStreamFileHeader swsfh;
+      if (pfs->Read(&swsfh, sizeof(swsfh)) != (int)sizeof(swsfh))
+         throw Exception("stream file '" + usFileName + "' is too short");
+      CheckHeader(swsfh);
+      // chunk header has changed in version 2
+      if (swsfh.nVersion != SWSF_VERSION)
+         throw Exception("stream file '" + usFileName + "' was written by an older version and cannot be appended");
+      if (swsfh.nNumChannels != nNumChannels || swsfh.nChunkSamples != nChunkSamples)
+         throw Exception("number of channels or buffer size do not match stream file: stream cannot be appended");
+
+      __int64 nChunkSize = (__int64)GetChunkSize(nNumChannels, nChunkSamples);
+      __int64 nNumChunks = (pfs->Size - (__int64)swsfh.nHeaderSize) / nChunkSize;
+      pfs->Size = (__int64)swsfh.nHeaderSize + nNumChunks * nChunkSize;
+
+      rnNumSamples   = nNumChunks * (__int64)nChunkSamples;
+      rnRun          = 0;
+      if (nNumChunks)
+         {
+         TSWStreamChunkHeader swsch;
+         pfs->Position = (__int64)swsfh.nHeaderSize + (nNumChunks-1) * nChunkSize;
+         if (pfs->Read(&swsch, sizeof(swsch)) != (int)sizeof(swsch) || swsch.nMagic != SWSF_CHUNKMAGIC)
+            throw Exception("invalid chunk in stream file '" + usFileName + "'");
+         rnRun = swsch.nRun + 1;
+         }
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// prepares a trigger index file for appending: removes incomplete trailing
+/// entry
+//------------------------------------------------------------------------------
+void TSWStreamFile::PrepareAppendIndex(UnicodeString usFileName)
+{
+   TFileStream *pfs = new TFileStream(usFileName, fmOpenReadWrite | fmShareDenyWrite);
+   try
+      {
+      TSWStreamIndexHeader swsih;
+      if (  pfs->Read(&swsih, sizeof(swsih)) != (int)sizeof(swsih)
+         || memcmp(swsih.szMagic, SWSF_INDEXMAGIC, sizeof(swsih.szMagic))
+         || swsih.nHeaderSize < sizeof(TSWStreamIndexHeader)
+         )
+         throw Exception("invalid trigger index file '" + usFileName + "'");
+      __int64 nNumTriggers = (pfs->Size - (__int64)swsih.nHeaderSize) / (__int64)sizeof(TSWStreamTrigger);
+      pfs->Size = (__int64)swsih.nHeaderSize + nNumTriggers * (__int64)sizeof(TSWStreamTrigger);
+      }
+   __finally
+      {
+      TRYDELETENULL(pfs);
+      }
+}
+//------------------------------------------------------------------------------
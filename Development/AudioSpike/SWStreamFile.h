@@ -0,0 +1,148 @@
+//------------------------------------------------------------------------------
+/// \file SWStreamFile.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWStreamFile for continuous recording of all
+/// electrode channels with a trigger index
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWStreamFileH
+#define SWStreamFileH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <SWTools.h>
+
+//------------------------------------------------------------------------------
+/// Layout of a stream file (all values little endian):
+///   - TSWStreamFileHeader
+///   - one chunk per audio buffer: TSWStreamChunkHeader, followed by the
+///     samples (float) of all electrode channels (channel by channel)
+/// All chunks have the same size, so chunk of a sample position is computed
+/// directly. A shorter buffer (e.g. the last one of a run) is padded with
+/// zeros, nNumSamples in chunk header contains number of recorded samples.
+/// Every start/resume of a measurement starts a new run (nRun in chunk header):
+/// within a run stream is gapless, between runs it is not.
+/// Layout of trigger index file:
+///   - TSWStreamIndexHeader
+///   - one TSWStreamTrigger per recorded epoche
+/// Epoches are views into the stream: epoche data of an epoche with N samples
+/// are samples nPosition...nPosition+N-1 of stream
+//------------------------------------------------------------------------------
+#define SWSF_FILENAME         "stream.bin"
+#define SWSF_INDEXFILENAME    "stream.idx"
+#define SWSF_MAGIC            "ASSTREAM"
+#define SWSF_INDEXMAGIC       "ASSTRIDX"
+#define SWSF_VERSION          2
+#define SWSF_CHUNKMAGIC       0x4B4E4843  // 'CHNK'
+/// trigger flags
+#define SWSF_TRIGGERERROR     0x01
+#define SWSF_DROPPED          0x02
+
+#pragma pack(push, 1)
+//------------------------------------------------------------------------------
+/// stream file header
+//------------------------------------------------------------------------------
+struct TSWStreamFileHeader
+{
+   char              szMagic[8];
+   unsigned int      nVersion;
+   unsigned int      nHeaderSize;
+   unsigned int      nNumChannels;
+   unsigned int      nChunkSamples;
+   double            dSampleRate;
+   double            dSampleRateDevider;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// header of one chunk
+//------------------------------------------------------------------------------
+struct TSWStreamChunkHeader
+{
+   unsigned int      nMagic;
+   unsigned int      nRun;
+   // first sample of chunk in stream
+   __int64           nStartSample;
+   // number of recorded samples (rest of chunk is padding)
+   unsigned int      nNumSamples;
+   unsigned int      nReserved;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// trigger index file header
+//------------------------------------------------------------------------------
+struct TSWStreamIndexHeader
+{
+   char              szMagic[8];
+   unsigned int      nVersion;
+   unsigned int      nHeaderSize;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// one entry of trigger index
+//------------------------------------------------------------------------------
+struct TSWStreamTrigger
+{
+   unsigned int      nEpoche;
+   unsigned int      nStimIndex;
+   unsigned int      nRepetitionIndex;
+   unsigned int      nFlags;
+   // first sample of epoche in stream
+   __int64           nPosition;
+   // interpolated trigger onset in stream (samples)
+   double            dOnset;
+};
+//------------------------------------------------------------------------------
+#pragma pack(pop)
+
+//------------------------------------------------------------------------------
+/// helper class for creating and appending stream files
+//------------------------------------------------------------------------------
+class TSWStreamFile
+{
+   public:
+      static UnicodeString GetFileName(UnicodeString usPath);
+      static UnicodeString GetIndexFileName(UnicodeString usPath);
+      static unsigned int  GetChunkSize(unsigned int nNumChannels, unsigned int nChunkSamples);
+      static void          InitHeader( TSWStreamFileHeader &rHeader,
+                                       unsigned int nNumChannels,
+                                       unsigned int nChunkSamples,
+                                       double dSampleRate,
+                                       double dSampleRateDevider);
+      static void          InitIndexHeader(TSWStreamIndexHeader &rHeader);
+      static void          CheckHeader(const TSWStreamFileHeader &rHeader);
+      static void          PrepareAppend( UnicodeString usFileName,
+                                          unsigned int nNumChannels,
+                                          unsigned int nChunkSamples,
+                                          __int64 &rnNumSamples,
+                                          unsigned int &rnRun);
+      static void          PrepareAppendIndex(UnicodeString usFileName);
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,210 @@
+//------------------------------------------------------------------------------
+/// \file SWTriggerDetector.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWTriggerDetector for detecting triggers by
+/// vectorized threshold crossing
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWTriggerDetector.h"
+#if defined(__SSE__) || defined(_M_X64) || defined(__x86_64__)
+   #define SWTD_SSE
+   #include <xmmintrin.h>
+#endif
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns index of first sample in [nStart, nEnd) that is >= fThreshold (if
+/// bAbove is true) or < fThreshold (if bAbove is false). Returns nEnd if no
+/// such sample exists
+//------------------------------------------------------------------------------
+static unsigned int FindCrossing( const float* pf,
+                                  unsigned int nStart,
+                                  unsigned int nEnd,
+                                  float fThreshold,
+                                  bool bAbove)
+{
+   unsigned int n = nStart;
+   #ifdef SWTD_SSE
+   __m128 m128Thr = _mm_set1_ps(fThreshold);
+   for (; n + 4 <= nEnd; n += 4)
+      {
+      __m128 m128 = _mm_loadu_ps(pf + n);
+      int nMask = _mm_movemask_ps(bAbove ? _mm_cmpge_ps(m128, m128Thr) : _mm_cmplt_ps(m128, m128Thr));
+      if (nMask)
+         {
+         // index of lowest set bit
+         unsigned int nBit = 0;
+         while (!(nMask & (1 << nBit)))
+            nBit++;
+         return n + nBit;
+         }
+      }
+   #endif
+   for (; n < nEnd; n++)
+      {
+      if (bAbove ? pf[n] >= fThreshold : pf[n] < fThreshold)
+         return n;
+      }
+   return nEnd;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Initializes members
+//------------------------------------------------------------------------------
+TSWTriggerDetector::TSWTriggerDetector()
+   :  m_fThreshold(0.1f), m_nDeadTime(0), m_nDeadTimeLeft(0), m_bArmed(false),
+      m_fLastSample(0.0f), m_nNumTriggers(0), m_nMissed(0)
+{
+   m_vTriggers.resize(256);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets threshold, dead time (in samples) and maximum number of triggers per
+/// buffer and resets state
+//------------------------------------------------------------------------------
+void TSWTriggerDetector::Initialize(float fThreshold, unsigned int nDeadTime, unsigned int nMaxTriggers)
+{
+   if (!nMaxTriggers)
+      throw Exception("invalid maximum number of triggers");
+   m_fThreshold   = fThreshold;
+   m_nDeadTime    = nDeadTime;
+   m_vTriggers.resize(nMaxTriggers);
+   Reset();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// resets state. NOTE: detector is not armed before signal was below threshold
+/// once, i.e. a trigger pulse that is 'on' at start is not detected
+//------------------------------------------------------------------------------
+void TSWTriggerDetector::Reset()
+{
+   m_nDeadTimeLeft   = 0;
+   m_bArmed          = false;
+   m_fLastSample     = 0.0f;
+   m_nNumTriggers    = 0;
+   m_nMissed         = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// processes one buffer and returns number of triggers found in it. Triggers
+/// are available with GetTrigger until next call
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerDetector::Process(const float* pfData, unsigned int nSize)
+{
+   m_nNumTriggers = 0;
+   if (!nSize)
+      return 0;
+
+   unsigned int n = 0;
+   while (n < nSize)
+      {
+      // still within dead time?
+      if (m_nDeadTimeLeft)
+         {
+         unsigned int nSkip = nSize - n;
+         if (nSkip > m_nDeadTimeLeft)
+            nSkip = m_nDeadTimeLeft;
+         m_nDeadTimeLeft -= nSkip;
+         n += nSkip;
+         continue;
+         }
+      // not armed: wait for signal to fall below threshold
+      if (!m_bArmed)
+         {
+         n = FindCrossing(pfData, n, nSize, m_fThreshold, false);
+         if (n < nSize)
+            m_bArmed = true;
+         continue;
+         }
+      // armed: look for next rising crossing
+      n = FindCrossing(pfData, n, nSize, m_fThreshold, true);
+      if (n == nSize)
+         break;
+
+      // linear interpolation between previous and current sample
+      float fPrev = n ? pfData[n-1] : m_fLastSample;
+      double dFrac = 1.0;
+      if (pfData[n] > fPrev)
+         dFrac = (double)(m_fThreshold - fPrev) / (double)(pfData[n] - fPrev);
+      if (dFrac < 0.0 || dFrac > 1.0)
+         dFrac = 1.0;
+
+      if (m_nNumTriggers < m_vTriggers.size())
+         {
+         m_vTriggers[m_nNumTriggers].nPos   = n;
+         m_vTriggers[m_nNumTriggers].dOnset = (double)n - 1.0 + dFrac;
+         m_nNumTriggers++;
+         }
+      else
+         m_nMissed++;
+
+      m_bArmed          = false;
+      m_nDeadTimeLeft   = m_nDeadTime;
+      n++;
+      }
+   m_fLastSample = pfData[nSize-1];
+   return m_nNumTriggers;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of triggers found by last call of Process
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerDetector::GetNumTriggers()
+{
+   return m_nNumTriggers;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns a trigger found by last call of Process
+//------------------------------------------------------------------------------
+const TSWTrigger& TSWTriggerDetector::GetTrigger(unsigned int nIndex)
+{
+   if (nIndex >= m_nNumTriggers)
+      throw Exception("trigger index out of range");
+   return m_vTriggers[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of triggers that could not be stored since last Reset,
+/// because there were more than nMaxTriggers triggers within one buffer
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerDetector::GetMissed()
+{
+   return m_nMissed;
+}
+//------------------------------------------------------------------------------
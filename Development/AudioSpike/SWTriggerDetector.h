@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+/// \file SWTriggerDetector.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWTriggerDetector for detecting triggers by
+/// vectorized threshold crossing
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWTriggerDetectorH
+#define SWTriggerDetectorH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+
+//------------------------------------------------------------------------------
+/// one detected trigger
+//------------------------------------------------------------------------------
+struct TSWTrigger
+{
+   /// first sample within buffer that reached the threshold
+   unsigned int   nPos;
+   /// interpolated threshold crossing relative to buffer start (in samples,
+   /// may be negative if crossing was between last buffer and this buffer)
+   double         dOnset;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// threshold crossing state machine for trigger detection. State is carried
+/// across buffer boundaries, so any number of triggers per buffer and triggers
+/// spanning two buffers are handled. After a trigger the detector is blocked
+/// for a dead time (to skip the trigger pulse itself and the second pulse of
+/// the special double trigger) and re-armed as soon as the signal has fallen
+/// below the threshold. Scanning is done with SSE if available.
+/// NOTE: Process() does not allocate memory, it may be called in the recording
+/// callback
+//------------------------------------------------------------------------------
+class TSWTriggerDetector
+{
+   private:
+      float                      m_fThreshold;
+      unsigned int               m_nDeadTime;
+      unsigned int               m_nDeadTimeLeft;
+      bool                       m_bArmed;
+      float                      m_fLastSample;
+      unsigned int               m_nNumTriggers;
+      unsigned int               m_nMissed;
+      std::vector<TSWTrigger >   m_vTriggers;
+   public:
+      TSWTriggerDetector();
+      void           Initialize(float fThreshold, unsigned int nDeadTime, unsigned int nMaxTriggers = 256);
+      void           Reset();
+      unsigned int   Process(const float* pfData, unsigned int nSize);
+      unsigned int   GetNumTriggers();
+      const TSWTrigger& GetTrigger(unsigned int nIndex);
+      unsigned int   GetMissed();
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,270 @@
+//------------------------------------------------------------------------------
+/// \file SWTriggerTiming.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWTriggerTiming collecting trigger timing
+/// telemetry
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWTriggerTiming.h"
+#include <algorithm>
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor, initializes members
+//------------------------------------------------------------------------------
+TSWTriggerTiming::TSWTriggerTiming()
+   :  m_vnDistanceHistogram(SWTT_DISTANCE_BINS, 0),
+      m_vnOffsetHistogram(SWTT_OFFSET_BINS, 0),
+      m_vEvents(SWTT_MAX_EVENTS)
+{
+   Initialize(0, 0);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// resets all data and sets expected trigger distance and tolerance in samples.
+/// NOTE: must not be called while recording callback is running
+//------------------------------------------------------------------------------
+void TSWTriggerTiming::Initialize(int nExpectedDistance, int nTolerance)
+{
+   if (nTolerance < 0)
+      throw Exception("invalid trigger tolerance");
+   m_nExpectedDistance     = nExpectedDistance;
+   m_nTolerance            = nTolerance;
+   std::fill(m_vnDistanceHistogram.begin(), m_vnDistanceHistogram.end(), 0);
+   std::fill(m_vnOffsetHistogram.begin(), m_vnOffsetHistogram.end(), 0);
+   m_nNumEvents            = 0;
+   m_nNumErrors            = 0;
+   m_nNumTriggers          = 0;
+   m_nNumEventsCorrelated  = 0;
+   m_nNumDistances         = 0;
+   m_nMinDistance          = 0;
+   m_nMaxDistance          = 0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// adds a trigger (called by recording callback). Distance is ignored for the
+/// first trigger after start or reset (bFirst). Returns true if distance is out
+/// of tolerance (trigger error)
+//------------------------------------------------------------------------------
+bool TSWTriggerTiming::AddTrigger(  unsigned int nEpoche,
+                                    __int64 nPosition,
+                                    int nDistance,
+                                    unsigned int nBufferOffset,
+                                    unsigned int nBufferSize,
+                                    bool bFirst)
+{
+   m_nNumTriggers.store(m_nNumTriggers.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+   if (nBufferSize && nBufferOffset < nBufferSize)
+      m_vnOffsetHistogram[(unsigned int)(((unsigned __int64)nBufferOffset * SWTT_OFFSET_BINS) / nBufferSize)]++;
+   if (bFirst)
+      return false;
+
+   if (!m_nNumDistances || nDistance < m_nMinDistance)
+      m_nMinDistance = nDistance;
+   if (!m_nNumDistances || nDistance > m_nMaxDistance)
+      m_nMaxDistance = nDistance;
+   m_nNumDistances++;
+
+   // first bin: below range, last bin: above range
+   int nDeviation = nDistance - m_nExpectedDistance;
+   unsigned int nBin;
+   if (nDeviation < -SWTT_DISTANCE_RANGE)
+      nBin = 0;
+   else if (nDeviation > SWTT_DISTANCE_RANGE)
+      nBin = SWTT_DISTANCE_BINS - 1;
+   else
+      nBin = (unsigned int)(nDeviation + SWTT_DISTANCE_RANGE + 1);
+   m_vnDistanceHistogram[nBin]++;
+
+   if (abs(nDeviation) <= m_nTolerance)
+      return false;
+
+   m_nNumErrors.store(m_nNumErrors.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+   // store details if there is room left. Event is published by incrementing
+   // counter after it was written
+   unsigned int nEvent = m_nNumEvents.load(std::memory_order_relaxed);
+   if (nEvent < m_vEvents.size())
+      {
+      TSWTriggerEvent& rswte = m_vEvents[nEvent];
+      rswte.nEpoche        = nEpoche;
+      rswte.nDistance      = nDistance;
+      rswte.nPosition      = nPosition;
+      rswte.nBufferOffset  = nBufferOffset;
+      rswte.nXRuns         = -1;
+      m_nNumEvents.store(nEvent + 1, std::memory_order_release);
+      }
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of trigger errors that were not yet correlated with xruns
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerTiming::GetNumUncorrelated()
+{
+   return m_nNumEvents.load(std::memory_order_acquire) - m_nNumEventsCorrelated;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets passed xrun counter (retrieved from SMP) for all trigger errors that
+/// were not yet correlated with xruns. Called by GUI thread
+//------------------------------------------------------------------------------
+void TSWTriggerTiming::CorrelateXRuns(int nXRuns)
+{
+   unsigned int nNumEvents = m_nNumEvents.load(std::memory_order_acquire);
+   for (; m_nNumEventsCorrelated < nNumEvents; m_nNumEventsCorrelated++)
+      m_vEvents[m_nNumEventsCorrelated].nXRuns = nXRuns;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns expected trigger distance in samples
+//------------------------------------------------------------------------------
+int TSWTriggerTiming::GetExpectedDistance()
+{
+   return m_nExpectedDistance;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns tolerance of trigger distance in samples
+//------------------------------------------------------------------------------
+int TSWTriggerTiming::GetTolerance()
+{
+   return m_nTolerance;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of detected triggers
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerTiming::GetNumTriggers()
+{
+   return m_nNumTriggers.load(std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of trigger errors (may be larger than GetNumEvents)
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerTiming::GetNumErrors()
+{
+   return m_nNumErrors.load(std::memory_order_relaxed);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of trigger errors stored with details
+//------------------------------------------------------------------------------
+unsigned int TSWTriggerTiming::GetNumEvents()
+{
+   return m_nNumEvents.load(std::memory_order_acquire);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns details of a trigger error
+//------------------------------------------------------------------------------
+const TSWTriggerEvent& TSWTriggerTiming::GetEvent(unsigned int nIndex)
+{
+   if (nIndex >= GetNumEvents())
+      throw Exception("trigger event index out of range");
+   return m_vEvents[nIndex];
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns minimum measured trigger distance
+//------------------------------------------------------------------------------
+int TSWTriggerTiming::GetMinDistance()
+{
+   return m_nMinDistance;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns maximum measured trigger distance
+//------------------------------------------------------------------------------
+int TSWTriggerTiming::GetMaxDistance()
+{
+   return m_nMaxDistance;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns histogram of inter-trigger distances (see SWTT_DISTANCE_BINS)
+//------------------------------------------------------------------------------
+const std::vector<unsigned int >& TSWTriggerTiming::GetDistanceHistogram()
+{
+   return m_vnDistanceHistogram;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns histogram of trigger positions within audio buffers (first bin:
+/// beginning of buffer)
+//------------------------------------------------------------------------------
+const std::vector<unsigned int >& TSWTriggerTiming::GetOffsetHistogram()
+{
+   return m_vnOffsetHistogram;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// converts policy string from INI to policy. Unknown strings return SWTP_STOP
+//------------------------------------------------------------------------------
+TSWTriggerPolicy TSWTriggerTiming::PolicyFromString(UnicodeString usPolicy)
+{
+   usPolicy = LowerCase(Trim(usPolicy));
+   if (usPolicy == "flag")
+      return SWTP_FLAG;
+   if (usPolicy == "drop")
+      return SWTP_DROP;
+   return SWTP_STOP;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// converts policy to string
+//------------------------------------------------------------------------------
+UnicodeString TSWTriggerTiming::PolicyToString(TSWTriggerPolicy tp)
+{
+   switch (tp)
+      {
+      case SWTP_FLAG: return "flag";
+      case SWTP_DROP: return "drop";
+      default:        return "stop";
+      }
+}
+//------------------------------------------------------------------------------
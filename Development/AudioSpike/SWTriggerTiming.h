@@ -0,0 +1,126 @@
+//------------------------------------------------------------------------------
+/// \file SWTriggerTiming.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWTriggerTiming collecting trigger timing
+/// telemetry
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWTriggerTimingH
+#define SWTriggerTimingH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <atomic>
+
+/// number of bins of inter-trigger distance histogram. Bins cover deviations
+/// from expected distance of -SWTT_DISTANCE_RANGE...SWTT_DISTANCE_RANGE samples,
+/// two additional bins count deviations below/above
+#define SWTT_DISTANCE_RANGE   32
+#define SWTT_DISTANCE_BINS    (2*SWTT_DISTANCE_RANGE + 3)
+/// number of bins of histogram of trigger positions within audio buffer
+#define SWTT_OFFSET_BINS      32
+/// maximum number of trigger errors stored with details
+#define SWTT_MAX_EVENTS       1024
+
+//------------------------------------------------------------------------------
+/// policy on trigger errors (measured trigger distance out of tolerance)
+//------------------------------------------------------------------------------
+enum TSWTriggerPolicy
+{
+   SWTP_STOP = 0,    ///< stop measurement
+   SWTP_FLAG,        ///< keep epoche, but flag it in result
+   SWTP_DROP         ///< keep epoche data, but flag it and exclude it from spike detection
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// one trigger error
+//------------------------------------------------------------------------------
+struct TSWTriggerEvent
+{
+   /// index of epoche started by the trigger
+   unsigned int   nEpoche;
+   /// measured distance to previous trigger in samples
+   int            nDistance;
+   /// position of trigger in samples since start
+   __int64        nPosition;
+   /// position of trigger within audio buffer
+   unsigned int   nBufferOffset;
+   /// xruns reported by SMP when error was processed by GUI (-1 if not yet)
+   int            nXRuns;
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// collects trigger timing telemetry: histogram of inter-trigger distances,
+/// histogram of trigger positions within audio buffers and details of all
+/// trigger errors with xrun counter of SMP at that time.
+/// NOTE: AddTrigger is called by the recording callback, all other functions
+/// by the GUI thread. Errors are published to GUI thread through atomic counter,
+/// histograms may be read while running (values may be off by one then)
+//------------------------------------------------------------------------------
+class TSWTriggerTiming
+{
+   private:
+      int                           m_nExpectedDistance;
+      int                           m_nTolerance;
+      std::vector<unsigned int >    m_vnDistanceHistogram;
+      std::vector<unsigned int >    m_vnOffsetHistogram;
+      std::vector<TSWTriggerEvent > m_vEvents;
+      std::atomic<unsigned int>     m_nNumEvents;
+      std::atomic<unsigned int>     m_nNumErrors;
+      std::atomic<unsigned int>     m_nNumTriggers;
+      unsigned int                  m_nNumEventsCorrelated;
+      unsigned int                  m_nNumDistances;
+      int                           m_nMinDistance;
+      int                           m_nMaxDistance;
+   public:
+      TSWTriggerTiming();
+      void           Initialize(int nExpectedDistance, int nTolerance);
+      bool           AddTrigger( unsigned int nEpoche,
+                                 __int64 nPosition,
+                                 int nDistance,
+                                 unsigned int nBufferOffset,
+                                 unsigned int nBufferSize,
+                                 bool bFirst);
+      unsigned int   GetNumUncorrelated();
+      void           CorrelateXRuns(int nXRuns);
+      int            GetExpectedDistance();
+      int            GetTolerance();
+      unsigned int   GetNumTriggers();
+      unsigned int   GetNumErrors();
+      unsigned int   GetNumEvents();
+      const TSWTriggerEvent& GetEvent(unsigned int nIndex);
+      int            GetMinDistance();
+      int            GetMaxDistance();
+      const std::vector<unsigned int >& GetDistanceHistogram();
+      const std::vector<unsigned int >& GetOffsetHistogram();
+      static TSWTriggerPolicy PolicyFromString(UnicodeString usPolicy);
+      static UnicodeString    PolicyToString(TSWTriggerPolicy tp);
+};
+//------------------------------------------------------------------------------
+#endif
@@ -0,0 +1,257 @@
+//------------------------------------------------------------------------------
+/// \file SWWorkerPool.cpp
+///
+/// \author Berg
+/// \brief Implementation of class TSWWorkerPool: base class for processing work
+/// items on a pool of worker threads
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#pragma hdrstop
+
+#include "SWWorkerPool.h"
+#include "SWTools.h"
+//------------------------------------------------------------------------------
+
+#pragma package(smart_init)
+
+//------------------------------------------------------------------------------
+/// CLASS TSWWorkerThread
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Creates thread running
+//------------------------------------------------------------------------------
+__fastcall TSWWorkerThread::TSWWorkerThread(TSWWorkerPool* pPool)
+   : TThread(false), m_pPool(pPool)
+{
+   FreeOnTerminate = false;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// thread function: processes work items until all are done or cancelled
+//------------------------------------------------------------------------------
+void __fastcall TSWWorkerThread::Execute()
+{
+   m_pPool->Work();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// CLASS TSWWorkerPool
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// constructor. Creates done event, threads are started by Start()
+//------------------------------------------------------------------------------
+TSWWorkerPool::TSWWorkerPool()
+   :  m_nNumItems(0), m_nNextItem(0), m_nItemsDone(0), m_nThreadsRunning(0),
+      m_bCancel(false)
+{
+   m_hDoneEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+   if (!m_hDoneEvent)
+      throw Exception("cannot create event for worker pool");
+   InitializeCriticalSection(&m_cs);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// destructor. Stops threads
+//------------------------------------------------------------------------------
+TSWWorkerPool::~TSWWorkerPool()
+{
+   StopThreads();
+   CloseHandle(m_hDoneEvent);
+   DeleteCriticalSection(&m_cs);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// starts workers for passed number of items. If nNumThreads is 0 the number
+/// of processors is used, never more threads than items are started. Stops
+/// already started threads and rethrows, if a thread cannot be created
+//------------------------------------------------------------------------------
+void TSWWorkerPool::Start(unsigned int nNumItems, unsigned int nNumThreads)
+{
+   m_nNumItems = nNumItems;
+   if (!nNumThreads)
+      nNumThreads = (unsigned int)TThread::ProcessorCount;
+   if (nNumThreads > m_nNumItems)
+      nNumThreads = m_nNumItems;
+   if (!nNumThreads)
+      {
+      SetEvent(m_hDoneEvent);
+      return;
+      }
+
+   try
+      {
+      // counter must be set before any thread is started
+      m_nThreadsRunning = nNumThreads;
+      unsigned int n;
+      for (n = 0; n < nNumThreads; n++)
+         m_vpThreads.push_back(new TSWWorkerThread(this));
+      }
+   catch (...)
+      {
+      StopThreads();
+      throw;
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// cancels processing and waits for all threads to be finished
+//------------------------------------------------------------------------------
+void TSWWorkerPool::StopThreads()
+{
+   m_bCancel = true;
+   unsigned int n;
+   for (n = 0; n < m_vpThreads.size(); n++)
+      {
+      m_vpThreads[n]->WaitFor();
+      TRYDELETENULL(m_vpThreads[n]);
+      }
+   m_vpThreads.clear();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// worker function (called by all threads): calls DoWork and stores first
+/// error
+//------------------------------------------------------------------------------
+void TSWWorkerPool::Work()
+{
+   try
+      {
+      DoWork();
+      }
+   catch (Exception &e)
+      {
+      EnterCriticalSection(&m_cs);
+      if (m_usError.IsEmpty())
+         m_usError = e.Message;
+      LeaveCriticalSection(&m_cs);
+      m_bCancel = true;
+      }
+   catch (...)
+      {
+      EnterCriticalSection(&m_cs);
+      if (m_usError.IsEmpty())
+         m_usError = "unknown error in worker thread";
+      LeaveCriticalSection(&m_cs);
+      m_bCancel = true;
+      }
+   if (--m_nThreadsRunning == 0)
+      SetEvent(m_hDoneEvent);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// pulls next item. Returns false if all items are pulled or processing was
+/// cancelled
+//------------------------------------------------------------------------------
+bool TSWWorkerPool::NextItem(unsigned int &rnItem)
+{
+   if (m_bCancel)
+      return false;
+   rnItem = m_nNextItem++;
+   return rnItem < m_nNumItems;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// marks an item as done
+//------------------------------------------------------------------------------
+void TSWWorkerPool::ItemDone()
+{
+   m_nItemsDone++;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if all items are done. NOTE: call after StopThreads() only
+//------------------------------------------------------------------------------
+bool TSWWorkerPool::IsComplete()
+{
+   return m_nItemsDone >= m_nNumItems;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns first error that occurred in a worker (empty if none).
+/// NOTE: call after StopThreads() only
+//------------------------------------------------------------------------------
+UnicodeString TSWWorkerPool::GetError()
+{
+   return m_usError;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// waits up to nTimeout milliseconds for all workers to be finished. Returns
+/// true if they are finished
+//------------------------------------------------------------------------------
+bool TSWWorkerPool::Wait(unsigned int nTimeout)
+{
+   return WaitForSingleObject(m_hDoneEvent, nTimeout) == WAIT_OBJECT_0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// requests cancellation. Workers stop as soon as they check m_bCancel
+//------------------------------------------------------------------------------
+void TSWWorkerPool::Cancel()
+{
+   m_bCancel = true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of finished work items
+//------------------------------------------------------------------------------
+unsigned int TSWWorkerPool::GetNumDone()
+{
+   return m_nItemsDone;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns total number of work items
+//------------------------------------------------------------------------------
+unsigned int TSWWorkerPool::GetNumTotal()
+{
+   return m_nNumItems;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns number of worker threads
+//------------------------------------------------------------------------------
+unsigned int TSWWorkerPool::GetNumThreads()
+{
+   return (unsigned int)m_vpThreads.size();
+}
+//------------------------------------------------------------------------------
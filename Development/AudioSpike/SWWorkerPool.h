@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+/// \file SWWorkerPool.h
+///
+/// \author Berg
+/// \brief Implementation of class TSWWorkerPool: base class for processing work
+/// items on a pool of worker threads
+///
+/// Project AudioSpike
+/// Module  AudioSpike.exe
+///
+/// ****************************************************************************
+/// Copyright 2023 Daniel Berg, Oldenburg, Germany
+/// ****************************************************************************
+///
+/// This file is part of AudioSpike.
+///
+///    AudioSpike is free software: you can redistribute it and/or modify
+///    it under the terms of the GNU General Public License as published by
+///    the Free Software Foundation, either version 3 of the License, or
+///    (at your option) any later version.
+///
+///    AudioSpike is distributed in the hope that it will be useful,
+///    but WITHOUT ANY WARRANTY; without even the implied warranty of
+///    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+///    GNU General Public License for more details.
+///
+///    You should have received a copy of the GNU General Public License
+///    along with AudioSpike.  If not, see <http:///www.gnu.org/licenses/>.
+///
+//------------------------------------------------------------------------------
+#ifndef SWWorkerPoolH
+#define SWWorkerPoolH
+//------------------------------------------------------------------------------
+
+#include <vcl.h>
+#include <vector>
+#include <atomic>
+
+class TSWWorkerPool;
+
+//------------------------------------------------------------------------------
+/// worker thread of TSWWorkerPool
+//------------------------------------------------------------------------------
+class TSWWorkerThread : public TThread
+{
+   private:
+      TSWWorkerPool* m_pPool;
+   protected:
+      void __fastcall Execute();
+   public:
+      __fastcall TSWWorkerThread(TSWWorkerPool* pPool);
+};
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// base class for processing a fixed number of work items on a pool of worker
+/// threads. Derived classes implement DoWork(), that is called by every
+/// worker: it pulls items lock-free by NextItem() until it returns false and
+/// calls ItemDone() for every completed item. Exceptions thrown by DoWork()
+/// cancel all workers, the first error message is kept (GetError()).
+/// NOTE: derived classes must call Start() at the end of their constructor
+/// and StopThreads() at the beginning of their destructor (workers must not
+/// run while the derived object is constructed or destroyed).
+/// Usage (GUI thread): construct derived class (starts the workers), call
+/// Wait() in a loop showing progress by GetNumDone()/GetNumTotal() and calling
+/// Cancel() if requested, finally collect the results
+//------------------------------------------------------------------------------
+class TSWWorkerPool
+{
+   friend class TSWWorkerThread;
+   private:
+      unsigned int               m_nNumItems;
+      std::vector<TSWWorkerThread* > m_vpThreads;
+      std::atomic<unsigned int>  m_nNextItem;
+      std::atomic<unsigned int>  m_nItemsDone;
+      std::atomic<unsigned int>  m_nThreadsRunning;
+      HANDLE                     m_hDoneEvent;
+      CRITICAL_SECTION           m_cs;
+      UnicodeString              m_usError;
+      void           Work();
+   protected:
+      std::atomic<bool>          m_bCancel;
+      void           Start(unsigned int nNumItems, unsigned int nNumThreads);
+      void           StopThreads();
+      bool           NextItem(unsigned int &rnItem);
+      void           ItemDone();
+      bool           IsComplete();
+      UnicodeString  GetError();
+      virtual void   DoWork() = 0;
+   public:
+      TSWWorkerPool();
+      virtual ~TSWWorkerPool();
+      bool           Wait(unsigned int nTimeout);
+      void           Cancel();
+      unsigned int   GetNumDone();
+      unsigned int   GetNumTotal();
+      unsigned int   GetNumThreads();
+};
+//------------------------------------------------------------------------------
+#endif
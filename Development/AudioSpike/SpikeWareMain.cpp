@@ -51,6 +51,8 @@
 #include "frmSelectChannels.h"
 #include "Encddecd.hpp"
 #include "frmWait.h"
+#include "SWSpikeRescan.h"
+#include "SWSpikeCluster.h"
 #include "frmSearchFree.h"
 #include "frmFFTEdit.h"
 #include "frmSignalPSTH.h"
@@ -99,6 +101,7 @@ UnicodeString TformSpikeWare::GetSettingsPath()
 //------------------------------------------------------------------------------
 __fastcall TformSpikeWare::TformSpikeWare(TComponent* Owner)
    :  TForm(Owner),
+      m_dwAutoThresholdUpdate(0),
       m_gs(SWGS_NONE),
       m_pformSearchFree(NULL),
       m_pformBatch(NULL),
@@ -623,6 +626,17 @@ void TformSpikeWare::ReadSettings()
 
    m_bSaveProbeMic      = m_pIni->ReadBool("Settings", "SaveProbeMic", true);
    m_bStartupInSitu     = m_pIni->ReadBool("Settings", "StartupInSitu", false);
+   // number of slots for epoches passed from recording callback to GUI. May only
+   // be changed if no epoches are pending
+   int nQueueSize       = m_pIni->ReadInteger("Settings", "EpocheQueueSize", 1024);
+   if (!m_sweEpoches.Pending() && nQueueSize > 1 && (unsigned int)nQueueSize != m_sweEpoches.GetQueueCapacity())
+      m_sweEpoches.SetQueueCapacity((unsigned int)nQueueSize);
+   // handling of trigger errors (trigger distance deviating more than
+   // TriggerTolerance samples from repetition period): stop, flag or drop
+   m_sweEpoches.m_tpTriggerPolicy   = TSWTriggerTiming::PolicyFromString(m_pIni->ReadString("Settings", "TriggerErrorPolicy", "stop"));
+   m_sweEpoches.m_nTriggerTolerance = m_pIni->ReadInteger("Settings", "TriggerTolerance", 5);
+   if (m_sweEpoches.m_nTriggerTolerance < 0)
+      m_sweEpoches.m_nTriggerTolerance = 5;
    m_bCheckUpdateOnStartup = m_pIni->ReadBool("Settings", "CheckUpdateOnStartup", true);
    if (m_bCheckUpdateOnStartup)
       {
@@ -894,16 +908,23 @@ bool TformSpikeWare::LoadMeasurement(UnicodeString usFile, int nMode)
             throw Exception("'PreStimulus' missing or invalid in 'Settings'");
          if (!TryStrToDouble(GetXMLValue(xmlSettings, "RepetitionPeriod"), dRepetitionPeriod))
             throw Exception("'RepetitionPeriod' missing or invalid in 'Settings'");
+         // optional: time recorded before trigger
+         double dPreTrigger = 0.0;
+         if (GetXMLValue(xmlSettings, "PreTrigger") != "" && !TryStrToDouble(GetXMLValue(xmlSettings, "PreTrigger"), dPreTrigger))
+            throw Exception("'PreTrigger' invalid in 'Settings'");
+         if (dPreTrigger < 0.0)
+            throw Exception("'PreTrigger' must not be negative");
 
 
          // check for consistancy. check vs. stim-length is done later
-         if (dEpocheLength < dPreStimulus)
-            throw Exception("'PreStimulus' must not exceed 'EpocheLength'");
+         if (dEpocheLength < dPreStimulus + dPreTrigger)
+            throw Exception("'PreStimulus' plus 'PreTrigger' must not exceed 'EpocheLength'");
          if (dRepetitionPeriod < dEpocheLength)
             throw Exception("'EpocheLength' must not exceed 'RepetitionPeriod'");
 
          m_sweEpoches.m_dEpocheLength     = dEpocheLength;
          m_sweEpoches.m_dPreStimulus      = dPreStimulus;
+         m_sweEpoches.m_dPreTrigger       = dPreTrigger;
          // repetitionperiod needed in samples!!
          m_sweEpoches.m_nRepetitionPeriod = (int)(dRepetitionPeriod * m_swsSpikes.GetSampleRate());
 
@@ -1001,7 +1022,7 @@ bool TformSpikeWare::LoadMeasurement(UnicodeString usFile, int nMode)
          // add stimuli AND stimulus parameters passing nodes and maximum allowed length of the
          // stimulus itself and the number of output channels
          m_swsStimuli.Add( xmlDoc,
-                           m_sweEpoches.m_dEpocheLength-m_sweEpoches.m_dPreStimulus,
+                           m_sweEpoches.m_dEpocheLength-m_sweEpoches.GetStimulusOnset(),
                            nChannelsOut,
                            // audio data needed for template AND resume
                            nMode
@@ -1030,6 +1051,9 @@ bool TformSpikeWare::LoadMeasurement(UnicodeString usFile, int nMode)
                for (n = 0; n < m_viStimSequence.size(); n++)
                   m_viStimSequence[n] -= 1;
 
+               // templates the spikes were detected with
+               LoadSpikeTemplates(xmlResultNode);
+
                // LoadSpikes!!
                _di_IXMLNode xmlSpikes = xmlResultNode->ChildNodes->FindNode("Spikes");
                if (!!xmlSpikes)
@@ -1038,6 +1062,7 @@ bool TformSpikeWare::LoadMeasurement(UnicodeString usFile, int nMode)
                xmlSpikes = xmlResultNode->ChildNodes->FindNode("NonSelectedSpikes");
                if (!!xmlSpikes)
                   m_swsSpikes.Add(xmlSpikes);
+               RegisterXMLSpikeDetection();
                }
 
             double dValue;
@@ -1090,7 +1115,10 @@ bool TformSpikeWare::LoadMeasurement(UnicodeString usFile, int nMode)
                         if (TryStrToDouble(GetXMLValue(xmlSel, "Y1"), dValue))
                            m_vpformCluster.back()->m_vvSWSelections[nChannel][nSel].dY1 = dValue;
                         if (TryStrToInt(GetXMLValue(xmlSel, "Active"), nValue))
+                           {
                            m_vpformCluster.back()->m_vvSWSelections[nChannel][nSel].bActive = nValue;
+                           m_vpformCluster.back()->m_vvSWSelections[nChannel][nSel].bAssigned = nValue;
+                           }
                         }
                      }
                   }
@@ -1399,6 +1427,7 @@ bool TformSpikeWare::InitFreeSearch()
 
       m_sweEpoches.m_dEpocheLength     = (double)m_smp.m_nFreeSearchRepetitionPeriodMs / 1000.0;
       m_sweEpoches.m_dPreStimulus      = (double)m_smp.m_nFreeSearchPreStimLengthMs / 1000.0;
+      m_sweEpoches.m_dPreTrigger       = 0.0;
 
       // repetitionperiod needed in samples!!
       m_sweEpoches.m_nRepetitionPeriod = (int)(m_sweEpoches.m_dEpocheLength * m_swsSpikes.GetSampleRate());
@@ -1505,7 +1534,7 @@ void TformSpikeWare::LoadEpoches(TEpocheLoadMode nELM)
    EnableEpocheTimer(false);
    // NOTE: when calling 'LoadEpoches' then we DON'T want to use 'ProcessEpoches'
    // function, because we want to keep ALL epoches in memory!
-   UnicodeString usEpocheFile = m_usResultPath + "epoches.pcm";
+   UnicodeString usEpocheFile = TSWEpocheFile::GetFileName(m_usResultPath);
 
    if (!FileExists(usEpocheFile))
       throw Exception("Epoche file '" + usEpocheFile + "' cannot be found");
@@ -1520,17 +1549,27 @@ void TformSpikeWare::LoadEpoches(TEpocheLoadMode nELM)
 
    m_sweEpoches.Clear();
 
+   // when resetting thresholds only channels, that were not scanned with the
+   // current threshold in all epoches, are scanned again. Spikes (and cluster
+   // groups) of all other channels are kept. NOTE: spikes of rescanned
+   // channels are replaced after a completed rescan only (see
+   // TSWSpikeRescan::Finish), so cancelling keeps the previous spikes
+   std::vector<unsigned int > vnRescanChannels;
+   std::vector<unsigned int > vnNumSpikesBefore;
+   unsigned int nChannel;
    if (nELM > SWELM_NOSPIKES)
       {
       m_pformSpikes->Clear();
-      m_swsSpikes.Clear();
+      for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+         {
+         vnNumSpikesBefore.push_back(m_swsSpikes.GetNumSpikes(nChannel));
+         if (nELM == SWELM_SPIKES || !m_swsSpikes.IsDetected(nChannel, GetThreshold(nChannel)))
+            vnRescanChannels.push_back(nChannel);
+         }
       }
 
-   unsigned int nChannelsIn   = (unsigned int)m_sweEpoches.m_vvfEpoche.size();
-   unsigned int nSamples      = (unsigned int)m_sweEpoches.m_vvfEpoche[0].size();
-   unsigned int nXMLEpoches   = (unsigned int)EpochesXML(true);
-
-   // we need the epoche nodes to re-read the original repetition index!
+   // we need the epoche nodes to re-read the original repetition index from
+   // legacy files and for resetting thresholds
    _di_IXMLNode xmlResultNode = xml->DocumentElement->ChildNodes->FindNode("Result");
    if (!xmlResultNode)
       throw Exception("Invalid Result in XML result");
@@ -1538,41 +1577,95 @@ void TformSpikeWare::LoadEpoches(TEpocheLoadMode nELM)
    if (!xmlEpocheNodes)
       throw Exception("Invalid Epoches in XML result");
 
-   vvf vvfData(nChannelsIn, std::valarray<float>(nSamples));
-
-   TFileStream *pfs = NULL;
    TSWEpoche* pswe = NULL;
+   bool bRescanDone = true;
 
    formWait->ShowWait("Loading epoches, please wait...");
    try
       {
-      pfs = new TFileStream(usEpocheFile, fmOpenRead | fmShareDenyNone);
-      unsigned int nEpoches = (unsigned int)pfs->Size / sizeof(float) / nSamples / nChannelsIn;
-      if (nXMLEpoches != nEpoches)
+      // NOTE: epoche data are not loaded to memory: the epoches read them from
+      // the (memory mapped) epoche store on demand
+      unsigned int nEpoches = m_sweEpoches.OpenStore(usEpocheFile);
+      bool bLegacy = m_sweEpoches.IsStoreLegacy();
+      // legacy files: number of epoches must match done epoches in XML. Epoche
+      // files: file must not contain more epoches than XML (cheap check, no
+      // need to walk the XML)
+      unsigned int nXMLEpoches = (unsigned int)EpochesXML(bLegacy);
+      if (bLegacy ? nXMLEpoches != nEpoches : nXMLEpoches < nEpoches)
          throw Exception("result XML contains " + IntToStr((int)nXMLEpoches) + " epoches, but audio data " + IntToStr((int)nEpoches));
-      unsigned int nChannel, nEpoche;
+
+      unsigned int nEpoche, nStimIndex, nRepetitionIndex, nFlags;
+      double dTriggerOffset;
+      std::vector<double > vdThreshold;
+      // thresholds saved for epoches: restored if rescan with reset
+      // thresholds is cancelled
+      std::vector<std::vector<double > > vvdSavedThreshold;
+      std::vector<TSWEpoche* > vpRescan;
       bool bLast;
       for (nEpoche = 0; nEpoche < nEpoches; nEpoche++)
          {
-         for (nChannel = 0; nChannel < nChannelsIn; nChannel++)
-            pfs->ReadBuffer(&vvfData[nChannel][0], (NativeInt)(nSamples*sizeof(float)));
-
-         // access epoche to read repetitionindex
-         _di_IXMLNode xmlEpocheNode  = xmlEpocheNodes->ChildNodes->Nodes[nEpoche];
-
+         // read metadata from epoche file. Legacy files: access epoche node
+         // to read thresholds, repetitionindex and trigger error
+         dTriggerOffset = 0.0;
+         nFlags         = 0;
+         if (!m_sweEpoches.ReadEpocheInfo(nEpoche, nStimIndex, nRepetitionIndex, vdThreshold, dTriggerOffset, nFlags))
+            {
+            _di_IXMLNode xmlEpocheNode  = xmlEpocheNodes->ChildNodes->Nodes[nEpoche];
+            _di_IXMLNode xmlTriggerError = xmlEpocheNode->ChildNodes->FindNode("TriggerError");
+            if (!!xmlTriggerError)
+               {
+               nFlags |= SWEF_TRIGGERERROR;
+               if (TSWTriggerTiming::PolicyFromString(xmlTriggerError->Text) == SWTP_DROP)
+                  nFlags |= SWEF_DROPPED;
+               }
+            // - use epoche thresholds or global thresholds (if to be resetted)
+            vdThreshold       = GetXMLEpocheThresholds(xmlEpocheNode);
+            nStimIndex        = (unsigned int)m_viStimSequence[nEpoche];
+            // NOTE: XML contains repetitionindex 1-based, thus subtract one here!!
+            nRepetitionIndex  = (unsigned int)StrToInt(xmlEpocheNode->ChildValues["RepetitionIndex"] - 1);
+            }
          if (nELM == SWELM_SPIKES_RESET_THRESHOLD)
-            SetXMLEpocheThreshold(xmlEpocheNode, m_sweEpoches.m_vdThreshold); //m_sweEpoches.m_vdThreshold);
-
-         // - use epoche thresholds or global thresholds (if to be resetted)
-         pswe = m_sweEpoches.Push(  vvfData,
-                                    GetXMLEpocheThresholds(xmlEpocheNode),
-                                    (unsigned int)m_viStimSequence[nEpoche],
-                                    // NOTE: XML contains repetitionindex 1-based, thus subtract one here!!
-                                    (unsigned int)StrToInt(xmlEpocheNode->ChildValues["RepetitionIndex"] - 1)
-                                    );
-         if (nELM > SWELM_NOSPIKES)
-            m_swsSpikes.Add(pswe);
-         pswe->ClearData();
+            {
+            vvdSavedThreshold.push_back(vdThreshold);
+            vdThreshold = m_sweEpoches.m_vdThreshold;
+            }
+
+         pswe = m_sweEpoches.Push(vdThreshold, nStimIndex, nRepetitionIndex);
+         pswe->m_dTriggerOffset  = dTriggerOffset;
+         pswe->m_bTriggerError   = (nFlags & SWEF_TRIGGERERROR) != 0;
+         pswe->m_bDropped        = (nFlags & SWEF_DROPPED) != 0;
+         // epoches dropped due to trigger errors are excluded from spike detection
+         if (nELM > SWELM_NOSPIKES && !pswe->m_bDropped)
+            vpRescan.push_back(pswe);
+         }
+      // detect spikes of all epoches in parallel. Without epoches to scan the
+      // channels have no spikes at all
+      if (vnRescanChannels.size())
+         {
+         if (vpRescan.size())
+            bRescanDone = RescanSpikes(vpRescan, &vnRescanChannels);
+         else
+            {
+            unsigned int n;
+            for (n = 0; n < vnRescanChannels.size(); n++)
+               m_swsSpikes.Clear(vnRescanChannels[n]);
+            }
+         }
+      // reset thresholds are saved only, if spikes were detected with them.
+      // Otherwise the saved thresholds are restored in the epoches
+      if (nELM == SWELM_SPIKES_RESET_THRESHOLD)
+         {
+         if (bRescanDone)
+            {
+            m_sweEpoches.WriteEpocheThresholds(-1, m_sweEpoches.m_vdThreshold);
+            for (nEpoche = 0; nEpoche < nEpoches; nEpoche++)
+               SetXMLEpocheThreshold(xmlEpocheNodes->ChildNodes->Nodes[nEpoche], m_sweEpoches.m_vdThreshold);
+            }
+         else
+            {
+            for (nEpoche = 0; nEpoche < nEpoches; nEpoche++)
+               m_sweEpoches.Get((int)nEpoche)->m_vdThreshold = vvdSavedThreshold[nEpoche];
+            }
          }
 
       // plot last epoche
@@ -1589,7 +1682,6 @@ void TformSpikeWare::LoadEpoches(TEpocheLoadMode nELM)
       }
    __finally
       {
-      TRYDELETENULL(pfs);
       formWait->Hide();
       m_pformEpoches->tbEpoches->OnChange = m_pformEpoches->tbEpochesChange;
 
@@ -1599,14 +1691,76 @@ void TformSpikeWare::LoadEpoches(TEpocheLoadMode nELM)
    m_pformEpoches->tbEpoches->Tag      = 1;
    m_pformSpikes->cbPlotEpocheSpikesOnly->Enabled  = true;
    m_pformEpoches->cbEpocheThreshold->Enabled  = true;
+
+   if (!bRescanDone)
+      {
+      UnicodeString us = "Spike detection was cancelled: spikes";
+      if (nELM == SWELM_SPIKES_RESET_THRESHOLD)
+         us += " and thresholds";
+      us += " of all channels were kept unchanged.";
+      MessageBoxW(Handle, us.w_str(), L"Information", MB_ICONINFORMATION);
+      }
+   // report changes of rescanned channels
+   else if (nELM == SWELM_SPIKES_RESET_THRESHOLD)
+      {
+      UnicodeString us;
+      if (!vnRescanChannels.size())
+         us = "Spikes of all channels were already detected with current thresholds, no channel was rescanned.";
+      else
+         {
+         us = "Rescanned channels:\n";
+         unsigned int n;
+         for (n = 0; n < vnRescanChannels.size(); n++)
+            {
+            nChannel = vnRescanChannels[n];
+            int nBefore = (int)vnNumSpikesBefore[nChannel];
+            int nAfter  = (int)m_swsSpikes.GetNumSpikes(nChannel);
+            us += "Channel " + IntToStr((int)nChannel+1) + ": "
+               + IntToStr(nBefore) + " -> " + IntToStr(nAfter) + " spikes ("
+               + UnicodeString(nAfter > nBefore ? "+" : "") + IntToStr(nAfter - nBefore) + ")\n";
+            }
+         if (vnRescanChannels.size() < m_swsSpikes.GetNumChannels())
+            us += "\nSpikes and clusters of "
+               + IntToStr((int)(m_swsSpikes.GetNumChannels() - vnRescanChannels.size()))
+               + " unchanged channel(s) were kept.";
+         }
+      MessageBoxW(Handle, us.w_str(), L"Information", MB_ICONINFORMATION);
+      }
 }
 //------------------------------------------------------------------------------
 
 
 //------------------------------------------------------------------------------
-/// sets an epoche "done/not done" in XML
+/// detects spikes of passed (stored) epoches on multiple threads. Shows
+/// progress in wait form, user may cancel by ESC. Number of threads can be set
+/// in INI (Settings/RescanThreads, 0: number of processors). If pvnChannels
+/// is not NULL, only passed channels are scanned. Returns false, if cancelled
+/// (no spikes are added then)
+//------------------------------------------------------------------------------
+bool TformSpikeWare::RescanSpikes(  const std::vector<TSWEpoche* >& rvpEpoches,
+                                    const std::vector<unsigned int >* pvnChannels)
+{
+   int nThreads = m_pIni->ReadInteger("Settings", "RescanThreads", 0);
+   if (nThreads < 0)
+      nThreads = 0;
+   TSWSpikeRescan swsr(&m_swsSpikes, rvpEpoches, (unsigned int)nThreads, pvnChannels);
+   formWait->m_bCancel = false;
+   unsigned int nTotal = swsr.GetNumTotal();
+   while (!swsr.Wait(100))
+      {
+      formWait->ShowWait("Detecting spikes, please wait (" + IntToStr((int)(100*swsr.GetNumDone()/nTotal)) + "%)... Press ESC to cancel");
+      if (formWait->m_bCancel)
+         swsr.Cancel();
+      }
+   return swsr.Finish();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets an epoche "done/not done" in XML. If passed trigger error (policy) is
+/// not empty, it is written to the epoche as well
 //------------------------------------------------------------------------------
-void TformSpikeWare::SetXMLEpocheDone(int nNode, bool bDone)
+void TformSpikeWare::SetXMLEpocheDone(int nNode, bool bDone, UnicodeString usTriggerError)
 {
    if (m_bFreeSearchRunning || m_gs == SWGS_SEARCH)
       return;
@@ -1636,6 +1790,8 @@ void TformSpikeWare::SetXMLEpocheDone(int nNode, bool bDone)
    SetXMLEpocheThreshold(xmlEpoche, GetThresholds());
 
    xmlEpoche->ChildValues["Done"] = bDone ? "1" : "0";
+   if (!usTriggerError.IsEmpty())
+      xmlEpoche->ChildValues["TriggerError"] = usTriggerError;
 }
 //------------------------------------------------------------------------------
 
@@ -1744,6 +1900,41 @@ std::vector<double > TformSpikeWare::GetXMLEpocheThresholds(_di_IXMLNode xml)
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// registers thresholds of all done epoches in current XML for spikes read from
+/// XML (see TSWSpikes::IsDetected). Epoches without thresholds use current
+/// thresholds (see EnsureXMLEpocheThresholds), dropped epoches were not scanned
+//------------------------------------------------------------------------------
+void TformSpikeWare::RegisterXMLSpikeDetection()
+{
+   _di_IXMLNode xmlResultNode = xml->DocumentElement->ChildNodes->FindNode("Result");
+   if (!xmlResultNode)
+      return;
+   _di_IXMLNode xmlEpocheNodes = xmlResultNode->ChildNodes->FindNode("Epoches");
+   if (!xmlEpocheNodes)
+      return;
+
+   std::vector<double > vdThreshold;
+   unsigned int nChannel;
+   int n;
+   for (n = 0; n < xmlEpocheNodes->ChildNodes->Count; n++)
+      {
+      _di_IXMLNode xmlEpocheNode  = xmlEpocheNodes->ChildNodes->Nodes[n];
+      if (GetXMLValue(xmlEpocheNode , "Done") != "1")
+         continue;
+      _di_IXMLNode xmlTriggerError = xmlEpocheNode->ChildNodes->FindNode("TriggerError");
+      if (!!xmlTriggerError && TSWTriggerTiming::PolicyFromString(xmlTriggerError->Text) == SWTP_DROP)
+         continue;
+      if (Trim(GetXMLValue(xmlEpocheNode, "Thresholds")) == "")
+         vdThreshold = m_sweEpoches.m_vdThreshold;
+      else
+         vdThreshold = GetXMLEpocheThresholds(xmlEpocheNode);
+      for (nChannel = 0; nChannel < vdThreshold.size() && nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+         m_swsSpikes.RegisterDetection(nChannel, vdThreshold[nChannel]);
+      }
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// ensures that ALL epoches in current XML have valid thresholds
 //------------------------------------------------------------------------------
@@ -1979,6 +2170,158 @@ void TformSpikeWare::SetMeasurementChanged(bool bChanged, bool bForce)
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// writes trigger timing telemetry to passed XML node
+//------------------------------------------------------------------------------
+void TformSpikeWare::SaveTriggerTiming(_di_IXMLNode xmlTriggerTiming)
+{
+   TSWTriggerTiming& rswtt = m_sweEpoches.m_swttTiming;
+   // retrieve xruns for errors that were not processed by timer
+   if (rswtt.GetNumUncorrelated() && m_smp.Initialized())
+      rswtt.CorrelateXRuns(m_smp.GetXRuns());
+
+   xmlTriggerTiming->ChildValues["Policy"]            = TSWTriggerTiming::PolicyToString(m_sweEpoches.m_tpTriggerPolicy);
+   xmlTriggerTiming->ChildValues["ExpectedDistance"]  = IntToStr(rswtt.GetExpectedDistance());
+   xmlTriggerTiming->ChildValues["Tolerance"]         = IntToStr(rswtt.GetTolerance());
+   xmlTriggerTiming->ChildValues["Triggers"]          = IntToStr((int)rswtt.GetNumTriggers());
+   xmlTriggerTiming->ChildValues["Errors"]            = IntToStr((int)rswtt.GetNumErrors());
+   xmlTriggerTiming->ChildValues["MinDistance"]       = IntToStr(rswtt.GetMinDistance());
+   xmlTriggerTiming->ChildValues["MaxDistance"]       = IntToStr(rswtt.GetMaxDistance());
+
+   // histogram of distances: first and last bin count deviations below/above range
+   xmlTriggerTiming->ChildValues["DistanceHistogramRange"] = IntToStr(SWTT_DISTANCE_RANGE);
+   UnicodeString us = "[";
+   unsigned int n;
+   for (n = 0; n < rswtt.GetDistanceHistogram().size(); n++)
+      us += IntToStr((int)rswtt.GetDistanceHistogram()[n]) + " ";
+   xmlTriggerTiming->ChildValues["DistanceHistogram"] = Trim(us) + "]";
+
+   us = "[";
+   for (n = 0; n < rswtt.GetOffsetHistogram().size(); n++)
+      us += IntToStr((int)rswtt.GetOffsetHistogram()[n]) + " ";
+   xmlTriggerTiming->ChildValues["BufferOffsetHistogram"] = Trim(us) + "]";
+
+   // NOTE: we write epoche index 1-based (grace for MATLAB users)
+   _di_IXMLNode xmlErrors = xmlTriggerTiming->AddChild("TriggerErrors");
+   for (n = 0; n < rswtt.GetNumEvents(); n++)
+      {
+      const TSWTriggerEvent& rswte = rswtt.GetEvent(n);
+      _di_IXMLNode xmlError = xmlErrors->AddChild("TriggerError");
+      xmlError->ChildValues["EpocheIndex"]   = IntToStr((int)rswte.nEpoche+1);
+      xmlError->ChildValues["Distance"]      = IntToStr(rswte.nDistance);
+      xmlError->ChildValues["Position"]      = IntToStr(rswte.nPosition);
+      xmlError->ChildValues["BufferOffset"]  = IntToStr((int)rswte.nBufferOffset);
+      xmlError->ChildValues["XRuns"]         = IntToStr(rswte.nXRuns);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes statistics of the real-time path of last measurement to passed XML
+/// node
+//------------------------------------------------------------------------------
+void TformSpikeWare::SaveRecordingStatistics(_di_IXMLNode xmlStatistics)
+{
+   // allocations in recording callback (pool exhausted): should be 0
+   xmlStatistics->ChildValues["EpochePoolSize"]          = IntToStr((int)m_sweEpoches.GetPoolSize());
+   xmlStatistics->ChildValues["EpochePoolAllocations"]   = IntToStr((int)m_sweEpoches.GetPoolAllocations());
+   xmlStatistics->ChildValues["EpocheQueueCapacity"]     = IntToStr((int)m_sweEpoches.GetQueueCapacity());
+   xmlStatistics->ChildValues["EpocheQueueMaxDepth"]     = IntToStr((int)m_sweEpoches.GetQueueHighWaterMark());
+   xmlStatistics->ChildValues["EpocheQueueOverflows"]    = IntToStr((int)m_sweEpoches.GetQueueOverflows());
+   // asynchronous file writers: latency in ms
+   xmlStatistics->ChildValues["WriteMaxQueueDepth"]      = IntToStr((int)m_sweEpoches.GetSaveMaxQueueDepth());
+   xmlStatistics->ChildValues["WriteMaxFlushLatency"]    = DoubleToStr(m_sweEpoches.GetSaveMaxFlushLatency());
+   xmlStatistics->ChildValues["WriteOverflows"]          = IntToStr((int)m_sweEpoches.GetSaveOverflows());
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes spike templates of all channels to a node 'SpikeTemplates' of passed
+/// result node (one 'Channel' node per channel, channels without templates use
+/// threshold detection). Returns false (and writes nothing) if no channel has
+/// templates
+//------------------------------------------------------------------------------
+bool TformSpikeWare::SaveSpikeTemplates(_di_IXMLNode xmlResultNode)
+{
+   unsigned int nChannel, nTemplate, n;
+   for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+      {
+      if (m_swsSpikes.GetNumTemplates(nChannel))
+         break;
+      }
+   if (nChannel == m_swsSpikes.GetNumChannels())
+      return false;
+
+   _di_IXMLNode xmlSpikeTemplates = xmlResultNode->AddChild("SpikeTemplates");
+   for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+      {
+      _di_IXMLNode xmlChannel = xmlSpikeTemplates->AddChild("Channel");
+      _di_IXMLNode xmlTemplates = xmlChannel->AddChild("Templates");
+      TSWSpikeTemplatesPtr pTemplates = m_swsSpikes.GetTemplates(nChannel);
+      if (!pTemplates)
+         continue;
+      xmlChannel->ChildValues["MinScore"] = DoubleToStr(pTemplates->GetMinScore());
+      xmlChannel->ChildValues["MinScale"] = DoubleToStr(pTemplates->GetMinScale());
+      for (nTemplate = 0; nTemplate < pTemplates->GetNumTemplates(); nTemplate++)
+         {
+         const double* pdTemplate = pTemplates->GetTemplate(nTemplate);
+         UnicodeString us = "[";
+         for (n = 0; n < pTemplates->GetLength(); n++)
+            us += DoubleToStr(pdTemplate[n]) + " ";
+         xmlTemplates->AddChild("Template")->Text = Trim(us) + "]";
+         }
+      }
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// reads spike templates written by SaveSpikeTemplates from passed result node
+/// and sets them for detection. Must be called after channels, sample rate and
+/// spike length were set (they reset the templates). Templates with a length
+/// not matching the current spike length are skipped
+//------------------------------------------------------------------------------
+void TformSpikeWare::LoadSpikeTemplates(_di_IXMLNode xmlResultNode)
+{
+   _di_IXMLNode xmlSpikeTemplates = xmlResultNode->ChildNodes->FindNode("SpikeTemplates");
+   if (!xmlSpikeTemplates)
+      return;
+
+   unsigned int nChannel, n;
+   int nTemplate;
+   for (nChannel = 0; nChannel < (unsigned int)xmlSpikeTemplates->ChildNodes->Count && nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+      {
+      _di_IXMLNode xmlChannel = xmlSpikeTemplates->ChildNodes->Nodes[(int)nChannel];
+      _di_IXMLNode xmlTemplates = xmlChannel->ChildNodes->FindNode("Templates");
+      if (!xmlTemplates || !xmlTemplates->ChildNodes->Count)
+         continue;
+      std::shared_ptr<TSWSpikeTemplates > pTemplates(new TSWSpikeTemplates(m_swsSpikes.GetSpikeLength(),
+                                                                            StrToDouble(GetXMLValue(xmlChannel, "MinScore")),
+                                                                            StrToDouble(GetXMLValue(xmlChannel, "MinScale"))
+                                                                            ));
+      std::vector<double > vdTemplate;
+      for (nTemplate = 0; nTemplate < xmlTemplates->ChildNodes->Count; nTemplate++)
+         {
+         vved vvedTemplate = ParseMLVector(xmlTemplates->ChildNodes->Nodes[nTemplate]->Text, "Template");
+         if (vvedTemplate.size() != pTemplates->GetLength())
+            break;
+         vdTemplate.resize(vvedTemplate.size());
+         for (n = 0; n < vvedTemplate.size(); n++)
+            {
+            if (!vvedTemplate[n].size())
+               throw Exception("invalid spike template found in result");
+            vdTemplate[n] = vvedTemplate[n][0];
+            }
+         pTemplates->Add(&vdTemplate[0]);
+         }
+      // spike length changed since templates were saved: use threshold detection
+      if (nTemplate < xmlTemplates->ChildNodes->Count)
+         continue;
+      m_swsSpikes.SetTemplates(nChannel, pTemplates);
+      }
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// saves a result
 //------------------------------------------------------------------------------
@@ -2088,6 +2431,27 @@ int TformSpikeWare::SaveResult(bool bForceNewResult)
          xmlChannel->ChildValues["NoiseSelection_Active"] = IntToStr((int)m_pformPSTH->m_vSWNoiseSelections[nChannel].bActive);
          }
 
+      // save spike templates (template matching detection)
+      _di_IXMLNode xmlSpikeTemplates = xmlResultNode->ChildNodes->FindNode("SpikeTemplates");
+      if (!!xmlSpikeTemplates)
+         xmlResultNode->ChildNodes->Remove(xmlSpikeTemplates);
+      SaveSpikeTemplates(xmlResultNode);
+
+      // save trigger timing telemetry and recording statistics of last
+      // measurement (keep existing ones, if nothing was measured)
+      if (m_sweEpoches.m_swttTiming.GetNumTriggers())
+         {
+         _di_IXMLNode xmlTriggerTiming = xmlResultNode->ChildNodes->FindNode("TriggerTiming");
+         if (!!xmlTriggerTiming)
+            xmlResultNode->ChildNodes->Remove(xmlTriggerTiming);
+         SaveTriggerTiming(xmlResultNode->AddChild("TriggerTiming"));
+
+         _di_IXMLNode xmlStatistics = xmlResultNode->ChildNodes->FindNode("RecordingStatistics");
+         if (!!xmlStatistics)
+            xmlResultNode->ChildNodes->Remove(xmlStatistics);
+         SaveRecordingStatistics(xmlResultNode->AddChild("RecordingStatistics"));
+         }
+
       // write Spikes and NonSelectedSpikes to different nodes in XML
       _di_IXMLNode xmlSpikes = xmlResultNode->ChildNodes->FindNode("Spikes");
       if (!!xmlSpikes)
@@ -2104,7 +2468,7 @@ int TformSpikeWare::SaveResult(bool bForceNewResult)
       UnicodeString usLevel;
       UnicodeString usProgress = ".";
 
-      for (nChannel = 0; nChannel < m_swsSpikes.m_vvSpikes.size(); nChannel++)
+      for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
          {
          if ((nChannel % 100) == 0)
             {
@@ -2169,7 +2533,7 @@ int TformSpikeWare::SaveResult(bool bForceNewResult)
                }
 
             // store raw spike data
-            AnsiString as = EncodeBase64(&m_swsSpikes.GetSpike(nChannel, nSpike)[0], (int)(m_swsSpikes.GetSpike(nChannel, nSpike).size()*sizeof(double)));
+            AnsiString as = EncodeBase64(m_swsSpikes.GetSpike(nChannel, nSpike), (int)(m_swsSpikes.GetSpikeLength()*sizeof(double)));
             xmlSpike->ChildValues["Data"] = as;
             }
          }
@@ -2462,11 +2826,10 @@ TSWRunResult TformSpikeWare::RunMeasurement(bool bResume)
          UpdateStimulusDisplay();
 
          EnableEpocheTimer(true);
-         m_smp.Start();
+         m_smp.Start(0, bResume);
          m_smp.Wait();
          m_smp.Exit();
 
-
          // if NOT paused, then we're done: stop saving PCM data
          if (m_gs != SWGS_PAUSE)
             {
@@ -2475,7 +2838,11 @@ TSWRunResult TformSpikeWare::RunMeasurement(bool bResume)
             swrr = SWRR_DONE;
             }
          else
+            {
+            // write pending data to make file consistent with XML
+            m_sweEpoches.FlushSave();
             swrr = SWRR_PAUSE;
+            }
          // adjust m_nStimPlayIndex to saved (!) epoches
          m_nStimPlayIndex = (int)m_sweEpoches.m_nEpochesTotal;
          EnableEpocheTimer(false);
@@ -2836,7 +3203,7 @@ void TformSpikeWare::CreateParameterWindow(int nX, int nY)
 #pragma argsused
 void __fastcall TformSpikeWare::btnClusterClick(TObject *Sender)
 {
-   CreateClusterWindow(-1, -1, (unsigned int)m_swsSpikes.m_vvSpikes.size());
+   CreateClusterWindow(-1, -1, m_swsSpikes.GetNumChannels());
 }
 //------------------------------------------------------------------------------
 
@@ -2929,6 +3296,10 @@ void TformSpikeWare::ScaleClusterPlot(TformCluster* pfrm)
       pfrm->chrt->BottomAxis->SetMinMax(0.0, dMax2);
       }
 
+   // principal components are rms values centered around zero
+   if (pfrm->m_spX >= SP_PC1)
+      pfrm->chrt->BottomAxis->SetMinMax(-0.5*(dMax - dMin), 0.5*(dMax - dMin));
+
 
    // check if Y axis to be updated at all
    if (  pfrm->m_spY == SP_PEAK1
@@ -2944,6 +3315,9 @@ void TformSpikeWare::ScaleClusterPlot(TformCluster* pfrm)
       double dMax2 = dMax - dMin;
       pfrm->chrt->LeftAxis->SetMinMax(0.0, dMax2);
       }
+
+   if (pfrm->m_spY >= SP_PC1)
+      pfrm->chrt->LeftAxis->SetMinMax(-0.5*(dMax - dMin), 0.5*(dMax - dMin));
 }
 //------------------------------------------------------------------------------
 
@@ -3199,8 +3573,14 @@ void __fastcall TformSpikeWare::EpocheTimerTimer(TObject *Sender)
 
       bool b = ProcessEpoches();
 
+      TrackAutoThresholds();
+
       Sleep(1);
 
+      // store current xruns with new trigger errors
+      if (m_sweEpoches.m_swttTiming.GetNumUncorrelated())
+         m_sweEpoches.m_swttTiming.CorrelateXRuns(m_smp.GetXRuns());
+
       if (m_sweEpoches.m_bTriggerError)
          {
          m_sweEpoches.m_bTriggerError = false;
@@ -3215,7 +3595,37 @@ void __fastcall TformSpikeWare::EpocheTimerTimer(TObject *Sender)
                      + m_sweEpoches.m_usTriggerError
                      + ", xruns: "
                      + IntToStr(n)
-                     + "). The measurement was stopped!.");
+                     + "). The measurement was stopped!. Set 'TriggerErrorPolicy' to 'flag' or 'drop' in the INI file to continue on trigger errors.");
+         return;
+         }
+
+      if (m_sweEpoches.m_bQueueOverflow)
+         {
+         m_sweEpoches.m_bQueueOverflow = false;
+         if (m_bFreeSearchRunning)
+            m_pformSearchFree->btnStopClick(NULL);
+         else
+            btnStopClick(NULL);
+         SWErrorBox("Epoches could not be processed fast enough (queue size: "
+                     + IntToStr((int)m_sweEpoches.GetQueueCapacity())
+                     + ", discarded epoches: "
+                     + IntToStr((int)m_sweEpoches.GetQueueOverflows())
+                     + "). The measurement was stopped!");
+         return;
+         }
+
+      UnicodeString usSaveError;
+      if (m_sweEpoches.GetSaveError(usSaveError) || m_sweEpoches.GetSaveOverflows())
+         {
+         if (m_bFreeSearchRunning)
+            m_pformSearchFree->btnStopClick(NULL);
+         else
+            btnStopClick(NULL);
+         if (usSaveError.IsEmpty())
+            usSaveError = "disk too slow, worst-case write time: "
+                        + FormatFloat("0.0", m_sweEpoches.GetSaveMaxFlushLatency())
+                        + " ms";
+         SWErrorBox("Epoches could not be written to file (" + usSaveError + "). The measurement was stopped!");
          return;
          }
 
@@ -3256,7 +3666,7 @@ bool TformSpikeWare::ProcessEpoches()
 {
    try
       {
-      if (!m_sweEpoches.Count())
+      if (!m_sweEpoches.Pending())
          return false;
       TSWEpoche *pswe      = NULL;
 
@@ -3268,20 +3678,24 @@ bool TformSpikeWare::ProcessEpoches()
          if (!pswe)
             break;
 
-         // set epoche done in XML
-         SetXMLEpocheDone((int)pswe->m_nIndex, true);
-         // add spikes for this epoche
-         m_swsSpikes.Add(pswe);
+         // set epoche done in XML (and trigger policy, if epoche had a trigger error)
+         SetXMLEpocheDone( (int)pswe->m_nIndex,
+                           true,
+                           pswe->m_bTriggerError ? TSWTriggerTiming::PolicyToString(pswe->m_bDropped ? SWTP_DROP : SWTP_FLAG) : UnicodeString());
+         // add spikes for this epoche (dropped epoches are kept in epoche
+         // file, but excluded from spike detection)
+         if (!pswe->m_bDropped)
+            m_swsSpikes.Add(pswe);
 
          if (bLast)
             {
             PlotEpoches(pswe);
-            TRYDELETENULL(pswe);
+            m_sweEpoches.Release(pswe);
             PlotSpikes();
             PlotClusters();
             return true;
             }
-         TRYDELETENULL(pswe);
+         m_sweEpoches.Release(pswe);
 
          Application->ProcessMessages();
          if (m_bBreak)
@@ -3342,6 +3756,248 @@ void __fastcall TformSpikeWare::miAdjustSpikeLengthClick(TObject *Sender)
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// asks for factor of automatic thresholds (multiple of noise level) and
+/// stores it in INI. Returns false if cancelled
+//------------------------------------------------------------------------------
+bool TformSpikeWare::AskAutoThresholdFactor()
+{
+   double dFactor = IniReadDouble(m_pIni, "Settings", "AutoThresholdFactor", 4.0);
+   if (!m_pformSetParameters->SetParameter("Threshold", "x sigma", dFactor, this))
+      return false;
+   m_pIni->WriteString("Settings", "AutoThresholdFactor", DoubleToStr(fabs(dFactor)));
+   return true;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// sets thresholds of all channels to the multiple of their current noise level
+/// stored in INI. Polarity of current thresholds is kept. Thresholds are only
+/// changed if they differ by more than the relative dHysteresis from the
+/// current thresholds. Returns (space separated) channels without estimate
+//------------------------------------------------------------------------------
+UnicodeString TformSpikeWare::SetAutoThresholds(double dHysteresis)
+{
+   double dFactor = fabs(IniReadDouble(m_pIni, "Settings", "AutoThresholdFactor", 4.0));
+   UnicodeString usMissing;
+   bool bChanged = false;
+   unsigned int nChannel;
+   for (nChannel = 0; nChannel < m_sweEpoches.GetNumChannels(); nChannel++)
+      {
+      double dThreshold = m_sweEpoches.m_swneNoise.GetThreshold(nChannel, dFactor);
+      if (dThreshold <= 0.0)
+         {
+         usMissing += IntToStr((int)nChannel+1) + " ";
+         continue;
+         }
+      double dCurrent = GetThreshold(nChannel);
+      if (dCurrent < 0.0)
+         dThreshold = -dThreshold;
+      if (fabs(dThreshold - dCurrent) <= dHysteresis * fabs(dCurrent))
+         continue;
+      SetThreshold(nChannel, dThreshold);
+      bChanged = true;
+      }
+   if (bChanged)
+      SetMeasurementChanged();
+   return usMissing.Trim();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// updates thresholds from noise estimator, if miAutoThresholdTracking is
+/// checked and SWNE_TRACKING_INTERVAL has elapsed since last update. Called
+/// by EpocheTimer
+//------------------------------------------------------------------------------
+void TformSpikeWare::TrackAutoThresholds()
+{
+   if (!miAutoThresholdTracking->Checked)
+      return;
+   DWORD dwNow = GetTickCount();
+   if (dwNow - m_dwAutoThresholdUpdate < SWNE_TRACKING_INTERVAL)
+      return;
+   m_dwAutoThresholdUpdate = dwNow;
+   SetAutoThresholds(SWNE_TRACKING_HYSTERESIS);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// OnClick callback of miAutoThreshold: sets thresholds of all channels to a
+/// multiple of their noise level estimated from the recent recording (e.g. by
+/// free search). Polarity of current thresholds is kept
+//------------------------------------------------------------------------------
+#pragma argsused
+void __fastcall TformSpikeWare::miAutoThresholdClick(TObject *Sender)
+{
+   if (!FormsCreated())
+      return;
+
+   if (!AskAutoThresholdFactor())
+      return;
+
+   UnicodeString usMissing = SetAutoThresholds(0.0);
+   if (!usMissing.IsEmpty())
+      {
+      UnicodeString us = "Not enough data recorded to estimate noise level of channel(s) " + usMissing;
+      MessageBoxW(Handle, us.w_str(), L"Warning", MB_ICONWARNING);
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// OnClick callback of miAutoThresholdTracking: toggles tracking of automatic
+/// thresholds. If enabled, factor is asked for and thresholds follow the
+/// estimated noise level while recording (see TrackAutoThresholds)
+//------------------------------------------------------------------------------
+#pragma argsused
+void __fastcall TformSpikeWare::miAutoThresholdTrackingClick(TObject *Sender)
+{
+   if (!FormsCreated())
+      return;
+
+   if (miAutoThresholdTracking->Checked)
+      {
+      miAutoThresholdTracking->Checked = false;
+      return;
+      }
+   if (!AskAutoThresholdFactor())
+      return;
+   miAutoThresholdTracking->Checked = true;
+   m_dwAutoThresholdUpdate = GetTickCount();
+   SetAutoThresholds(0.0);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// OnClick callback of miAutoClusterKMeans and miAutoClusterGMM: clusters the
+/// spikes of all channels automatically and sets the spike groups, that can be
+/// edited in cluster windows afterwards. Used spike parameters are read from
+/// INI (ClusterFeatures, comma separated parameter IDs), maximum number of
+/// groups is asked for (limited to number of spike colors)
+//------------------------------------------------------------------------------
+void __fastcall TformSpikeWare::miAutoClusterClick(TObject *Sender)
+{
+   if (!FormsCreated())
+      return;
+
+   std::vector<TSpikeParam > vspFeatures;
+   TStringList* psl = new TStringList();
+   try
+      {
+      psl->CommaText = m_pIni->ReadString("Settings", "ClusterFeatures", "PC1,PC2,PC3");
+      int n;
+      for (n = 0; n < psl->Count; n++)
+         {
+         vspFeatures.push_back((TSpikeParam)m_swsSpikes.m_swspSpikePars.IndexFromID(psl->Strings[n].Trim()));
+         }
+      }
+   __finally
+      {
+      TRYDELETENULL(psl);
+      }
+   if (!vspFeatures.size())
+      throw Exception("no spike parameters specified in ClusterFeatures");
+
+   double dMaxGroups = (double)m_pIni->ReadInteger("Settings", "ClusterMaxGroups", 4);
+   if (!m_pformSetParameters->SetParameter("Groups", "max.", dMaxGroups, this))
+      return;
+   int nMaxGroups = (int)dMaxGroups;
+   if (nMaxGroups < 1)
+      nMaxGroups = 1;
+   if (nMaxGroups > (int)m_vclSpikeColors.size())
+      nMaxGroups = (int)m_vclSpikeColors.size();
+   m_pIni->WriteInteger("Settings", "ClusterMaxGroups", nMaxGroups);
+
+   int nThreads = m_pIni->ReadInteger("Settings", "ClusterThreads", 0);
+   if (nThreads < 0)
+      nThreads = 0;
+   TSWClusterMethod cm = Sender == miAutoClusterGMM ? SWCM_GMM : SWCM_KMEANS;
+   try
+      {
+      TSWSpikeCluster swsc(&m_swsSpikes, vspFeatures, cm, (unsigned int)nMaxGroups, (unsigned int)nThreads);
+      formWait->m_bCancel = false;
+      unsigned int nTotal = swsc.GetNumTotal();
+      while (!swsc.Wait(100))
+         {
+         formWait->ShowWait("Clustering spikes, please wait (" + IntToStr((int)(100*swsc.GetNumDone()/nTotal)) + "%)... Press ESC to cancel");
+         if (formWait->m_bCancel)
+            swsc.Cancel();
+         }
+      if (swsc.Finish())
+         {
+         // rectangles in cluster windows do not match new groups any more
+         UnicodeString usReport;
+         unsigned int nChannel, nWindow;
+         for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+            {
+            int nGroups = swsc.GetNumClusters(nChannel);
+            usReport += "Channel " + IntToStr((int)nChannel+1) + ": "
+                     + (nGroups > 0 ? IntToStr(nGroups) + " group(s)" : UnicodeString("not clustered")) + "\n";
+            if (nGroups <= 0)
+               continue;
+            for (nWindow = 0; nWindow < m_vpformCluster.size(); nWindow++)
+               m_vpformCluster[nWindow]->ClearSelections(nChannel);
+            }
+         UpdateClusterColors();
+         SetMeasurementChanged();
+         formWait->Hide();
+         MessageBoxW(Handle, usReport.w_str(), L"Spike clustering", MB_ICONINFORMATION);
+         }
+      }
+   __finally
+      {
+      if (formWait->Visible)
+         formWait->Hide();
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// OnClick callback of miTemplateDetection and miThresholdDetection: switches
+/// spike detection of all channels to template matching with the mean spikes
+/// of the current spike groups (miTemplateDetection) or back to threshold
+/// crossing. Minimum score is asked for, minimum scale of matched templates is
+/// read from INI (TemplateMinScale). Changed channels are rescanned on request
+//------------------------------------------------------------------------------
+void __fastcall TformSpikeWare::miTemplateDetectionClick(TObject *Sender)
+{
+   if (!FormsCreated())
+      return;
+
+   UnicodeString usReport;
+   unsigned int nChannel;
+   if (Sender == miTemplateDetection)
+      {
+      double dScore = IniReadDouble(m_pIni, "Settings", "TemplateScore", 0.8);
+      if (!m_pformSetParameters->SetParameter("Score", "min.", dScore, this))
+         return;
+      if (dScore <= 0.0 || dScore > 1.0)
+         throw Exception("template score must be > 0 and <= 1");
+      m_pIni->WriteString("Settings", "TemplateScore", DoubleToStr(dScore));
+      double dScale = IniReadDouble(m_pIni, "Settings", "TemplateMinScale", 0.5);
+      for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+         {
+         unsigned int nTemplates = m_swsSpikes.SetGroupTemplates(nChannel, dScore, dScale);
+         usReport += "Channel " + IntToStr((int)nChannel+1) + ": "
+                  + (nTemplates ? IntToStr((int)nTemplates) + " template(s)" : UnicodeString("threshold detection")) + "\n";
+         }
+      }
+   else
+      {
+      for (nChannel = 0; nChannel < m_swsSpikes.GetNumChannels(); nChannel++)
+         {
+         if (m_swsSpikes.GetNumTemplates(nChannel))
+            m_swsSpikes.SetTemplates(nChannel, TSWSpikeTemplatesPtr());
+         }
+      usReport = "Threshold detection is used for all channels.\n";
+      }
+   // channels with changed detection are not marked as scanned any more
+   usReport += "\nRescan spikes of changed channels now (all individual epoche thresholds will be cleared)?";
+   if (ID_YES == MessageBoxW(Handle, usReport.w_str(), L"Spike detection", MB_ICONQUESTION | MB_YESNO))
+      LoadEpoches(SWELM_SPIKES_RESET_THRESHOLD);
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// OnClick callback of btnLoadTemplate: loads a measurement template
 //------------------------------------------------------------------------------
@@ -3473,8 +4129,18 @@ void TformSpikeWare::SetGUIStatus(TSWGuiStatus gs)
 
    miAdjustSpikeLength->Enabled = m_gs == SWGS_RESULTLOADED;
 
+   // automatic thresholds need data recorded in this session
+   miAutoThreshold->Enabled = !IsBatchMode() && m_gs != SWGS_NONE && m_gs != SWGS_RESULTLOADED;
+   miAutoThresholdTracking->Enabled = miAutoThreshold->Enabled;
+   if (!miAutoThresholdTracking->Enabled)
+      miAutoThresholdTracking->Checked = false;
+
    btnRescanSpikes->Enabled   = !bRunning && (m_gs == SWGS_RESULTLOADED || m_gs == SWGS_STOP);
    btnReloadEpoches->Enabled  = btnRescanSpikes->Enabled;
+   miAutoClusterKMeans->Enabled  = !IsBatchMode() && btnRescanSpikes->Enabled;
+   miAutoClusterGMM->Enabled     = miAutoClusterKMeans->Enabled;
+   miTemplateDetection->Enabled  = miAutoClusterKMeans->Enabled;
+   miThresholdDetection->Enabled = miAutoClusterKMeans->Enabled;
 
    miUpdateCheck->Enabled      = btnLoadTemplate->Enabled;
 
@@ -3554,7 +4220,7 @@ void __fastcall TformSpikeWare::btnRescanSpikesClick(TObject *Sender)
 {
    // ask user....
    if (ID_YES != MessageBox(  Handle,
-                              "Are you sure, that you want to rescan all spikes with current threshold (all individual epoche thresholds will be cleared)?",
+                              "Are you sure, that you want to rescan all spikes with current threshold (all individual epoche thresholds will be cleared)? Only channels with changed thresholds are rescanned.",
                               "Question",
                               MB_ICONQUESTION | MB_YESNO)
       )
@@ -233,6 +233,12 @@ class TformSpikeWare : public TForm
       TMenuItem *miSignalPSTH;
       TMenuItem *miTools;
       TMenuItem *miAdjustSpikeLength;
+      TMenuItem *miAutoThreshold;
+      TMenuItem *miAutoThresholdTracking;
+      TMenuItem *miAutoClusterKMeans;
+      TMenuItem *miAutoClusterGMM;
+      TMenuItem *miTemplateDetection;
+      TMenuItem *miThresholdDetection;
       TToolButton *btnReloadEpoches;
       TMenuItem *N1;
       TMenuItem *miBatchRun;
@@ -260,6 +266,10 @@ class TformSpikeWare : public TForm
       void __fastcall miAboutClick(TObject *Sender);
       void __fastcall btnInSituClick(TObject *Sender);
       void __fastcall miAdjustSpikeLengthClick(TObject *Sender);
+      void __fastcall miAutoThresholdClick(TObject *Sender);
+      void __fastcall miAutoThresholdTrackingClick(TObject *Sender);
+      void __fastcall miAutoClusterClick(TObject *Sender);
+      void __fastcall miTemplateDetectionClick(TObject *Sender);
       void __fastcall FormShow(TObject *Sender);
       void __fastcall btnReloadEpochesClick(TObject *Sender);
       void __fastcall btnBatchClick(TObject *Sender);
@@ -267,6 +277,7 @@ class TformSpikeWare : public TForm
    void __fastcall miUpdateCheckClick(TObject *Sender);
    private:	// Benutzer-Deklarationen
       bool     m_bFormsCreated;      
+      DWORD    m_dwAutoThresholdUpdate;
       void     CreateForms();
       void     CreateClusterWindow(int nX = -1, int nY = -1, unsigned int nChannels = 1);
       bool     ProcessEpoches();
@@ -277,6 +288,9 @@ class TformSpikeWare : public TForm
       void     ConvertIniFile();
       void     ReadSettings();
       void     SetStyle();
+      bool     AskAutoThresholdFactor();
+      UnicodeString SetAutoThresholds(double dHysteresis);
+      void     TrackAutoThresholds();
    public:		// Benutzer-Deklarationen
       UnicodeString        ParameterWindowName(unsigned int nX, unsigned int nY);
       bool                 FormsCreated();
@@ -352,9 +366,16 @@ class TformSpikeWare : public TForm
       int            EpochesXML(bool bDone);
       void           CreateXMLEpoches(std::vector<int >* vn = NULL);
       void           LoadEpoches(TEpocheLoadMode nELM);
-      void           SetXMLEpocheDone(int nNode, bool bDone);
+      bool           RescanSpikes(const std::vector<TSWEpoche* >& rvpEpoches,
+                                  const std::vector<unsigned int >* pvnChannels = NULL);
+      void           RegisterXMLSpikeDetection();
+      void           SetXMLEpocheDone(int nNode, bool bDone, UnicodeString usTriggerError = "");
       void           SetXMLEpocheThreshold(int nNode, std::vector<double >& rvd);
       void           SetXMLEpocheThreshold(_di_IXMLNode xml, std::vector<double >& rvd);
+      void           SaveTriggerTiming(_di_IXMLNode xmlTriggerTiming);
+      void           SaveRecordingStatistics(_di_IXMLNode xmlStatistics);
+      bool           SaveSpikeTemplates(_di_IXMLNode xmlResultNode);
+      void           LoadSpikeTemplates(_di_IXMLNode xmlResultNode);
       void           EnsureXMLEpocheThresholds();
       std::vector<double > GetXMLEpocheThresholds(int nNode);
       std::vector<double > GetXMLEpocheThresholds(_di_IXMLNode xml);
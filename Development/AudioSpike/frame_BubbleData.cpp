@@ -88,8 +88,12 @@ void TframeBubbleData::Initialize(int nType)
    m_pthf->DataStyle = hdsTruncate;
    m_pthf->Cumulative = false;
 
-   csData->FunctionType = m_pthf;
-   csData->SetFunction(m_pthf);
+   // period histogram is summed up from bins of TBubbleData, no function needed
+   if (m_nChartType != BPSTH_PERIOD)
+      {
+      csData->FunctionType = m_pthf;
+      csData->SetFunction(m_pthf);
+      }
    csData->Marks->Visible = false;
 
    chrt->LeftAxis->Minimum = 0;
@@ -137,7 +141,7 @@ void TframeBubbleData::SetNumBins(int n)
    m_pthf->NumBins = n;
 
    if (m_nChartType == BPSTH_PERIOD)
-      NormalizeHistogram();
+      PlotPeriodHistogram();
 
    ShowBinSize();
 }
@@ -158,36 +162,35 @@ void TframeBubbleData::Plot(TBubbleData& rbd, UnicodeString usInfo)
          chrt->BottomAxis->SetMinMax(0, formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0);
       ShowBinSize();
 
-      // access spike times or cycles respectively
-      std::vector<double >& rvd = (m_nChartType == BPSTH_STANDARD) ? rbd.m_vdSpikeTimes : rbd.m_vdSpikeCycles;
+      if (!usInfo.IsEmpty())
+         chrt->Title->Text->Text = m_usName + " - " + usInfo;
+
+      // period histogram: keep a copy of the bins for changing bin size
+      if (m_nChartType == BPSTH_PERIOD)
+         {
+         m_vnPhaseBins = rbd.m_vnPhaseBins;
+         PlotPeriodHistogram();
+         return;
+         }
 
       csData->Clear();
       csNormalizedData->Clear();
       csPoints->Clear();
 
-      if (!usInfo.IsEmpty())
-         chrt->Title->Text->Text = m_usName + " - " + usInfo;
-
+      std::vector<double >& rvd = rbd.m_vdSpikeTimes;
       unsigned int nNum = (unsigned int)rvd.size();
       if (!nNum)
          return;
 
       // scale seconds to milliseconds for spiketime
-      double dMultiplier = 1.0;
-      if (m_nChartType == BPSTH_STANDARD)
-         dMultiplier = 1000.0;
-
       unsigned int n;
       for (n = 0; n < nNum; n++)
          {
-         csPoints->AddY(rvd[n] * dMultiplier);
+         csPoints->AddY(rvd[n] * 1000.0);
          }
 
       csData->DataSources->Clear();
       csData->DataSources->Add(csPoints);
-
-      if (m_nChartType == BPSTH_PERIOD)
-         NormalizeHistogram();
       }
    __finally
       {
@@ -196,6 +199,26 @@ void TframeBubbleData::Plot(TBubbleData& rbd, UnicodeString usInfo)
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// plots period histogram from stored bins with current number of bins
+//------------------------------------------------------------------------------
+void TframeBubbleData::PlotPeriodHistogram()
+{
+   csData->Clear();
+   csNormalizedData->Clear();
+   if (m_vnPhaseBins.empty())
+      return;
+
+   std::vector<unsigned int > vnBins;
+   TBubbleData::SumPhaseBins(m_vnPhaseBins, (unsigned int)m_pthf->NumBins, vnBins);
+   unsigned int n;
+   for (n = 0; n < vnBins.size(); n++)
+      csData->AddXY(((double)n + 0.5) / (double)vnBins.size(), (double)vnBins[n]);
+
+   NormalizeHistogram();
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// normalizes histogram data
 //------------------------------------------------------------------------------
@@ -218,6 +241,7 @@ void TframeBubbleData::NormalizeHistogram()
 //------------------------------------------------------------------------------
 void TframeBubbleData::Clear()
 {
+   m_vnPhaseBins.clear();
    csPoints->Clear();
    csData->Clear();
    csNormalizedData->Clear();
@@ -84,8 +84,10 @@ class TframeBubbleData : public TFrame
       UnicodeString        m_usName;
       THistogramFunction*  m_pthf;
       int                  m_nChartType;
+      std::vector<unsigned int > m_vnPhaseBins;
       void                 SetNumBins(int n);
       void                 NormalizeHistogram();
+      void                 PlotPeriodHistogram();
       void                 Initialize(int nType);
    public:		// Benutzer-Deklarationen
       __fastcall TframeBubbleData(TComponent* Owner);
@@ -169,14 +169,7 @@ void TformBubblePlot::Initialize()
       if (m_bpd.m_nFreqAxis != (int)m_nParamX && m_bpd.m_nFreqAxis != (int)m_nParamY)
          m_bpd.m_nFreqAxis = -1;
       if (m_bpd.m_nFreqAxis > -1)
-         {
-         // try try check for kHz or MHz .....
-         UnicodeString usUnit = UpperCase(formSpikeWare->m_swsStimuli.m_swspStimPars.m_vusUnits[(unsigned int)m_bpd.m_nFreqAxis]);
-         if (usUnit == "KHZ")
-            dFreqMultiplier = 1000.0;
-         else if (usUnit == "MHZ")
-            dFreqMultiplier = 1000000.0;
-         }
+         dFreqMultiplier = GetFrequencyMultiplier(m_bpd.m_nFreqAxis);
 
       // add all possible bubbles with radius 0: needed to show axis fine and to reverse lookup
       // X and Y for a particular buble
@@ -249,7 +242,6 @@ void TformBubblePlot::Plot(unsigned int nChannelIndex)
 
       psl = new TStringList();
 
-      double dPreStimulus = formSpikeWare->m_sweEpoches.m_dPreStimulus;
       Tag = (NativeInt)nChannelIndex;
 
       m_bpd.Clear();
@@ -264,73 +256,31 @@ void TformBubblePlot::Plot(unsigned int nChannelIndex)
          if (!formSpikeWare->m_pformPSTH->Selected() && !formSpikeWare->m_pformPSTH->NoiseSelected())
             return;
 
-         // retrieve selections from PSTH plot
-         double dMin, dMax, dNoiseMin, dNoiseMax;
-         formSpikeWare->m_pformPSTH->GetSelections(dMin, dMax, dNoiseMin, dNoiseMax);
-         m_dSelLen = dMax - dMin;
-
+         // spike counts and phases of all stimuli (maintained by spikes, no
+         // spikes read here)
+         std::vector<TSWStimulusResponse > vswsr;
+         GetResponse(nChannelIndex, vswsr);
 
-         // get references to stimulus values and their sizes once before loop
-         std::vector<double >& rvdXParamValues = formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamX];
-         std::vector<double >& rvdYParamValues = formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamY];
-         unsigned int nXSize = (unsigned int)formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamX].size();
-         unsigned int nYSize = (unsigned int)formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamY].size();
+         // bubble index of every stimulus
+         std::vector<unsigned int > vnBubbleIndex;
+         GetBubbleIndices(vnBubbleIndex);
 
-         double dSpikeTime, dMod;
-         unsigned int nSpike, nX, nY, nBubbleIndex;
-         unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes(nChannelIndex);
-
-         for (nSpike = 0; nSpike < nNum; nSpike++)
+         // sum up stimuli of all bubbles
+         unsigned int nStim, nBubbleIndex;
+         for (nStim = 0; nStim < vswsr.size() && nStim < vnBubbleIndex.size(); nStim++)
             {
-            // check if spike selected at all!
-            if (formSpikeWare->m_swsSpikes.GetSpikeGroup(nChannelIndex, nSpike) < 0)
+            nBubbleIndex = vnBubbleIndex[nStim];
+            if (nBubbleIndex == UINT_MAX)
                continue;
-
-            // retrieve spiketime
-            dSpikeTime = formSpikeWare->m_swsSpikes.GetSpikeTime(nChannelIndex, nSpike);
-
-            // in the spike we have stored m_nStimIndex which points to the stimulus, that evoked
-            // this spike. In this stimulus the corresponding stimulus parameters are stored.
-            // Get a reference to the stimulus parameters
-            std::vector<double >& rvdParams =
-               formSpikeWare->m_swsStimuli.m_swstStimuli[formSpikeWare->m_swsSpikes.GetStimIndex(nChannelIndex, nSpike)].m_vdParams;
-
-            // now find the indices within the parameter values
-            nX = (unsigned int)(int)(std::find(rvdXParamValues.begin(), rvdXParamValues.end(), rvdParams[m_nParamX]) - rvdXParamValues.begin());
-            nY = (unsigned int)(int)(std::find(rvdYParamValues.begin(), rvdYParamValues.end(), rvdParams[m_nParamY]) - rvdYParamValues.begin());
-            // not found? (should not happen)
-            if (nX >= nXSize || nY >= nYSize)
-               continue;
-
-            nBubbleIndex = nX*nYSize + nY;
-            
-            // push all (!) spiketimes (not only those selected in PSTH)
-            m_bpd.m_vBubbleData[nBubbleIndex].m_vdSpikeTimes.push_back(dSpikeTime);
-
-            if (formSpikeWare->m_pformPSTH->Selected())
-               {
-               // increase bubble size and add bubble values
-               if (dSpikeTime >= dMin && dSpikeTime <= dMax)
-                  {
-                  // push only spike cycles selected in PSTH!!
-                  // NOTE: here we subtract PreStimulus from Spiketime to get correct phase!!
-                  if (m_bpd.HasFrequency())
-                     {
-                     m_bpd.m_vBubbleData[nBubbleIndex].m_vdSpikeCycles.push_back(
-                        modf((dSpikeTime - dPreStimulus)* m_bpd.m_vBubbleData[nBubbleIndex].m_dFrequency, &dMod)
-                        );
-                     }
-
-                  //increase bubble size
-                  m_vadData[nBubbleIndex] += 1;
-                  }
-               }
-            if (formSpikeWare->m_pformPSTH->NoiseSelected())
-               {
-               // decrease bubble size
-               if (dSpikeTime >= dNoiseMin && dSpikeTime <= dNoiseMax)
-                  m_vadData[nBubbleIndex] -= 1;
-               }
+            const TSWStimulusResponse& rswsr = vswsr[nStim];
+            // increase bubble size by spikes in selection, decrease by spikes in
+            // noise selection
+            m_vadData[nBubbleIndex] += (double)rswsr.nNumSelected;
+            m_vadData[nBubbleIndex] -= (double)rswsr.nNumNoise;
+            // phases of spikes selected in PSTH (frequency of stimulus is
+            // frequency of bubble)
+            if (m_bpd.HasFrequency())
+               m_bpd.m_vBubbleData[nBubbleIndex].AddCycles(rswsr.dSumCos, rswsr.dSumSin, rswsr.nNumCycles, rswsr.vnPhaseBins);
             }
 
          if (m_bpd.HasFrequency())
@@ -375,6 +325,123 @@ void TformBubblePlot::Plot(unsigned int nChannelIndex)
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// returns multiplier for values of a frequency parameter to Hz (checks unit
+/// for kHz or MHz)
+//------------------------------------------------------------------------------
+double TformBubblePlot::GetFrequencyMultiplier(int nParam)
+{
+   UnicodeString usUnit = UpperCase(formSpikeWare->m_swsStimuli.m_swspStimPars.m_vusUnits[(unsigned int)nParam]);
+   if (usUnit == "KHZ")
+      return 1000.0;
+   else if (usUnit == "MHZ")
+      return 1000000.0;
+   return 1.0;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// writes bubble index of every stimulus to rvnBubbleIndex (UINT_MAX: not
+/// found, should not happen)
+//------------------------------------------------------------------------------
+void TformBubblePlot::GetBubbleIndices(std::vector<unsigned int >& rvnBubbleIndex)
+{
+   // get sizes of stimulus values once before loop
+   unsigned int nXSize = (unsigned int)formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamX].size();
+   unsigned int nYSize = (unsigned int)formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamY].size();
+
+   unsigned int nNumStimuli = (unsigned int)formSpikeWare->m_swsStimuli.m_swstStimuli.size();
+   rvnBubbleIndex.assign(nNumStimuli, UINT_MAX);
+   unsigned int nStim, nX, nY;
+   for (nStim = 0; nStim < nNumStimuli; nStim++)
+      {
+      nX = formSpikeWare->m_swsStimuli.GetValueIndex(nStim, m_nParamX);
+      nY = formSpikeWare->m_swsStimuli.GetValueIndex(nStim, m_nParamY);
+      if (nX < nXSize && nY < nYSize)
+         rvnBubbleIndex[nStim] = nX*nYSize + nY;
+      }
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// passes current PSTH selections, stimulus onset and the frequencies of all
+/// stimuli (parameter FREQUENCY, independent of the axes of the plot) to
+/// spikes and writes spike counts and phases of all stimuli of a channel to
+/// rvswsr. They are only rebuilt from the spikes, if the settings were changed
+//------------------------------------------------------------------------------
+void TformBubblePlot::GetResponse(unsigned int nChannelIndex, std::vector<TSWStimulusResponse >& rvswsr)
+{
+   TSWResponseSettings swrs;
+   formSpikeWare->m_pformPSTH->GetSelections(swrs.dMin, swrs.dMax, swrs.dNoiseMin, swrs.dNoiseMax);
+   swrs.bSelected       = formSpikeWare->m_pformPSTH->Selected();
+   swrs.bNoiseSelected  = formSpikeWare->m_pformPSTH->NoiseSelected();
+   // NOTE: phases are relative to stimulus onset
+   swrs.dOnset          = formSpikeWare->m_sweEpoches.GetStimulusOnset();
+   m_dSelLen = swrs.dMax - swrs.dMin;
+
+   int nFreq = formSpikeWare->m_swsStimuli.m_swspStimPars.IndexFromName("FREQUENCY");
+   if (nFreq > -1)
+      {
+      const std::vector<double >& rvdValues = formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[(unsigned int)nFreq];
+      double dFreqMultiplier = GetFrequencyMultiplier(nFreq);
+      unsigned int nNumStimuli = (unsigned int)formSpikeWare->m_swsStimuli.m_swstStimuli.size();
+      swrs.vdFrequency.assign(nNumStimuli, 0.0);
+      unsigned int nStim, nValue;
+      for (nStim = 0; nStim < nNumStimuli; nStim++)
+         {
+         nValue = formSpikeWare->m_swsStimuli.GetValueIndex(nStim, (unsigned int)nFreq);
+         if (nValue < rvdValues.size())
+            swrs.vdFrequency[nStim] = dFreqMultiplier * rvdValues[nValue];
+         }
+      }
+
+   formSpikeWare->m_swsSpikes.SetResponseSettings(swrs);
+   formSpikeWare->m_swsSpikes.GetResponse(nChannelIndex, rvswsr);
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// collects spike times of all grouped spikes of one bubble (for the bubble
+/// PSTH). Called on demand for the clicked bubble only
+//------------------------------------------------------------------------------
+void TformBubblePlot::CollectSpikeTimes(unsigned int nChannelIndex, unsigned int nBubbleIndex)
+{
+   if (nBubbleIndex >= m_bpd.m_vBubbleData.size())
+      return;
+   std::vector<double >& rvdSpikeTimes = m_bpd.m_vBubbleData[nBubbleIndex].m_vdSpikeTimes;
+   rvdSpikeTimes.clear();
+
+   std::vector<unsigned int > vnBubbleIndex;
+   GetBubbleIndices(vnBubbleIndex);
+
+   // number of spikes from stimulus counts: nothing to read, if bubble is empty
+   std::vector<TSWStimulusResponse > vswsr;
+   GetResponse(nChannelIndex, vswsr);
+   unsigned int nStim;
+   unsigned int nNumSpikes = 0;
+   for (nStim = 0; nStim < vswsr.size() && nStim < vnBubbleIndex.size(); nStim++)
+      {
+      if (vnBubbleIndex[nStim] == nBubbleIndex)
+         nNumSpikes += vswsr[nStim].nNumSpikes;
+      }
+   if (!nNumSpikes)
+      return;
+   rvdSpikeTimes.reserve(nNumSpikes);
+
+   unsigned int nSpike;
+   TSWSpikeSnapshot swss = formSpikeWare->m_swsSpikes.GetSnapshot(nChannelIndex);
+   unsigned int nNum = swss.GetNumSpikes();
+   for (nSpike = 0; nSpike < nNum; nSpike++)
+      {
+      if (swss.GetSpikeGroup(nSpike) < 0)
+         continue;
+      nStim = swss.GetStimIndex(nSpike);
+      if (nStim < vnBubbleIndex.size() && vnBubbleIndex[nStim] == nBubbleIndex)
+         rvdSpikeTimes.push_back(swss.GetSpikeTime(nSpike));
+      }
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// called by Plot() to plot special things if Y-Axis is a response axis
 //------------------------------------------------------------------------------
@@ -393,55 +460,25 @@ void TformBubblePlot::PlotResponse(unsigned int nChannelIndex)
    for (n = 0; n < csResponseData->YValues->Count; n++)
       csResponseData->YValues->Value[n] = 0;
 
-   // retrieve selections from PSTH plot
-   double dMin, dMax, dNoiseMin, dNoiseMax;
-   formSpikeWare->m_pformPSTH->GetSelections(dMin, dMax, dNoiseMin, dNoiseMax);
-   m_dSelLen = dMax - dMin;
+   // spike counts of all stimuli (maintained by spikes, no spikes read here)
+   std::vector<TSWStimulusResponse > vswsr;
+   GetResponse(nChannelIndex, vswsr);
 
-   // get references to stimulus value and the sizes once before loop
-   std::vector<double >& rvdXParamValues = formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamX];
+   // get size of stimulus values once before loop
    unsigned int nXSize = (unsigned int)formSpikeWare->m_swsStimuli.m_swspStimPars.m_vvdValues[m_nParamX].size();
 
-   double dSpikeTime;
-   unsigned int nSpike, nX;
-   unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes(nChannelIndex);
-   for (nSpike = 0; nSpike < nNum; nSpike++)
+   unsigned int nNumStimuli = (unsigned int)formSpikeWare->m_swsStimuli.m_swstStimuli.size();
+   unsigned int nStim, nX;
+   for (nStim = 0; nStim < vswsr.size() && nStim < nNumStimuli; nStim++)
       {
-      // check if spike selected at all!
-      if (formSpikeWare->m_swsSpikes.GetSpikeGroup(nChannelIndex, nSpike) < 0)
-         continue;
-
-      // retrieve spiketime
-      dSpikeTime = formSpikeWare->m_swsSpikes.GetSpikeTime(nChannelIndex, nSpike);
-
-      // in the spike we have stored m_nStimIndex which points to the stimulus, that evoked
-      // this spike. In this stimulus the corresponding stimulus parameters are stored.
-      // Get a reference to the stimulus parameters
-      std::vector<double >& rvdParams =
-         formSpikeWare->m_swsStimuli.m_swstStimuli[formSpikeWare->m_swsSpikes.GetStimIndex(nChannelIndex, nSpike)].m_vdParams;
-
-      // now find the indices within the parameter values
-      nX = (unsigned int)(int)(std::find(rvdXParamValues.begin(), rvdXParamValues.end(), rvdParams[m_nParamX]) - rvdXParamValues.begin());
+      // look up index of value of the parameter of the stimulus
+      nX = formSpikeWare->m_swsStimuli.GetValueIndex(nStim, m_nParamX);
       // not found? (should not happen
       if (nX >= nXSize)
          continue;
-
-      if (formSpikeWare->m_pformPSTH->Selected())
-         {
-         // increase bubble size
-         if (dSpikeTime >= dMin && dSpikeTime <= dMax)
-            {
-            csResponseData->YValues->Value[(int)nX] += 1;
-            }
-         }
-      if (formSpikeWare->m_pformPSTH->NoiseSelected())
-         {
-         // increase bubble size
-         if (dSpikeTime >= dNoiseMin && dSpikeTime <= dNoiseMax)
-            {
-            csResponseData->YValues->Value[(int)nX] -= 1;
-            }
-         }
+      // increase by spikes in selection, decrease by spikes in noise selection
+      csResponseData->YValues->Value[(int)nX] += (double)vswsr[nStim].nNumSelected;
+      csResponseData->YValues->Value[(int)nX] -= (double)vswsr[nStim].nNumNoise;
       }
       csResponseData->Repaint();
 }
@@ -633,6 +670,7 @@ void __fastcall TformBubblePlot::chrtMouseDown(TObject *Sender, TMouseButton But
             formSpikeWare->m_swsStimuli.m_swspStimPars.m_vusUnits[m_nParamY].w_str()
             );
 
+         CollectSpikeTimes((unsigned int)Tag, (unsigned int)nIndex);
          formSpikeWare->SetWindowVisible(formSpikeWare->m_pformBubbleData, true);
          formSpikeWare->m_pformBubbleData->Plot(m_bpd.m_vBubbleData[(unsigned int)nIndex], m_bpd.HasFrequency(), usInfo);
          formSpikeWare->m_pformBubbleData->BringToFront();
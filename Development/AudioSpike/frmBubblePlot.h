@@ -82,6 +82,10 @@ class TformBubblePlot : public TformASUI
 
       void        AdjustLogAxis(TChartAxis* pca);
       double      GetAbsMax();
+      double      GetFrequencyMultiplier(int nParam);
+      void        GetBubbleIndices(std::vector<unsigned int >& rvnBubbleIndex);
+      void        GetResponse(unsigned int nChannelIndex, std::vector<TSWStimulusResponse >& rvswsr);
+      void        CollectSpikeTimes(unsigned int nChannelIndex, unsigned int nBubbleIndex);
    public:		// Benutzer-Deklarationen
       TBubblePlotData   m_bpd;
       bool        m_bResponseYAxis;
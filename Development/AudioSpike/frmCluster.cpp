@@ -29,6 +29,7 @@
 //------------------------------------------------------------------------------
 #include <vcl.h>
 #include <math.h>
+#include <algorithm>
 #pragma hdrstop
 
 #include "frmCluster.h"
@@ -50,7 +51,9 @@ TSWClusterSelection::TSWClusterSelection()
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// resets all members
+/// resets all members. bAssigned is set, as soon as the selection has set the
+/// spike group with its index: spikes of this group are owned by the
+/// selection from then on (even if it is deactivated)
 //------------------------------------------------------------------------------
 void TSWClusterSelection::Clear()
 {
@@ -59,6 +62,7 @@ void TSWClusterSelection::Clear()
    dY0      = 0.0;
    dY1      = 0.0;
    bActive  = false;
+   bAssigned = false;
 }
 //------------------------------------------------------------------------------
 
@@ -66,7 +70,7 @@ void TSWClusterSelection::Clear()
 /// constructor. Initializes members and creates ChartShapes for cluster selections
 //------------------------------------------------------------------------------
 __fastcall TformCluster::TformCluster(TComponent* Owner, TSpikeParam spX, TSpikeParam spY)
-   : TformASUI(Owner), m_spX(spX), m_spY(spY), m_nPlotCounter(0)
+   : TformASUI(Owner), m_bIndexValid(false), m_bPreviewValid(false), m_spX(spX), m_spY(spY), m_nPlotCounter(0)
 {
    Name        = "Cluster_"
                + formSpikeWare->m_swsSpikes.m_swspSpikePars.m_vusIDs[m_spX] + "_"
@@ -159,7 +163,8 @@ void TformCluster::Initialize(unsigned int nChannels)
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// resets all selections (ChartShapes and TSWClusterSelections)
+/// resets all selections (ChartShapes and TSWClusterSelections). Spike groups
+/// are only reset, if bInit is false
 //------------------------------------------------------------------------------
 void TformCluster::ResetSelection(bool bInit)
 {
@@ -179,7 +184,7 @@ void TformCluster::ResetSelection(bool bInit)
          }
       if (!bInit)
          formSpikeWare->m_swsSpikes.SpikeGroupReset((unsigned int)Tag);
-      SetColors();
+      formSpikeWare->UpdateClusterColors();
       }
    __finally
       {
@@ -189,6 +194,22 @@ void TformCluster::ResetSelection(bool bInit)
 }
 //------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// clears all selections of a channel without touching the spike groups, e.g.
+/// after the groups were set by automatic clustering
+//------------------------------------------------------------------------------
+void TformCluster::ClearSelections(unsigned int nChannel)
+{
+   if (nChannel >= m_vvSWSelections.size())
+      return;
+   unsigned int n;
+   for (n = 0; n < m_vvSWSelections[nChannel].size(); n++)
+      m_vvSWSelections[nChannel][n].Clear();
+   if (Tag == (int)nChannel)
+      SelectionsToSelectionSeries();
+}
+//------------------------------------------------------------------------------
+
 //------------------------------------------------------------------------------
 /// resets currently active spike groups
 //------------------------------------------------------------------------------
@@ -258,7 +279,8 @@ void TformCluster::Plot(unsigned int nChannelIndex)
 
       Caption = "Clusterplot - Channel " + IntToStr(Tag+1);
 
-      unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes((unsigned int)Tag);
+      TSWSpikeSnapshot swss = formSpikeWare->m_swsSpikes.GetSnapshot((unsigned int)Tag);
+      unsigned int nNum = swss.GetNumSpikes();
       if (!nNum)
          {
          csData->Clear();
@@ -272,12 +294,21 @@ void TformCluster::Plot(unsigned int nChannelIndex)
       // and afterwards set values, than calling AddXY in a loop (example found in
       // the web -  and tested with success!!)!!
       csData->FillSampleValues((int)nNum);
+      // read parameter and group columns in one go
+      m_vdX.resize(nNum);
+      m_vdY.resize(nNum);
+      m_vnGroups.resize(nNum);
+      swss.GetSpikeParams(m_spX, &m_vdX[0], 0, nNum);
+      swss.GetSpikeParams(m_spY, &m_vdY[0], 0, nNum);
+      m_bIndexValid = false;
+      m_bPreviewValid = false;
+      swss.GetSpikeGroups(&m_vnGroups[0], 0, nNum);
       unsigned int n;
       for (n = 0; n < nNum; n++)
          {
-         csData->XValues->Value[(int)n]  = formSpikeWare->m_swsSpikes.GetSpikeParam((unsigned int)Tag, n, m_spX);
-         csData->YValues->Value[(int)n]  = formSpikeWare->m_swsSpikes.GetSpikeParam((unsigned int)Tag, n, m_spY);
-         csData->ValueColor[(int)n]      = formSpikeWare->SpikeGroupToColor(formSpikeWare->m_swsSpikes.GetSpikeGroup((unsigned int)Tag, n));
+         csData->XValues->Value[(int)n]  = m_vdX[n];
+         csData->YValues->Value[(int)n]  = m_vdY[n];
+         csData->ValueColor[(int)n]      = formSpikeWare->SpikeGroupToColor(m_vnGroups[n]);
          }
 
 
@@ -313,9 +344,13 @@ void TformCluster::UpdateColors()
       int nSelected = 0;
       int nGroup;
       unsigned int n;
+      m_vnGroups.resize(nNum);
+      m_bPreviewValid = false;
+      if (nNum)
+         formSpikeWare->m_swsSpikes.GetSpikeGroups((unsigned int)Tag, &m_vnGroups[0], 0, nNum);
       for (n = 0; n < nNum; n++)
          {
-         nGroup = formSpikeWare->m_swsSpikes.GetSpikeGroup((unsigned int)Tag, n);
+         nGroup = m_vnGroups[n];
          if (nGroup >= 0)
             nSelected++;
          csData->ValueColor[(int)n] = formSpikeWare->SpikeGroupToColor(nGroup);
@@ -348,56 +383,236 @@ void TformCluster::SetColors()
    try
       {
       m_nPlotCounter++;
-      unsigned int nSpike, n;
-      bool bAnyActiveSel = true;
+      unsigned int nNum = SelectionsToGroups(m_vnSelGroups);
+      if (nNum)
+         formSpikeWare->m_swsSpikes.SetSpikeGroups((unsigned int)Tag, &m_vnSelGroups[0], 0, nNum);
+      // active selections own their groups now. 'select all' assigns group 0
+      // to all unassigned spikes: they are owned by selection 0
+      if (nNum)
+         {
+         std::vector<TSWClusterSelection >& rvSelections = m_vvSWSelections[(unsigned int)Tag];
+         unsigned int n;
+         for (n = 0; n < m_vpcs.size() && n < rvSelections.size(); n++)
+            {
+            if (m_vpcs[n]->Active)
+               rvSelections[n].bAssigned = true;
+            }
+         if (!AnySelectionActive() && rvSelections.size())
+            rvSelections[0].bAssigned = true;
+         }
+      }
+   __finally
+      {
+      m_nPlotCounter--;
+      }
+   formSpikeWare->UpdateClusterColors();
+   formSpikeWare->SetMeasurementChanged();
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns true if a selection is active (always true if 'select all' on no
+/// selection is not set)
+//------------------------------------------------------------------------------
+bool TformCluster::AnySelectionActive()
+{
+   bool bAnyActiveSel = !m_bSelectAllOnNoSelection;
+   unsigned int n;
+   for (n = 0; n < m_vpcs.size() && !bAnyActiveSel; n++)
+      bAnyActiveSel = m_vpcs[n]->Active;
+   return bAnyActiveSel;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// calculates spike groups of plotted spikes without the active selections:
+/// spikes that belong to the group of an assigned selection (see
+/// TSWClusterSelection::Clear) get -1 (or 0, if no selection is active and
+/// m_bSelectAllOnNoSelection is set, then unassigned spikes get 0 as well).
+/// The groups of all other spikes are kept, e.g. groups set by automatic
+/// clustering. The grid index is rebuilt after plotted values changed.
+/// Returns number of spikes
+//------------------------------------------------------------------------------
+unsigned int TformCluster::BaseGroups(std::vector<int >& rvnGroups)
+{
+   if ((unsigned int)Tag >= m_vvSWSelections.size())
+      {
+      rvnGroups.clear();
+      return 0;
+      }
+   unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes((unsigned int)Tag);
+   if ((unsigned int)csData->YValues->Count < nNum)
+      nNum = (unsigned int)csData->YValues->Count;
+   if (m_vdX.size() < nNum)
+      nNum = (unsigned int)m_vdX.size();
+
+   if (!m_bIndexValid || m_swgiIndex.GetNumPoints() != nNum)
+      {
+      if (nNum)
+         m_swgiIndex.Build(&m_vdX[0], &m_vdY[0], nNum);
+      else
+         m_swgiIndex.Clear();
+      m_bIndexValid = true;
+      }
+
+   int nDefault = AnySelectionActive() ? -1 : 0;
+   rvnGroups.resize(nNum);
+   if (nNum)
+      formSpikeWare->m_swsSpikes.GetSpikeGroups((unsigned int)Tag, &rvnGroups[0], 0, nNum);
+   std::vector<TSWClusterSelection >& rvSelections = m_vvSWSelections[(unsigned int)Tag];
+   unsigned int n;
+   for (n = 0; n < nNum; n++)
+      {
+      int nGroup = rvnGroups[n];
+      if (nGroup < 0)
+         rvnGroups[n] = nDefault;
+      else if ((unsigned int)nGroup < rvSelections.size() && rvSelections[(unsigned int)nGroup].bAssigned)
+         rvnGroups[n] = nDefault;
+      }
+   return nNum;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// applies active selections to groups returned by BaseGroups: spikes within
+/// a selection get its index as group (lowest index wins, if selections
+/// overlap). Only the grid cells overlapping the selections are visited
+//------------------------------------------------------------------------------
+void TformCluster::ApplySelections(std::vector<int >& rvnGroups)
+{
+   if (!rvnGroups.size())
+      return;
+   // selections in reverse order: lower indices overwrite higher ones
+   unsigned int nSel, nHit;
+   for (nSel = (unsigned int)m_vpcs.size(); nSel-- > 0; )
+      {
+      TChartShape* pcs = m_vpcs[nSel];
+      if (!pcs->Active)
+         continue;
+      m_vnHits.clear();
+      m_swgiIndex.QueryRect(pcs->X0, pcs->X1, pcs->Y0, pcs->Y1, m_vnHits);
+      for (nHit = 0; nHit < m_vnHits.size(); nHit++)
+         rvnGroups[m_vnHits[nHit]] = (int)nSel;
+      }
+}
+//------------------------------------------------------------------------------
 
+//------------------------------------------------------------------------------
+/// calculates spike groups of plotted spikes from active selections (see
+/// BaseGroups and ApplySelections). Returns number of spikes
+//------------------------------------------------------------------------------
+unsigned int TformCluster::SelectionsToGroups(std::vector<int >& rvnGroups)
+{
+   unsigned int nNum = BaseGroups(rvnGroups);
+   ApplySelections(rvnGroups);
+   return nNum;
+}
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+/// returns group of a single plotted spike from active selections and
+/// m_vnBaseGroups (same rules as SelectionsToGroups)
+//------------------------------------------------------------------------------
+int TformCluster::PreviewGroup(unsigned int nSpike)
+{
+   double dX = m_vdX[nSpike];
+   double dY = m_vdY[nSpike];
+   unsigned int nSel;
+   for (nSel = 0; nSel < m_vpcs.size(); nSel++)
+      {
+      TChartShape* pcs = m_vpcs[nSel];
+      if (  pcs->Active
+         && dX >= std::min(pcs->X0, pcs->X1) && dX <= std::max(pcs->X0, pcs->X1)
+         && dY >= std::min(pcs->Y0, pcs->Y1) && dY <= std::max(pcs->Y0, pcs->Y1)
+         )
+         return (int)nSel;
+      }
+   return m_vnBaseGroups[nSpike];
+}
+//------------------------------------------------------------------------------
 
-      if (m_bSelectAllOnNoSelection)
+//------------------------------------------------------------------------------
+/// shows colors resulting from current selections while a selection is
+/// dragged without setting the spike groups. Only points changing their
+/// color are updated (m_vnGroups holds the shown groups). Visits all spikes
+/// and stores the groups without selections in m_vnBaseGroups for the
+/// incremental updates while dragging
+//------------------------------------------------------------------------------
+void TformCluster::PreviewColors()
+{
+   if (!formSpikeWare->m_bPlotAllowed)
+      return;
+   try
+      {
+      m_nPlotCounter++;
+      unsigned int nNum = BaseGroups(m_vnBaseGroups);
+      m_vnBaseGroups.resize(nNum);
+      m_vnSelGroups = m_vnBaseGroups;
+      ApplySelections(m_vnSelGroups);
+      if (m_vnGroups.size() < nNum)
+         nNum = (unsigned int)m_vnGroups.size();
+      bool bChanged = false;
+      unsigned int n;
+      for (n = 0; n < nNum; n++)
          {
-         bAnyActiveSel = false;
-         for (n = 0; n < m_vpcs.size(); n++)
+         if (m_vnGroups[n] != m_vnSelGroups[n])
             {
-            if (m_vpcs[n]->Active)
-               {
-               bAnyActiveSel = true;
-               break;
-               }
+            m_vnGroups[n] = m_vnSelGroups[n];
+            csData->ValueColor[(int)n] = formSpikeWare->SpikeGroupToColor(m_vnGroups[n]);
+            bChanged = true;
             }
          }
+      m_bPreviewValid = true;
+      if (bChanged)
+         csData->Repaint();
+      }
+   __finally
+      {
+      m_nPlotCounter--;
+      }
+}
+//------------------------------------------------------------------------------
 
-      unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes((unsigned int)Tag);
-      if ((unsigned int)csData->YValues->Count < nNum)
-         nNum = (unsigned int)csData->YValues->Count;
-      int nGroup;
-      double dX, dY, dXMin, dXMax, dYMin, dYMax;
-      for (nSpike = 0; nSpike < nNum; nSpike++)
+//------------------------------------------------------------------------------
+/// updates preview colors after the dragged selection pcs was moved from the
+/// passed old end point to its current end point: only the spikes of the grid
+/// cells that may have changed are visited (see TSWGridIndex::QueryChanged),
+/// so costs per mouse move do not depend on the total number of spikes
+//------------------------------------------------------------------------------
+void TformCluster::PreviewColors(TChartShape* pcs, double dX1Old, double dY1Old)
+{
+   if (!formSpikeWare->m_bPlotAllowed)
+      return;
+   try
+      {
+      m_nPlotCounter++;
+      m_vnHits.clear();
+      m_swgiIndex.QueryChanged(pcs->X0, dX1Old, pcs->Y0, dY1Old,
+                               pcs->X0, pcs->X1, pcs->Y0, pcs->Y1,
+                               m_vnHits);
+      unsigned int nNum = (unsigned int)std::min(m_vnGroups.size(), m_vnBaseGroups.size());
+      bool bChanged = false;
+      unsigned int nHit;
+      for (nHit = 0; nHit < m_vnHits.size(); nHit++)
          {
-         nGroup =  bAnyActiveSel ? -1 : 0;
-         dX = csData->XValues->Value[(int)nSpike];
-         dY = csData->YValues->Value[(int)nSpike];
-         for (n = 0; n < m_vpcs.size(); n++)
+         unsigned int n = m_vnHits[nHit];
+         if (n >= nNum)
+            continue;
+         int nGroup = PreviewGroup(n);
+         if (m_vnGroups[n] != nGroup)
             {
-            if (!m_vpcs[n]->Active)
-               continue;
-            dXMin = m_vpcs[n]->X0 < m_vpcs[n]->X1 ? m_vpcs[n]->X0 : m_vpcs[n]->X1;
-            dXMax = m_vpcs[n]->X0 < m_vpcs[n]->X1 ? m_vpcs[n]->X1 : m_vpcs[n]->X0;
-            dYMin = m_vpcs[n]->Y0 < m_vpcs[n]->Y1 ? m_vpcs[n]->Y0 : m_vpcs[n]->Y1;
-            dYMax = m_vpcs[n]->Y0 < m_vpcs[n]->Y1 ? m_vpcs[n]->Y1 : m_vpcs[n]->Y0;
-            if (dX >= dXMin && dX <= dXMax && dY >= dYMin && dY <= dYMax)
-               {
-               nGroup = (int)n;
-               break;
-               }
+            m_vnGroups[n] = nGroup;
+            csData->ValueColor[(int)n] = formSpikeWare->SpikeGroupToColor(nGroup);
+            bChanged = true;
             }
-         formSpikeWare->m_swsSpikes.SetSpikeGroup((unsigned int)Tag, nSpike, nGroup);
          }
+      if (bChanged)
+         csData->Repaint();
       }
    __finally
       {
       m_nPlotCounter--;
       }
-   formSpikeWare->UpdateClusterColors();
-   formSpikeWare->SetMeasurementChanged();
 }
 //------------------------------------------------------------------------------
 
@@ -449,6 +664,8 @@ void __fastcall TformCluster::chrtMouseDown(TObject *Sender, TMouseButton Button
    m_vvSWSelections[nTag][(unsigned int)m_nCurrentSelectionIndex].dY1 = dY;
    m_vvSWSelections[nTag][(unsigned int)m_nCurrentSelectionIndex].bActive  = true;
    SelectionToSelectionSeries((unsigned int)m_nCurrentSelectionIndex);
+   // first mouse move calculates complete preview
+   m_bPreviewValid = false;
 
 }
 //------------------------------------------------------------------------------
@@ -468,12 +685,18 @@ void __fastcall TformCluster::chrtMouseMove(TObject *Sender, TShiftState Shift,
    TChartShape* pcs = m_vpcs[(unsigned int)m_nCurrentSelectionIndex];
 
    double dX, dY;
+   double dX1Old = pcs->X1;
+   double dY1Old = pcs->Y1;
    pcs->GetCursorValues(dX, dY);
    pcs->X1 = dX;
    pcs->Y1 = dY;
    m_vvSWSelections[(unsigned int)Tag][(unsigned int)m_nCurrentSelectionIndex].dX1 = dX;
    m_vvSWSelections[(unsigned int)Tag][(unsigned int)m_nCurrentSelectionIndex].dY1 = dY;
-
+   // the grid index must be the one used by the complete preview
+   if (m_bPreviewValid && m_bIndexValid)
+      PreviewColors(pcs, dX1Old, dY1Old);
+   else
+      PreviewColors();
 }
 //------------------------------------------------------------------------------
 
@@ -496,6 +719,8 @@ void __fastcall TformCluster::chrtMouseUp(TObject *Sender, TMouseButton Button,
       {
       pcs->Active = false;
       m_vvSWSelections[(unsigned int)Tag][(unsigned int)m_nCurrentSelectionIndex].bActive = false;
+      // restore colors changed by PreviewColors
+      UpdateColors();
       }
    else
       SetColors();
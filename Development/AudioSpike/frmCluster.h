@@ -44,6 +44,7 @@
 #include <VCLTee.TeeProcs.hpp>
 #include <VCLTee.TeeShape.hpp>
 #include "SWSpike.h"
+#include "SWGridIndex.h"
 #include "frmASUI.h"
 //------------------------------------------------------------------------------
 
@@ -60,6 +61,7 @@ class TSWClusterSelection
       double   dY0;
       double   dY1;
       bool     bActive;
+      bool     bAssigned;
 };
 //------------------------------------------------------------------------------
 
@@ -94,6 +96,22 @@ class TformCluster : public TformASUI
       int         m_nCurrentSelectionIndex;
       bool        m_bSelectAllOnNoSelection;
       std::vector<TChartShape* > m_vpcs;
+      TSWGridIndex               m_swgiIndex;
+      bool                       m_bIndexValid;
+      std::vector<unsigned int > m_vnHits;
+      std::vector<int >          m_vnSelGroups;
+      std::vector<int >          m_vnBaseGroups;
+      bool                       m_bPreviewValid;
+      std::vector<double >       m_vdX;
+      std::vector<double >       m_vdY;
+      std::vector<int >          m_vnGroups;
+      bool           AnySelectionActive();
+      unsigned int   BaseGroups(std::vector<int >& rvnGroups);
+      void           ApplySelections(std::vector<int >& rvnGroups);
+      unsigned int   SelectionsToGroups(std::vector<int >& rvnGroups);
+      int            PreviewGroup(unsigned int nSpike);
+      void           PreviewColors();
+      void           PreviewColors(TChartShape* pcs, double dX1Old, double dY1Old);
       void        SelectionsToSelectionSeries();
       void        SelectionToSelectionSeries(unsigned int nSelectionIndex);
       void        ResetActiveSpikeGroups();
@@ -107,6 +125,7 @@ class TformCluster : public TformASUI
       __fastcall ~TformCluster();
       void EnableSelection(bool bEnable);
       void ResetSelection(bool bInit = false);
+      void ClearSelections(unsigned int nChannel);
       void Clear();
       void Plot(unsigned int nChannelIndex);
       void UpdateColors();
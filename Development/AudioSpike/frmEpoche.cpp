@@ -142,7 +142,7 @@ void TformEpoches::Plot(TSWEpoche *pswe)
 
       if (formSpikeWare->m_smp.Playing())
          {
-         csStimSeries->X0 = MsToSamples(formSpikeWare->m_sweEpoches.m_dPreStimulus*1000.0, formSpikeWare->m_swsSpikes.GetSampleRate());
+         csStimSeries->X0 = MsToSamples(formSpikeWare->m_sweEpoches.GetStimulusOnset()*1000.0, formSpikeWare->m_swsSpikes.GetSampleRate());
          // for free search subtract trigger offset!
          if (formSpikeWare->m_bFreeSearchRunning)
             csStimSeries->X0 -= MsToSamples(1000.0*formSpikeWare->m_smp.m_dTriggerLatency, formSpikeWare->m_swsStimuli.m_dDeviceSampleRate);
@@ -155,8 +155,8 @@ void TformEpoches::Plot(TSWEpoche *pswe)
          }
       formSpikeWare->SetThreshold((unsigned int)Tag, pswe->m_vdThreshold[(unsigned int)Tag]);
          
-      vvd vvdData = pswe->GetData();
-      Plot(vvdData);
+      vvf vvfData = pswe->GetData();
+      Plot(vvfData);
       }
    __finally
       {
@@ -167,11 +167,13 @@ void TformEpoches::Plot(TSWEpoche *pswe)
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// plots averaged double values of epoche (called by Plot(TSWEpoche *pswe))
+/// plots averaged values of epoche (called by Plot(TSWEpoche *pswe)). Float
+/// data are converted to double only for own channel, because the chart needs
+/// double values
 //------------------------------------------------------------------------------
-void TformEpoches::Plot(vvd &rvvdData)
+void TformEpoches::Plot(vvf &rvvfData)
 {
-   if ((int)rvvdData.size() <= Tag)
+   if ((int)rvvfData.size() <= Tag)
       return;
 
    if (!Visible)
@@ -180,17 +182,23 @@ void TformEpoches::Plot(vvd &rvvdData)
       return;
    try
       {
-      if (m_vad.size() != rvvdData[(unsigned int)Tag].size())
-         m_vad.resize(rvvdData[(unsigned int)Tag].size());
+      const std::valarray<float >& rvaf = rvvfData[(unsigned int)Tag];
+      unsigned int n, nSize = (unsigned int)rvaf.size();
+      if (m_vad.size() != nSize)
+         m_vad.resize(nSize);
 
       if (tbtnAverage->Down && formSpikeWare->m_smp.Playing())
          {
          m_dAverageCounter += 1.0;
-         m_vad *= (m_dAverageCounter-1.0)/m_dAverageCounter;
-         m_vad += rvvdData[(unsigned int)Tag]/m_dAverageCounter;
+         double dFactor = (m_dAverageCounter-1.0)/m_dAverageCounter;
+         for (n = 0; n < nSize; n++)
+            m_vad[n] = m_vad[n]*dFactor + (double)rvaf[n]/m_dAverageCounter;
          }
       else
-         m_vad = rvvdData[(unsigned int)Tag];
+         {
+         for (n = 0; n < nSize; n++)
+            m_vad[n] = (double)rvaf[n];
+         }
       // NOTE: the second parameter must be the index of the last item rather than the size
       // of the array (despite it's name). For this purpose we can use the SLICE macro
       csEpoche->Clear();
@@ -309,6 +317,7 @@ void __fastcall TformEpoches::chrtMouseDown(TObject *Sender, TMouseButton Button
       // get thresholds of current epoche
       pswe->m_vdThreshold[(unsigned int)Tag] = csThreshold->YScreenToValue(Y);
       formSpikeWare->SetXMLEpocheThreshold(nEpoche, pswe->m_vdThreshold);
+      formSpikeWare->m_sweEpoches.WriteEpocheThresholds(nEpoche, pswe->m_vdThreshold);
 
 
       formSpikeWare->m_swsSpikes.Add(pswe);
@@ -97,7 +97,7 @@ class TformEpoches : public TForm
       __fastcall TformEpoches(TComponent* Owner, int nChannelIndex);
       __fastcall ~TformEpoches();
       void Initialize();
-      void Plot(vvd &rvvdData);
+      void Plot(vvf &rvvfData);
       void SetData(vvd &rvvdData);
       void PlotData();
       void UpdateThreshold(double dThreshold);
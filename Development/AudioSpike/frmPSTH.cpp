@@ -61,18 +61,12 @@ void TSWPSTHSelection::Clear()
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// constructor. creates THistogramFunction and initializes members
+/// constructor. initializes members
 //------------------------------------------------------------------------------
 __fastcall TformPSTH::TformPSTH(TComponent* Owner, TMenuItem* pmi)
    : TformASUI(Owner, pmi)
 {
-   m_pthf = new THistogramFunction(this);
-   m_pthf->DataStyle = hdsTruncate;
-   m_pthf->Cumulative = false;
-   m_pthf->NumBins = 100;
-
-   csData->FunctionType = m_pthf;
-   csData->SetFunction(m_pthf);
+   m_nNumBins = 100;
    csData->Marks->Visible = false;
 
    csSelection->Y0 = 0;
@@ -104,7 +98,9 @@ void TformPSTH::Initialize(unsigned int nChannels)
    chrt->BottomAxis->SetMinMax(0, formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0);
 
    int nBinLen = formSpikeWare->m_pIni->ReadInteger("Settings", "PSTHBinSize", 1);
-   m_pthf->NumBins = (int)floor(formSpikeWare->m_sweEpoches.m_dEpocheLength*1000) / nBinLen;
+   m_nNumBins = (int)floor(formSpikeWare->m_sweEpoches.m_dEpocheLength*1000) / nBinLen;
+   if (m_nNumBins < 1)
+      m_nNumBins = 1;
    ShowBinSize();
    csSelection->Active      = false;
    csNoiseSelection->Active = false;
@@ -146,7 +142,8 @@ void TformPSTH::Initialize(unsigned int nChannels)
 //------------------------------------------------------------------------------
 
 //------------------------------------------------------------------------------
-/// plots the PSTH
+/// plots the PSTH. Bins are summed up from the spike time histogram maintained
+/// by TSWSpikes, so plotting does not depend on the number of spikes
 //------------------------------------------------------------------------------
 void TformPSTH::Plot(unsigned int nChannelIndex, bool bForce)
 {
@@ -168,21 +165,15 @@ void TformPSTH::Plot(unsigned int nChannelIndex, bool bForce)
          }
 
       csData->Clear();
-      csPoints->Clear();
       chrt->LeftAxis->Minimum = 0;
       chrt->LeftAxis->AutomaticMaximum = true;
-      unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes(nChannelIndex);
-      if (!nNum)
+      double dBinSize = formSpikeWare->m_sweEpoches.m_dEpocheLength / (double)m_nNumBins;
+      std::vector<unsigned int > vnBins;
+      if (!formSpikeWare->m_swsSpikes.GetHistogram(nChannelIndex, dBinSize, (unsigned int)m_nNumBins, vnBins))
          return;
       unsigned int n;
-      for (n = 0; n < nNum; n++)
-         {
-         if (formSpikeWare->m_swsSpikes.GetSpikeGroup(nChannelIndex, n) >= 0)
-            csPoints->AddY(formSpikeWare->m_swsSpikes.GetSpikeTime(nChannelIndex, n)*1000.0);
-         }
-
-      csData->DataSources->Clear();
-      csData->DataSources->Add(csPoints);
+      for (n = 0; n < vnBins.size(); n++)
+         csData->AddXY(((double)n + 0.5)*dBinSize*1000.0, (double)vnBins[n]);
       }
    __finally
       {
@@ -196,7 +187,6 @@ void TformPSTH::Plot(unsigned int nChannelIndex, bool bForce)
 //------------------------------------------------------------------------------
 void TformPSTH::Clear()
 {
-   csPoints->Clear();
    csData->Clear();
    chrt->LeftAxis->Minimum = 0;
    chrt->LeftAxis->AutomaticMaximum = true;
@@ -209,9 +199,10 @@ void TformPSTH::Clear()
 #pragma argsused
 void __fastcall TformPSTH::tbtnZoomOutClick(TObject *Sender)
 {
-   if (m_pthf->NumBins < 1000)
-      m_pthf->NumBins *= 2;
+   if (m_nNumBins < 1000)
+      m_nNumBins *= 2;
    ShowBinSize();
+   Plot((unsigned int)Tag);
 }
 //------------------------------------------------------------------------------
 
@@ -221,9 +212,10 @@ void __fastcall TformPSTH::tbtnZoomOutClick(TObject *Sender)
 #pragma argsused
 void __fastcall TformPSTH::tbtnZoomInClick(TObject *Sender)
 {
-   if (m_pthf->NumBins > 2)
-      m_pthf->NumBins /= 2;
+   if (m_nNumBins > 2)
+      m_nNumBins /= 2;
    ShowBinSize();
+   Plot((unsigned int)Tag);
 }
 //------------------------------------------------------------------------------
 
@@ -424,7 +416,7 @@ void  TformPSTH::GetSelections(double& dMin, double& dMax, double& dNoiseMin, do
 //------------------------------------------------------------------------------
 void  TformPSTH::ShowBinSize()
 {
-  lblBinSize->Caption = "  binsize: " + FormatFloat("0.00", (Extended)(formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0 / m_pthf->NumBins)) + " ms";;
+  lblBinSize->Caption = "  binsize: " + FormatFloat("0.00", (Extended)(formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0 / m_nNumBins)) + " ms";;
 }
 //------------------------------------------------------------------------------
 
@@ -435,14 +427,17 @@ void  TformPSTH::ShowBinSize()
 void __fastcall TformPSTH::tbtnBinSizeClick(TObject *Sender)
 {
    //
-   double dValue = formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0 / (double)m_pthf->NumBins;
+   double dValue = formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0 / (double)m_nNumBins;
    dValue = (double)StrToFloat(FormatFloat("0.00", (Extended)dValue));
 
-   if (!formSpikeWare->m_pformSetParameters->SetParameter("Binsize", "ms", dValue, this))
+   if (!formSpikeWare->m_pformSetParameters->SetParameter("Binsize", "ms", dValue, this) || dValue <= 0.0)
       return;
 
-   m_pthf->NumBins = (int)floor(formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0 / dValue);
+   m_nNumBins = (int)floor(formSpikeWare->m_sweEpoches.m_dEpocheLength*1000.0 / dValue);
+   if (m_nNumBins < 1)
+      m_nNumBins = 1;
    ShowBinSize();
+   Plot((unsigned int)Tag);
 
 }
 //------------------------------------------------------------------------------
@@ -72,7 +72,6 @@ class TformPSTH : public TformASUI
    __published:	// IDE-verwaltete Komponenten
       TChart *chrt;
       THistogramSeries *csData;
-      TPointSeries *csPoints;
       TChartShape *csSelection;
       TChartShape *csNoiseSelection;
       TImageList *il1;
@@ -103,7 +102,7 @@ class TformPSTH : public TformASUI
    private:	// Benutzer-Deklarationen
       double   m_dLastX0;
       double   m_dLastX1;
-      THistogramFunction* m_pthf;
+      int      m_nNumBins;
       void StoreSelection(TChartShape* pcs);
    public:		// Benutzer-Deklarationen
       std::vector<TSWPSTHSelection > m_vSWSelections;
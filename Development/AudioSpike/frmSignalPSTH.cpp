@@ -222,17 +222,18 @@ void TformSignalPSTH::Plot(unsigned int nChannelIndex)
          // SAME MAX FOR ALL!!
 //         pca->AutomaticMaximum = true;
 
-         unsigned int nNum = formSpikeWare->m_swsSpikes.GetNumSpikes(nChannelIndex);
+         TSWSpikeSnapshot swss = formSpikeWare->m_swsSpikes.GetSnapshot(nChannelIndex);
+         unsigned int nNum = swss.GetNumSpikes();
          if (!nNum)
             return;
          unsigned int n;
          for (n = 0; n < nNum; n++)
             {
-            if (formSpikeWare->m_swsSpikes.GetSpikeGroup(nChannelIndex, n) < 0)
+            if (swss.GetSpikeGroup(n) < 0)
                continue;
-            if (nStimIndex != (int)formSpikeWare->m_swsSpikes.GetStimIndex(nChannelIndex, n))
+            if (nStimIndex != (int)swss.GetStimIndex(n))
                continue;
-            csPoints->AddY(formSpikeWare->m_swsSpikes.GetSpikeTime(nChannelIndex, n)*1000.0);
+            csPoints->AddY(swss.GetSpikeTime(n)*1000.0);
             }
 
          csData->DataSources->Clear();
@@ -139,7 +139,9 @@ void TformSpikes::Plot(unsigned int nChannelIndex)
       Tag = (NativeInt)nChannelIndex;
 
       int n, nGroup;
-      int nNum    = (int)formSpikeWare->m_swsSpikes.GetNumSpikes(nChannelIndex);
+      // read from a snapshot: no locking per spike, not affected by new spikes
+      TSWSpikeSnapshot swss = formSpikeWare->m_swsSpikes.GetSnapshot(nChannelIndex);
+      int nNum    = (int)swss.GetNumSpikes();
       int nOffset = m_nMaxNumSpikes*(int)tbtnSpikesBack->Tag;
 
       if ((nNum - nOffset) > m_nMaxNumSpikes)
@@ -150,7 +152,7 @@ void TformSpikes::Plot(unsigned int nChannelIndex)
       TFastLineSeries* pls;
       for (n = nNum-1; n >= 0; n--)
          {
-         nGroup = formSpikeWare->m_swsSpikes.GetSpikeGroup(nChannelIndex, (unsigned int)n);
+         nGroup = swss.GetSpikeGroup((unsigned int)n);
          if (nGroup >= 0 || formSpikeWare->m_bFreeSearchRunning)
             nSpikes++;
          else
@@ -159,7 +161,7 @@ void TformSpikes::Plot(unsigned int nChannelIndex)
          if (nSpikes >= (chrt->SeriesCount()-2))
             break;
 
-         int nEpocheIndex = (int)formSpikeWare->m_swsSpikes.GetEpocheIndex(nChannelIndex, (unsigned int)n);
+         int nEpocheIndex = (int)swss.GetEpocheIndex((unsigned int)n);
          if (cbPlotEpocheSpikesOnly->Checked && !!formSpikeWare->m_pformEpoches->tbEpoches->Tag)
             {
             if (nEpocheIndex != formSpikeWare->m_pformEpoches->tbEpoches->Position)
@@ -170,10 +172,10 @@ void TformSpikes::Plot(unsigned int nChannelIndex)
          pls = (TFastLineSeries*)chrt->Series[nSpikes+2];
          pls->Clear();
          pls->SeriesColor = formSpikeWare->SpikeGroupToColor(nGroup);
-         std::valarray<double >& rvad = formSpikeWare->m_swsSpikes.GetSpike(nChannelIndex, (unsigned int)n);
+         const double* pdSpike = swss.GetSpike((unsigned int)n);
          // NOTE: the second parameter must be the index of the last item rather than the size
          // of the array (despite it's name). For this purpose we can use the SLICE macro
-         pls->AddArray(SLICE(&rvad[0], (int)rvad.size()));
+         pls->AddArray(SLICE(pdSpike, (int)formSpikeWare->m_swsSpikes.GetSpikeLength()));
          pls->Active = true;
          }
       if (formSpikeWare->m_bFreeSearchRunning)
@@ -256,10 +258,10 @@ void TformSpikes::Plot(unsigned int nChannelIndex)
          pls->SeriesColor = formSpikeWare->SpikeGroupToColor(nGroup);
          pls->HorizAxis = aTopAxis;
          pls->Active    = nGroup >= 0 || formSpikeWare->m_bFreeSearchRunning;
-         std::valarray<double >& rvad = formSpikeWare->m_swsSpikes.GetSpike(nChannelIndex, n);
+         const double* pdSpike = formSpikeWare->m_swsSpikes.GetSpike(nChannelIndex, n);
          // NOTE: the second parameter must be the index of the last item rather than the size
          // of the array (despite it's name). For this purpose we can use the SLICE macro
-         pls->AddArray(SLICE(&rvad[0], rvad.size()));
+         pls->AddArray(SLICE(pdSpike, formSpikeWare->m_swsSpikes.GetSpikeLength()));
          }
 
 